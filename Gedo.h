@@ -17,6 +17,7 @@
  *      - Min,Max,Clamp
  *      - ArrayCount: get the count of a constant sized c array.
  *      - QuickSort.
+ *      - NthElement.
  *      - BinarySearch.
  * - Memory utils:
  *      provide Allocator interface that proved Allocate and Free functions,
@@ -40,7 +41,7 @@
  *      - ArrayView<T>      a non owning view of array of type T.
  *      - StaticArray<T,N>  owning stretchy array of type T allocated on the stack with max size N.
  *      - Array<T,N>        owning stretchy array of type T allocated using Allocator*.
- *      - HashTable<T>      TODO.
+ *      - HashTable<K,V>    owning open addressing hash table allocated using Allocator*.
  * - Maths:
  *      - Math code uses double not float.
  *      - 2D/3D Vector.
@@ -60,6 +61,9 @@
  *      - Check if a file exists    DoesFileExist(const char* fileName, Allocator& allocator);
  *      - Get the file size         GetFileSize(const char* fileName, Allocator& allocator);
  *      - Check a path type         GetPathType(const char* path, Allocator& allocator);
+ *      - Memory map a file         MapFile(const char* fileName, Allocator& allocator);
+ *      - Buffered writing          CreateBufferedFileWriter, WriteToFile, DestroyBufferedFileWriter.
+ *      - Hash a file's content     HashFile(const char* fileName, uint64_t& hash, Allocator& allocator);
  * - Strings:
  *      Provides custom implementation of both String (owning container) and StringView (non owning view).
  *      it uses the Allocator* interface for managing memory
@@ -73,6 +77,8 @@
  *          - SplitStringView(const char* string, char delim, Allocator& allocator);
  *          - SplitStringIntoLines(const char* string, Allocator& allocator);
  *          - SplitStringViewIntoLines(const char* string, char delim, Allocator& allocator);
+ *          - ParseDouble(const char* begin, const char* end, double& value);
+ *          - ParseInt64(const char* begin, const char* end, int64_t& value);
  * - Bitmaps:
  *      Provide a way of creating bitmap (colored and mono) and blit data to the bitmap,
  *      it also provide some util for creating colors, rect, and define some common colors.
@@ -80,6 +86,66 @@
  *            FillRectangle(ColorBitmap& dest, Rect fillArea, const ColorBitmap& src);
  *            FillRectangle(ColorBitmap& dest, Rect fillArea, const Bitmap& mask, Color c);
  *            FillRectangle(ColorBitmap& dest, Rect fillArea, Color color);
+ *        Resampling functions:
+ *            ResizeBitmap(const ColorBitmap& src, size_t width, size_t height, ResizeFilter filter, Allocator& allocator);
+ *            GenerateMipChain(const ColorBitmap& src, Allocator& allocator);
+ *        Filters (also available for Bitmap):
+ *            ConvolveSeparable(ColorBitmap& bitmap, ArrayView<float> kernelX, ArrayView<float> kernelY, Allocator& allocator);
+ *            BoxBlur(ColorBitmap& bitmap, size_t radius, Allocator& allocator);
+ *            GaussianBlur(ColorBitmap& bitmap, double sigma, Allocator& allocator);
+ *        Pixel format conversion (RGBA8, BGRA8, RGB8, GREY8 and linear float RGBA):
+ *            ConvertPixels(const Color* src, size_t count, PixelFormat format, void* dest);
+ *            ConvertPixels(const void* src, size_t count, PixelFormat format, Color* dest);
+ *        Rasterization:
+ *            DrawTriangles(ColorBitmap& target, DepthBuffer& depth, const Mat4& mvp, positions, colors, indices, shading, stats);
+ *        Anti-aliased drawing:
+ *            DrawLine, DrawThickLine, DrawPolyline, DrawCircle, FillCircle, FillPolygon.
+ *        Text:
+ *            GlyphAtlas caches glyph coverage bitmaps (rasterized by the user) in one skyline packed bitmap.
+ *            DrawString(ColorBitmap& dest, const GlyphAtlas& atlas, font, size, StringView text, x, y, Color color);
+ *        Dirty regions:
+ *            set ColorBitmap::dirty to a DirtyRegion and every drawing function marks the tiles it touches,
+ *            ComposeLayers then re-blends only the dirty tiles and GetDirtyRects reports them.
+ *        Image codecs (QOI, BMP, PPM for ColorBitmap and PGM for Bitmap):
+ *            ColorBitmap DecodeQOI(MemoryBlock data, Allocator& allocator);
+ *            bool EncodeQOI(const ColorBitmap& bitmap, BufferedFileWriter& writer);
+ *            ColorBitmap LoadColorBitmap(const char* fileName, Allocator& allocator);
+ *            bool SaveColorBitmap(const char* fileName, const ColorBitmap& bitmap, Allocator& allocator);
+ *        PNG encoder with a built-in parallel deflate:
+ *            bool EncodePNG(const ColorBitmap& bitmap, BufferedFileWriter& writer, PNGCompression compression, Allocator& allocator);
+ * - Geometry:
+ *      TriangleMesh stores positions, normals, uvs and 32 bits indices as separate arrays (SoA),
+ *      BuildHalfEdges adds an optional half edge connectivity built in O(n) with a hash table of the edges.
+ *      ComputeBounds(points) and MinMaxReduce(values) reduce big arrays with AVX2 on all the cores.
+ *      the adjacency queries don't allocate:
+ *          ForEachOneRing(mesh, vertex, func);
+ *          ForEachBoundaryLoop(mesh, func);
+ *          IsManifold(mesh);
+ *      Mesh IO, files are memory mapped and parsed in place on all the cores:
+ *          LoadSTL(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats, Allocator& allocator);
+ *          LoadOBJ(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats, Allocator& allocator);
+ *          LoadPLY/SavePLY, binary PLY properties can also be streamed into SoA columns with ReadPlyProperty.
+ *          SaveMeshCache/LoadMeshCache, a binary cache that is memory mapped and used in place.
+ *      Mesh processing:
+ *          WeldVertices(mesh, epsilon, allocator); merges the vertices closer than epsilon, e.g. after LoadSTL.
+ *          ComputeVertexNormals/ComputeVertexTangents gather per face values through VertexCorners (CSR).
+ *          SimplifyMesh(mesh, targetTrianglesCount, maxError); quadric error decimation, returns the error reached.
+ *          SpatialSort(mesh); reorders the vertices and the triangles along a Morton curve with a radix sort.
+ *          OptimizeVertexCache(mesh, before, after); Forsyth triangle order, OptimizeVertexFetch then renumbers the vertices.
+ *      Spatial queries:
+ *          BuildBVH(mesh, bvh, allocator); binned SAH BVH with 32 bytes nodes, RefitBVH after deformations.
+ *          IntersectRay(bvh, mesh, ray, hit); IntersectRayPacket for 8 coherent rays at once.
+ *          BuildKdTree(points, tree, stats, allocator); implicit k-d tree with kNN and radius queries, single or batched.
+ *          BuildSpatialHashGrid(points, cellSize, grid, allocator); CSR hash grid rebuilt in O(n), ForEachPointNearby.
+ *      Volumes:
+ *          ScalarVolume, a dense grid of float samples.
+ *          MarchingCubes(volume, isoValue, mesh, allocator); indexed isosurface extracted by parallel slabs.
+ *          VoxelizeMesh(mesh, voxelSize, mode, grid, allocator); surface or solid voxels in a dense or sparse grid.
+ * - Threads:
+ *      ParallelFor(count, minBatch, func) splits a range into contiguous batches and runs them on
+ *      all the cores, the calling thread waits until all the batches are done.
+ * - Time:
+ *      Stopwatch stopwatch = StartStopwatch(); ... GetElapsedSeconds(stopwatch);
  *
  */
 
@@ -105,12 +171,21 @@
 #elif defined __linux__
 #define GEDO_OS_LINUX 1
 #include <uuid/uuid.h> // user will have to link against libuuid.
+#include <pthread.h>   // user will have to link against pthread.
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <stdio.h>
 #else
 #error "Not supported OS"
 #endif
 
+#if defined __AVX2__ || defined __BMI2__
+#include <immintrin.h> // the ray packets slab test, the SIMD kernels and pdep/pext.
+#endif // __AVX2__ || __BMI2__
+
 #if !defined GEDO_ASSERT
 #include <assert.h>
 #define GEDO_ASSERT assert
@@ -197,6 +272,12 @@ namespace gedo
         return (t < low) ? low : (t > high) ? high : t;
     }
 
+    template<typename T>
+    T Abs(const T& t)
+    {
+        return (t < T(0)) ? -t : t;
+    }
+
     template <typename T>
     void Swap(T& t0, T& t1)
     {
@@ -251,19 +332,29 @@ namespace gedo
                 ++i;
                 --j;
             }
+            /* p[1..j] are not greater than the pivot, moving it to j puts it in its final place */
+            Swap(p[0], p[j]);
             /* recurse on smaller side, iterate on larger */
-            if (j < (size - i))
+            if (j < (size - j - 1))
             {
-                QuickSort(p, j);
-                p = p + i;
-                size = size - i;
+                QuickSort(p, j, compare);
+                p = p + j + 1;
+                size = size - j - 1;
             }
             else
             {
-                QuickSort(p + i, size - i);
+                QuickSort(p + j + 1, size - j - 1, compare);
                 size = j;
             }
         }
+        /* insertion sort for the small leftover */
+        for (size_t i = 1; i < size; ++i)
+        {
+            for (size_t j = i; j > 0 && compare(p[j], p[j - 1]); --j)
+            {
+                Swap(p[j], p[j - 1]);
+            }
+        }
     }
 
     template <typename T>
@@ -276,6 +367,69 @@ namespace gedo
                   });
     }
 
+    // partially sorts p so p[n] is the element that would be there if p was sorted, with the elements before
+    // it not greater and the elements after it not smaller. O(size) on average.
+    template <typename T, typename TPredicate>
+    void NthElement(T* p, size_t size, size_t n, TPredicate compare)
+    {
+        while (size > 12)
+        {
+            /* same median of three and partition loop as QuickSort */
+            const size_t m = size >> 1;
+            const bool c01 = compare(p[0], p[m]);
+            const bool c12 = compare(p[m], p[size - 1]);
+            if (c01 != c12)
+            {
+                const bool c = compare(p[0], p[size - 1]);
+                const size_t z = (c == c12) ? 0 : size - 1;
+                Swap(p[z], p[m]);
+            }
+            Swap(p[0], p[m]);
+
+            size_t i = 1;
+            size_t j = size - 1;
+            for (;;)
+            {
+                for (;; ++i)
+                {
+                    if (!compare(p[i], p[0])) break;
+                }
+                for (;; --j)
+                {
+                    if (!compare(p[0], p[j])) break;
+                }
+                if (i >= j) break;
+                Swap(p[i], p[j]);
+
+                ++i;
+                --j;
+            }
+            /* p[1..j] are not greater than the pivot, moving it to j splits the range around it */
+            Swap(p[0], p[j]);
+            if (n == j)
+            {
+                return;
+            }
+            if (n < j)
+            {
+                size = j;
+            }
+            else
+            {
+                p = p + j + 1;
+                n = n - j - 1;
+                size = size - j - 1;
+            }
+        }
+        for (size_t i = 1; i < size; ++i)
+        {
+            for (size_t j = i; j > 0 && compare(p[j], p[j - 1]); --j)
+            {
+                Swap(p[j], p[j - 1]);
+            }
+        }
+    }
+
     template <typename T, typename TCompare, typename TPredicate>
     int64_t BinarySearch(T* p, size_t size, const T& key, TCompare compare, TPredicate predicate)
     {
@@ -460,6 +614,8 @@ namespace gedo
     GEDO_DEF double BytesToGigaBytes(size_t bytes);
     GEDO_DEF size_t MegaBytesToBytes(size_t megabytes);
     GEDO_DEF size_t GigaBytesToBytes(size_t gigabytes);
+    // 64 bit non cryptographic hash (MurmurHash64A).
+    GEDO_DEF uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
     // end of memory util functions.
 
     GEDO_DEF LinearAllocator* CreateLinearAllocator(size_t bytes);
@@ -483,6 +639,45 @@ namespace gedo
     GEDO_DEF bool DoesFileExist(const char* fileName, Allocator& allocator = GetDefaultAllocator());
     GEDO_DEF int64_t GetFileSize(const char* fileName, Allocator& allocator = GetDefaultAllocator());
     GEDO_DEF PathType GetPathType(const char* path, Allocator& allocator = GetDefaultAllocator());
+
+    // read only mapping of a whole file, block is empty if the file couldn't be mapped.
+    struct MappedFile
+    {
+        MemoryBlock block;
+#if defined GEDO_OS_WINDOWS
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+#else
+        int file = -1;
+#endif
+    };
+
+    GEDO_DEF MappedFile MapFile(const char* fileName, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void UnmapFile(MappedFile& file);
+    // content hash of a whole file, e.g. to know if a cache built from it is stale. returns false if the
+    // file is missing or can't be read, so it never collides with the hash of an empty file.
+    GEDO_DEF bool HashFile(const char* fileName, uint64_t& hash, Allocator& allocator = GetDefaultAllocator());
+
+    // collects small writes in a buffer and writes it to the file in big blocks.
+    struct BufferedFileWriter
+    {
+        Allocator* allocator = &GetDefaultAllocator();
+        MemoryBlock buffer;
+        size_t used = 0;
+        bool failed = false;
+#if defined GEDO_OS_WINDOWS
+        HANDLE file = INVALID_HANDLE_VALUE;
+#else
+        int file = -1;
+#endif
+    };
+
+    // creates or truncates fileName, check failed to know if the file was opened.
+    GEDO_DEF BufferedFileWriter CreateBufferedFileWriter(const char* fileName, size_t bufferSize = 1024 * 1024, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool WriteToFile(BufferedFileWriter& writer, const void* data, size_t size);
+    GEDO_DEF bool FlushFileWriter(BufferedFileWriter& writer);
+    // flushes and closes the file, returns false if any write failed.
+    GEDO_DEF bool DestroyBufferedFileWriter(BufferedFileWriter& writer);
     //------------------------------------------------------------//
 
     //------------------------------Containers--------------------//
@@ -710,9 +905,208 @@ namespace gedo
         }
     };
 
+    // keys are hashed with HashKey, overload it for keys that can't be hashed byte by byte.
+    template<typename T>
+    uint64_t HashKey(const T& key)
+    {
+        return HashBytes(&key, sizeof(T));
+    }
+
+    // open addressing with linear probing, keys must support operator==.
     template<typename TKey, typename TValue>
     struct HashTable
     {
+        struct Slot
+        {
+            TKey key;
+            TValue value;
+            bool used;
+        };
+
+        Allocator* allocator = &GetDefaultAllocator();
+        MemoryBlock block;
+        size_t count = 0;
+
+        HashTable() = default;
+        ~HashTable()
+        {
+            if (block.data)
+            {
+                allocator->FreeMemoryBlock(block);
+            }
+        }
+        HashTable(const HashTable& s)
+        {
+            allocator = s.allocator;
+            block = allocator->AllocateMemoryBlock(s.block.size);
+            GEDO_MEMCPY(block.data, s.block.data, block.size);
+            count = s.count;
+        }
+        HashTable& operator=(const HashTable& s)
+        {
+            allocator = s.allocator;
+            block = allocator->AllocateMemoryBlock(s.block.size);
+            GEDO_MEMCPY(block.data, s.block.data, block.size);
+            count = s.count;
+            return *this;
+        }
+        HashTable(HashTable&& s) noexcept
+        {
+            allocator = s.allocator;
+            block = s.block;
+            count = s.count;
+            s.allocator = NULL;
+            s.block = MemoryBlock{};
+            s.count = 0;
+        }
+        HashTable& operator=(HashTable&& s) noexcept
+        {
+            allocator = s.allocator;
+            block = s.block;
+            count = s.count;
+            s.allocator = NULL;
+            s.block = MemoryBlock{};
+            s.count = 0;
+            return *this;
+        }
+        Slot* slots()
+        {
+            return (Slot*)block.data;
+        }
+        const Slot* slots() const
+        {
+            return (const Slot*)block.data;
+        }
+        // always a power of 2.
+        size_t capacity() const
+        {
+            return block.size / sizeof(Slot);
+        }
+        size_t size() const
+        {
+            return count;
+        }
+        void clear()
+        {
+            ZeroMemoryBlock(block);
+            count = 0;
+        }
+        TValue* find(const TKey& key)
+        {
+            return (TValue*)((const HashTable*)this)->find(key);
+        }
+        const TValue* find(const TKey& key) const
+        {
+            if (!count)
+            {
+                return NULL;
+            }
+            const size_t mask = capacity() - 1;
+            for (size_t i = HashKey(key) & mask;; i = (i + 1) & mask)
+            {
+                const Slot& slot = slots()[i];
+                if (!slot.used)
+                {
+                    return NULL;
+                }
+                if (slot.key == key)
+                {
+                    return &slot.value;
+                }
+            }
+        }
+        // inserts the key or overwrites its value if it already exists.
+        TValue& insert(const TKey& key, const TValue& value)
+        {
+            // keep the load factor under 3/4.
+            if ((count + 1) * 4 > capacity() * 3)
+            {
+                reserve(Max<size_t>(capacity() * 2, 16));
+            }
+            const size_t mask = capacity() - 1;
+            for (size_t i = HashKey(key) & mask;; i = (i + 1) & mask)
+            {
+                Slot& slot = slots()[i];
+                if (!slot.used)
+                {
+                    slot.used = true;
+                    slot.key = key;
+                    slot.value = value;
+                    count++;
+                    return slot.value;
+                }
+                if (slot.key == key)
+                {
+                    slot.value = value;
+                    return slot.value;
+                }
+            }
+        }
+        bool remove(const TKey& key)
+        {
+            if (!count)
+            {
+                return false;
+            }
+            const size_t mask = capacity() - 1;
+            size_t i = HashKey(key) & mask;
+            for (;; i = (i + 1) & mask)
+            {
+                if (!slots()[i].used)
+                {
+                    return false;
+                }
+                if (slots()[i].key == key)
+                {
+                    break;
+                }
+            }
+            // shift the following entries of the cluster back so lookups don't need tombstones.
+            size_t hole = i;
+            for (size_t j = (i + 1) & mask; slots()[j].used; j = (j + 1) & mask)
+            {
+                const size_t home = HashKey(slots()[j].key) & mask;
+                const bool movable = (hole <= j) ? (home <= hole || home > j) : (home <= hole && home > j);
+                if (movable)
+                {
+                    slots()[hole] = slots()[j];
+                    hole = j;
+                }
+            }
+            slots()[hole].used = false;
+            count--;
+            return true;
+        }
+        // makes room for at least s entries without growing.
+        void reserve(size_t s)
+        {
+            size_t newCapacity = 16;
+            while (newCapacity * 3 < s * 4)
+            {
+                newCapacity *= 2;
+            }
+            if (newCapacity <= capacity())
+            {
+                return;
+            }
+            MemoryBlock oldBlock = block;
+            const size_t oldCapacity = capacity();
+            block = allocator->AllocateMemoryBlock(newCapacity * sizeof(Slot));
+            ZeroMemoryBlock(block);
+            count = 0;
+            const Slot* oldSlots = (const Slot*)oldBlock.data;
+            for (size_t i = 0; i < oldCapacity; ++i)
+            {
+                if (oldSlots[i].used)
+                {
+                    insert(oldSlots[i].key, oldSlots[i].value);
+                }
+            }
+            if (oldBlock.data)
+            {
+                allocator->FreeMemoryBlock(oldBlock);
+            }
+        }
     };
 
     template <typename T>
@@ -725,6 +1119,81 @@ namespace gedo
     }
     //-------------------------------------------------------------//
 
+    //------------------------------Threads-----------------------//
+    typedef void (*ThreadProc)(void* userData);
+
+    GEDO_DEF uint32_t GetProcessorCount();
+
+    // runs proc(userData[i]) for each i on its own thread and waits for all of them,
+    // the first task is executed on the calling thread.
+    GEDO_DEF void RunInParallel(ThreadProc proc, void** userData, size_t count);
+
+    // splits [0, count) into contiguous ranges and calls func(begin, end) for each range in parallel.
+    // a range is never smaller than minBatch, so small workloads stay on the calling thread.
+    // e.g.
+    //  ParallelFor(bitmap.height, 64, [&](size_t begin, size_t end) { ProcessRows(begin, end); });
+    template<typename F>
+    void ParallelFor(size_t count, size_t minBatch, F func)
+    {
+        struct Task
+        {
+            F* func;
+            size_t begin;
+            size_t end;
+        };
+        const size_t maxTasks = 64;
+        if (!count)
+        {
+            return;
+        }
+        minBatch = Max<size_t>(minBatch, 1);
+        size_t tasksCount = Min<size_t>(GetProcessorCount(), maxTasks);
+        tasksCount = Min<size_t>(tasksCount, (count + minBatch - 1) / minBatch);
+        if (tasksCount <= 1)
+        {
+            func(size_t(0), count);
+            return;
+        }
+
+        StaticArray<Task, maxTasks> tasks;
+        StaticArray<void*, maxTasks> userData;
+        const size_t batch = count / tasksCount;
+        const size_t remainder = count % tasksCount;
+        size_t begin = 0;
+        for (size_t i = 0; i < tasksCount; ++i)
+        {
+            const size_t end = begin + batch + (i < remainder ? 1 : 0);
+            tasks.push_back(Task{ &func, begin, end });
+            begin = end;
+        }
+        for (size_t i = 0; i < tasksCount; ++i)
+        {
+            userData.push_back(&tasks[i]);
+        }
+        RunInParallel([](void* data)
+                      {
+                          Task* task = (Task*)data;
+                          (*task->func)(task->begin, task->end);
+                      },
+                      userData.data(), tasksCount);
+    }
+    //-------------------------------------------------------------//
+
+    //------------------------------Time--------------------------//
+    // measures wall clock time with the highest resolution monotonic clock of the OS.
+    // e.g.
+    //  Stopwatch stopwatch = StartStopwatch();
+    //  DoWork();
+    //  printf("%f\n", GetElapsedSeconds(stopwatch));
+    struct Stopwatch
+    {
+        uint64_t start = 0;
+    };
+
+    GEDO_DEF Stopwatch StartStopwatch();
+    GEDO_DEF double GetElapsedSeconds(const Stopwatch& stopwatch);
+    //-------------------------------------------------------------//
+
     //--------------------------Strings----------------------------//
     // Can be used when parsing a file.
     struct StreamBuffer
@@ -923,6 +1392,15 @@ namespace gedo
     GEDO_DEF Array<StringView> SplitStringView(const char* string, char delim, Allocator& allocator = GetDefaultAllocator());
     GEDO_DEF Array<String> SplitStringIntoLines(const char* string, Allocator& allocator = GetDefaultAllocator());
     GEDO_DEF Array<StringView> SplitStringViewIntoLines(const char* string, char delim, Allocator& allocator = GetDefaultAllocator());
+
+    GEDO_DEF bool IsDigit(char c);
+    GEDO_DEF bool IsSpace(char c);
+    // parses a decimal number (e.g. -1.5e-3) at the start of [begin, end) without needing a null terminator,
+    // returns the end of the number or NULL if there is none. much faster than strtod, exact for up to
+    // 15 significant digits and exponents up to 22.
+    GEDO_DEF const char* ParseDouble(const char* begin, const char* end, double& value);
+    // returns NULL if there are no digits or the number doesn't fit in an int64_t.
+    GEDO_DEF const char* ParseInt64(const char* begin, const char* end, int64_t& value);
     //-------------------------------------------------------------//
 
     //------------------------------Bitmap-------------------------//
@@ -950,11 +1428,15 @@ namespace gedo
         uint8_t* data = NULL;
     };
 
+    struct DirtyRegion;
+
     struct ColorBitmap
     {
         size_t width = 0;
         size_t height = 0;
         Color* data = NULL;
+        // when set, the drawing functions mark the pixels they touch in this region.
+        DirtyRegion* dirty = NULL;
     };
 
     GEDO_DEF void FillRectangle(ColorBitmap& dest, Rect fillArea, const ColorBitmap& src);
@@ -967,40 +1449,955 @@ namespace gedo
     GEDO_DEF ColorBitmap CreateColorBitmap(size_t width, size_t height, Allocator& allocator = GetDefaultAllocator());
     GEDO_DEF void DestoryColorBitmap(ColorBitmap& bitmap, Allocator& allocator = GetDefaultAllocator());
 
-    GEDO_DEF Color CreateColor(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha);
+    enum class ResizeFilter
+    {
+        BOX,
+        BILINEAR,
+        LANCZOS
+    };
 
-    GEDO_DEF const Color RED = CreateColor(255, 0, 0, 255);
-    GEDO_DEF const Color GREEN = CreateColor(0, 255, 0, 255);
-    GEDO_DEF const Color GREEN_BLUE = CreateColor(78, 201, 176, 255);
-    GEDO_DEF const Color BLUE = CreateColor(0, 0, 255, 255);
-    GEDO_DEF const Color WHITE = CreateColor(255, 255, 255, 255);
-    GEDO_DEF const Color BLACK = CreateColor(0, 0, 0, 255);
-    GEDO_DEF const Color DARK_GREY = CreateColor(30, 30, 30, 255);
-    //------------------------------------------------------------//
+    // resamples src into a new bitmap of size width x height allocated from allocator.
+    // the filter is applied separably (rows then columns) using precomputed weight tables,
+    // when downscaling the filter is widened so every source pixel contributes.
+    GEDO_DEF ColorBitmap ResizeBitmap(const ColorBitmap& src, size_t width, size_t height, ResizeFilter filter, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF Bitmap ResizeBitmap(const Bitmap& src, size_t width, size_t height, ResizeFilter filter, Allocator& allocator = GetDefaultAllocator());
 
-#if defined GEDO_IMPLEMENTATION
+    struct MipChain
+    {
+        // all the levels are stored in this block, levels[0] is a copy of the source.
+        MemoryBlock block;
+        StaticArray<ColorBitmap, 64> levels;
+    };
 
-    //----------------------------Memory-------------------------//
-    static Allocator* defaultAllocator = CreateMallocAllocator();
+    // every level is half the size of the previous one (2x2 box filter) down to 1x1, the last row and
+    // column of odd sizes are folded into the edge texels (3 wide boxes) so every texel contributes.
+    GEDO_DEF MipChain GenerateMipChain(const ColorBitmap& src, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyMipChain(MipChain& chain, Allocator& allocator = GetDefaultAllocator());
 
-    Allocator& GetDefaultAllocator()
+    // convolves the rows with kernelX and then the columns with kernelY, kernels must have an odd size
+    // and are centered on the middle element. pixels outside the bitmap are clamped to the edge.
+    GEDO_DEF void ConvolveSeparable(ColorBitmap& bitmap, ArrayView<float> kernelX, ArrayView<float> kernelY, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void ConvolveSeparable(Bitmap& bitmap, ArrayView<float> kernelX, ArrayView<float> kernelY, Allocator& allocator = GetDefaultAllocator());
+
+    // box blur of size (2 * radius + 1)^2 using running sums, the cost doesn't depend on the radius.
+    GEDO_DEF void BoxBlur(ColorBitmap& bitmap, size_t radius, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void BoxBlur(Bitmap& bitmap, size_t radius, Allocator& allocator = GetDefaultAllocator());
+
+    // approximates a gaussian blur with 3 stacked box blurs.
+    GEDO_DEF void GaussianBlur(ColorBitmap& bitmap, double sigma, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void GaussianBlur(Bitmap& bitmap, double sigma, Allocator& allocator = GetDefaultAllocator());
+
+    // memory layout of the pixels outside of Color.
+    enum class PixelFormat
     {
-        return *defaultAllocator;
-    }
+        RGBA8,      // bytes r, g, b, a.
+        BGRA8,      // bytes b, g, r, a.
+        RGB8,       // bytes r, g, b, alpha is dropped (and set to 255 when reading).
+        GREY8,      // one byte of Rec.709 luma, alpha is dropped.
+        RGBA_FLOAT  // 4 floats, r, g, b converted from sRGB to linear, alpha scaled to [0, 1].
+    };
 
-    void SetDefaultAllocator(Allocator& allocator)
+    GEDO_DEF size_t GetPixelSize(PixelFormat format);
+
+    // convert count pixels between Color and format, the buffer in the other format must hold
+    // count * GetPixelSize(format) bytes. large buffers are converted in parallel.
+    GEDO_DEF void ConvertPixels(const Color* src, size_t count, PixelFormat format, void* dest);
+    GEDO_DEF void ConvertPixels(const void* src, size_t count, PixelFormat format, Color* dest);
+
+    // sRGB <-> linear conversion based on lookup tables.
+    GEDO_DEF float SRGBToLinear(uint8_t value);
+    GEDO_DEF uint8_t LinearToSRGB(float value);
+
+    struct DepthBuffer
     {
-        defaultAllocator = &allocator;
-    }
+        size_t width = 0;
+        size_t height = 0;
+        float* data = NULL;
+    };
 
-    bool IsPointerInsideMemoryBlock(const uint8_t* ptr, MemoryBlock block)
+    GEDO_DEF DepthBuffer CreateDepthBuffer(size_t width, size_t height, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyDepthBuffer(DepthBuffer& depth, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void ClearDepthBuffer(DepthBuffer& depth, float value = 1.0f);
+
+    struct RasterStats
     {
-        const uint8_t* begin = block.data;
-        const uint8_t* end = block.data + block.size;
-        return (ptr >= begin && ptr < end);
-    }
+        size_t trianglesCount = 0; // submitted triangles.
+        size_t trianglesDrawn = 0; // triangles left after culling.
+        double seconds = 0.0;
+        double trianglesPerSecond = 0.0;
+    };
 
-    bool IsMemoryBlockInside(MemoryBlock big, MemoryBlock small)
+    enum class ShadingMode
+    {
+        FLAT,   // the whole triangle uses the color of its first vertex.
+        GOURAUD // vertex colors are interpolated across the triangle.
+    };
+
+    // rasterizes indexed triangles (3 indices per triangle) transformed by mvp into target.
+    // depth must have the same size as target, it stores window space depth in [0, 1] and
+    // fragments pass when they are closer than the stored value.
+    // the screen is split into tiles which are rasterized in parallel, pixel centers are sampled
+    // with the top-left fill rule so shared edges are drawn exactly once.
+    // stats (if not NULL) gets the triangle counts, time and throughput.
+    // NOTE: triangles are not clipped, triangles with a vertex behind the eye or very far outside
+    //       the screen are dropped. back faces are not culled.
+    GEDO_DEF void DrawTriangles(ColorBitmap& target, DepthBuffer& depth, const Mat4& mvp,
+                                ArrayView<Vec3d> positions, ArrayView<Color> colors, ArrayView<uint32_t> indices,
+                                ShadingMode shading, RasterStats* stats = NULL, Allocator& allocator = GetDefaultAllocator());
+
+    enum class FillRule
+    {
+        NON_ZERO,
+        EVEN_ODD
+    };
+
+    // blends color over dest with an opacity of color.a * coverage / 255, coverage is in [0, 255].
+    GEDO_DEF void BlendPixel(Color& dest, Color color, uint32_t coverage);
+
+    // anti-aliased shapes, coordinates are in pixels where pixel (x, y) is centered at (x + 0.5, y + 0.5).
+    // everything is clipped to the bitmap.
+    GEDO_DEF void DrawLine(ColorBitmap& dest, Vec2d from, Vec2d to, Color color);
+    GEDO_DEF void DrawThickLine(ColorBitmap& dest, Vec2d from, Vec2d to, double thickness, Color color, Allocator& allocator = GetDefaultAllocator());
+    // draws 1 pixel wide segments between consecutive points, clipping is decided once for the whole batch.
+    GEDO_DEF void DrawPolyline(ColorBitmap& dest, ArrayView<Vec2d> points, bool closed, Color color);
+    GEDO_DEF void DrawCircle(ColorBitmap& dest, Vec2d center, double radius, Color color);
+    GEDO_DEF void FillCircle(ColorBitmap& dest, Vec2d center, double radius, Color color);
+    // scanline polygon filler with an active edge table, coverage is accumulated from 4 sub-scanlines
+    // per row with exact horizontal coverage.
+    GEDO_DEF void FillPolygon(ColorBitmap& dest, ArrayView<Vec2d> points, Color color, FillRule rule, Allocator& allocator = GetDefaultAllocator());
+
+    // blends color over count pixels using coverage[i] as the opacity of each pixel.
+    GEDO_DEF void BlendCoverage(Color* dest, const uint8_t* coverage, size_t count, Color color);
+
+    struct GlyphKey
+    {
+        uint32_t font = 0;
+        uint32_t size = 0;
+        uint32_t codepoint = 0;
+    };
+
+    inline bool operator==(const GlyphKey& a, const GlyphKey& b)
+    {
+        return a.font == b.font && a.size == b.size && a.codepoint == b.codepoint;
+    }
+
+    // hashes the fields instead of the bytes of the struct so padding never reaches the hash.
+    inline uint64_t HashKey(const GlyphKey& key)
+    {
+        const uint32_t words[3] = { key.font, key.size, key.codepoint };
+        return HashBytes(words, sizeof(words));
+    }
+
+    struct Glyph
+    {
+        Rect rect;            // location of the coverage mask inside the atlas.
+        int32_t offsetX = 0;  // from the pen position to the top left corner of the mask.
+        int32_t offsetY = 0;
+        int32_t advance = 0;  // horizontal pen movement after the glyph.
+    };
+
+    struct SkylineNode
+    {
+        size_t x = 0;
+        size_t y = 0;
+        size_t width = 0;
+    };
+
+    struct GlyphAtlas
+    {
+        Bitmap bitmap;
+        Array<SkylineNode> skyline;
+        HashTable<GlyphKey, Glyph> glyphs;
+    };
+
+    GEDO_DEF GlyphAtlas CreateGlyphAtlas(size_t width, size_t height, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyGlyphAtlas(GlyphAtlas& atlas, Allocator& allocator = GetDefaultAllocator());
+    // removes all the glyphs, useful when the atlas is full.
+    GEDO_DEF void ClearGlyphAtlas(GlyphAtlas& atlas);
+    // copies the coverage mask of a glyph into the atlas, returns NULL if there is no space left.
+    // if key is already in the atlas its glyph is returned and mask isn't copied again.
+    // the returned pointer is valid until the next AddGlyph.
+    GEDO_DEF const Glyph* AddGlyph(GlyphAtlas& atlas, GlyphKey key, const Bitmap& mask, int32_t offsetX, int32_t offsetY, int32_t advance);
+    GEDO_DEF const Glyph* FindGlyph(const GlyphAtlas& atlas, GlyphKey key);
+    // draws utf8 text starting with the pen at (x, y) (y is the baseline), codepoints that are
+    // not in the atlas are skipped. returns the pen x position after the text.
+    // NOTE: not called DrawText which windows.h defines as a macro.
+    GEDO_DEF int64_t DrawString(ColorBitmap& dest, const GlyphAtlas& atlas, uint32_t font, uint32_t size,
+                                StringView text, int64_t x, int64_t y, Color color);
+
+    // tracks the modified parts of a bitmap as one bit per square tile.
+    struct DirtyRegion
+    {
+        size_t width = 0;
+        size_t height = 0;
+        size_t tileSize = 0;
+        size_t tilesX = 0;
+        size_t tilesY = 0;
+        Array<uint64_t> tiles;
+    };
+
+    GEDO_DEF DirtyRegion CreateDirtyRegion(size_t width, size_t height, size_t tileSize = 64, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void MarkDirty(DirtyRegion& region, Rect rect);
+    GEDO_DEF void MarkAllDirty(DirtyRegion& region);
+    GEDO_DEF void ClearDirtyRegion(DirtyRegion& region);
+    GEDO_DEF bool IsDirty(const DirtyRegion& region);
+    GEDO_DEF bool IsTileDirty(const DirtyRegion& region, size_t tileX, size_t tileY);
+    // dirty tiles merged into rects, horizontal runs of tiles are merged first and then runs with
+    // the same extent on consecutive tile rows. the rects are clipped to the bitmap.
+    GEDO_DEF Array<Rect> GetDirtyRects(const DirtyRegion& region, Allocator& allocator = GetDefaultAllocator());
+
+    // blends layers (back to front, each the size of dest) into dest, only the dirty tiles are recomposed.
+    // the first layer is copied, the rest are alpha blended on top of it.
+    GEDO_DEF void ComposeLayers(ColorBitmap& dest, ArrayView<ColorBitmap> layers, const DirtyRegion& region);
+
+    // the decoders read an encoded image from memory (e.g. a MappedFile), the bitmap is allocated from
+    // allocator and is empty (data == NULL) if the data is not a valid image.
+    // the encoders stream the image to the writer and return false if writing failed.
+    GEDO_DEF ColorBitmap DecodeQOI(MemoryBlock data, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool EncodeQOI(const ColorBitmap& bitmap, BufferedFileWriter& writer);
+    // 24 and 32 bits uncompressed BMP, the encoder writes 32 bits top-down BGRA.
+    GEDO_DEF ColorBitmap DecodeBMP(MemoryBlock data, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool EncodeBMP(const ColorBitmap& bitmap, BufferedFileWriter& writer);
+    // binary PPM (P6) and PGM (P5) with a max value of 255.
+    GEDO_DEF ColorBitmap DecodePPM(MemoryBlock data, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool EncodePPM(const ColorBitmap& bitmap, BufferedFileWriter& writer);
+    GEDO_DEF Bitmap DecodePGM(MemoryBlock data, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool EncodePGM(const Bitmap& bitmap, BufferedFileWriter& writer);
+
+    enum class PNGCompression
+    {
+        STORE,  // uncompressed deflate blocks and no row filters, for latency critical dumps.
+        RLE,    // row filters and runs of the previous byte only.
+        DEFAULT // row filters and LZ77 with dynamic huffman codes.
+    };
+
+    // writes an 8 bits RGBA (or grey for Bitmap) PNG, the image is deflated in independent chunks
+    // on all the processors and the chunks are joined with sync flushes.
+    GEDO_DEF bool EncodePNG(const ColorBitmap& bitmap, BufferedFileWriter& writer, PNGCompression compression = PNGCompression::DEFAULT, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool EncodePNG(const Bitmap& bitmap, BufferedFileWriter& writer, PNGCompression compression = PNGCompression::DEFAULT, Allocator& allocator = GetDefaultAllocator());
+
+    // pick the codec from the file extension (.qoi, .bmp, .ppm and .png for saving only), the file is memory mapped while decoding.
+    GEDO_DEF ColorBitmap LoadColorBitmap(const char* fileName, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool SaveColorBitmap(const char* fileName, const ColorBitmap& bitmap, Allocator& allocator = GetDefaultAllocator());
+
+    GEDO_DEF Color CreateColor(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha);
+
+    GEDO_DEF const Color RED = CreateColor(255, 0, 0, 255);
+    GEDO_DEF const Color GREEN = CreateColor(0, 255, 0, 255);
+    GEDO_DEF const Color GREEN_BLUE = CreateColor(78, 201, 176, 255);
+    GEDO_DEF const Color BLUE = CreateColor(0, 0, 255, 255);
+    GEDO_DEF const Color WHITE = CreateColor(255, 255, 255, 255);
+    GEDO_DEF const Color BLACK = CreateColor(0, 0, 0, 255);
+    GEDO_DEF const Color DARK_GREY = CreateColor(30, 30, 30, 255);
+    //------------------------------------------------------------//
+
+    //------------------------------Geometry-----------------------//
+    GEDO_DEF const uint32_t INVALID_INDEX = 0xffffffff;
+
+    // axis aligned bounds, min is +INFINITY and max -INFINITY on every axis when empty.
+    struct Bounds
+    {
+        Vec3d min;
+        Vec3d max;
+    };
+
+    template<typename T>
+    struct MinMax
+    {
+        T min;
+        T max;
+    };
+
+    // the count of values reduced by one task, smaller inputs stay on the calling thread.
+    static const size_t MIN_MAX_BATCH = 1 << 16;
+
+    // the serial kernels of MinMaxReduce, float and double use AVX2 when enabled and count > 0.
+    GEDO_DEF MinMax<float> MinMaxRange(const float* values, size_t count);
+    GEDO_DEF MinMax<double> MinMaxRange(const double* values, size_t count);
+
+    template<typename T>
+    MinMax<T> MinMaxRange(const T* values, size_t count)
+    {
+        GEDO_ASSERT(count);
+        MinMax<T> result = { values[0], values[0] };
+        for (size_t i = 1; i < count; ++i)
+        {
+            result.min = Min(result.min, values[i]);
+            result.max = Max(result.max, values[i]);
+        }
+        return result;
+    }
+
+    // the smallest and the largest of values (not empty) in one pass, split in chunks reduced in parallel.
+    // e.g.
+    //  MinMax<uint8_t> range = MinMaxReduce(ArrayView<uint8_t>{ bitmap.data, bitmap.width * bitmap.height });
+    template<typename T>
+    MinMax<T> MinMaxReduce(ArrayView<T> values)
+    {
+        GEDO_ASSERT(values.size);
+        const size_t maxChunks = 64;
+        MinMax<T> chunks[maxChunks];
+        const size_t chunksCount = Min<size_t>((values.size + MIN_MAX_BATCH - 1) / MIN_MAX_BATCH, maxChunks);
+        ParallelFor(chunksCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t c = begin; c < end; ++c)
+                        {
+                            const size_t first = values.size * c / chunksCount;
+                            const size_t last = values.size * (c + 1) / chunksCount;
+                            chunks[c] = MinMaxRange(values.data + first, last - first);
+                        }
+                    });
+        MinMax<T> result = chunks[0];
+        for (size_t c = 1; c < chunksCount; ++c)
+        {
+            result.min = Min(result.min, chunks[c].min);
+            result.max = Max(result.max, chunks[c].max);
+        }
+        return result;
+    }
+
+    // the bounds of points, AVX2 reduces 4 points per 3 loads without shuffles and big arrays are split
+    // in parallel like MinMaxReduce.
+    GEDO_DEF Bounds ComputeBounds(ArrayView<Vec3d> points);
+
+    // Morton (Z curve) codes interleave the bits of quantised coordinates, x takes the lowest bit. 2D codes
+    // keep 32 bits per axis and 3D codes 21 bits per axis. pdep/pext are used when BMI2 is enabled.
+    GEDO_DEF uint64_t EncodeMorton2(uint32_t x, uint32_t y);
+    GEDO_DEF uint64_t EncodeMorton3(uint32_t x, uint32_t y, uint32_t z);
+    GEDO_DEF void DecodeMorton2(uint64_t code, uint32_t& x, uint32_t& y);
+    GEDO_DEF void DecodeMorton3(uint64_t code, uint32_t& x, uint32_t& y, uint32_t& z);
+    // the codes of points quantised to bitsPerAxis (<= 21) bits over the largest extent of bounds, 4 points at
+    // once with AVX2 and in parallel.
+    GEDO_DEF void EncodeMorton3(ArrayView<Vec3d> points, const Bounds& bounds, size_t bitsPerAxis, uint64_t* codes);
+
+    // triangle soup with SoA vertex attributes and an optional half edge connectivity.
+    // half edge h is the edge of triangle h / 3 that goes from indices[h] to indices[NextHalfEdge(h)],
+    // so the half edges themselves are implicit and only their twins are stored.
+    struct TriangleMesh
+    {
+        Array<Vec3d> positions;
+        Array<Vec3d> normals;    // empty or one per vertex.
+        Array<Vec2d> uvs;        // empty or one per vertex.
+        Array<uint32_t> indices; // 3 per triangle, counter clockwise.
+
+        // filled by BuildHalfEdges.
+        Array<uint32_t> twins;           // the opposite half edge or INVALID_INDEX on a boundary, one per index.
+        Array<uint32_t> vertexHalfEdges; // an outgoing half edge per vertex, a boundary one for boundary vertices.
+        size_t nonManifoldEdges = 0;     // half edges left without a twin because their edge is shared by more
+                                         // than 2 triangles or the triangles disagree on the orientation.
+    };
+
+    GEDO_DEF TriangleMesh CreateTriangleMesh(size_t verticesCount, size_t trianglesCount, bool withNormals, bool withUVs, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyTriangleMesh(TriangleMesh& mesh);
+
+    // builds twins and vertexHalfEdges in O(n) using a hash table of the edges, the connectivity and
+    // the temporary table are allocated from allocator.
+    GEDO_DEF void BuildHalfEdges(TriangleMesh& mesh, Allocator& allocator = GetDefaultAllocator());
+
+    GEDO_DEF uint32_t NextHalfEdge(uint32_t halfEdge);
+    GEDO_DEF uint32_t PrevHalfEdge(uint32_t halfEdge);
+    GEDO_DEF bool IsBoundaryHalfEdge(const TriangleMesh& mesh, uint32_t halfEdge);
+    GEDO_DEF bool IsBoundaryVertex(const TriangleMesh& mesh, uint32_t vertex);
+    // the boundary half edge that follows the boundary half edge halfEdge on its loop.
+    GEDO_DEF uint32_t NextBoundaryHalfEdge(const TriangleMesh& mesh, uint32_t halfEdge);
+    // true if every edge has at most 2 consistently oriented triangles and the triangles around every
+    // vertex form a single fan.
+    GEDO_DEF bool IsManifold(const TriangleMesh& mesh);
+
+    // the queries below need BuildHalfEdges and don't allocate.
+
+    // calls func(neighbour) for every vertex connected to vertex in counter clockwise order, starting at the
+    // boundary for boundary vertices. only the fan of vertexHalfEdges[vertex] is visited on non manifold vertices.
+    template<typename F>
+    void ForEachOneRing(const TriangleMesh& mesh, uint32_t vertex, F func)
+    {
+        const uint32_t start = mesh.vertexHalfEdges[vertex];
+        if (start == INVALID_INDEX)
+        {
+            return;
+        }
+        uint32_t halfEdge = start;
+        // guards against cycles in broken connectivity.
+        size_t steps = mesh.twins.size();
+        do
+        {
+            func(mesh.indices[NextHalfEdge(halfEdge)]);
+            const uint32_t previous = PrevHalfEdge(halfEdge);
+            const uint32_t twin = mesh.twins[previous];
+            if (twin == INVALID_INDEX)
+            {
+                // the last neighbour of a boundary vertex has no outgoing half edge.
+                func(mesh.indices[previous]);
+                return;
+            }
+            halfEdge = twin;
+        } while (halfEdge != start && --steps);
+    }
+
+    // calls func(halfEdge) for every half edge of the boundary loop of the boundary half edge start.
+    template<typename F>
+    void ForEachBoundaryLoopHalfEdge(const TriangleMesh& mesh, uint32_t start, F func)
+    {
+        uint32_t halfEdge = start;
+        size_t steps = mesh.twins.size();
+        do
+        {
+            func(halfEdge);
+            halfEdge = NextBoundaryHalfEdge(mesh, halfEdge);
+        } while (halfEdge != start && --steps);
+    }
+
+    // calls func(halfEdge) once per boundary loop with the smallest half edge of the loop, returns the loops count.
+    template<typename F>
+    size_t ForEachBoundaryLoop(const TriangleMesh& mesh, F func)
+    {
+        size_t loopsCount = 0;
+        const size_t halfEdgesCount = mesh.twins.size();
+        for (uint32_t halfEdge = 0; halfEdge < halfEdgesCount; ++halfEdge)
+        {
+            if (mesh.twins[halfEdge] != INVALID_INDEX)
+            {
+                continue;
+            }
+            // walking stops at the first smaller half edge, so only the owner of the loop walks all of it.
+            uint32_t next = NextBoundaryHalfEdge(mesh, halfEdge);
+            size_t steps = halfEdgesCount;
+            while (next > halfEdge && --steps)
+            {
+                next = NextBoundaryHalfEdge(mesh, next);
+            }
+            if (next == halfEdge)
+            {
+                func(halfEdge);
+                loopsCount++;
+            }
+        }
+        return loopsCount;
+    }
+
+    //------Mesh IO------//
+    struct MeshIOStats
+    {
+        size_t bytes = 0;
+        double seconds = 0.0;
+        double gigabytesPerSecond = 0.0;
+    };
+
+    // parses a binary or ASCII STL in place (e.g. from a MappedFile), STL doesn't share vertices so there are
+    // 3 positions per triangle. binary files are split across threads by triangles and ASCII files by facets.
+    GEDO_DEF bool ParseSTL(MemoryBlock data, Array<Vec3d>& positions, Allocator& allocator = GetDefaultAllocator());
+    // memory maps fileName and parses it into mesh, stats (if not NULL) gets the size, time and throughput.
+    // the triangles don't share vertices until WeldVertices(mesh, epsilon).
+    GEDO_DEF bool LoadSTL(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats = NULL, Allocator& allocator = GetDefaultAllocator());
+
+    // the attributes of an OBJ file indexed separately like in the file.
+    struct ObjData
+    {
+        Array<Vec3d> positions;
+        Array<Vec2d> uvs;
+        Array<Vec3d> normals;
+        // 3 per triangle (polygons are triangulated as fans), uv and normal indices are INVALID_INDEX
+        // for corners without them.
+        Array<uint32_t> positionIndices;
+        Array<uint32_t> uvIndices;
+        Array<uint32_t> normalIndices;
+    };
+
+    // parses the v, vt, vn and f lines of an OBJ in place on all the cores without allocating per line or token,
+    // negative (relative) indices are supported. returns false on malformed lines or out of range indices.
+    GEDO_DEF bool ParseOBJ(MemoryBlock data, ObjData& obj, Allocator& allocator = GetDefaultAllocator());
+    // memory maps fileName, every distinct position/uv/normal combination becomes a vertex of mesh.
+    GEDO_DEF bool LoadOBJ(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats = NULL, Allocator& allocator = GetDefaultAllocator());
+
+    enum class PlyFormat
+    {
+        ASCII,
+        BINARY_LITTLE_ENDIAN,
+        BINARY_BIG_ENDIAN
+    };
+
+    enum class PlyType
+    {
+        INT8,
+        UINT8,
+        INT16,
+        UINT16,
+        INT32,
+        UINT32,
+        FLOAT32,
+        FLOAT64
+    };
+
+    struct PlyProperty
+    {
+        char name[64] = {};
+        PlyType type = PlyType::FLOAT32;
+        bool isList = false;
+        PlyType countType = PlyType::UINT8; // type of the items count of a list.
+        size_t offset = 0;                  // byte offset inside the record, for fixed size records.
+    };
+
+    struct PlyElement
+    {
+        char name[64] = {};
+        size_t count = 0;
+        size_t stride = 0;        // record size in bytes, 0 if the element has list properties.
+        size_t offset = SIZE_MAX; // file offset of the first record, SIZE_MAX if it follows variable sized records.
+        size_t firstProperty = 0; // the properties are [firstProperty, firstProperty + propertiesCount) of PlyHeader::properties.
+        size_t propertiesCount = 0;
+    };
+
+    struct PlyHeader
+    {
+        PlyFormat format = PlyFormat::BINARY_LITTLE_ENDIAN;
+        size_t size = 0; // bytes up to and including the end_header line.
+        Array<PlyElement> elements;
+        Array<PlyProperty> properties;
+    };
+
+    GEDO_DEF size_t GetPlyTypeSize(PlyType type);
+    GEDO_DEF bool ParsePlyHeader(MemoryBlock data, PlyHeader& header, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF const PlyElement* FindPlyElement(const PlyHeader& header, const char* name);
+    GEDO_DEF const PlyProperty* FindPlyProperty(const PlyHeader& header, const PlyElement& element, const char* name);
+
+    // strided copy of one property of records [first, first + count) of a binary PLY into a column (SoA),
+    // converting and byte swapping on the fly. reading a mapped file range by range keeps only the current
+    // columns in memory, so files bigger than the memory can be streamed.
+    GEDO_DEF bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                                  size_t first, size_t count, float* dest);
+    GEDO_DEF bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                                  size_t first, size_t count, double* dest);
+    // the whole column of a property.
+    GEDO_DEF bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                                  Array<float>& column, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                                  Array<double>& column, Allocator& allocator = GetDefaultAllocator());
+    // the "face" element (vertex_indices or vertex_index list) as 3 indices per triangle, polygons are fan triangulated.
+    GEDO_DEF bool ReadPlyTriangles(MemoryBlock data, const PlyHeader& header, Array<uint32_t>& indices, Allocator& allocator = GetDefaultAllocator());
+
+    // a column of values to write, value i is at data + i * stride (stride 0 means tightly packed).
+    struct PlyColumn
+    {
+        const char* name = NULL;
+        PlyType type = PlyType::FLOAT32;
+        const void* data = NULL;
+        size_t stride = 0;
+    };
+
+    // writes a binary PLY (in the byte order of the host) with a "vertex" element made of the columns and an
+    // optional "face" element, records are assembled in small chunks straight from the columns.
+    GEDO_DEF bool WritePly(BufferedFileWriter& writer, size_t verticesCount, ArrayView<PlyColumn> columns,
+                           ArrayView<uint32_t> triangles = ArrayView<uint32_t>());
+
+    // x, y, z and when available nx, ny, nz and u, v (or s, t) of the vertex element and the faces if any.
+    GEDO_DEF bool LoadPLY(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats = NULL, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool SavePLY(const char* fileName, const TriangleMesh& mesh, Allocator& allocator = GetDefaultAllocator());
+
+    // a mesh loaded from a gedo binary mesh cache, the views point straight into the mapped file.
+    struct MeshCache
+    {
+        MappedFile file;
+        uint64_t sourceHash = 0;
+        ArrayView<Vec3d> positions;
+        ArrayView<Vec3d> normals; // empty if the mesh had no normals.
+        ArrayView<Vec2d> uvs;     // empty if the mesh had no uvs.
+        ArrayView<uint32_t> indices;
+    };
+
+    // writes mesh as a versioned binary cache with 64 bytes aligned sections, sourceHash is stored in the
+    // header to detect stale caches (e.g. HashFile of the file the mesh was loaded from).
+    // e.g.
+    //  uint64_t hash = 0;
+    //  MeshCache cache;
+    //  if (HashFile("model.obj", hash) && (!LoadMeshCache("model.gmc", cache) || cache.sourceHash != hash))
+    //  {
+    //      LoadOBJ("model.obj", mesh);
+    //      SaveMeshCache("model.gmc", mesh, hash);
+    //  }
+    GEDO_DEF bool SaveMeshCache(const char* fileName, const TriangleMesh& mesh, uint64_t sourceHash, Allocator& allocator = GetDefaultAllocator());
+    // O(1), maps the file and validates the header, the cache stays mapped until UnloadMeshCache.
+    GEDO_DEF bool LoadMeshCache(const char* fileName, MeshCache& cache, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void UnloadMeshCache(MeshCache& cache);
+
+    //------Mesh processing------//
+    // merges the vertices closer than epsilon (0 merges exact duplicates only), uniquePositions gets the
+    // first vertex of every group in input order and indices the group of every input vertex, so an STL
+    // soup becomes an indexed mesh. positions are hashed in fixed size chunks in parallel, each with its own
+    // grid of 2 * epsilon cells, and the chunk tables are then merged into one in input order, so the result
+    // doesn't depend on the cores count. returns false if there are more vertices than 32 bits indices.
+    GEDO_DEF bool WeldVertices(ArrayView<Vec3d> positions, double epsilon, Array<Vec3d>& uniquePositions, Array<uint32_t>& indices, Allocator& allocator = GetDefaultAllocator());
+    // welds mesh.positions and remaps mesh.indices, the welded vertices keep the normal and uv of the first
+    // vertex of their group. the half edges are dropped and need a new BuildHalfEdges.
+    GEDO_DEF bool WeldVertices(TriangleMesh& mesh, double epsilon, Allocator& allocator = GetDefaultAllocator());
+
+    // the corners (positions in mesh.indices, the triangle is corner / 3) around every vertex in CSR form,
+    // the corners of vertex v are corners[offsets[v]] to corners[offsets[v + 1] - 1] in increasing order.
+    struct VertexCorners
+    {
+        Array<uint32_t> offsets; // one per vertex + 1.
+        Array<uint32_t> corners; // one per index.
+    };
+
+    GEDO_DEF void BuildVertexCorners(const TriangleMesh& mesh, VertexCorners& vertexCorners, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyVertexCorners(VertexCorners& vertexCorners);
+
+    // area weighted vertex normals. the face normals are computed in one pass and every vertex then gathers
+    // the normals of its faces through the vertex corners, so the vertices are split across threads without
+    // atomics or per thread buffers and the sums don't depend on the cores count. vertices without faces get
+    // a zero normal. the overload without vertexCorners builds them.
+    GEDO_DEF void ComputeVertexNormals(TriangleMesh& mesh, const VertexCorners& vertexCorners, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void ComputeVertexNormals(TriangleMesh& mesh, Allocator& allocator = GetDefaultAllocator());
+    // per vertex tangents in the MikkTSpace convention: the tangent of every face is projected on the plane of
+    // the vertex normal, normalised and weighted by the corner angle, and the bitangent is
+    // signs[v] * CrossProduct(normal, tangent). vertices are not split on uv seams like MikkTSpace does, so
+    // the results match it on meshes where the seams already have their own vertices. needs normals and uvs,
+    // returns false without them. tangents of vertices without a valid uv mapping are zero.
+    GEDO_DEF bool ComputeVertexTangents(const TriangleMesh& mesh, const VertexCorners& vertexCorners, Array<Vec3d>& tangents, Array<double>& signs, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF bool ComputeVertexTangents(const TriangleMesh& mesh, Array<Vec3d>& tangents, Array<double>& signs, Allocator& allocator = GetDefaultAllocator());
+    // quadric error metric decimation by half edge collapses, vertices only move onto their neighbours so the
+    // kept vertices keep their attributes. runs in passes: the collapses of every edge are evaluated in
+    // parallel, sorted by error and applied in that order while skipping the ones next to an earlier collapse
+    // of the pass, then the triangles are re-indexed for the next pass. stops at targetTrianglesCount or when
+    // the next collapse would move the surface more than maxError (in mesh units). borders collapse only along
+    // themselves, lockBorders keeps them as is (e.g. uv seams split in separate vertices, which could
+    // otherwise open). the unused vertices are removed and the half edges dropped. returns the error reached.
+    GEDO_DEF double SimplifyMesh(TriangleMesh& mesh, size_t targetTrianglesCount, double maxError, bool lockBorders = false, Allocator& allocator = GetDefaultAllocator());
+
+    // order gets the point indices sorted along a Morton curve by a radix sort of their codes, the codes get
+    // just enough bits to tell the points apart. e.g. to reorder another array with the same points.
+    GEDO_DEF void ComputeSpatialOrder(ArrayView<Vec3d> points, Array<uint32_t>& order, Allocator& allocator = GetDefaultAllocator());
+    // reorders the vertices (with their normals and uvs when they have one per position) along a Morton
+    // curve, then the triangles by the Morton codes of their centers, so the later passes read the vertices
+    // mostly sequentially. remap gets the new index of every old vertex if not null. the half edges are dropped.
+    GEDO_DEF void SpatialSort(TriangleMesh& mesh, Array<uint32_t>* remap = NULL, Allocator& allocator = GetDefaultAllocator());
+
+    // the vertex shader invocations of an index buffer through a FIFO post transform cache. acmr is the
+    // average per triangle (0.5 is ideal on big regular meshes, 3 the worst) and atvr per used vertex (1 is ideal).
+    struct VertexCacheStats
+    {
+        size_t transformedVertices = 0;
+        double acmr = 0.0;
+        double atvr = 0.0;
+    };
+
+    GEDO_DEF VertexCacheStats AnalyzeVertexCache(ArrayView<uint32_t> indices, size_t verticesCount, size_t cacheSize = 16, Allocator& allocator = GetDefaultAllocator());
+    // reorders the triangles for a post transform vertex cache with the Forsyth linear speed algorithm, the
+    // next triangle is the best scored one around the simulated LRU cache, or the next one in the input order
+    // when the cache has no triangles left. the vertices and the windings are kept, the half edges are dropped.
+    // before and after get AnalyzeVertexCache of the indices if not null.
+    GEDO_DEF void OptimizeVertexCache(TriangleMesh& mesh, VertexCacheStats* before = NULL, VertexCacheStats* after = NULL, Allocator& allocator = GetDefaultAllocator());
+    // renumbers the vertices in the order the indices first use them (the unused ones go last) so the vertex
+    // fetches follow the triangles, run it after OptimizeVertexCache. the normals and uvs follow when they have
+    // one per position. remap gets the new index of every old vertex if not null. the half edges are dropped.
+    GEDO_DEF void OptimizeVertexFetch(TriangleMesh& mesh, Array<uint32_t>* remap = NULL, Allocator& allocator = GetDefaultAllocator());
+
+    //------Spatial queries------//
+    // 32 bytes, the nodes are stored depth first so the left child of an inner node is the next node.
+    struct BVHNode
+    {
+        float min[3];
+        uint32_t first; // the right child for inner nodes, the first entry in BVH::triangles for leaves.
+        float max[3];
+        uint32_t count; // 0 for inner nodes, the triangles count for leaves.
+    };
+
+    struct BVH
+    {
+        Array<BVHNode> nodes;
+        Array<uint32_t> triangles; // the triangles of the leaves, triangle t is mesh.indices[t * 3] to mesh.indices[t * 3 + 2].
+    };
+
+    struct Ray
+    {
+        Vec3d origin;
+        Vec3d direction; // doesn't need to be normalised, distances are in units of its length.
+        double maxDistance = INFINITY;
+    };
+
+    struct RayHit
+    {
+        double distance = INFINITY;
+        uint32_t triangle = INVALID_INDEX; // INVALID_INDEX if the ray missed.
+        double u = 0.0;                    // barycentric coordinates of the hit point relative to the 2nd and 3rd corners.
+        double v = 0.0;
+    };
+
+    static const size_t RAY_PACKET_SIZE = 8;
+
+    // binned SAH build, the top of the tree is split with the binning spread across threads and the subtrees
+    // below are then built in parallel. nodes bounds are floats rounded outwards so they stay conservative.
+    // e.g.
+    //  BVH bvh;
+    //  BuildBVH(mesh, bvh);
+    //  RayHit hit;
+    //  if (IntersectRay(bvh, mesh, Ray{ origin, direction }, hit)) { ... }
+    GEDO_DEF void BuildBVH(const TriangleMesh& mesh, BVH& bvh, Allocator& allocator = GetDefaultAllocator());
+    // updates the bounds after the positions moved, the topology must be the one the BVH was built from.
+    // the tree gets slower as the triangles move away from their build positions, rebuild after large deformations.
+    GEDO_DEF void RefitBVH(const TriangleMesh& mesh, BVH& bvh);
+    GEDO_DEF void DestroyBVH(BVH& bvh);
+    // closest hit along the ray (back faces included), returns false if there is none before ray.maxDistance.
+    GEDO_DEF bool IntersectRay(const BVH& bvh, const TriangleMesh& mesh, const Ray& ray, RayHit& hit);
+    // traverses the tree once for RAY_PACKET_SIZE rays, faster than single rays for coherent rays (e.g. a
+    // 4x2 tile of camera pixels) when compiled with AVX2. returns the number of rays that hit something.
+    GEDO_DEF size_t IntersectRayPacket(const BVH& bvh, const TriangleMesh& mesh, const Ray rays[RAY_PACKET_SIZE], RayHit hits[RAY_PACKET_SIZE]);
+
+    // balanced k-d tree over points, every inner node splits its points at the median along the axis
+    // of largest extent. the tree is implicit: inner node i has the children 2 * i + 1 and 2 * i + 2, its
+    // points range is halved at every level and all the leaves are on the last level with at most
+    // KDTREE_LEAF_SIZE points. the points are stored in leaf order for cache locality.
+    struct KdTree
+    {
+        Array<Vec3d> points;     // the points reordered by leaf.
+        Array<uint32_t> indices; // the index of every reordered point in the input.
+        Array<double> splits;    // one per inner node.
+        Array<uint8_t> axes;     // one per inner node.
+        size_t depth = 0;        // the level of the leaves, the tree has 2^depth - 1 inner nodes.
+    };
+
+    static const size_t KDTREE_LEAF_SIZE = 16;
+
+    struct KdTreeStats
+    {
+        size_t count = 0;        // points built or queries run.
+        size_t resultsCount = 0; // points found by the queries.
+        double seconds = 0.0;
+        double countPerSecond = 0.0;
+    };
+
+    // every level is split in parallel over its nodes.
+    GEDO_DEF void BuildKdTree(ArrayView<Vec3d> points, KdTree& tree, KdTreeStats* stats = NULL, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyKdTree(KdTree& tree);
+    // the k nearest points of query sorted by distance, indices and squaredDistances have room for k entries.
+    // returns the found count, less than k only if the tree has less than k points. doesn't allocate.
+    GEDO_DEF size_t FindNearestNeighbours(const KdTree& tree, const Vec3d& query, size_t k, uint32_t* indices, double* squaredDistances);
+    // runs the queries in parallel, indices and squaredDistances get k entries per query padded with
+    // INVALID_INDEX and INFINITY.
+    GEDO_DEF void FindNearestNeighbours(const KdTree& tree, ArrayView<Vec3d> queries, size_t k, Array<uint32_t>& indices, Array<double>& squaredDistances,
+                                   KdTreeStats* stats = NULL, Allocator& allocator = GetDefaultAllocator());
+    // the input indices of the points within radius of query, in no particular order.
+    GEDO_DEF void FindPointsInRadius(const KdTree& tree, const Vec3d& query, double radius, Array<uint32_t>& indices);
+    // runs the queries in parallel, the points of query q are indices[offsets[q]] to indices[offsets[q + 1] - 1].
+    GEDO_DEF void FindPointsInRadius(const KdTree& tree, ArrayView<Vec3d> queries, double radius, Array<uint32_t>& offsets, Array<uint32_t>& indices,
+                                 KdTreeStats* stats = NULL, Allocator& allocator = GetDefaultAllocator());
+
+    // calls func(index, squaredDistance) for every point within radius of query, index is the input index.
+    template<typename F>
+    void ForEachPointInRadius(const KdTree& tree, const Vec3d& query, double radius, F func)
+    {
+        struct Range
+        {
+            size_t node;
+            size_t begin;
+            size_t end;
+        };
+        const size_t innerCount = ((size_t)1 << tree.depth) - 1;
+        const double radiusSquared = radius * radius;
+        Range stack[64];
+        size_t stackSize = 0;
+        Range range = { 0, 0, tree.points.size() };
+        for (;;)
+        {
+            if (range.node >= innerCount)
+            {
+                for (size_t i = range.begin; i < range.end; ++i)
+                {
+                    const Vec3d d = tree.points[i] - query;
+                    const double distance = DotProduct(d, d);
+                    if (distance <= radiusSquared)
+                    {
+                        func(tree.indices[i], distance);
+                    }
+                }
+                if (!stackSize)
+                {
+                    return;
+                }
+                range = stack[--stackSize];
+                continue;
+            }
+            const size_t middle = range.begin + (range.end - range.begin) / 2;
+            const double offset = query.data[tree.axes[range.node]] - tree.splits[range.node];
+            const Range left = { range.node * 2 + 1, range.begin, middle };
+            const Range right = { range.node * 2 + 2, middle, range.end };
+            if (offset * offset <= radiusSquared)
+            {
+                stack[stackSize++] = (offset < 0.0) ? right : left;
+            }
+            range = (offset < 0.0) ? left : right;
+        }
+    }
+
+    // uniform grid for roughly uniform point sets, the cells are hashed into a power of 2 buckets table and
+    // the points are counting sorted by bucket, so the points of a bucket are contiguous (CSR).
+    struct SpatialHashGrid
+    {
+        double cellSize = 0.0;
+        Array<uint32_t> bucketStarts; // one per bucket + 1, the points of bucket b are bucketStarts[b] to bucketStarts[b + 1] - 1.
+        Array<Vec3d> points;          // the points sorted by bucket.
+        Array<uint32_t> indices;      // the input index of every sorted point.
+    };
+
+    // O(n) and parallel, meant to be rebuilt every frame. the table has about 2 buckets per point.
+    GEDO_DEF void BuildSpatialHashGrid(ArrayView<Vec3d> points, double cellSize, SpatialHashGrid& grid, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroySpatialHashGrid(SpatialHashGrid& grid);
+    GEDO_DEF size_t GetSpatialHashGridBucket(const SpatialHashGrid& grid, int64_t x, int64_t y, int64_t z);
+
+    // calls func(index, squaredDistance) for every point within radius of query, index is the input index.
+    // radius can't be larger than the cell size, so only the cells of the 27 around the query cell that the
+    // sphere overlaps are visited, buckets shared by several of them are visited once. doesn't allocate.
+    template<typename F>
+    void ForEachPointNearby(const SpatialHashGrid& grid, const Vec3d& query, double radius, F func)
+    {
+        GEDO_ASSERT(radius <= grid.cellSize);
+        if (!grid.points.size())
+        {
+            return;
+        }
+        const double inverseCellSize = 1.0 / grid.cellSize;
+        int64_t low[3];
+        int64_t high[3];
+        for (size_t a = 0; a < 3; ++a)
+        {
+            low[a] = (int64_t)floor((query.data[a] - radius) * inverseCellSize);
+            high[a] = (int64_t)floor((query.data[a] + radius) * inverseCellSize);
+        }
+        const double radiusSquared = radius * radius;
+        StaticArray<size_t, 27> visited;
+        for (int64_t z = low[2]; z <= high[2]; ++z)
+        {
+            for (int64_t y = low[1]; y <= high[1]; ++y)
+            {
+                for (int64_t x = low[0]; x <= high[0]; ++x)
+                {
+                    const size_t bucket = GetSpatialHashGridBucket(grid, x, y, z);
+                    bool seen = false;
+                    for (size_t i = 0; i < visited.size(); ++i)
+                    {
+                        seen |= visited[i] == bucket;
+                    }
+                    if (seen)
+                    {
+                        continue;
+                    }
+                    visited.push_back(bucket);
+                    for (uint32_t i = grid.bucketStarts[bucket]; i < grid.bucketStarts[bucket + 1]; ++i)
+                    {
+                        const Vec3d d = grid.points[i] - query;
+                        const double distance = DotProduct(d, d);
+                        if (distance <= radiusSquared)
+                        {
+                            func(grid.indices[i], distance);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //------Volumes------//
+    // dense grid of width * height * depth samples, sample (x, y, z) is data[x + (y + z * height) * width]
+    // and sits at origin + spacing * (x, y, z).
+    struct ScalarVolume
+    {
+        size_t width = 0;
+        size_t height = 0;
+        size_t depth = 0;
+        float* data = NULL;
+        Vec3d origin = {};
+        double spacing = 1.0;
+    };
+
+    GEDO_DEF ScalarVolume CreateScalarVolume(size_t width, size_t height, size_t depth, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyScalarVolume(ScalarVolume& volume, Allocator& allocator = GetDefaultAllocator());
+
+    // marching cubes isosurface of volume, samples below isoValue are inside and the triangles face the larger
+    // values. the ambiguous faces always separate the inside corners so neighbouring cubes agree and the
+    // surface is closed wherever it doesn't leave the volume. slabs of z layers run in parallel: a first pass
+    // counts the vertices and triangles of every slab, the second writes them in place in mesh. every edge
+    // vertex is made once and found again through edge caches of 2 slices per slab, the vertices of the plane
+    // between 2 slabs are owned by the upper slab and the lower one predicts their indices, so the mesh is
+    // indexed without welding. mesh gets positions and indices, ComputeVertexNormals can add the normals.
+    GEDO_DEF void MarchingCubes(const ScalarVolume& volume, float isoValue, TriangleMesh& mesh, Allocator& allocator = GetDefaultAllocator());
+
+    enum class VoxelizationMode
+    {
+        SURFACE,          // conservative, every voxel a triangle touches.
+        SOLID,            // the voxels with their center inside the mesh by parity along x, needs a closed mesh.
+        SURFACE_AND_SOLID // both, e.g. for collisions.
+    };
+
+    // dense occupancy bits, voxel (x, y, z) covers origin + voxelSize * ([x, x + 1], [y, y + 1], [z, z + 1]) and is
+    // bit x % 64 of words[x / 64 + (y + z * height) * wordsPerRow].
+    struct VoxelGrid
+    {
+        size_t width = 0;
+        size_t height = 0;
+        size_t depth = 0;
+        size_t wordsPerRow = 0;
+        Vec3d origin = {};
+        double voxelSize = 1.0;
+        Array<uint64_t> words;
+    };
+
+    static const size_t VOXEL_BRICK_SIZE = 8;
+
+    // only the 8^3 voxels bricks with a voxel set are stored. brick (x, y, z) is brickIndices[x + (y + z *
+    // bricksHeight) * bricksWidth], INVALID_INDEX when empty, and its voxel (x, y, z) is bit x + y * 8 of
+    // bricks[brickIndex * 8 + z].
+    struct SparseVoxelGrid
+    {
+        size_t width = 0; // in voxels.
+        size_t height = 0;
+        size_t depth = 0;
+        size_t bricksWidth = 0;
+        size_t bricksHeight = 0;
+        size_t bricksDepth = 0;
+        Vec3d origin = {};
+        double voxelSize = 1.0;
+        Array<uint32_t> brickIndices;
+        Array<uint64_t> bricks;
+    };
+
+    // voxelizes mesh in a grid over its bounds. the triangles are binned in slabs of 8 layers that run in
+    // parallel, the surface uses the triangle/box overlap tests of Schwarz and Seidel on 8 voxels at once (with
+    // AVX2 when enabled) and the solid flips a bit where every column crosses a triangle then fills the rows
+    // by prefix xor. the sparse version only keeps a slab or 2 per thread besides the bricks, so 1024^3 grids of
+    // thin surfaces stay small.
+    GEDO_DEF void VoxelizeMesh(const TriangleMesh& mesh, double voxelSize, VoxelizationMode mode, VoxelGrid& grid, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void VoxelizeMesh(const TriangleMesh& mesh, double voxelSize, VoxelizationMode mode, SparseVoxelGrid& grid, Allocator& allocator = GetDefaultAllocator());
+    GEDO_DEF void DestroyVoxelGrid(VoxelGrid& grid);
+    GEDO_DEF void DestroySparseVoxelGrid(SparseVoxelGrid& grid);
+    GEDO_DEF bool GetVoxel(const VoxelGrid& grid, size_t x, size_t y, size_t z);
+    GEDO_DEF bool GetVoxel(const SparseVoxelGrid& grid, size_t x, size_t y, size_t z);
+    // the count of voxels set, times voxelSize^3 for a volume.
+    GEDO_DEF size_t CountVoxels(const VoxelGrid& grid);
+    GEDO_DEF size_t CountVoxels(const SparseVoxelGrid& grid);
+    //------------------------------------------------------------//
+
+#if defined GEDO_IMPLEMENTATION
+
+    //----------------------------Memory-------------------------//
+    static Allocator* defaultAllocator = CreateMallocAllocator();
+
+    Allocator& GetDefaultAllocator()
+    {
+        return *defaultAllocator;
+    }
+
+    void SetDefaultAllocator(Allocator& allocator)
+    {
+        defaultAllocator = &allocator;
+    }
+
+    bool IsPointerInsideMemoryBlock(const uint8_t* ptr, MemoryBlock block)
+    {
+        const uint8_t* begin = block.data;
+        const uint8_t* end = block.data + block.size;
+        return (ptr >= begin && ptr < end);
+    }
+
+    bool IsMemoryBlockInside(MemoryBlock big, MemoryBlock small)
     {
         return IsPointerInsideMemoryBlock(small.data, big) &&
             IsPointerInsideMemoryBlock(small.data + small.size, big);
@@ -1031,6 +2428,44 @@ namespace gedo
         return (gigabytes * 1024ULL * 1024ULL * 1024ULL);
     }
 
+    uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+    {
+        const uint64_t m = 0xc6a4a7935bd1e995ULL;
+        const int r = 47;
+        uint64_t h = seed ^ (size * m);
+
+        const uint8_t* bytes = (const uint8_t*)data;
+        const size_t blocks = size / 8;
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            uint64_t k;
+            GEDO_MEMCPY(&k, bytes + i * 8, 8);
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        const uint8_t* tail = bytes + blocks * 8;
+        switch (size & 7)
+        {
+        case 7: h ^= uint64_t(tail[6]) << 48; // fallthrough
+        case 6: h ^= uint64_t(tail[5]) << 40; // fallthrough
+        case 5: h ^= uint64_t(tail[4]) << 32; // fallthrough
+        case 4: h ^= uint64_t(tail[3]) << 24; // fallthrough
+        case 3: h ^= uint64_t(tail[2]) << 16; // fallthrough
+        case 2: h ^= uint64_t(tail[1]) << 8;  // fallthrough
+        case 1: h ^= uint64_t(tail[0]);
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
     LinearAllocator* CreateLinearAllocator(size_t bytes)
     {
         LinearAllocator* allocator = new LinearAllocator();
@@ -1121,22 +2556,369 @@ namespace gedo
     }
     //-----------------------------------------------------------//
 
-    //-------------------------Bitmap manipulation---------------//
-    void FillRectangle(ColorBitmap& dest, Rect fillArea, const ColorBitmap& src)
+    //---------------------------Threads-------------------------//
+#if defined GEDO_OS_WINDOWS
+    struct ThreadTask
     {
-        uint32_t srcIdx = 0;
-        for (uint32_t y = fillArea.y; y < (fillArea.y + fillArea.height); ++y)
-        {
-            for (uint32_t x = fillArea.x; x < (fillArea.x + fillArea.width); ++x)
-            {
-                const uint32_t index = y * dest.width + x;
-                dest.data[index] = src.data[srcIdx++];
+        ThreadProc proc;
+        void* userData;
+    };
+
+    static DWORD WINAPI ThreadTaskEntry(LPVOID data)
+    {
+        ThreadTask* task = (ThreadTask*)data;
+        task->proc(task->userData);
+        return 0;
+    }
+
+    uint32_t GetProcessorCount()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return Max<uint32_t>(info.dwNumberOfProcessors, 1);
+    }
+
+    void RunInParallel(ThreadProc proc, void** userData, size_t count)
+    {
+        const size_t maxThreads = 64;
+        GEDO_ASSERT(count <= maxThreads);
+        ThreadTask tasks[maxThreads];
+        HANDLE handles[maxThreads];
+        for (size_t i = 1; i < count; ++i)
+        {
+            tasks[i].proc = proc;
+            tasks[i].userData = userData[i];
+            handles[i] = CreateThread(NULL, 0, ThreadTaskEntry, &tasks[i], 0, NULL);
+            if (!handles[i])
+            {
+                // could not spawn a thread, run the task inline instead.
+                proc(userData[i]);
+            }
+        }
+        if (count)
+        {
+            proc(userData[0]);
+        }
+        for (size_t i = 1; i < count; ++i)
+        {
+            if (handles[i])
+            {
+                WaitForSingleObject(handles[i], INFINITE);
+                CloseHandle(handles[i]);
+            }
+        }
+    }
+#elif defined GEDO_OS_LINUX
+    struct ThreadTask
+    {
+        ThreadProc proc;
+        void* userData;
+    };
+
+    static void* ThreadTaskEntry(void* data)
+    {
+        ThreadTask* task = (ThreadTask*)data;
+        task->proc(task->userData);
+        return NULL;
+    }
+
+    uint32_t GetProcessorCount()
+    {
+        const long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (uint32_t)count : 1;
+    }
+
+    void RunInParallel(ThreadProc proc, void** userData, size_t count)
+    {
+        const size_t maxThreads = 64;
+        GEDO_ASSERT(count <= maxThreads);
+        ThreadTask tasks[maxThreads];
+        pthread_t threads[maxThreads];
+        bool started[maxThreads] = {};
+        for (size_t i = 1; i < count; ++i)
+        {
+            tasks[i].proc = proc;
+            tasks[i].userData = userData[i];
+            started[i] = pthread_create(&threads[i], NULL, ThreadTaskEntry, &tasks[i]) == 0;
+            if (!started[i])
+            {
+                // could not spawn a thread, run the task inline instead.
+                proc(userData[i]);
+            }
+        }
+        if (count)
+        {
+            proc(userData[0]);
+        }
+        for (size_t i = 1; i < count; ++i)
+        {
+            if (started[i])
+            {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+#endif
+    //-----------------------------------------------------------//
+
+    //---------------------------Time----------------------------//
+#if defined GEDO_OS_WINDOWS
+    static uint64_t GetTicks()
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return counter.QuadPart;
+    }
+
+    static double GetTicksPerSecond()
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return (double)frequency.QuadPart;
+    }
+#elif defined GEDO_OS_LINUX
+    static uint64_t GetTicks()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return uint64_t(time.tv_sec) * 1000000000ull + time.tv_nsec;
+    }
+
+    static double GetTicksPerSecond()
+    {
+        return 1e9;
+    }
+#endif
+
+    Stopwatch StartStopwatch()
+    {
+        Stopwatch result;
+        result.start = GetTicks();
+        return result;
+    }
+
+    double GetElapsedSeconds(const Stopwatch& stopwatch)
+    {
+        return (GetTicks() - stopwatch.start) / GetTicksPerSecond();
+    }
+    //-----------------------------------------------------------//
+
+    //-------------------------Bitmap manipulation---------------//
+    DirtyRegion CreateDirtyRegion(size_t width, size_t height, size_t tileSize, Allocator& allocator)
+    {
+        GEDO_ASSERT(tileSize);
+        DirtyRegion result;
+        result.width = width;
+        result.height = height;
+        result.tileSize = tileSize;
+        result.tilesX = (width + tileSize - 1) / tileSize;
+        result.tilesY = (height + tileSize - 1) / tileSize;
+        result.tiles.allocator = &allocator;
+        result.tiles.resize((result.tilesX * result.tilesY + 63) / 64);
+        ClearDirtyRegion(result);
+        return result;
+    }
+
+    void MarkDirty(DirtyRegion& region, Rect rect)
+    {
+        if (!rect.width || !rect.height || rect.x >= region.width || rect.y >= region.height)
+        {
+            return;
+        }
+        const size_t maxX = Min(rect.x + rect.width, region.width) - 1;
+        const size_t maxY = Min(rect.y + rect.height, region.height) - 1;
+        for (size_t ty = rect.y / region.tileSize; ty <= maxY / region.tileSize; ++ty)
+        {
+            for (size_t tx = rect.x / region.tileSize; tx <= maxX / region.tileSize; ++tx)
+            {
+                const size_t bit = ty * region.tilesX + tx;
+                region.tiles[bit / 64] |= uint64_t(1) << (bit % 64);
+            }
+        }
+    }
+
+    void MarkAllDirty(DirtyRegion& region)
+    {
+        MarkDirty(region, Rect{ 0, 0, region.width, region.height });
+    }
+
+    void ClearDirtyRegion(DirtyRegion& region)
+    {
+        for (uint64_t& word : region.tiles)
+        {
+            word = 0;
+        }
+    }
+
+    bool IsDirty(const DirtyRegion& region)
+    {
+        for (const uint64_t& word : region.tiles)
+        {
+            if (word)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool IsTileDirty(const DirtyRegion& region, size_t tileX, size_t tileY)
+    {
+        const size_t bit = tileY * region.tilesX + tileX;
+        return (region.tiles[bit / 64] >> (bit % 64)) & 1;
+    }
+
+    Array<Rect> GetDirtyRects(const DirtyRegion& region, Allocator& allocator)
+    {
+        Array<Rect> result;
+        result.allocator = &allocator;
+        if (!region.tilesX)
+        {
+            return result;
+        }
+        // for every tile column, the rect whose run started there on the previous / current tile row.
+        const uint32_t none = UINT32_MAX;
+        MemoryBlock block = allocator.AllocateMemoryBlock(2 * region.tilesX * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(block));
+        uint32_t* previousRow = (uint32_t*)block.data;
+        uint32_t* currentRow = previousRow + region.tilesX;
+        for (size_t tx = 0; tx < region.tilesX; ++tx)
+        {
+            previousRow[tx] = none;
+        }
+
+        for (size_t ty = 0; ty < region.tilesY; ++ty)
+        {
+            for (size_t tx = 0; tx < region.tilesX; ++tx)
+            {
+                currentRow[tx] = none;
+            }
+            for (size_t tx = 0; tx < region.tilesX;)
+            {
+                if (!IsTileDirty(region, tx, ty))
+                {
+                    ++tx;
+                    continue;
+                }
+                size_t end = tx + 1;
+                while (end < region.tilesX && IsTileDirty(region, end, ty))
+                {
+                    ++end;
+                }
+                Rect rect;
+                rect.x = tx * region.tileSize;
+                rect.y = ty * region.tileSize;
+                rect.width = Min(end * region.tileSize, region.width) - rect.x;
+                rect.height = Min((ty + 1) * region.tileSize, region.height) - rect.y;
+
+                const uint32_t above = previousRow[tx];
+                if (above != none && result[above].width == rect.width)
+                {
+                    result[above].height += rect.height;
+                    currentRow[tx] = above;
+                }
+                else
+                {
+                    currentRow[tx] = (uint32_t)result.size();
+                    result.push_back(rect);
+                }
+                tx = end;
+            }
+            Swap(previousRow, currentRow);
+        }
+        return result;
+    }
+
+    // blends a row of src over dest with the "over" operator.
+    static void BlendRow(Color* dest, const Color* src, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            Color& d = dest[i];
+            const Color& s = src[i];
+            const int32_t alpha = s.a;
+            d.r = (uint8_t)(d.r + ((s.r - d.r) * alpha) / 255);
+            d.g = (uint8_t)(d.g + ((s.g - d.g) * alpha) / 255);
+            d.b = (uint8_t)(d.b + ((s.b - d.b) * alpha) / 255);
+            d.a = (uint8_t)(alpha + (d.a * (255 - alpha) + 127) / 255);
+        }
+    }
+
+    void ComposeLayers(ColorBitmap& dest, ArrayView<ColorBitmap> layers, const DirtyRegion& region)
+    {
+        GEDO_ASSERT(dest.width == region.width && dest.height == region.height);
+        if (!layers.size)
+        {
+            return;
+        }
+        const size_t tilesCount = region.tilesX * region.tilesY;
+        ParallelFor(tilesCount, 4, [&](size_t begin, size_t end)
+                    {
+                        for (size_t tile = begin; tile < end; ++tile)
+                        {
+                            const size_t tx = tile % region.tilesX;
+                            const size_t ty = tile / region.tilesX;
+                            if (!IsTileDirty(region, tx, ty))
+                            {
+                                continue;
+                            }
+                            const size_t minX = tx * region.tileSize;
+                            const size_t minY = ty * region.tileSize;
+                            const size_t width = Min(minX + region.tileSize, dest.width) - minX;
+                            const size_t maxY = Min(minY + region.tileSize, dest.height);
+                            for (size_t y = minY; y < maxY; ++y)
+                            {
+                                const size_t offset = y * dest.width + minX;
+                                GEDO_MEMCPY((void*)(dest.data + offset), layers.data[0].data + offset, width * sizeof(Color));
+                                for (size_t l = 1; l < layers.size; ++l)
+                                {
+                                    BlendRow(dest.data + offset, layers.data[l].data + offset, width);
+                                }
+                            }
+                        }
+                    });
+    }
+
+    // marks [minX, maxX) x [minY, maxY) as dirty if the bitmap tracks its changes.
+    static void MarkBitmapDirty(ColorBitmap& bitmap, int64_t minX, int64_t minY, int64_t maxX, int64_t maxY)
+    {
+        if (!bitmap.dirty)
+        {
+            return;
+        }
+        minX = Max<int64_t>(minX, 0);
+        minY = Max<int64_t>(minY, 0);
+        maxX = Min<int64_t>(maxX, bitmap.width);
+        maxY = Min<int64_t>(maxY, bitmap.height);
+        if (minX < maxX && minY < maxY)
+        {
+            MarkDirty(*bitmap.dirty, Rect{ size_t(minX), size_t(minY), size_t(maxX - minX), size_t(maxY - minY) });
+        }
+    }
+
+    void FillRectangle(ColorBitmap& dest, Rect fillArea, const ColorBitmap& src)
+    {
+        if (dest.dirty)
+        {
+            MarkDirty(*dest.dirty, fillArea);
+        }
+        uint32_t srcIdx = 0;
+        for (uint32_t y = fillArea.y; y < (fillArea.y + fillArea.height); ++y)
+        {
+            for (uint32_t x = fillArea.x; x < (fillArea.x + fillArea.width); ++x)
+            {
+                const uint32_t index = y * dest.width + x;
+                dest.data[index] = src.data[srcIdx++];
             }
         }
     }
 
     void FillRectangle(ColorBitmap& dest, Rect fillArea, const Bitmap& mask, Color c)
     {
+        if (dest.dirty)
+        {
+            MarkDirty(*dest.dirty, fillArea);
+        }
         uint32_t srcIdx = 0;
         for (uint32_t y = fillArea.y; y < (fillArea.y + fillArea.height); ++y)
         {
@@ -1153,6 +2935,10 @@ namespace gedo
 
     void FillRectangle(ColorBitmap& dest, Rect fillArea, Color color)
     {
+        if (dest.dirty)
+        {
+            MarkDirty(*dest.dirty, fillArea);
+        }
         for (uint32_t y = fillArea.y; y < (fillArea.y + fillArea.height); ++y)
         {
             for (uint32_t x = fillArea.x; x < (fillArea.x + fillArea.width); ++x)
@@ -1216,844 +3002,9886 @@ namespace gedo
         allocator.FreeMemoryBlock(block);
         bitmap.data = NULL;
     }
-    //-----------------------------------------------------------//
 
-    //--------------------------------File IO---------------------//
-#if defined GEDO_OS_WINDOWS
-    static MemoryBlock UTF8ToUTF16(const char* fileName, Allocator& allocator)
+    // weights are stored in Q14 fixed point, every destination pixel reads taps consecutive source pixels.
+    static const int32_t RESAMPLE_WEIGHT_BITS = 14;
+    static const int32_t RESAMPLE_WEIGHT_ONE = 1 << RESAMPLE_WEIGHT_BITS;
+
+    struct ResampleWeights
     {
-        const size_t len = strlen(fileName);
-        const size_t wlen =
-            MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, fileName, len, NULL, 0);
-        MemoryBlock data =
-            allocator.AllocateMemoryBlock(sizeof(wchar_t) * (wlen + 1));
-        wchar_t* utf16 = (wchar_t*)data.data;
-        utf16[wlen] = 0;
-        MultiByteToWideChar(
-            CP_UTF8, MB_ERR_INVALID_CHARS, fileName, len, utf16, wlen);
-        return data;
-    }
+        MemoryBlock block;
+        uint32_t* first = NULL;
+        int16_t* weights = NULL;
+        size_t taps = 0;
+    };
 
-    static HANDLE GetFileHandle(const char* fileName, bool read, Allocator& allocator)
+    static double ResampleFilterSupport(ResizeFilter filter)
     {
-        if (!fileName)
+        switch (filter)
         {
-            return NULL;
+        case ResizeFilter::BOX: return 0.5;
+        case ResizeFilter::BILINEAR: return 1.0;
+        case ResizeFilter::LANCZOS: return 3.0;
         }
-        MemoryBlock utf16Memory = UTF8ToUTF16(fileName, allocator);
-        defer(allocator.FreeMemoryBlock(utf16Memory));
-        wchar_t* text = (wchar_t*)utf16Memory.data;
-        HANDLE handle = NULL;
-        if (read)
+        return 1.0;
+    }
+
+    static double ResampleFilterWeight(ResizeFilter filter, double x)
+    {
+        switch (filter)
         {
-            handle =
-                CreateFile(text,            // file to open
-                           GENERIC_READ,    // open for reading
-                           FILE_SHARE_READ, // share for reading
-                           NULL,            // default security
-                           OPEN_EXISTING,   // existing file only
-                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, // normal file
-                           NULL);
-        }
-        else
+        case ResizeFilter::BOX:
+            return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+        case ResizeFilter::BILINEAR:
+            x = fabs(x);
+            return x < 1.0 ? 1.0 - x : 0.0;
+        case ResizeFilter::LANCZOS:
         {
-            handle = CreateFile(text,                  // name of the write
-                                GENERIC_WRITE,         // open for writing
-                                0,                     // do not share
-                                NULL,                  // default security
-                                CREATE_NEW,            // create new file only
-                                FILE_ATTRIBUTE_NORMAL, // normal file
-                                NULL);
+            x = fabs(x);
+            if (x < 1e-8)
+            {
+                return 1.0;
+            }
+            if (x >= 3.0)
+            {
+                return 0.0;
+            }
+            const double px = PI * x;
+            return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
         }
-        return handle;
+        }
+        return 0.0;
     }
 
-    MemoryBlock ReadFile(const char* fileName, Allocator& allocator)
+    static ResampleWeights CreateResampleWeights(size_t srcSize, size_t dstSize, ResizeFilter filter, Allocator& allocator)
     {
-        MemoryBlock result;
-        const int64_t fileSize = GetFileSize(fileName);
-        if (fileSize < 0)
+        const double scale = double(srcSize) / double(dstSize);
+        const double filterScale = Max(scale, 1.0);
+        const double support = ResampleFilterSupport(filter) * filterScale;
+        const size_t rawTaps = (size_t)ceil(support * 2.0) + 1;
+
+        ResampleWeights result;
+        result.taps = Min(rawTaps, srcSize);
+        // the double scratch goes first so it keeps the alignment of the block.
+        result.block = allocator.AllocateMemoryBlock(rawTaps * sizeof(double) +
+                                                     dstSize * (sizeof(uint32_t) + result.taps * sizeof(int16_t)));
+        double* weights = (double*)result.block.data;
+        result.first = (uint32_t*)(weights + rawTaps);
+        result.weights = (int16_t*)(result.first + dstSize);
+
+        for (size_t i = 0; i < dstSize; ++i)
         {
-            return result;
+            const double center = (i + 0.5) * scale;
+            const int64_t left = (int64_t)floor(center - support);
+            const int64_t first = Clamp<int64_t>(left, 0, srcSize - result.taps);
+            for (size_t t = 0; t < result.taps; ++t)
+            {
+                weights[t] = 0;
+            }
+
+            // contributions falling outside the source are folded into the edge pixels.
+            double total = 0;
+            for (size_t t = 0; t < rawTaps; ++t)
+            {
+                const int64_t j = left + t;
+                const double w = ResampleFilterWeight(filter, (j + 0.5 - center) / filterScale);
+                weights[Clamp<int64_t>(j, 0, srcSize - 1) - first] += w;
+                total += w;
+            }
+            if (total == 0)
+            {
+                // can happen with the box filter when upscaling, fall back to nearest.
+                weights[Clamp<int64_t>((int64_t)center, 0, srcSize - 1) - first] = total = 1.0;
+            }
+
+            int16_t* fixedWeights = result.weights + i * result.taps;
+            int32_t fixedTotal = 0;
+            size_t largest = 0;
+            for (size_t t = 0; t < result.taps; ++t)
+            {
+                fixedWeights[t] = (int16_t)floor(weights[t] / total * RESAMPLE_WEIGHT_ONE + 0.5);
+                fixedTotal += fixedWeights[t];
+                if (fixedWeights[t] > fixedWeights[largest])
+                {
+                    largest = t;
+                }
+            }
+            // make sure the weights add up to exactly one so flat areas stay flat.
+            fixedWeights[largest] += (int16_t)(RESAMPLE_WEIGHT_ONE - fixedTotal);
+            result.first[i] = (uint32_t)first;
         }
-        result = allocator.AllocateMemoryBlock(fileSize + 1);
-        HANDLE handle = GetFileHandle(fileName, true, allocator);
-        defer(CloseHandle(handle));
-        OVERLAPPED overlapped = {};
-        const bool success = ReadFileEx(handle,
-                                        result.data,
-                                        result.size - 1,
-                                        &overlapped,
-                                        NULL);
-        GEDO_ASSERT(success);
         return result;
     }
 
-    bool WriteFile(const char* fileName, MemoryBlock block, Allocator& allocator)
+    static inline uint8_t ResampleRound(int32_t sum)
     {
-        HANDLE handle = GetFileHandle(fileName, false, allocator);
-        if (handle)
-        {
-            defer(CloseHandle(handle));
-            OVERLAPPED overlapped = {};
-            return WriteFileEx(handle, block.data, block.size - 1, &overlapped, NULL);
-        }
-        return false;
+        return (uint8_t)Clamp<int32_t>((sum + (RESAMPLE_WEIGHT_ONE >> 1)) >> RESAMPLE_WEIGHT_BITS, 0, 255);
     }
 
-    bool DoesFileExist(const char* fileName, Allocator& allocator)
+#if defined __AVX2__
+    // the horizontal taps of one RGBA pixel, 2 taps per madd on the channels interleaved as (tap t, tap t + 1).
+    static void ResampleRGBAPixelAVX2(const uint8_t* s, const int16_t* w, size_t taps, uint8_t* dst)
     {
-        HANDLE handle = GetFileHandle(fileName, true, allocator);
-        const bool found = handle != INVALID_HANDLE_VALUE;
-        if (found)
+        const __m128i interleave = _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+        __m128i sum = _mm_setzero_si128();
+        size_t t = 0;
+        for (; t + 2 <= taps; t += 2)
         {
-            CloseHandle(handle);
+            const __m128i pixels = _mm_shuffle_epi8(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(s + t * 4))), interleave);
+            const __m128i weights = _mm_set1_epi32((int32_t)(((uint32_t)(uint16_t)w[t + 1] << 16) | (uint16_t)w[t]));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pixels, weights));
         }
-        return found;
+        if (t < taps)
+        {
+            // the last odd tap reads 4 bytes only, it can be the last pixel of the image.
+            uint32_t pixel;
+            GEDO_MEMCPY(&pixel, s + t * 4, 4);
+            const __m128i pixels = _mm_cvtepu8_epi32(_mm_cvtsi32_si128((int32_t)pixel));
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(pixels, _mm_set1_epi32(w[t])));
+        }
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(RESAMPLE_WEIGHT_ONE >> 1)), RESAMPLE_WEIGHT_BITS);
+        const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(sum, sum), _mm_setzero_si128());
+        const uint32_t pixel = (uint32_t)_mm_cvtsi128_si32(bytes);
+        GEDO_MEMCPY(dst, &pixel, 4);
     }
 
-    int64_t GetFileSize(const char* fileName, Allocator& allocator)
+    // dst[x] = sum of w[t] * s[t * stride + x] for 16 bytes per step, with the bytes widened to 16 bits and 2 taps
+    // per madd. stride is a row for the vertical taps and a pixel for the horizontal ones, returns the count of
+    // bytes done.
+    static size_t ConvolveBytesAVX2(const uint8_t* s, size_t stride, const int16_t* w, size_t taps, uint8_t* dst, size_t count)
     {
-        HANDLE handle = GetFileHandle(fileName, true, allocator);
-        const bool found = handle != INVALID_HANDLE_VALUE;
-        if (found)
+        const __m256i half = _mm256_set1_epi32(RESAMPLE_WEIGHT_ONE >> 1);
+        size_t x = 0;
+        for (; x + 16 <= count; x += 16)
         {
-            LARGE_INTEGER size;
-            GetFileSizeEx(handle, &size);
-            CloseHandle(handle);
-            return size.QuadPart;
+            __m256i low = _mm256_setzero_si256();
+            __m256i high = _mm256_setzero_si256();
+            for (size_t t = 0; t < taps; t += 2)
+            {
+                const bool pair = t + 1 < taps;
+                const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(s + t * stride + x)));
+                const __m256i b = pair ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(s + (t + 1) * stride + x))) : _mm256_setzero_si256();
+                const int16_t next = pair ? w[t + 1] : 0;
+                const __m256i weights = _mm256_set1_epi32((int32_t)(((uint32_t)(uint16_t)next << 16) | (uint16_t)w[t]));
+                // in lane interleaves, low gets bytes 0-3 and 8-11, high 4-7 and 12-15.
+                low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights));
+                high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights));
+            }
+            low = _mm256_srai_epi32(_mm256_add_epi32(low, half), RESAMPLE_WEIGHT_BITS);
+            high = _mm256_srai_epi32(_mm256_add_epi32(high, half), RESAMPLE_WEIGHT_BITS);
+            // the in lane packs restore the order, the bytes end up in the qwords 0 and 2.
+            const __m256i words = _mm256_packs_epi32(low, high);
+            const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+            _mm_storeu_si128((__m128i*)(dst + x), _mm256_castsi256_si128(bytes));
         }
-        return -1;
+        return x;
     }
+#endif // __AVX2__
 
-    PathType GetPathType(const char* path, Allocator& allocator)
+    template<size_t CHANNELS>
+    static void ResampleRow(const uint8_t* srcRow, const ResampleWeights& wx, size_t dstWidth, uint8_t* dstRow)
     {
-        HANDLE handle = GetFileHandle(path, true, allocator);
-        const bool found = handle != INVALID_HANDLE_VALUE;
-        if (found)
+        for (size_t x = 0; x < dstWidth; ++x)
         {
-            defer(CloseHandle(handle));
-            FILE_BASIC_INFO basicInfo;
-            GetFileInformationByHandleEx(handle, FileBasicInfo, &basicInfo, sizeof(basicInfo));
-            return (basicInfo.FileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-                ? PathType::DIRECTORY
-                : PathType::FILE;
+            const uint8_t* s = srcRow + wx.first[x] * CHANNELS;
+            const int16_t* w = wx.weights + x * wx.taps;
+#if defined __AVX2__
+            if (CHANNELS == 4)
+            {
+                ResampleRGBAPixelAVX2(s, w, wx.taps, dstRow + x * 4);
+                continue;
+            }
+#endif // __AVX2__
+            int32_t sum[CHANNELS] = {};
+            for (size_t t = 0; t < wx.taps; ++t)
+            {
+                for (size_t c = 0; c < CHANNELS; ++c)
+                {
+                    sum[c] += w[t] * s[t * CHANNELS + c];
+                }
+            }
+            for (size_t c = 0; c < CHANNELS; ++c)
+            {
+                dstRow[x * CHANNELS + c] = ResampleRound(sum[c]);
+            }
         }
-        return PathType::FAILURE;
     }
-#elif defined GEDO_OS_LINUX
-    MemoryBlock ReadFile(const char* fileName, Allocator& allocator)
+
+    // the vertical taps of a row, accumulates whole rows so the inner loop runs over contiguous memory.
+    static void ResampleColumns(const uint8_t* s, size_t rowSize, const int16_t* w, size_t taps, uint8_t* dstRow)
     {
-        FILE* fp = fopen(fileName, "r");
-        MemoryBlock result;
-        if (fp)
+        size_t x0 = 0;
+#if defined __AVX2__
+        x0 = ConvolveBytesAVX2(s, rowSize, w, taps, dstRow, rowSize);
+#endif // __AVX2__
+        const size_t chunk = 1024;
+        int32_t sum[chunk];
+        for (; x0 < rowSize; x0 += chunk)
         {
-            fseek(fp, 0, SEEK_END);
-            const int64_t size = ftell(fp);
-            fseek(fp, 0, SEEK_SET);
-            result = allocator.AllocateMemoryBlock(size + 1);
-            fread(result.data, 1, size, fp);
-            result.data[size] = 0;
-            fclose(fp);
+            const size_t count = Min(chunk, rowSize - x0);
+            for (size_t i = 0; i < count; ++i)
+            {
+                sum[i] = 0;
+            }
+            for (size_t t = 0; t < taps; ++t)
+            {
+                const uint8_t* row = s + t * rowSize + x0;
+                const int32_t weight = w[t];
+                for (size_t i = 0; i < count; ++i)
+                {
+                    sum[i] += weight * row[i];
+                }
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                dstRow[x0 + i] = ResampleRound(sum[i]);
+            }
         }
-        return result;
     }
 
-    bool WriteFile(const char* fileName, MemoryBlock block, Allocator& allocator)
+    template<size_t CHANNELS>
+    static void ResampleRows(const uint8_t* src, size_t srcWidth, size_t srcHeight,
+                             uint8_t* dst, size_t dstWidth, size_t dstHeight,
+                             ResizeFilter filter, Allocator& allocator)
     {
-        FILE* fp = fopen(fileName, "w");
-        MemoryBlock result;
-        if (fp)
+        ResampleWeights wx = CreateResampleWeights(srcWidth, dstWidth, filter, allocator);
+        defer(allocator.FreeMemoryBlock(wx.block));
+        ResampleWeights wy = CreateResampleWeights(srcHeight, dstHeight, filter, allocator);
+        defer(allocator.FreeMemoryBlock(wy.block));
+
+        // the destination rows are split in chunks that run both passes in a single ParallelFor, every chunk
+        // resamples horizontally the source rows it needs into its own part of temp (the few rows shared by 2
+        // chunks are done twice) then resamples them vertically.
+        const size_t maxChunks = 64;
+        const size_t chunksCount = Clamp<size_t>(dstHeight / 16, 1, Min<size_t>(GetProcessorCount(), maxChunks));
+        size_t tempOffsets[maxChunks + 1];
+        size_t srcBegins[maxChunks];
+        const size_t rowSize = dstWidth * CHANNELS;
+        tempOffsets[0] = 0;
+        for (size_t c = 0; c < chunksCount; ++c)
         {
-            fwrite(result.data, 1, result.size, fp);
-            fclose(fp);
-            return true;
+            const size_t begin = dstHeight * c / chunksCount;
+            const size_t end = dstHeight * (c + 1) / chunksCount;
+            srcBegins[c] = wy.first[begin];
+            tempOffsets[c + 1] = tempOffsets[c] + (wy.first[end - 1] + wy.taps - srcBegins[c]) * rowSize;
         }
-        return false;
+        MemoryBlock temp = allocator.AllocateMemoryBlock(tempOffsets[chunksCount]);
+        defer(allocator.FreeMemoryBlock(temp));
+
+        ParallelFor(chunksCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t c = begin; c < end; ++c)
+                        {
+                            uint8_t* rows = temp.data + tempOffsets[c];
+                            const size_t rowsCount = (tempOffsets[c + 1] - tempOffsets[c]) / rowSize;
+                            // horizontal pass: srcWidth x rowsCount -> dstWidth x rowsCount.
+                            for (size_t y = 0; y < rowsCount; ++y)
+                            {
+                                ResampleRow<CHANNELS>(src + (srcBegins[c] + y) * srcWidth * CHANNELS, wx, dstWidth, rows + y * rowSize);
+                            }
+                            for (size_t y = dstHeight * c / chunksCount; y < dstHeight * (c + 1) / chunksCount; ++y)
+                            {
+                                ResampleColumns(rows + (wy.first[y] - srcBegins[c]) * rowSize, rowSize, wy.weights + y * wy.taps, wy.taps, dst + y * rowSize);
+                            }
+                        }
+                    });
     }
 
-    bool DoesFileExist(const char* fileName, Allocator& allocator)
+    ColorBitmap ResizeBitmap(const ColorBitmap& src, size_t width, size_t height, ResizeFilter filter, Allocator& allocator)
     {
-        FILE* fp = fopen(fileName, "r");
-        if (fp)
+        ColorBitmap result = CreateColorBitmap(width, height, allocator);
+        if (width && height && src.width && src.height)
         {
-            fclose(fp);
-            return true;
+            ResampleRows<4>((const uint8_t*)src.data, src.width, src.height,
+                            (uint8_t*)result.data, width, height, filter, allocator);
         }
-        return false;
+        return result;
     }
 
-    int64_t GetFileSize(const char* fileName, Allocator& allocator)
+    Bitmap ResizeBitmap(const Bitmap& src, size_t width, size_t height, ResizeFilter filter, Allocator& allocator)
     {
-        FILE* fp = fopen(fileName, "r");
-        if (fp)
+        Bitmap result = CreateBitmap(width, height, allocator);
+        if (width && height && src.width && src.height)
         {
-            fseek(fp, 0, SEEK_END);
-            fclose(fp);
-            const int64_t size = ftell(fp);
-            return size;
+            ResampleRows<1>(src.data, src.width, src.height, result.data, width, height, filter, allocator);
         }
-        return -1;
+        return result;
     }
 
-    PathType GetPathType(const char* path, Allocator& allocator)
+    // the rounded average of the texels [x0, x1) x [y0, y1) of src.
+    static void AverageMipTexels(const ColorBitmap& src, size_t x0, size_t x1, size_t y0, size_t y1, uint8_t* dst)
     {
-        struct stat s;
-        if (stat(path, &s) == 0)
+        uint32_t sum[4] = {};
+        for (size_t y = y0; y < y1; ++y)
         {
-            if (s.st_mode & S_IFDIR)
-            {
-                return PathType::DIRECTORY;
-            }
-            else if (s.st_mode & S_IFREG)
+            const uint8_t* row = (const uint8_t*)(src.data + y * src.width);
+            for (size_t x = x0; x < x1; ++x)
             {
-                return PathType::FILE;
+                for (size_t c = 0; c < 4; ++c)
+                {
+                    sum[c] += row[x * 4 + c];
+                }
             }
         }
-        return PathType::FAILURE;
+        const uint32_t count = uint32_t((x1 - x0) * (y1 - y0));
+        for (size_t c = 0; c < 4; ++c)
+        {
+            dst[c] = (uint8_t)((sum[c] + count / 2) / count);
+        }
     }
-#endif
-    //------------------------------------------------------------//
 
-    //------------------Strings----------------------------------//
-    static String CopyString(const char* string, size_t from, size_t to, Allocator& allocator)
+    MipChain GenerateMipChain(const ColorBitmap& src, Allocator& allocator)
     {
-        String s;
-        s.allocator = &allocator;
-        s.reserve(to - from + 1);
-        for (size_t i = from; i < to; ++i)
+        MipChain result;
+        if (!src.width || !src.height)
         {
-            s.append(string[i]);
+            return result;
         }
-        return s;
-    }
 
-    size_t StringLength(const char* string)
-    {
-        size_t result = 0;
-        while (*string++)
+        size_t totalPixels = 0;
+        size_t width = src.width;
+        size_t height = src.height;
+        for (;;)
         {
-            result++;
+            totalPixels += width * height;
+            if (width == 1 && height == 1)
+            {
+                break;
+            }
+            width = Max<size_t>(width / 2, 1);
+            height = Max<size_t>(height / 2, 1);
+        }
+
+        result.block = allocator.AllocateMemoryBlock(totalPixels * sizeof(Color));
+        GEDO_ASSERT(result.block.data);
+        Color* pixels = (Color*)result.block.data;
+
+        ColorBitmap level0;
+        level0.width = src.width;
+        level0.height = src.height;
+        level0.data = pixels;
+        GEDO_MEMCPY(level0.data, src.data, src.width * src.height * sizeof(Color));
+        result.levels.push_back(level0);
+        pixels += src.width * src.height;
+
+        while (result.levels[result.levels.size() - 1].width > 1 ||
+               result.levels[result.levels.size() - 1].height > 1)
+        {
+            const ColorBitmap& prev = result.levels[result.levels.size() - 1];
+            ColorBitmap level;
+            level.width = Max<size_t>(prev.width / 2, 1);
+            level.height = Max<size_t>(prev.height / 2, 1);
+            level.data = pixels;
+            pixels += level.width * level.height;
+
+            ParallelFor(level.height, 32, [&](size_t begin, size_t end)
+                        {
+                            const size_t lastX = level.width - 1;
+                            for (size_t y = begin; y < end; ++y)
+                            {
+                                // the last texels of a level take the rest of the previous one, 1 to 3 rows or columns.
+                                const size_t y0 = 2 * y;
+                                const size_t y1 = (y == level.height - 1) ? prev.height : y0 + 2;
+                                uint8_t* dst = (uint8_t*)(level.data + y * level.width);
+                                if (y1 - y0 == 2)
+                                {
+                                    const uint8_t* row0 = (const uint8_t*)(prev.data + y0 * prev.width);
+                                    const uint8_t* row1 = (const uint8_t*)(prev.data + (y0 + 1) * prev.width);
+                                    for (size_t x = 0; x < lastX; ++x)
+                                    {
+                                        const size_t x0 = 2 * x * 4;
+                                        const size_t x1 = x0 + 4;
+                                        for (size_t c = 0; c < 4; ++c)
+                                        {
+                                            dst[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                                        }
+                                    }
+                                }
+                                else
+                                {
+                                    for (size_t x = 0; x < lastX; ++x)
+                                    {
+                                        AverageMipTexels(prev, 2 * x, 2 * x + 2, y0, y1, dst + x * 4);
+                                    }
+                                }
+                                AverageMipTexels(prev, 2 * lastX, prev.width, y0, y1, dst + lastX * 4);
+                            }
+                        });
+            result.levels.push_back(level);
         }
         return result;
     }
 
-    const char* GetFileExtension(const char* string)
+    void DestroyMipChain(MipChain& chain, Allocator& allocator)
     {
-        const size_t len = StringLength(string);
-        if (!len)
+        GEDO_ASSERT(chain.block.data);
+        allocator.FreeMemoryBlock(chain.block);
+        chain.levels.clear();
+    }
+
+    // the filter passes process the rows in blocks and write their output transposed,
+    // so running a pass twice filters both directions while always reading contiguous rows.
+    static const size_t FILTER_BLOCK_ROWS = 8;
+
+    // pixels of a row filtered at once before they are written transposed.
+    static const size_t FILTER_SPAN = 256;
+
+    // weights16 is NULL when a weight doesn't fit in 16 bits, the AVX2 path then falls back to the scalar taps.
+    template<size_t CHANNELS>
+    static void ConvolveRowsTransposed(const uint8_t* src, size_t width, size_t height, uint8_t* dst,
+                                       const int32_t* weights, const int16_t* weights16, size_t taps)
+    {
+#if !defined __AVX2__
+        (void)weights16; // only read by the AVX2 path.
+#endif // __AVX2__
+        const int64_t radius = taps / 2;
+        const size_t blocks = (height + FILTER_BLOCK_ROWS - 1) / FILTER_BLOCK_ROWS;
+        ParallelFor(blocks, 4, [&](size_t begin, size_t end)
+                    {
+                        uint8_t span[FILTER_BLOCK_ROWS][FILTER_SPAN * CHANNELS];
+                        for (size_t block = begin; block < end; ++block)
+                        {
+                            const size_t y0 = block * FILTER_BLOCK_ROWS;
+                            const size_t rows = Min(FILTER_BLOCK_ROWS, height - y0);
+                            for (size_t x0 = 0; x0 < width; x0 += FILTER_SPAN)
+                            {
+                                const size_t x1 = Min(x0 + FILTER_SPAN, width);
+                                // the pixels whose taps are all inside the row.
+                                const size_t insideBegin = Clamp<int64_t>(radius, x0, x1);
+                                const size_t insideEnd = Clamp<int64_t>(int64_t(width) - radius, insideBegin, x1);
+                                for (size_t r = 0; r < rows; ++r)
+                                {
+                                    const uint8_t* row = src + (y0 + r) * width * CHANNELS;
+                                    uint8_t* out = span[r] - x0 * CHANNELS;
+                                    size_t x = insideBegin;
+#if defined __AVX2__
+                                    if (weights16 && insideEnd > insideBegin)
+                                    {
+                                        x += ConvolveBytesAVX2(row + (insideBegin - radius) * CHANNELS, CHANNELS, weights16, taps,
+                                                               out + insideBegin * CHANNELS, (insideEnd - insideBegin) * CHANNELS) / CHANNELS;
+                                    }
+#endif // __AVX2__
+                                    for (; x < insideEnd; ++x)
+                                    {
+                                        const uint8_t* s = row + (x - radius) * CHANNELS;
+                                        int32_t sum[CHANNELS] = {};
+                                        for (size_t t = 0; t < taps; ++t)
+                                        {
+                                            for (size_t c = 0; c < CHANNELS; ++c)
+                                            {
+                                                sum[c] += weights[t] * s[t * CHANNELS + c];
+                                            }
+                                        }
+                                        for (size_t c = 0; c < CHANNELS; ++c)
+                                        {
+                                            out[x * CHANNELS + c] = ResampleRound(sum[c]);
+                                        }
+                                    }
+                                    // the edges clamp their taps.
+                                    auto filterEdge = [&](size_t edgeX)
+                                    {
+                                        int32_t sum[CHANNELS] = {};
+                                        for (size_t t = 0; t < taps; ++t)
+                                        {
+                                            const int64_t sx = Clamp<int64_t>(int64_t(edgeX) + int64_t(t) - radius, 0, width - 1);
+                                            for (size_t c = 0; c < CHANNELS; ++c)
+                                            {
+                                                sum[c] += weights[t] * row[sx * CHANNELS + c];
+                                            }
+                                        }
+                                        for (size_t c = 0; c < CHANNELS; ++c)
+                                        {
+                                            out[edgeX * CHANNELS + c] = ResampleRound(sum[c]);
+                                        }
+                                    };
+                                    for (x = x0; x < insideBegin; ++x)
+                                    {
+                                        filterEdge(x);
+                                    }
+                                    for (x = insideEnd; x < x1; ++x)
+                                    {
+                                        filterEdge(x);
+                                    }
+                                }
+                                for (size_t x = x0; x < x1; ++x)
+                                {
+                                    uint8_t* out = dst + (x * height + y0) * CHANNELS;
+                                    for (size_t r = 0; r < rows; ++r)
+                                    {
+                                        for (size_t c = 0; c < CHANNELS; ++c)
+                                        {
+                                            out[r * CHANNELS + c] = span[r][(x - x0) * CHANNELS + c];
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    });
+    }
+
+    template<size_t CHANNELS>
+    static void BoxBlurRowsTransposed(const uint8_t* src, size_t width, size_t height, uint8_t* dst, size_t radius)
+    {
+        // sum * scale >> 24 divides by the window size without a division per pixel.
+        const uint64_t scale = (uint64_t)((double(1 << 24) / double(2 * radius + 1)) + 0.5);
+        const size_t blocks = (height + FILTER_BLOCK_ROWS - 1) / FILTER_BLOCK_ROWS;
+        ParallelFor(blocks, 4, [&](size_t begin, size_t end)
+                    {
+                        for (size_t block = begin; block < end; ++block)
+                        {
+                            const size_t y0 = block * FILTER_BLOCK_ROWS;
+                            const size_t rows = Min(FILTER_BLOCK_ROWS, height - y0);
+                            uint32_t sum[FILTER_BLOCK_ROWS][CHANNELS] = {};
+                            for (size_t r = 0; r < rows; ++r)
+                            {
+                                const uint8_t* row = src + (y0 + r) * width * CHANNELS;
+                                for (int64_t t = -int64_t(radius); t <= int64_t(radius); ++t)
+                                {
+                                    const int64_t sx = Clamp<int64_t>(t, 0, width - 1);
+                                    for (size_t c = 0; c < CHANNELS; ++c)
+                                    {
+                                        sum[r][c] += row[sx * CHANNELS + c];
+                                    }
+                                }
+                            }
+                            for (size_t x = 0; x < width; ++x)
+                            {
+                                uint8_t* out = dst + (x * height + y0) * CHANNELS;
+                                const size_t add = Min<size_t>(x + radius + 1, width - 1);
+                                const size_t remove = (size_t)Max<int64_t>(int64_t(x) - int64_t(radius), 0);
+                                for (size_t r = 0; r < rows; ++r)
+                                {
+                                    const uint8_t* row = src + (y0 + r) * width * CHANNELS;
+                                    for (size_t c = 0; c < CHANNELS; ++c)
+                                    {
+                                        out[r * CHANNELS + c] = (uint8_t)((sum[r][c] * scale + (1 << 23)) >> 24);
+                                        sum[r][c] += row[add * CHANNELS + c];
+                                        sum[r][c] -= row[remove * CHANNELS + c];
+                                    }
+                                }
+                            }
+                        }
+                    });
+    }
+
+    // returns weights16 or NULL if a weight doesn't fit in 16 bits.
+    static const int16_t* CreateConvolutionWeights(ArrayView<float> kernel, int32_t* weights, int16_t* weights16)
+    {
+        bool fits = true;
+        for (size_t i = 0; i < kernel.size; ++i)
         {
-            return NULL;
+            weights[i] = (int32_t)floor(kernel.data[i] * RESAMPLE_WEIGHT_ONE + 0.5f);
+            weights16[i] = (int16_t)weights[i];
+            fits &= weights[i] >= INT16_MIN && weights[i] <= INT16_MAX;
         }
+        return fits ? weights16 : NULL;
+    }
 
-        for (int64_t i = len - 1; i >= 0; --i)
+    template<size_t CHANNELS>
+    static void ConvolveSeparable(uint8_t* data, size_t width, size_t height,
+                                  ArrayView<float> kernelX, ArrayView<float> kernelY, Allocator& allocator)
+    {
+        GEDO_ASSERT(kernelX.size % 2 == 1 && kernelY.size % 2 == 1);
+        if (!width || !height)
         {
-            if (string[i] == '.')
-            {
-                return string + i;
-            }
+            return;
         }
-        return NULL;
+        const size_t taps = kernelX.size + kernelY.size;
+        MemoryBlock temp = allocator.AllocateMemoryBlock(taps * (sizeof(int32_t) + sizeof(int16_t)) + width * height * CHANNELS);
+        defer(allocator.FreeMemoryBlock(temp));
+        int32_t* weightsX = (int32_t*)temp.data;
+        int32_t* weightsY = weightsX + kernelX.size;
+        int16_t* weights16X = (int16_t*)(weightsY + kernelY.size);
+        int16_t* weights16Y = weights16X + kernelX.size;
+        uint8_t* pixels = (uint8_t*)(weights16Y + kernelY.size);
+        const int16_t* fittingX = CreateConvolutionWeights(kernelX, weightsX, weights16X);
+        const int16_t* fittingY = CreateConvolutionWeights(kernelY, weightsY, weights16Y);
+
+        ConvolveRowsTransposed<CHANNELS>(data, width, height, pixels, weightsX, fittingX, kernelX.size);
+        ConvolveRowsTransposed<CHANNELS>(pixels, height, width, data, weightsY, fittingY, kernelY.size);
     }
 
-    bool CompareStrings(const StringView str1, const StringView str2)
+    template<size_t CHANNELS>
+    static void BoxBlurPasses(uint8_t* data, size_t width, size_t height, const size_t* radii, size_t count, Allocator& allocator)
     {
-        if (str1.size != str2.size)
+        if (!width || !height)
         {
-            return false;
+            return;
         }
-        for (size_t i = 0; i < str1.size; ++i)
+        MemoryBlock temp = allocator.AllocateMemoryBlock(width * height * CHANNELS);
+        defer(allocator.FreeMemoryBlock(temp));
+        for (size_t i = 0; i < count; ++i)
         {
-            if (str1.data[i] != str2.data[i])
-            {
-                return false;
-            }
+            BoxBlurRowsTransposed<CHANNELS>(data, width, height, temp.data, radii[i]);
+            BoxBlurRowsTransposed<CHANNELS>(temp.data, height, width, data, radii[i]);
         }
-        return true;
     }
 
-    bool CompareStrings(const char* str1, const char* str2)
+    // computes the radii of 3 box filters that approximate a gaussian of the given sigma.
+    static void GaussianBoxRadii(double sigma, size_t radii[3])
     {
-        const size_t len1 = StringLength(str1);
-        const size_t len2 = StringLength(str2);
-        if (len1 != len2)
+        const double n = 3;
+        const double idealWidth = sqrt((12 * sigma * sigma / n) + 1);
+        int64_t lower = (int64_t)floor(idealWidth);
+        if (lower % 2 == 0)
         {
-            return false;
+            lower--;
         }
-        for (size_t i = 0; i < len1; ++i)
+        lower = Max<int64_t>(lower, 1);
+        const int64_t upper = lower + 2;
+        const double ideal = (12 * sigma * sigma - n * lower * lower - 4 * n * lower - 3 * n) / (-4 * lower - 4);
+        const int64_t m = (int64_t)floor(ideal + 0.5);
+        for (int64_t i = 0; i < 3; ++i)
         {
-            if (str1[i] != str2[i])
-            {
-                return false;
-            }
+            radii[i] = (size_t)(((i < m) ? lower : upper) - 1) / 2;
         }
-        return true;
     }
 
-    String ConcatStrings(const String* strings, size_t stringsCount, char seperator)
+    void ConvolveSeparable(ColorBitmap& bitmap, ArrayView<float> kernelX, ArrayView<float> kernelY, Allocator& allocator)
     {
-        const bool addSeperator = seperator != 0;
-        size_t resultSize = 0;
-        for (size_t i = 0; i < stringsCount; ++i)
+        MarkBitmapDirty(bitmap, 0, 0, bitmap.width, bitmap.height);
+        ConvolveSeparable<4>((uint8_t*)bitmap.data, bitmap.width, bitmap.height, kernelX, kernelY, allocator);
+    }
+
+    void ConvolveSeparable(Bitmap& bitmap, ArrayView<float> kernelX, ArrayView<float> kernelY, Allocator& allocator)
+    {
+        ConvolveSeparable<1>(bitmap.data, bitmap.width, bitmap.height, kernelX, kernelY, allocator);
+    }
+
+    void BoxBlur(ColorBitmap& bitmap, size_t radius, Allocator& allocator)
+    {
+        MarkBitmapDirty(bitmap, 0, 0, bitmap.width, bitmap.height);
+        BoxBlurPasses<4>((uint8_t*)bitmap.data, bitmap.width, bitmap.height, &radius, 1, allocator);
+    }
+
+    void BoxBlur(Bitmap& bitmap, size_t radius, Allocator& allocator)
+    {
+        BoxBlurPasses<1>(bitmap.data, bitmap.width, bitmap.height, &radius, 1, allocator);
+    }
+
+    void GaussianBlur(ColorBitmap& bitmap, double sigma, Allocator& allocator)
+    {
+        MarkBitmapDirty(bitmap, 0, 0, bitmap.width, bitmap.height);
+        size_t radii[3];
+        GaussianBoxRadii(sigma, radii);
+        BoxBlurPasses<4>((uint8_t*)bitmap.data, bitmap.width, bitmap.height, radii, 3, allocator);
+    }
+
+    void GaussianBlur(Bitmap& bitmap, double sigma, Allocator& allocator)
+    {
+        size_t radii[3];
+        GaussianBoxRadii(sigma, radii);
+        BoxBlurPasses<1>(bitmap.data, bitmap.width, bitmap.height, radii, 3, allocator);
+    }
+
+    struct SRGBTables
+    {
+        static const size_t LINEAR_STEPS = 4096;
+        float toLinear[256];
+        uint8_t toSRGB[LINEAR_STEPS + 3]; // the AVX2 gathers read 4 bytes at the last entry.
+    };
+
+    static SRGBTables CreateSRGBTables()
+    {
+        SRGBTables tables;
+        for (size_t i = 0; i < 256; ++i)
         {
-            resultSize += strings[i].size();
+            const double v = i / 255.0;
+            tables.toLinear[i] = (float)((v <= 0.04045) ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4));
         }
-        if (addSeperator)
+        for (size_t i = 0; i < SRGBTables::LINEAR_STEPS; ++i)
         {
-            resultSize += (stringsCount - 1);
+            const double v = i / double(SRGBTables::LINEAR_STEPS - 1);
+            const double s = (v <= 0.0031308) ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+            tables.toSRGB[i] = (uint8_t)Clamp(s * 255.0 + 0.5, 0.0, 255.0);
         }
+        return tables;
+    }
 
-        String result;
-        result.reserve(resultSize);
-        for (size_t i = 0; i < stringsCount; ++i)
+    static const SRGBTables& GetSRGBTables()
+    {
+        static const SRGBTables tables = CreateSRGBTables();
+        return tables;
+    }
+
+    float SRGBToLinear(uint8_t value)
+    {
+        return GetSRGBTables().toLinear[value];
+    }
+
+    uint8_t LinearToSRGB(float value)
+    {
+        const float steps = float(SRGBTables::LINEAR_STEPS - 1);
+        const float index = Clamp(value, 0.0f, 1.0f) * steps + 0.5f;
+        return GetSRGBTables().toSRGB[(size_t)index];
+    }
+
+    size_t GetPixelSize(PixelFormat format)
+    {
+        switch (format)
         {
-            result.append(strings[i].data());
-            if (addSeperator && i != stringsCount - 1)
-            {
-                result.append(seperator);
-            }
+        case PixelFormat::RGBA8: return 4;
+        case PixelFormat::BGRA8: return 4;
+        case PixelFormat::RGB8: return 3;
+        case PixelFormat::GREY8: return 1;
+        case PixelFormat::RGBA_FLOAT: return 4 * sizeof(float);
         }
-        return result;
+        return 0;
     }
 
-    StringView CreateStringView(const char* string)
+    // Color is 0xRRGGBBAA when loaded as a little endian uint32, the 4 byte formats are then
+    // a byte swap (RGBA8) or a rotation (BGRA8), pshufb does 8 pixels of either at once.
+    static inline uint32_t SwapPixelBytes(uint32_t v)
     {
-        StringView result;
-        result.data = string;
-        result.size = StringLength(string);
-        return result;
+        return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
     }
 
-    Array<StringView> SplitStringView(const char* string, char delim, Allocator& allocator)
+    static inline uint8_t PixelLuma(uint8_t r, uint8_t g, uint8_t b)
     {
-        Array<StringView> result;
-        result.allocator = &allocator;
-        const size_t len = StringLength(string);
-        size_t previousOffset = 0;
-        size_t i = 0;
+        return (uint8_t)((54 * r + 183 * g + 19 * b + 128) >> 8);
+    }
 
-        size_t partsCount = 0;
-        while (i < len)
+#if defined __AVX2__
+    // the pshufb patterns of the 4 byte layouts, the destination byte i of a pixel is the source byte pattern[i].
+    static const uint8_t PIXEL_SHUFFLE_SWAP[4] = { 3, 2, 1, 0 };           // Color <-> RGBA8.
+    static const uint8_t PIXEL_SHUFFLE_COLOR_TO_BGRA[4] = { 1, 2, 3, 0 };
+    static const uint8_t PIXEL_SHUFFLE_BGRA_TO_COLOR[4] = { 3, 0, 1, 2 };
+
+    static __m256i CreatePixelShuffle(const uint8_t pattern[4])
+    {
+        uint8_t bytes[32];
+        for (size_t i = 0; i < 32; ++i)
         {
-            if (string[i] == delim)
-            {
-                if (i - previousOffset)
-                {
-                    partsCount++;
-                }
-                while (string[i] == delim && i < len)
-                {
-                    i++;
-                }
-                previousOffset = i;
-            }
-            else
-            {
-                i++;
-            }
+            bytes[i] = (uint8_t)((i & ~(size_t)3) + pattern[i & 3]);
         }
-        if (i - previousOffset)
+        return _mm256_loadu_si256((const __m256i*)bytes);
+    }
+
+    // shuffles the bytes of 8 pixels of 4 bytes per step, returns the count of pixels done.
+    static size_t ShufflePixelsAVX2(const uint8_t* src, size_t count, const uint8_t pattern[4], uint8_t* dest)
+    {
+        const __m256i shuffle = CreatePixelShuffle(pattern);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
         {
-            partsCount++;
+            const __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+            _mm256_storeu_si256((__m256i*)(dest + i * 4), _mm256_shuffle_epi8(pixels, shuffle));
         }
-        result.reserve(partsCount);
+        return i;
+    }
 
-        previousOffset = 0;
-        i = 0;
+    static size_t ColorToRGBAVX2(const Color* src, size_t count, uint8_t* dest)
+    {
+        // 4 pixels make 12 bytes, r g b are the bytes 3 2 1 of a Color.
+        const __m128i shuffle = _mm_setr_epi8(3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuffle);
+            const __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i + 4)), shuffle);
+            _mm_storeu_si128((__m128i*)(dest + i * 3), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+            _mm_storel_epi64((__m128i*)(dest + i * 3 + 16), _mm_srli_si128(b, 4));
+        }
+        return i;
+    }
+
+    static size_t RGBToColorAVX2(const uint8_t* src, size_t count, Color* dest)
+    {
+        const __m128i shuffle = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+        const __m128i alpha = _mm_set1_epi32(0xff);
+        size_t i = 0;
+        // every load reads 16 bytes for 12, the last 4 must still be inside src.
+        for (; i + 6 <= count; i += 4)
+        {
+            const __m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 3)), shuffle);
+            _mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(pixels, alpha));
+        }
+        return i;
+    }
+
+    static size_t ColorToGreyAVX2(const Color* src, size_t count, uint8_t* dest)
+    {
+        const __m256i mask = _mm256_set1_epi32(0xff);
+        const __m256i gather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + i));
+            const __m256i r = _mm256_srli_epi32(pixels, 24);
+            const __m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask);
+            const __m256i b = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask);
+            __m256i luma = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(54)), _mm256_mullo_epi32(g, _mm256_set1_epi32(183)));
+            luma = _mm256_add_epi32(luma, _mm256_add_epi32(_mm256_mullo_epi32(b, _mm256_set1_epi32(19)), _mm256_set1_epi32(128)));
+            const __m256i bytes = _mm256_shuffle_epi8(_mm256_srli_epi32(luma, 8), gather);
+            const uint32_t low = (uint32_t)_mm256_extract_epi32(bytes, 0);
+            const uint32_t high = (uint32_t)_mm256_extract_epi32(bytes, 4);
+            GEDO_MEMCPY(dest + i, &low, 4);
+            GEDO_MEMCPY(dest + i + 4, &high, 4);
+        }
+        return i;
+    }
+
+    static size_t GreyToColorAVX2(const uint8_t* src, size_t count, Color* dest)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i grey = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+            const __m256i pixels = _mm256_or_si256(_mm256_mullo_epi32(grey, _mm256_set1_epi32(0x01010100)), _mm256_set1_epi32(0xff));
+            _mm256_storeu_si256((__m256i*)(dest + i), pixels);
+        }
+        return i;
+    }
+
+    // 2 pixels per gather of the sRGB table, the alpha lanes are only scaled.
+    static size_t ColorToLinearAVX2(const Color* src, size_t count, float* dest)
+    {
+        const float* toLinear = GetSRGBTables().toLinear;
+        const __m128i toRGBA = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m256 alphaScale = _mm256_set1_ps(1.0f / 255.0f);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128i rgba = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), toRGBA);
+            for (size_t k = 0; k < 2; ++k)
+            {
+                const __m256i indices = _mm256_cvtepu8_epi32(k ? _mm_srli_si128(rgba, 8) : rgba);
+                const __m256 linear = _mm256_i32gather_ps(toLinear, indices, 4);
+                const __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(indices), alphaScale);
+                _mm256_storeu_ps(dest + (i + k * 2) * 4, _mm256_blend_ps(linear, alpha, 0x88));
+            }
+        }
+        return i;
+    }
+
+    static size_t LinearToColorAVX2(const float* src, size_t count, Color* dest)
+    {
+        const uint8_t* toSRGB = GetSRGBTables().toSRGB;
+        const __m256 scales = _mm256_setr_ps(SRGBTables::LINEAR_STEPS - 1, SRGBTables::LINEAR_STEPS - 1, SRGBTables::LINEAR_STEPS - 1, 255.0f,
+                                             SRGBTables::LINEAR_STEPS - 1, SRGBTables::LINEAR_STEPS - 1, SRGBTables::LINEAR_STEPS - 1, 255.0f);
+        const __m256i alphaLanes = _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+        const __m128i toColor = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            __m256 v = _mm256_loadu_ps(src + i * 4);
+            v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+            const __m256i scaled = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scales), _mm256_set1_ps(0.5f)));
+            const __m256i srgb = _mm256_and_si256(_mm256_i32gather_epi32((const int*)toSRGB, scaled, 1), _mm256_set1_epi32(0xff));
+            const __m256i values = _mm256_blendv_epi8(srgb, scaled, alphaLanes);
+            // 8 ints to the bytes r g b a r g b a, then to 2 Colors.
+            const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+            const __m128i bytes = _mm_shuffle_epi8(_mm_packus_epi16(words, words), toColor);
+            _mm_storel_epi64((__m128i*)(dest + i), bytes);
+        }
+        return i;
+    }
+#endif // __AVX2__
+
+    static void ConvertPixelsFromColor(const Color* src, size_t count, PixelFormat format, uint8_t* dest)
+    {
+        // the AVX2 kernels do the bulk and the scalar loops the remaining pixels.
+        size_t i = 0;
+        switch (format)
+        {
+        case PixelFormat::RGBA8:
+#if defined __AVX2__
+            i = ShufflePixelsAVX2((const uint8_t*)src, count, PIXEL_SHUFFLE_SWAP, dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                uint32_t v;
+                GEDO_MEMCPY(&v, src + i, 4);
+                v = SwapPixelBytes(v);
+                GEDO_MEMCPY(dest + i * 4, &v, 4);
+            }
+            break;
+        case PixelFormat::BGRA8:
+#if defined __AVX2__
+            i = ShufflePixelsAVX2((const uint8_t*)src, count, PIXEL_SHUFFLE_COLOR_TO_BGRA, dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                uint32_t v;
+                GEDO_MEMCPY(&v, src + i, 4);
+                v = (v >> 8) | (v << 24);
+                GEDO_MEMCPY(dest + i * 4, &v, 4);
+            }
+            break;
+        case PixelFormat::RGB8:
+#if defined __AVX2__
+            i = ColorToRGBAVX2(src, count, dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                dest[i * 3 + 0] = src[i].r;
+                dest[i * 3 + 1] = src[i].g;
+                dest[i * 3 + 2] = src[i].b;
+            }
+            break;
+        case PixelFormat::GREY8:
+#if defined __AVX2__
+            i = ColorToGreyAVX2(src, count, dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                dest[i] = PixelLuma(src[i].r, src[i].g, src[i].b);
+            }
+            break;
+        case PixelFormat::RGBA_FLOAT:
+        {
+            const float* toLinear = GetSRGBTables().toLinear;
+            float* out = (float*)dest;
+#if defined __AVX2__
+            i = ColorToLinearAVX2(src, count, out);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                out[i * 4 + 0] = toLinear[src[i].r];
+                out[i * 4 + 1] = toLinear[src[i].g];
+                out[i * 4 + 2] = toLinear[src[i].b];
+                out[i * 4 + 3] = src[i].a * (1.0f / 255.0f);
+            }
+            break;
+        }
+        }
+    }
+
+    static void ConvertPixelsToColor(const uint8_t* src, size_t count, PixelFormat format, Color* dest)
+    {
+        size_t i = 0;
+        switch (format)
+        {
+        case PixelFormat::RGBA8:
+#if defined __AVX2__
+            i = ShufflePixelsAVX2(src, count, PIXEL_SHUFFLE_SWAP, (uint8_t*)dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                uint32_t v;
+                GEDO_MEMCPY(&v, src + i * 4, 4);
+                v = SwapPixelBytes(v);
+                GEDO_MEMCPY((void*)(dest + i), &v, 4);
+            }
+            break;
+        case PixelFormat::BGRA8:
+#if defined __AVX2__
+            i = ShufflePixelsAVX2(src, count, PIXEL_SHUFFLE_BGRA_TO_COLOR, (uint8_t*)dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                uint32_t v;
+                GEDO_MEMCPY(&v, src + i * 4, 4);
+                v = (v << 8) | (v >> 24);
+                GEDO_MEMCPY((void*)(dest + i), &v, 4);
+            }
+            break;
+        case PixelFormat::RGB8:
+#if defined __AVX2__
+            i = RGBToColorAVX2(src, count, dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                dest[i] = CreateColor(src[i * 3 + 0], src[i * 3 + 1], src[i * 3 + 2], 255);
+            }
+            break;
+        case PixelFormat::GREY8:
+#if defined __AVX2__
+            i = GreyToColorAVX2(src, count, dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                dest[i] = CreateColor(src[i], src[i], src[i], 255);
+            }
+            break;
+        case PixelFormat::RGBA_FLOAT:
+        {
+            const float* in = (const float*)src;
+#if defined __AVX2__
+            i = LinearToColorAVX2(in, count, dest);
+#endif // __AVX2__
+            for (; i < count; ++i)
+            {
+                dest[i] = CreateColor(LinearToSRGB(in[i * 4 + 0]),
+                                      LinearToSRGB(in[i * 4 + 1]),
+                                      LinearToSRGB(in[i * 4 + 2]),
+                                      (uint8_t)(Clamp(in[i * 4 + 3], 0.0f, 1.0f) * 255.0f + 0.5f));
+            }
+            break;
+        }
+        }
+    }
+
+    static const size_t PIXEL_CONVERSION_BATCH = 64 * 1024;
+
+    void ConvertPixels(const Color* src, size_t count, PixelFormat format, void* dest)
+    {
+        // make sure the tables are created before the threads start.
+        GetSRGBTables();
+        const size_t pixelSize = GetPixelSize(format);
+        ParallelFor(count, PIXEL_CONVERSION_BATCH, [&](size_t begin, size_t end)
+                    {
+                        ConvertPixelsFromColor(src + begin, end - begin, format, (uint8_t*)dest + begin * pixelSize);
+                    });
+    }
+
+    void ConvertPixels(const void* src, size_t count, PixelFormat format, Color* dest)
+    {
+        GetSRGBTables();
+        const size_t pixelSize = GetPixelSize(format);
+        ParallelFor(count, PIXEL_CONVERSION_BATCH, [&](size_t begin, size_t end)
+                    {
+                        ConvertPixelsToColor((const uint8_t*)src + begin * pixelSize, end - begin, format, dest + begin);
+                    });
+    }
+
+    static inline uint32_t ReadBigEndian32(const uint8_t* p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    static inline void WriteBigEndian32(uint8_t* p, uint32_t v)
+    {
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+
+    static inline uint32_t ReadLittleEndian32(const uint8_t* p)
+    {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    static inline uint16_t ReadLittleEndian16(const uint8_t* p)
+    {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    static inline void WriteLittleEndian32(uint8_t* p, uint32_t v)
+    {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+        p[2] = (uint8_t)(v >> 16);
+        p[3] = (uint8_t)(v >> 24);
+    }
+
+    static inline void WriteLittleEndian16(uint8_t* p, uint16_t v)
+    {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+    }
+
+    // QOI, see https://qoiformat.org/qoi-specification.pdf
+    static const uint8_t QOI_OP_INDEX = 0x00;
+    static const uint8_t QOI_OP_DIFF = 0x40;
+    static const uint8_t QOI_OP_LUMA = 0x80;
+    static const uint8_t QOI_OP_RUN = 0xc0;
+    static const uint8_t QOI_OP_RGB = 0xfe;
+    static const uint8_t QOI_OP_RGBA = 0xff;
+    static const uint8_t QOI_MASK = 0xc0;
+    static const size_t QOI_HEADER_SIZE = 14;
+    // the limit of the reference decoder.
+    static const size_t QOI_PIXELS_MAX = 400000000;
+    static const uint8_t QOI_PADDING[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+    static inline uint32_t QOIHash(Color c)
+    {
+        return (c.r * 3 + c.g * 5 + c.b * 7 + c.a * 11) % 64;
+    }
+
+    static inline bool SameColor(Color a, Color b)
+    {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+
+    ColorBitmap DecodeQOI(MemoryBlock data, Allocator& allocator)
+    {
+        ColorBitmap result;
+        const uint8_t* bytes = data.data;
+        if (data.size < QOI_HEADER_SIZE + sizeof(QOI_PADDING) ||
+            bytes[0] != 'q' || bytes[1] != 'o' || bytes[2] != 'i' || bytes[3] != 'f')
+        {
+            return result;
+        }
+        const size_t width = ReadBigEndian32(bytes + 4);
+        const size_t height = ReadBigEndian32(bytes + 8);
+        const uint8_t channels = bytes[12];
+        // a run op covers at most 62 pixels, so the data can't encode more than 62 pixels per byte.
+        const size_t opsSize = data.size - QOI_HEADER_SIZE - sizeof(QOI_PADDING);
+        if (!width || !height || (channels != 3 && channels != 4) || width > QOI_PIXELS_MAX / height ||
+            width * height > QOI_PIXELS_MAX || width * height > opsSize * 62)
+        {
+            return result;
+        }
+
+        result = CreateColorBitmap(width, height, allocator);
+        Color index[64] = {};
+        Color px = CreateColor(0, 0, 0, 255);
+        const size_t pixelsCount = width * height;
+        const size_t end = data.size - sizeof(QOI_PADDING);
+        size_t p = QOI_HEADER_SIZE;
+        size_t i = 0;
+        while (i < pixelsCount && p < end)
+        {
+            const uint8_t b1 = bytes[p++];
+            if (b1 == QOI_OP_RGB)
+            {
+                px.r = bytes[p];
+                px.g = bytes[p + 1];
+                px.b = bytes[p + 2];
+                p += 3;
+            }
+            else if (b1 == QOI_OP_RGBA)
+            {
+                px.r = bytes[p];
+                px.g = bytes[p + 1];
+                px.b = bytes[p + 2];
+                px.a = bytes[p + 3];
+                p += 4;
+            }
+            else if ((b1 & QOI_MASK) == QOI_OP_INDEX)
+            {
+                px = index[b1];
+            }
+            else if ((b1 & QOI_MASK) == QOI_OP_DIFF)
+            {
+                px.r += ((b1 >> 4) & 0x03) - 2;
+                px.g += ((b1 >> 2) & 0x03) - 2;
+                px.b += (b1 & 0x03) - 2;
+            }
+            else if ((b1 & QOI_MASK) == QOI_OP_LUMA)
+            {
+                const uint8_t b2 = bytes[p++];
+                const int32_t vg = (b1 & 0x3f) - 32;
+                px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                px.g += vg;
+                px.b += vg - 8 + (b2 & 0x0f);
+            }
+            else
+            {
+                // run, the pixel is already in the index.
+                const size_t run = Min<size_t>((b1 & 0x3f) + 1, pixelsCount - i);
+                for (size_t r = 0; r < run; ++r)
+                {
+                    result.data[i++] = px;
+                }
+                continue;
+            }
+            index[QOIHash(px)] = px;
+            result.data[i++] = px;
+        }
+        if (i != pixelsCount)
+        {
+            DestoryColorBitmap(result, allocator);
+            result = ColorBitmap{};
+        }
+        return result;
+    }
+
+    bool EncodeQOI(const ColorBitmap& bitmap, BufferedFileWriter& writer)
+    {
+        uint8_t header[QOI_HEADER_SIZE] = { 'q', 'o', 'i', 'f' };
+        WriteBigEndian32(header + 4, (uint32_t)bitmap.width);
+        WriteBigEndian32(header + 8, (uint32_t)bitmap.height);
+        header[12] = 4; // channels.
+        header[13] = 0; // sRGB with linear alpha.
+        WriteToFile(writer, header, sizeof(header));
+
+        // ops are collected in a small chunk, a pixel takes at most 5 bytes.
+        uint8_t chunk[4096];
+        size_t used = 0;
+        Color index[64] = {};
+        Color previous = CreateColor(0, 0, 0, 255);
+        size_t run = 0;
+        const size_t pixelsCount = bitmap.width * bitmap.height;
+        for (size_t i = 0; i < pixelsCount; ++i)
+        {
+            if (used > sizeof(chunk) - 8)
+            {
+                WriteToFile(writer, chunk, used);
+                used = 0;
+            }
+            const Color px = bitmap.data[i];
+            if (SameColor(px, previous))
+            {
+                run++;
+                if (run == 62 || i == pixelsCount - 1)
+                {
+                    chunk[used++] = QOI_OP_RUN | (uint8_t)(run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run)
+            {
+                chunk[used++] = QOI_OP_RUN | (uint8_t)(run - 1);
+                run = 0;
+            }
+
+            const uint32_t hash = QOIHash(px);
+            if (SameColor(index[hash], px))
+            {
+                chunk[used++] = QOI_OP_INDEX | (uint8_t)hash;
+            }
+            else
+            {
+                index[hash] = px;
+                if (px.a == previous.a)
+                {
+                    const int8_t vr = (int8_t)(px.r - previous.r);
+                    const int8_t vg = (int8_t)(px.g - previous.g);
+                    const int8_t vb = (int8_t)(px.b - previous.b);
+                    const int8_t vgr = (int8_t)(vr - vg);
+                    const int8_t vgb = (int8_t)(vb - vg);
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                    {
+                        chunk[used++] = QOI_OP_DIFF | (uint8_t)((vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                    }
+                    else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8)
+                    {
+                        chunk[used++] = QOI_OP_LUMA | (uint8_t)(vg + 32);
+                        chunk[used++] = (uint8_t)((vgr + 8) << 4 | (vgb + 8));
+                    }
+                    else
+                    {
+                        chunk[used++] = QOI_OP_RGB;
+                        chunk[used++] = px.r;
+                        chunk[used++] = px.g;
+                        chunk[used++] = px.b;
+                    }
+                }
+                else
+                {
+                    chunk[used++] = QOI_OP_RGBA;
+                    chunk[used++] = px.r;
+                    chunk[used++] = px.g;
+                    chunk[used++] = px.b;
+                    chunk[used++] = px.a;
+                }
+            }
+            previous = px;
+        }
+        WriteToFile(writer, chunk, used);
+        return WriteToFile(writer, QOI_PADDING, sizeof(QOI_PADDING));
+    }
+
+    static const size_t BMP_FILE_HEADER_SIZE = 14;
+    static const size_t BMP_INFO_HEADER_SIZE = 40;
+
+    ColorBitmap DecodeBMP(MemoryBlock data, Allocator& allocator)
+    {
+        ColorBitmap result;
+        const uint8_t* bytes = data.data;
+        if (data.size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || bytes[0] != 'B' || bytes[1] != 'M')
+        {
+            return result;
+        }
+        const size_t pixelsOffset = ReadLittleEndian32(bytes + 10);
+        const uint8_t* info = bytes + BMP_FILE_HEADER_SIZE;
+        const int32_t width = (int32_t)ReadLittleEndian32(info + 4);
+        const int32_t signedHeight = (int32_t)ReadLittleEndian32(info + 8);
+        const uint16_t bitsPerPixel = ReadLittleEndian16(info + 14);
+        const uint32_t compression = ReadLittleEndian32(info + 16);
+        // BI_RGB, or BI_BITFIELDS which is only accepted as plain BGRA.
+        if (width <= 0 || signedHeight == 0 || (bitsPerPixel != 24 && bitsPerPixel != 32) ||
+            (compression != 0 && !(compression == 3 && bitsPerPixel == 32)))
+        {
+            return result;
+        }
+        if (compression == 3)
+        {
+            // the red, green and blue masks follow the 40 bytes header (they are part of the v4 and v5
+            // headers which also add the alpha mask). zero, overlapping or shuffled masks are rejected.
+            const uint32_t infoSize = ReadLittleEndian32(info);
+            if (data.size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + 16 ||
+                ReadLittleEndian32(info + 40) != 0x00ff0000 || ReadLittleEndian32(info + 44) != 0x0000ff00 ||
+                ReadLittleEndian32(info + 48) != 0x000000ff)
+            {
+                return result;
+            }
+            const uint32_t alphaMask = (infoSize >= 56) ? ReadLittleEndian32(info + 52) : 0;
+            if (alphaMask != 0 && alphaMask != 0xff000000)
+            {
+                return result;
+            }
+        }
+        const bool topDown = signedHeight < 0;
+        const size_t height = topDown ? size_t(-int64_t(signedHeight)) : size_t(signedHeight);
+        const size_t bytesPerPixel = bitsPerPixel / 8;
+        const size_t stride = (width * bytesPerPixel + 3) & ~size_t(3);
+        // all the rows must be in the data, which caps the pixels by the input size before allocating.
+        if (pixelsOffset > data.size || (data.size - pixelsOffset) / stride < height)
+        {
+            return result;
+        }
+
+        result = CreateColorBitmap(width, height, allocator);
+        const PixelFormat format = (bytesPerPixel == 4) ? PixelFormat::BGRA8 : PixelFormat::RGB8;
+        bool hasAlpha = false;
+        for (size_t y = 0; y < height; ++y)
+        {
+            const uint8_t* row = bytes + pixelsOffset + (topDown ? y : height - 1 - y) * stride;
+            Color* dest = result.data + y * result.width;
+            ConvertPixelsToColor(row, width, format, dest);
+            for (int32_t x = 0; x < width; ++x)
+            {
+                if (bytesPerPixel == 3)
+                {
+                    // RGB8 reads r, g, b but the file stores b, g, r.
+                    Swap(dest[x].r, dest[x].b);
+                }
+                hasAlpha |= dest[x].a != 0;
+            }
+        }
+        // most 32 bits BMP files leave the alpha channel at zero.
+        if (!hasAlpha)
+        {
+            for (size_t i = 0; i < result.width * result.height; ++i)
+            {
+                result.data[i].a = 255;
+            }
+        }
+        return result;
+    }
+
+    bool EncodeBMP(const ColorBitmap& bitmap, BufferedFileWriter& writer)
+    {
+        const size_t pixelsSize = bitmap.width * bitmap.height * 4;
+        uint8_t header[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE] = { 'B', 'M' };
+        WriteLittleEndian32(header + 2, (uint32_t)(sizeof(header) + pixelsSize));
+        WriteLittleEndian32(header + 10, (uint32_t)sizeof(header));
+        uint8_t* info = header + BMP_FILE_HEADER_SIZE;
+        WriteLittleEndian32(info, (uint32_t)BMP_INFO_HEADER_SIZE);
+        WriteLittleEndian32(info + 4, (uint32_t)bitmap.width);
+        WriteLittleEndian32(info + 8, (uint32_t)(-int32_t(bitmap.height))); // top-down.
+        WriteLittleEndian16(info + 12, 1);                                   // planes.
+        WriteLittleEndian16(info + 14, 32);                                  // bits per pixel.
+        WriteLittleEndian32(info + 20, (uint32_t)pixelsSize);
+        WriteLittleEndian32(info + 24, 2835);                                // 72 dpi.
+        WriteLittleEndian32(info + 28, 2835);
+        WriteToFile(writer, header, sizeof(header));
+
+        // convert in chunks so no copy of the whole image is needed.
+        uint8_t chunk[4096 * 4];
+        const size_t pixelsCount = bitmap.width * bitmap.height;
+        for (size_t i = 0; i < pixelsCount; i += 4096)
+        {
+            const size_t count = Min<size_t>(4096, pixelsCount - i);
+            ConvertPixelsFromColor(bitmap.data + i, count, PixelFormat::BGRA8, chunk);
+            WriteToFile(writer, chunk, count * 4);
+        }
+        return !writer.failed;
+    }
+
+    // parses the header of binary netpbm files, returns the offset of the pixels or 0 on failure.
+    static size_t ParseNetpbmHeader(MemoryBlock data, char magic, size_t& width, size_t& height)
+    {
+        const uint8_t* bytes = data.data;
+        if (data.size < 3 || bytes[0] != 'P' || bytes[1] != magic)
+        {
+            return 0;
+        }
+        size_t p = 2;
+        size_t values[3] = {};
+        for (size_t v = 0; v < 3; ++v)
+        {
+            // skip white space and comments.
+            while (p < data.size && (bytes[p] == ' ' || bytes[p] == '\t' || bytes[p] == '\r' || bytes[p] == '\n' || bytes[p] == '#'))
+            {
+                if (bytes[p] == '#')
+                {
+                    while (p < data.size && bytes[p] != '\n')
+                    {
+                        p++;
+                    }
+                }
+                else
+                {
+                    p++;
+                }
+            }
+            if (p >= data.size || bytes[p] < '0' || bytes[p] > '9')
+            {
+                return 0;
+            }
+            while (p < data.size && bytes[p] >= '0' && bytes[p] <= '9')
+            {
+                values[v] = values[v] * 10 + (bytes[p++] - '0');
+            }
+        }
+        // exactly one white space character before the pixels.
+        if (p >= data.size || values[2] != 255 || !values[0] || !values[1])
+        {
+            return 0;
+        }
+        width = values[0];
+        height = values[1];
+        return p + 1;
+    }
+
+    ColorBitmap DecodePPM(MemoryBlock data, Allocator& allocator)
+    {
+        ColorBitmap result;
+        size_t width = 0;
+        size_t height = 0;
+        const size_t offset = ParseNetpbmHeader(data, '6', width, height);
+        if (!offset || (data.size - offset) / 3 / width < height)
+        {
+            return result;
+        }
+        result = CreateColorBitmap(width, height, allocator);
+        ConvertPixels(data.data + offset, width * height, PixelFormat::RGB8, result.data);
+        return result;
+    }
+
+    bool EncodePPM(const ColorBitmap& bitmap, BufferedFileWriter& writer)
+    {
+        char header[64];
+        const int length = snprintf(header, sizeof(header), "P6\n%zu %zu\n255\n", bitmap.width, bitmap.height);
+        WriteToFile(writer, header, length);
+        uint8_t chunk[4096 * 3];
+        const size_t pixelsCount = bitmap.width * bitmap.height;
+        for (size_t i = 0; i < pixelsCount; i += 4096)
+        {
+            const size_t count = Min<size_t>(4096, pixelsCount - i);
+            ConvertPixelsFromColor(bitmap.data + i, count, PixelFormat::RGB8, chunk);
+            WriteToFile(writer, chunk, count * 3);
+        }
+        return !writer.failed;
+    }
+
+    Bitmap DecodePGM(MemoryBlock data, Allocator& allocator)
+    {
+        Bitmap result;
+        size_t width = 0;
+        size_t height = 0;
+        const size_t offset = ParseNetpbmHeader(data, '5', width, height);
+        if (!offset || (data.size - offset) / width < height)
+        {
+            return result;
+        }
+        result = CreateBitmap(width, height, allocator);
+        GEDO_MEMCPY(result.data, data.data + offset, width * height);
+        return result;
+    }
+
+    bool EncodePGM(const Bitmap& bitmap, BufferedFileWriter& writer)
+    {
+        char header[64];
+        const int length = snprintf(header, sizeof(header), "P5\n%zu %zu\n255\n", bitmap.width, bitmap.height);
+        WriteToFile(writer, header, length);
+        return WriteToFile(writer, bitmap.data, bitmap.width * bitmap.height);
+    }
+
+    // deflate (RFC 1951) inside a zlib stream (RFC 1950) for the PNG encoder.
+    static const size_t DEFLATE_WINDOW_SIZE = 32768;
+    static const size_t DEFLATE_MIN_MATCH = 3;
+    static const size_t DEFLATE_MAX_MATCH = 258;
+    static const size_t DEFLATE_HASH_BITS = 15;
+    static const size_t DEFLATE_MAX_CHAIN = 24;
+    static const size_t DEFLATE_NICE_MATCH = 128;
+    // input bytes per block, also the largest stored block.
+    static const size_t DEFLATE_BLOCK_SIZE = 65535;
+    // input bytes compressed independently by one task.
+    static const size_t DEFLATE_CHUNK_SIZE = 256 * 1024;
+    static const size_t DEFLATE_LITLEN_CODES = 286;
+    static const size_t DEFLATE_DIST_CODES = 30;
+    static const size_t DEFLATE_CODELEN_CODES = 19;
+
+    static const uint16_t DEFLATE_LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t DEFLATE_LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t DEFLATE_DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t DEFLATE_DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    static const uint8_t DEFLATE_CODELEN_EXTRA[DEFLATE_CODELEN_CODES] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+    static const uint8_t DEFLATE_CODELEN_ORDER[DEFLATE_CODELEN_CODES] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    struct DeflateTables
+    {
+        uint8_t lengthCode[DEFLATE_MAX_MATCH + 1];
+        // distance d is at [d - 1] if d <= 256, otherwise at [256 + ((d - 1) >> 7)].
+        uint8_t distanceCode[512];
+        uint32_t crc[256];
+    };
+
+    static DeflateTables CreateDeflateTables()
+    {
+        DeflateTables tables;
+        for (size_t code = 0; code < 29; ++code)
+        {
+            for (size_t i = 0; i < (size_t(1) << DEFLATE_LENGTH_EXTRA[code]); ++i)
+            {
+                tables.lengthCode[DEFLATE_LENGTH_BASE[code] + i] = (uint8_t)code;
+            }
+        }
+        // 258 is also reachable as 227 + 31 but must use its own code.
+        tables.lengthCode[DEFLATE_MAX_MATCH] = 28;
+        for (size_t code = 0; code < DEFLATE_DIST_CODES; ++code)
+        {
+            for (size_t i = 0; i < (size_t(1) << DEFLATE_DIST_EXTRA[code]); ++i)
+            {
+                const size_t d = DEFLATE_DIST_BASE[code] + i - 1;
+                tables.distanceCode[(d < 256) ? d : 256 + (d >> 7)] = (uint8_t)code;
+            }
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (size_t k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            tables.crc[i] = c;
+        }
+        return tables;
+    }
+
+    static const DeflateTables& GetDeflateTables()
+    {
+        static const DeflateTables tables = CreateDeflateTables();
+        return tables;
+    }
+
+    static inline uint32_t GetDistanceCode(const DeflateTables& tables, size_t distance)
+    {
+        const size_t d = distance - 1;
+        return tables.distanceCode[(d < 256) ? d : 256 + (d >> 7)];
+    }
+
+    // crc can be the result of a previous call to continue the checksum.
+    static uint32_t UpdateCRC32(uint32_t crc, const uint8_t* data, size_t size)
+    {
+        const uint32_t* table = GetDeflateTables().crc;
+        uint32_t c = crc ^ 0xffffffffu;
+        for (size_t i = 0; i < size; ++i)
+        {
+            c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+        }
+        return c ^ 0xffffffffu;
+    }
+
+    static const uint32_t ADLER32_BASE = 65521;
+
+    static uint32_t ComputeAdler32(const uint8_t* data, size_t size)
+    {
+        uint32_t a = 1;
+        uint32_t b = 0;
+        while (size)
+        {
+            // largest n where the sums can't overflow before the modulo.
+            const size_t n = Min<size_t>(size, 5552);
+            for (size_t i = 0; i < n; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= ADLER32_BASE;
+            b %= ADLER32_BASE;
+            data += n;
+            size -= n;
+        }
+        return (b << 16) | a;
+    }
+
+    // adler32 of the concatenation of two buffers from their checksums, size is the size of the second buffer.
+    static uint32_t CombineAdler32(uint32_t adler1, uint32_t adler2, size_t size)
+    {
+        const uint32_t remainder = (uint32_t)(size % ADLER32_BASE);
+        uint32_t sum1 = adler1 & 0xffff;
+        uint32_t sum2 = (uint32_t)((uint64_t(remainder) * sum1) % ADLER32_BASE);
+        sum1 += (adler2 & 0xffff) + ADLER32_BASE - 1;
+        sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER32_BASE - remainder;
+        if (sum1 >= ADLER32_BASE) sum1 -= ADLER32_BASE;
+        if (sum1 >= ADLER32_BASE) sum1 -= ADLER32_BASE;
+        if (sum2 >= ADLER32_BASE * 2) sum2 -= ADLER32_BASE * 2;
+        if (sum2 >= ADLER32_BASE) sum2 -= ADLER32_BASE;
+        return (sum2 << 16) | sum1;
+    }
+
+    struct DeflateWriter
+    {
+        uint8_t* out = NULL;
+        size_t size = 0;
+        uint64_t bits = 0;
+        uint32_t bitsCount = 0;
+    };
+
+    static inline void PutBits(DeflateWriter& writer, uint32_t value, uint32_t count)
+    {
+        writer.bits |= uint64_t(value) << writer.bitsCount;
+        writer.bitsCount += count;
+        while (writer.bitsCount >= 8)
+        {
+            writer.out[writer.size++] = (uint8_t)writer.bits;
+            writer.bits >>= 8;
+            writer.bitsCount -= 8;
+        }
+    }
+
+    static inline void AlignToByte(DeflateWriter& writer)
+    {
+        if (writer.bitsCount)
+        {
+            PutBits(writer, 0, 8 - writer.bitsCount);
+        }
+    }
+
+    // length limited huffman code lengths, symbols with a zero frequency get a zero length.
+    // the code is always complete, a lone symbol gets a partner so decoders accept it.
+    static void BuildHuffmanLengths(const uint32_t* frequencies, size_t count, uint32_t maxBits, uint8_t* lengths)
+    {
+        struct Leaf
+        {
+            uint32_t frequency;
+            uint16_t symbol;
+        };
+        Leaf leaves[DEFLATE_LITLEN_CODES];
+        size_t leavesCount = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            lengths[i] = 0;
+            if (frequencies[i])
+            {
+                leaves[leavesCount++] = Leaf{ frequencies[i], (uint16_t)i };
+            }
+        }
+        if (leavesCount < 2)
+        {
+            const size_t symbol = leavesCount ? leaves[0].symbol : 0;
+            lengths[symbol] = 1;
+            lengths[symbol ? 0 : 1] = 1;
+            return;
+        }
+        // the two queues below need the leaves in increasing frequency, ties are broken by symbol so the
+        // lengths don't depend on the sort.
+        QuickSort(leaves, leavesCount, [](const Leaf& a, const Leaf& b)
+                  {
+                      return a.frequency < b.frequency || (a.frequency == b.frequency && a.symbol < b.symbol);
+                  });
+
+        // two queues huffman, leaves are [0, leavesCount) and internal nodes are created in increasing weight.
+        uint64_t weights[DEFLATE_LITLEN_CODES * 2];
+        uint16_t parents[DEFLATE_LITLEN_CODES * 2];
+        uint32_t depths[DEFLATE_LITLEN_CODES * 2];
+        for (size_t i = 0; i < leavesCount; ++i)
+        {
+            weights[i] = leaves[i].frequency;
+        }
+        const size_t root = leavesCount * 2 - 2;
+        size_t leaf = 0;
+        size_t node = leavesCount;
+        for (size_t next = leavesCount; next <= root; ++next)
+        {
+            size_t picked[2];
+            for (size_t k = 0; k < 2; ++k)
+            {
+                if (leaf < leavesCount && (node >= next || weights[leaf] <= weights[node]))
+                {
+                    picked[k] = leaf++;
+                }
+                else
+                {
+                    picked[k] = node++;
+                }
+            }
+            weights[next] = weights[picked[0]] + weights[picked[1]];
+            parents[picked[0]] = parents[picked[1]] = (uint16_t)next;
+        }
+        depths[root] = 0;
+        for (size_t i = root; i-- > 0;)
+        {
+            depths[i] = depths[parents[i]] + 1;
+        }
+
+        // clamp to maxBits then fix the kraft sum by pushing shorter codes down, see miniz.
+        uint32_t lengthsCount[32] = {};
+        for (size_t i = 0; i < leavesCount; ++i)
+        {
+            lengthsCount[Min(depths[i], maxBits)]++;
+        }
+        uint32_t total = 0;
+        for (uint32_t bits = 1; bits <= maxBits; ++bits)
+        {
+            total += lengthsCount[bits] << (maxBits - bits);
+        }
+        while (total != (1u << maxBits))
+        {
+            lengthsCount[maxBits]--;
+            for (uint32_t bits = maxBits - 1; bits > 0; --bits)
+            {
+                if (lengthsCount[bits])
+                {
+                    lengthsCount[bits]--;
+                    lengthsCount[bits + 1] += 2;
+                    break;
+                }
+            }
+            total--;
+        }
+        // the least frequent symbols get the longest codes.
+        size_t i = 0;
+        for (uint32_t bits = maxBits; bits > 0; --bits)
+        {
+            for (uint32_t k = 0; k < lengthsCount[bits]; ++k)
+            {
+                lengths[leaves[i++].symbol] = (uint8_t)bits;
+            }
+        }
+    }
+
+    // canonical codes, bit reversed since deflate writes huffman codes starting from the most significant bit.
+    static void BuildHuffmanCodes(const uint8_t* lengths, size_t count, uint16_t* codes)
+    {
+        uint32_t lengthsCount[16] = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            lengthsCount[lengths[i]]++;
+        }
+        lengthsCount[0] = 0;
+        uint32_t nextCode[16] = {};
+        uint32_t code = 0;
+        for (size_t bits = 1; bits < 16; ++bits)
+        {
+            code = (code + lengthsCount[bits - 1]) << 1;
+            nextCode[bits] = code;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint32_t length = lengths[i];
+            if (!length)
+            {
+                continue;
+            }
+            const uint32_t c = nextCode[length]++;
+            uint32_t reversed = 0;
+            for (uint32_t k = 0; k < length; ++k)
+            {
+                reversed |= ((c >> k) & 1) << (length - 1 - k);
+            }
+            codes[i] = (uint16_t)reversed;
+        }
+    }
+
+    struct DeflateToken
+    {
+        uint16_t length;   // the literal byte when distance is 0.
+        uint16_t distance;
+    };
+
+    static void WriteStoredBlocks(DeflateWriter& writer, const uint8_t* data, size_t size, bool final)
+    {
+        do
+        {
+            const size_t n = Min(size, DEFLATE_BLOCK_SIZE);
+            PutBits(writer, (final && n == size) ? 1 : 0, 1);
+            PutBits(writer, 0, 2);
+            AlignToByte(writer);
+            PutBits(writer, (uint32_t)n, 16);
+            PutBits(writer, (uint32_t)(~n & 0xffff), 16);
+            GEDO_MEMCPY(writer.out + writer.size, data, n);
+            writer.size += n;
+            data += n;
+            size -= n;
+        } while (size);
+    }
+
+    // writes the tokens of data with dynamic huffman codes, or data as stored if that is smaller.
+    static void WriteDeflateBlock(DeflateWriter& writer, const uint8_t* data, size_t size,
+                                  const DeflateToken* tokens, size_t tokensCount, bool final)
+    {
+        const DeflateTables& tables = GetDeflateTables();
+        uint32_t litFrequencies[DEFLATE_LITLEN_CODES] = {};
+        uint32_t distFrequencies[DEFLATE_DIST_CODES] = {};
+        for (size_t i = 0; i < tokensCount; ++i)
+        {
+            const DeflateToken t = tokens[i];
+            if (t.distance)
+            {
+                litFrequencies[257 + tables.lengthCode[t.length]]++;
+                distFrequencies[GetDistanceCode(tables, t.distance)]++;
+            }
+            else
+            {
+                litFrequencies[t.length]++;
+            }
+        }
+        litFrequencies[256] = 1;
+
+        uint8_t litLengths[DEFLATE_LITLEN_CODES];
+        uint8_t distLengths[DEFLATE_DIST_CODES];
+        BuildHuffmanLengths(litFrequencies, DEFLATE_LITLEN_CODES, 15, litLengths);
+        BuildHuffmanLengths(distFrequencies, DEFLATE_DIST_CODES, 15, distLengths);
+        size_t litCount = DEFLATE_LITLEN_CODES;
+        while (litCount > 257 && !litLengths[litCount - 1])
+        {
+            litCount--;
+        }
+        size_t distCount = DEFLATE_DIST_CODES;
+        while (distCount > 1 && !distLengths[distCount - 1])
+        {
+            distCount--;
+        }
+        // the distance lengths follow the used literal lengths directly.
+        uint8_t lengths[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES];
+        GEDO_MEMCPY(lengths, litLengths, litCount);
+        GEDO_MEMCPY(lengths + litCount, distLengths, distCount);
+
+        // run length encoding of the code lengths with the symbols 16 (repeat), 17 and 18 (zeros).
+        struct CodeLengthOp
+        {
+            uint8_t symbol;
+            uint8_t extra;
+        };
+        CodeLengthOp ops[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES];
+        size_t opsCount = 0;
+        uint32_t codeLengthFrequencies[DEFLATE_CODELEN_CODES] = {};
+        const size_t lengthsCount = litCount + distCount;
+        for (size_t i = 0; i < lengthsCount;)
+        {
+            const uint8_t length = lengths[i];
+            size_t run = 1;
+            while (i + run < lengthsCount && lengths[i + run] == length)
+            {
+                run++;
+            }
+            if (!length && run >= 3)
+            {
+                const size_t n = Min<size_t>(run, 138);
+                ops[opsCount++] = (n >= 11) ? CodeLengthOp{ 18, (uint8_t)(n - 11) } : CodeLengthOp{ 17, (uint8_t)(n - 3) };
+                i += n;
+                continue;
+            }
+            ops[opsCount++] = CodeLengthOp{ length, 0 };
+            i++;
+            run--;
+            while (run >= 3)
+            {
+                const size_t n = Min<size_t>(run, 6);
+                ops[opsCount++] = CodeLengthOp{ 16, (uint8_t)(n - 3) };
+                i += n;
+                run -= n;
+            }
+        }
+        for (size_t i = 0; i < opsCount; ++i)
+        {
+            codeLengthFrequencies[ops[i].symbol]++;
+        }
+        uint8_t codeLengthLengths[DEFLATE_CODELEN_CODES];
+        BuildHuffmanLengths(codeLengthFrequencies, DEFLATE_CODELEN_CODES, 7, codeLengthLengths);
+        size_t codeLengthCount = DEFLATE_CODELEN_CODES;
+        while (codeLengthCount > 4 && !codeLengthLengths[DEFLATE_CODELEN_ORDER[codeLengthCount - 1]])
+        {
+            codeLengthCount--;
+        }
+
+        // compare the exact sizes and fall back to stored blocks.
+        size_t dynamicBits = 3 + 5 + 5 + 4 + 3 * codeLengthCount + litLengths[256];
+        for (size_t i = 0; i < opsCount; ++i)
+        {
+            dynamicBits += codeLengthLengths[ops[i].symbol] + DEFLATE_CODELEN_EXTRA[ops[i].symbol];
+        }
+        for (size_t i = 0; i < DEFLATE_LITLEN_CODES; ++i)
+        {
+            dynamicBits += size_t(litFrequencies[i]) * (litLengths[i] + (i > 256 ? DEFLATE_LENGTH_EXTRA[i - 257] : 0));
+        }
+        for (size_t i = 0; i < DEFLATE_DIST_CODES; ++i)
+        {
+            dynamicBits += size_t(distFrequencies[i]) * (distLengths[i] + DEFLATE_DIST_EXTRA[i]);
+        }
+        const size_t storedBits = 3 + ((8 - ((writer.bitsCount + 3) & 7)) & 7) + 32 + size * 8;
+        if (dynamicBits >= storedBits)
+        {
+            WriteStoredBlocks(writer, data, size, final);
+            return;
+        }
+
+        uint16_t litCodes[DEFLATE_LITLEN_CODES];
+        uint16_t distCodes[DEFLATE_DIST_CODES];
+        uint16_t codeLengthCodes[DEFLATE_CODELEN_CODES];
+        BuildHuffmanCodes(litLengths, DEFLATE_LITLEN_CODES, litCodes);
+        BuildHuffmanCodes(distLengths, DEFLATE_DIST_CODES, distCodes);
+        BuildHuffmanCodes(codeLengthLengths, DEFLATE_CODELEN_CODES, codeLengthCodes);
+
+        PutBits(writer, final ? 1 : 0, 1);
+        PutBits(writer, 2, 2);
+        PutBits(writer, (uint32_t)(litCount - 257), 5);
+        PutBits(writer, (uint32_t)(distCount - 1), 5);
+        PutBits(writer, (uint32_t)(codeLengthCount - 4), 4);
+        for (size_t i = 0; i < codeLengthCount; ++i)
+        {
+            PutBits(writer, codeLengthLengths[DEFLATE_CODELEN_ORDER[i]], 3);
+        }
+        for (size_t i = 0; i < opsCount; ++i)
+        {
+            const CodeLengthOp op = ops[i];
+            PutBits(writer, codeLengthCodes[op.symbol], codeLengthLengths[op.symbol]);
+            PutBits(writer, op.extra, DEFLATE_CODELEN_EXTRA[op.symbol]);
+        }
+        for (size_t i = 0; i < tokensCount; ++i)
+        {
+            const DeflateToken t = tokens[i];
+            if (t.distance)
+            {
+                const uint32_t lengthCode = tables.lengthCode[t.length];
+                const uint32_t distanceCode = GetDistanceCode(tables, t.distance);
+                PutBits(writer, litCodes[257 + lengthCode], litLengths[257 + lengthCode]);
+                PutBits(writer, t.length - DEFLATE_LENGTH_BASE[lengthCode], DEFLATE_LENGTH_EXTRA[lengthCode]);
+                PutBits(writer, distCodes[distanceCode], distLengths[distanceCode]);
+                PutBits(writer, t.distance - DEFLATE_DIST_BASE[distanceCode], DEFLATE_DIST_EXTRA[distanceCode]);
+            }
+            else
+            {
+                PutBits(writer, litCodes[t.length], litLengths[t.length]);
+            }
+        }
+        PutBits(writer, litCodes[256], litLengths[256]);
+    }
+
+    static inline uint32_t DeflateHash(const uint8_t* p)
+    {
+        const uint32_t v = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+        return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+    }
+
+    static inline size_t MatchLength(const uint8_t* a, const uint8_t* b, size_t maxLength)
+    {
+        size_t length = 0;
+        while (length + 8 <= maxLength)
+        {
+            uint64_t x;
+            uint64_t y;
+            GEDO_MEMCPY(&x, a + length, 8);
+            GEDO_MEMCPY(&y, b + length, 8);
+            if (x != y)
+            {
+                break;
+            }
+            length += 8;
+        }
+        while (length < maxLength && a[length] == b[length])
+        {
+            length++;
+        }
+        return length;
+    }
+
+    struct DeflateContext
+    {
+        // positions are relative to the start of the window and offset by one, 0 is an empty slot.
+        uint32_t* head = NULL;
+        uint32_t* previous = NULL;
+        DeflateToken* tokens = NULL;
+    };
+
+    // compresses data[begin, end) to a byte aligned piece of a deflate stream, matches can reference
+    // the 32KB before begin as the decoder has them already. non final pieces end with a sync flush
+    // (an empty stored block) so independently compressed pieces can be concatenated.
+    static void DeflateChunk(const uint8_t* data, size_t size, size_t begin, size_t end, bool final,
+                             PNGCompression compression, DeflateContext& context, DeflateWriter& writer)
+    {
+        if (compression == PNGCompression::STORE)
+        {
+            WriteStoredBlocks(writer, data + begin, end - begin, final);
+        }
+        else
+        {
+            const size_t base = begin - Min(begin, DEFLATE_WINDOW_SIZE);
+            const size_t windowMask = DEFLATE_WINDOW_SIZE - 1;
+            const bool lz77 = compression == PNGCompression::DEFAULT;
+            if (lz77)
+            {
+                GEDO_MEMSET(context.head, 0, sizeof(uint32_t) << DEFLATE_HASH_BITS);
+            }
+            auto insert = [&](size_t position)
+            {
+                const uint32_t h = DeflateHash(data + position);
+                const uint32_t candidate = context.head[h];
+                context.previous[(position - base) & windowMask] = candidate;
+                context.head[h] = (uint32_t)(position - base + 1);
+                return candidate;
+            };
+            if (lz77)
+            {
+                for (size_t position = base; position < begin && position + DEFLATE_MIN_MATCH <= size; ++position)
+                {
+                    insert(position);
+                }
+            }
+
+            for (size_t blockBegin = begin; blockBegin < end; blockBegin += DEFLATE_BLOCK_SIZE)
+            {
+                const size_t blockEnd = Min(blockBegin + DEFLATE_BLOCK_SIZE, end);
+                size_t tokensCount = 0;
+                size_t position = blockBegin;
+                while (position < blockEnd)
+                {
+                    const size_t maxLength = Min(DEFLATE_MAX_MATCH, blockEnd - position);
+                    size_t bestLength = 0;
+                    size_t bestDistance = 0;
+                    if (maxLength >= DEFLATE_MIN_MATCH && position + DEFLATE_MIN_MATCH <= size)
+                    {
+                        if (lz77)
+                        {
+                            const size_t relative = position - base;
+                            uint32_t candidate = insert(position);
+                            size_t chain = DEFLATE_MAX_CHAIN;
+                            while (candidate && chain--)
+                            {
+                                const size_t match = candidate - 1;
+                                const size_t distance = relative - match;
+                                if (distance >= DEFLATE_WINDOW_SIZE)
+                                {
+                                    break;
+                                }
+                                const uint8_t* a = data + base + match;
+                                if (a[bestLength] == data[position + bestLength])
+                                {
+                                    const size_t length = MatchLength(a, data + position, maxLength);
+                                    if (length > bestLength)
+                                    {
+                                        bestLength = length;
+                                        bestDistance = distance;
+                                        if (length >= DEFLATE_NICE_MATCH || length == maxLength)
+                                        {
+                                            break;
+                                        }
+                                    }
+                                }
+                                const uint32_t next = context.previous[match & windowMask];
+                                if (next >= candidate)
+                                {
+                                    // the slot was reused by a newer position, the chain left the window.
+                                    break;
+                                }
+                                candidate = next;
+                            }
+                        }
+                        else if (position)
+                        {
+                            bestLength = MatchLength(data + position - 1, data + position, maxLength);
+                            bestDistance = 1;
+                        }
+                    }
+
+                    if (bestLength >= DEFLATE_MIN_MATCH)
+                    {
+                        context.tokens[tokensCount++] = DeflateToken{ (uint16_t)bestLength, (uint16_t)bestDistance };
+                        if (lz77)
+                        {
+                            // long matches are usually runs, skipping their positions keeps the chains short.
+                            const size_t insertEnd = (bestLength <= 32) ? Min(position + bestLength, size - 2) : position + 1;
+                            for (size_t p = position + 1; p < insertEnd; ++p)
+                            {
+                                insert(p);
+                            }
+                        }
+                        position += bestLength;
+                    }
+                    else
+                    {
+                        context.tokens[tokensCount++] = DeflateToken{ data[position], 0 };
+                        position++;
+                    }
+                }
+                WriteDeflateBlock(writer, data + blockBegin, blockEnd - blockBegin, context.tokens, tokensCount, final && blockEnd == end);
+            }
+        }
+        if (!final)
+        {
+            PutBits(writer, 0, 3);
+            AlignToByte(writer);
+            PutBits(writer, 0, 16);
+            PutBits(writer, 0xffff, 16);
+        }
+        AlignToByte(writer);
+    }
+
+    static inline uint8_t PaethPredictor(int32_t a, int32_t b, int32_t c)
+    {
+        const int32_t p = a + b - c;
+        const int32_t pa = Abs(p - a);
+        const int32_t pb = Abs(p - b);
+        const int32_t pc = Abs(p - c);
+        if (pa <= pb && pa <= pc)
+        {
+            return (uint8_t)a;
+        }
+        return (uint8_t)((pb <= pc) ? b : c);
+    }
+
+    static inline uint8_t FilterPNGByte(uint8_t filter, uint8_t x, uint8_t a, uint8_t b, uint8_t c)
+    {
+        switch (filter)
+        {
+            case 0: return x;
+            case 1: return (uint8_t)(x - a);
+            case 2: return (uint8_t)(x - b);
+            case 3: return (uint8_t)(x - ((a + b) >> 1));
+            default: return (uint8_t)(x - PaethPredictor(a, b, c));
+        }
+    }
+
+    // picks the filter with the smallest sum of absolute (signed) differences, previous is NULL for the first row.
+    static void FilterPNGRow(const uint8_t* row, const uint8_t* previous, size_t stride, size_t pixelSize, bool noFilter, uint8_t* dest)
+    {
+        uint8_t best = 0;
+        if (!noFilter)
+        {
+            uint32_t costs[5] = {};
+            for (size_t i = 0; i < stride; ++i)
+            {
+                const uint8_t x = row[i];
+                const uint8_t a = (i >= pixelSize) ? row[i - pixelSize] : 0;
+                const uint8_t b = previous ? previous[i] : 0;
+                const uint8_t c = (previous && i >= pixelSize) ? previous[i - pixelSize] : 0;
+                costs[0] += Abs<int32_t>((int8_t)x);
+                costs[1] += Abs<int32_t>((int8_t)(x - a));
+                costs[2] += Abs<int32_t>((int8_t)(x - b));
+                costs[3] += Abs<int32_t>((int8_t)(x - ((a + b) >> 1)));
+                costs[4] += Abs<int32_t>((int8_t)(x - PaethPredictor(a, b, c)));
+            }
+            for (uint8_t filter = 1; filter < 5; ++filter)
+            {
+                if (costs[filter] < costs[best])
+                {
+                    best = filter;
+                }
+            }
+        }
+        dest[0] = best;
+        if (!best)
+        {
+            GEDO_MEMCPY(dest + 1, row, stride);
+            return;
+        }
+        for (size_t i = 0; i < stride; ++i)
+        {
+            const uint8_t a = (i >= pixelSize) ? row[i - pixelSize] : 0;
+            const uint8_t b = previous ? previous[i] : 0;
+            const uint8_t c = (previous && i >= pixelSize) ? previous[i - pixelSize] : 0;
+            dest[i + 1] = FilterPNGByte(best, row[i], a, b, c);
+        }
+    }
+
+    static void WritePNGChunk(BufferedFileWriter& writer, const char* type, const uint8_t* data, size_t size, uint32_t crc)
+    {
+        uint8_t length[4];
+        uint8_t checksum[4];
+        WriteBigEndian32(length, (uint32_t)size);
+        WriteBigEndian32(checksum, crc);
+        WriteToFile(writer, length, 4);
+        WriteToFile(writer, type, 4);
+        WriteToFile(writer, data, size);
+        WriteToFile(writer, checksum, 4);
+    }
+
+    static uint32_t GetPNGChunkCRC(const char* type, const uint8_t* data, size_t size)
+    {
+        return UpdateCRC32(UpdateCRC32(0, (const uint8_t*)type, 4), data, size);
+    }
+
+    struct PNGChunk
+    {
+        size_t size = 0; // compressed size.
+        uint32_t crc = 0; // crc of "IDAT" and the compressed data.
+        uint32_t adler = 0; // adler32 of the uncompressed data.
+    };
+
+    struct PNGDeflateTask
+    {
+        const uint8_t* data;
+        size_t size;
+        PNGCompression compression;
+        DeflateContext context;
+        uint8_t* output;
+        size_t chunkBound;
+        PNGChunk* chunks;
+        size_t chunksCount;
+        size_t first;
+        size_t step;
+    };
+
+    static void RunPNGDeflateTask(void* userData)
+    {
+        PNGDeflateTask& task = *(PNGDeflateTask*)userData;
+        for (size_t i = task.first; i < task.chunksCount; i += task.step)
+        {
+            const size_t begin = i * DEFLATE_CHUNK_SIZE;
+            const size_t end = Min(begin + DEFLATE_CHUNK_SIZE, task.size);
+            DeflateWriter writer;
+            writer.out = task.output + i * task.chunkBound;
+            if (i == 0)
+            {
+                // zlib header, deflate with a 32KB window and no dictionary.
+                PutBits(writer, 0x78, 8);
+                PutBits(writer, 0x01, 8);
+            }
+            DeflateChunk(task.data, task.size, begin, end, i == task.chunksCount - 1, task.compression, task.context, writer);
+            PNGChunk& chunk = task.chunks[i];
+            chunk.size = writer.size;
+            chunk.crc = GetPNGChunkCRC("IDAT", writer.out, writer.size);
+            chunk.adler = ComputeAdler32(task.data + begin, end - begin);
+        }
+    }
+
+    static bool EncodePNGPixels(const uint8_t* pixels, size_t width, size_t height, size_t pixelSize,
+                          BufferedFileWriter& writer, PNGCompression compression, Allocator& allocator)
+    {
+        if (!width || !height || width > 0x7fffffff || height > 0x7fffffff)
+        {
+            return false;
+        }
+        // every row starts with its filter type.
+        const size_t stride = width * pixelSize;
+        const size_t size = (stride + 1) * height;
+        MemoryBlock filteredBlock = allocator.AllocateMemoryBlock(size);
+        defer(allocator.FreeMemoryBlock(filteredBlock));
+        uint8_t* filtered = filteredBlock.data;
+        ParallelFor(height, 16, [&](size_t begin, size_t end)
+                    {
+                        for (size_t y = begin; y < end; ++y)
+                        {
+                            FilterPNGRow(pixels + y * stride, y ? pixels + (y - 1) * stride : NULL, stride, pixelSize,
+                                         compression == PNGCompression::STORE, filtered + y * (stride + 1));
+                        }
+                    });
+
+        // a chunk never grows beyond its stored size, plus block headers, the sync flush, the zlib header and adler32.
+        const size_t chunksCount = (size + DEFLATE_CHUNK_SIZE - 1) / DEFLATE_CHUNK_SIZE;
+        const size_t chunkBound = DEFLATE_CHUNK_SIZE + 5 * (DEFLATE_CHUNK_SIZE / DEFLATE_BLOCK_SIZE + 2) + 16;
+        const size_t tasksCount = Min<size_t>(Min<size_t>(GetProcessorCount(), 64), chunksCount);
+        const size_t contextSize = (sizeof(uint32_t) << DEFLATE_HASH_BITS) + sizeof(uint32_t) * DEFLATE_WINDOW_SIZE +
+                                   sizeof(DeflateToken) * DEFLATE_BLOCK_SIZE;
+        MemoryBlock outputBlock = allocator.AllocateMemoryBlock(chunksCount * chunkBound);
+        defer(allocator.FreeMemoryBlock(outputBlock));
+        MemoryBlock chunksBlock = allocator.AllocateMemoryBlock(chunksCount * sizeof(PNGChunk));
+        defer(allocator.FreeMemoryBlock(chunksBlock));
+        MemoryBlock contextsBlock = allocator.AllocateMemoryBlock(tasksCount * contextSize);
+        defer(allocator.FreeMemoryBlock(contextsBlock));
+        PNGChunk* chunks = (PNGChunk*)chunksBlock.data;
+
+        // chunks are dealt round robin so every task gets a similar amount of work.
+        StaticArray<PNGDeflateTask, 64> tasks;
+        StaticArray<void*, 64> userData;
+        for (size_t i = 0; i < tasksCount; ++i)
+        {
+            uint8_t* memory = contextsBlock.data + i * contextSize;
+            PNGDeflateTask task;
+            task.data = filtered;
+            task.size = size;
+            task.compression = compression;
+            task.context.head = (uint32_t*)memory;
+            task.context.previous = task.context.head + (size_t(1) << DEFLATE_HASH_BITS);
+            task.context.tokens = (DeflateToken*)(task.context.previous + DEFLATE_WINDOW_SIZE);
+            task.output = outputBlock.data;
+            task.chunkBound = chunkBound;
+            task.chunks = chunks;
+            task.chunksCount = chunksCount;
+            task.first = i;
+            task.step = tasksCount;
+            tasks.push_back(task);
+        }
+        for (size_t i = 0; i < tasksCount; ++i)
+        {
+            userData.push_back(&tasks[i]);
+        }
+        RunInParallel(RunPNGDeflateTask, userData.data(), tasksCount);
+
+        // the zlib stream ends with the adler32 of all the chunks, appended to the last one.
+        uint32_t adler = chunks[0].adler;
+        for (size_t i = 1; i < chunksCount; ++i)
+        {
+            const size_t chunkSize = Min(DEFLATE_CHUNK_SIZE, size - i * DEFLATE_CHUNK_SIZE);
+            adler = CombineAdler32(adler, chunks[i].adler, chunkSize);
+        }
+        PNGChunk& last = chunks[chunksCount - 1];
+        uint8_t* lastOutput = outputBlock.data + (chunksCount - 1) * chunkBound;
+        WriteBigEndian32(lastOutput + last.size, adler);
+        last.crc = UpdateCRC32(last.crc, lastOutput + last.size, 4);
+        last.size += 4;
+
+        static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        WriteToFile(writer, signature, sizeof(signature));
+        uint8_t header[13];
+        WriteBigEndian32(header, (uint32_t)width);
+        WriteBigEndian32(header + 4, (uint32_t)height);
+        header[8] = 8;                          // bits per channel.
+        header[9] = (pixelSize == 4) ? 6 : 0;   // RGBA or grey.
+        header[10] = 0;                         // deflate.
+        header[11] = 0;                         // adaptive filters.
+        header[12] = 0;                         // no interlacing.
+        WritePNGChunk(writer, "IHDR", header, sizeof(header), GetPNGChunkCRC("IHDR", header, sizeof(header)));
+        // every compressed chunk becomes an IDAT chunk, together they are one zlib stream.
+        for (size_t i = 0; i < chunksCount; ++i)
+        {
+            WritePNGChunk(writer, "IDAT", outputBlock.data + i * chunkBound, chunks[i].size, chunks[i].crc);
+        }
+        WritePNGChunk(writer, "IEND", NULL, 0, GetPNGChunkCRC("IEND", NULL, 0));
+        return !writer.failed;
+    }
+
+    bool EncodePNG(const ColorBitmap& bitmap, BufferedFileWriter& writer, PNGCompression compression, Allocator& allocator)
+    {
+        const size_t pixelsCount = bitmap.width * bitmap.height;
+        MemoryBlock pixels = allocator.AllocateMemoryBlock(pixelsCount * 4);
+        defer(allocator.FreeMemoryBlock(pixels));
+        ConvertPixels(bitmap.data, pixelsCount, PixelFormat::RGBA8, pixels.data);
+        return EncodePNGPixels(pixels.data, bitmap.width, bitmap.height, 4, writer, compression, allocator);
+    }
+
+    bool EncodePNG(const Bitmap& bitmap, BufferedFileWriter& writer, PNGCompression compression, Allocator& allocator)
+    {
+        return EncodePNGPixels(bitmap.data, bitmap.width, bitmap.height, 1, writer, compression, allocator);
+    }
+
+    static bool HasExtension(const char* fileName, const char* extension)
+    {
+        const char* fileExtension = GetFileExtension(fileName);
+        if (!fileExtension)
+        {
+            return false;
+        }
+        for (; *fileExtension && *extension; ++fileExtension, ++extension)
+        {
+            char c = *fileExtension;
+            if (c >= 'A' && c <= 'Z')
+            {
+                c = c - 'A' + 'a';
+            }
+            if (c != *extension)
+            {
+                return false;
+            }
+        }
+        return *fileExtension == *extension;
+    }
+
+    ColorBitmap LoadColorBitmap(const char* fileName, Allocator& allocator)
+    {
+        ColorBitmap result;
+        MappedFile file = MapFile(fileName, allocator);
+        defer(UnmapFile(file));
+        if (!file.block.data)
+        {
+            return result;
+        }
+        if (HasExtension(fileName, ".qoi"))
+        {
+            result = DecodeQOI(file.block, allocator);
+        }
+        else if (HasExtension(fileName, ".bmp"))
+        {
+            result = DecodeBMP(file.block, allocator);
+        }
+        else if (HasExtension(fileName, ".ppm"))
+        {
+            result = DecodePPM(file.block, allocator);
+        }
+        return result;
+    }
+
+    bool SaveColorBitmap(const char* fileName, const ColorBitmap& bitmap, Allocator& allocator)
+    {
+        bool (*encode)(const ColorBitmap&, BufferedFileWriter&) = NULL;
+        if (HasExtension(fileName, ".qoi"))
+        {
+            encode = EncodeQOI;
+        }
+        else if (HasExtension(fileName, ".bmp"))
+        {
+            encode = EncodeBMP;
+        }
+        else if (HasExtension(fileName, ".ppm"))
+        {
+            encode = EncodePPM;
+        }
+        const bool png = HasExtension(fileName, ".png");
+        if (!encode && !png)
+        {
+            return false;
+        }
+        BufferedFileWriter writer = CreateBufferedFileWriter(fileName, 1024 * 1024, allocator);
+        if (writer.failed)
+        {
+            return false;
+        }
+        if (png)
+        {
+            EncodePNG(bitmap, writer, PNGCompression::DEFAULT, allocator);
+        }
+        else
+        {
+            encode(bitmap, writer);
+        }
+        return DestroyBufferedFileWriter(writer);
+    }
+
+    DepthBuffer CreateDepthBuffer(size_t width, size_t height, Allocator& allocator)
+    {
+        DepthBuffer result;
+        result.width = width;
+        result.height = height;
+        MemoryBlock block = allocator.AllocateMemoryBlock(sizeof(float) * width * height);
+        GEDO_ASSERT(block.data);
+        result.data = (float*)block.data;
+        ClearDepthBuffer(result);
+        return result;
+    }
+
+    void DestroyDepthBuffer(DepthBuffer& depth, Allocator& allocator)
+    {
+        GEDO_ASSERT(depth.data);
+        MemoryBlock block;
+        block.data = (uint8_t*)depth.data;
+        block.size = depth.width * depth.height * sizeof(float);
+        allocator.FreeMemoryBlock(block);
+        depth.data = NULL;
+    }
+
+    void ClearDepthBuffer(DepthBuffer& depth, float value)
+    {
+        const size_t count = depth.width * depth.height;
+        for (size_t i = 0; i < count; ++i)
+        {
+            depth.data[i] = value;
+        }
+    }
+
+    // vertices are snapped to a grid of 1/256 pixel, edge functions are evaluated in 64 bit integers.
+    static const int64_t RASTER_SUBPIXEL_BITS = 8;
+    static const int64_t RASTER_SUBPIXEL_ONE = 1 << RASTER_SUBPIXEL_BITS;
+    static const double RASTER_GUARD_BAND = double(1 << 20);
+    static const size_t RASTER_TILE_SIZE = 64;
+    static const size_t RASTER_SPAN = 8;
+
+    struct RasterVertex
+    {
+        double x = 0;
+        double y = 0;
+        float z = 0;
+        bool visible = false;
+    };
+
+    struct RasterTriangle
+    {
+        int64_t x[3];
+        int64_t y[3];
+        float z[3];
+        Color color[3];
+        int64_t area;
+        size_t minX, minY, maxX, maxY; // inclusive pixel bounds.
+        bool visible;
+    };
+
+    static bool IsTopLeftEdge(int64_t ax, int64_t ay, int64_t bx, int64_t by)
+    {
+        return (by < ay) || (by == ay && bx > ax);
+    }
+
+    // returns a bit per pixel of the span [0, count) that is inside the 3 edges, e are the edge values at
+    // the first pixel and a their steps in x. a pixel is inside when no edge value is negative.
+    static uint32_t RasterSpanMask(const int64_t e[3], const int64_t a[3], size_t count)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < RASTER_SPAN; ++i)
+        {
+            const int64_t w0 = e[0] + int64_t(i) * a[0];
+            const int64_t w1 = e[1] + int64_t(i) * a[1];
+            const int64_t w2 = e[2] + int64_t(i) * a[2];
+            mask |= uint32_t((w0 | w1 | w2) >= 0) << i;
+        }
+        return mask & ((1u << count) - 1);
+    }
+
+#if defined __AVX2__
+    // same as RasterSpanMask for the 8 pixels of a span, steps holds i * a[edge] for the lanes [0, 4) and [4, 8).
+    static uint32_t RasterSpanMaskAVX2(const int64_t e[3], const __m256i steps[3][2], size_t count)
+    {
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+        for (int i = 0; i < 3; ++i)
+        {
+            const __m256i edge = _mm256_set1_epi64x(e[i]);
+            lo = _mm256_or_si256(lo, _mm256_add_epi64(edge, steps[i][0]));
+            hi = _mm256_or_si256(hi, _mm256_add_epi64(edge, steps[i][1]));
+        }
+        // the sign bits of the ORed edge values are set for the pixels outside.
+        const uint32_t outside = uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(lo))) |
+            (uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(hi))) << 4);
+        return ~outside & ((1u << count) - 1);
+    }
+#endif // __AVX2__
+
+    static void RasterizeTriangleInTile(ColorBitmap& target, DepthBuffer& depth, const RasterTriangle& tri,
+                                        size_t tileMinX, size_t tileMinY, size_t tileMaxX, size_t tileMaxY,
+                                        ShadingMode shading)
+    {
+        const size_t minX = Max(tri.minX, tileMinX);
+        const size_t minY = Max(tri.minY, tileMinY);
+        const size_t maxX = Min(tri.maxX, tileMaxX);
+        const size_t maxY = Min(tri.maxY, tileMaxY);
+        if (minX > maxX || minY > maxY)
+        {
+            return;
+        }
+
+        // edge i is opposite to vertex i, E(p) = (b - a) x (p - a) is positive inside.
+        int64_t a[3], b[3], rowStart[3];
+        const int64_t px = int64_t(minX) * RASTER_SUBPIXEL_ONE + RASTER_SUBPIXEL_ONE / 2;
+        const int64_t py = int64_t(minY) * RASTER_SUBPIXEL_ONE + RASTER_SUBPIXEL_ONE / 2;
+        for (int i = 0; i < 3; ++i)
+        {
+            const int i0 = (i + 1) % 3;
+            const int i1 = (i + 2) % 3;
+            const int64_t ax = tri.x[i0], ay = tri.y[i0];
+            const int64_t bx = tri.x[i1], by = tri.y[i1];
+            a[i] = -(by - ay) * RASTER_SUBPIXEL_ONE; // step in x.
+            b[i] = (bx - ax) * RASTER_SUBPIXEL_ONE;  // step in y.
+            const int64_t bias = IsTopLeftEdge(ax, ay, bx, by) ? 0 : -1;
+            rowStart[i] = (bx - ax) * (py - ay) - (by - ay) * (px - ax) + bias;
+        }
+
+        const float invArea = 1.0f / float(tri.area);
+        float colors[3][4];
+        for (int i = 0; i < 3; ++i)
+        {
+            const Color& c = (shading == ShadingMode::FLAT) ? tri.color[0] : tri.color[i];
+            colors[i][0] = c.r;
+            colors[i][1] = c.g;
+            colors[i][2] = c.b;
+            colors[i][3] = c.a;
+        }
+
+#if defined __AVX2__
+        __m256i steps[3][2];
+        for (int i = 0; i < 3; ++i)
+        {
+            steps[i][0] = _mm256_setr_epi64x(0, a[i], 2 * a[i], 3 * a[i]);
+            steps[i][1] = _mm256_setr_epi64x(4 * a[i], 5 * a[i], 6 * a[i], 7 * a[i]);
+        }
+#endif // __AVX2__
+
+        for (size_t y = minY; y <= maxY; ++y)
+        {
+            int64_t e[3] = { rowStart[0], rowStart[1], rowStart[2] };
+            Color* colorRow = target.data + y * target.width;
+            float* depthRow = depth.data + y * depth.width;
+            for (size_t x = minX; x <= maxX; x += RASTER_SPAN)
+            {
+                const size_t count = Min(RASTER_SPAN, maxX - x + 1);
+                // evaluate the 3 edges for a span of pixels at once, only the covered pixels are shaded.
+#if defined __AVX2__
+                const uint32_t mask = RasterSpanMaskAVX2(e, steps, count);
+#else
+                const uint32_t mask = RasterSpanMask(e, a, count);
+#endif // __AVX2__
+                for (size_t i = 0; mask >> i; ++i)
+                {
+                    if (!((mask >> i) & 1))
+                    {
+                        continue;
+                    }
+                    const float b0 = float(e[0] + int64_t(i) * a[0]) * invArea;
+                    const float b1 = float(e[1] + int64_t(i) * a[1]) * invArea;
+                    const float b2 = 1.0f - b0 - b1;
+                    const float z = b0 * tri.z[0] + b1 * tri.z[1] + b2 * tri.z[2];
+                    if (z < depthRow[x + i])
+                    {
+                        depthRow[x + i] = z;
+                        Color& c = colorRow[x + i];
+                        c.r = (uint8_t)(b0 * colors[0][0] + b1 * colors[1][0] + b2 * colors[2][0] + 0.5f);
+                        c.g = (uint8_t)(b0 * colors[0][1] + b1 * colors[1][1] + b2 * colors[2][1] + 0.5f);
+                        c.b = (uint8_t)(b0 * colors[0][2] + b1 * colors[1][2] + b2 * colors[2][2] + 0.5f);
+                        c.a = (uint8_t)(b0 * colors[0][3] + b1 * colors[1][3] + b2 * colors[2][3] + 0.5f);
+                    }
+                }
+                e[0] += RASTER_SPAN * a[0];
+                e[1] += RASTER_SPAN * a[1];
+                e[2] += RASTER_SPAN * a[2];
+            }
+            rowStart[0] += b[0];
+            rowStart[1] += b[1];
+            rowStart[2] += b[2];
+        }
+    }
+
+    void DrawTriangles(ColorBitmap& target, DepthBuffer& depth, const Mat4& mvp,
+                       ArrayView<Vec3d> positions, ArrayView<Color> colors, ArrayView<uint32_t> indices,
+                       ShadingMode shading, RasterStats* stats, Allocator& allocator)
+    {
+        GEDO_ASSERT(target.width == depth.width && target.height == depth.height);
+        GEDO_ASSERT(colors.size >= positions.size);
+        const Stopwatch stopwatch = StartStopwatch();
+        const size_t trianglesCount = indices.size / 3;
+        if (stats)
+        {
+            *stats = RasterStats();
+            stats->trianglesCount = trianglesCount;
+        }
+        if (!trianglesCount || !target.width || !target.height)
+        {
+            return;
+        }
+
+        const size_t tilesX = (target.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        const size_t tilesY = (target.height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        const size_t tilesCount = tilesX * tilesY;
+
+        MemoryBlock vertexBlock = allocator.AllocateMemoryBlock(positions.size * sizeof(RasterVertex));
+        defer(allocator.FreeMemoryBlock(vertexBlock));
+        MemoryBlock triangleBlock = allocator.AllocateMemoryBlock(trianglesCount * sizeof(RasterTriangle));
+        defer(allocator.FreeMemoryBlock(triangleBlock));
+        MemoryBlock tileBlock = allocator.AllocateMemoryBlock((tilesCount + 1) * sizeof(size_t));
+        defer(allocator.FreeMemoryBlock(tileBlock));
+        RasterVertex* vertices = (RasterVertex*)vertexBlock.data;
+        RasterTriangle* triangles = (RasterTriangle*)triangleBlock.data;
+        size_t* tileOffsets = (size_t*)tileBlock.data;
+
+        // 1- transform the vertices to window space.
+        const double width = double(target.width);
+        const double height = double(target.height);
+        ParallelFor(positions.size, 4096, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            const Vec3d& p = positions.data[i];
+                            double clip[4];
+                            for (int row = 0; row < 4; ++row)
+                            {
+                                clip[row] = mvp.elements[0][row] * p.x + mvp.elements[1][row] * p.y +
+                                    mvp.elements[2][row] * p.z + mvp.elements[3][row];
+                            }
+                            RasterVertex& v = vertices[i];
+                            v.visible = clip[3] > 1e-9;
+                            if (v.visible)
+                            {
+                                const double invW = 1.0 / clip[3];
+                                v.x = (clip[0] * invW * 0.5 + 0.5) * width;
+                                v.y = (0.5 - clip[1] * invW * 0.5) * height;
+                                v.z = (float)(clip[2] * invW * 0.5 + 0.5);
+                                v.visible = fabs(v.x) < RASTER_GUARD_BAND && fabs(v.y) < RASTER_GUARD_BAND;
+                            }
+                        }
+                    });
+
+        // 2- triangle setup: snap to the subpixel grid, fix the winding and compute the bounds.
+        ParallelFor(trianglesCount, 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t t = begin; t < end; ++t)
+                        {
+                            RasterTriangle& tri = triangles[t];
+                            tri.visible = false;
+                            uint32_t idx[3] = { indices.data[t * 3], indices.data[t * 3 + 1], indices.data[t * 3 + 2] };
+                            if (!vertices[idx[0]].visible || !vertices[idx[1]].visible || !vertices[idx[2]].visible)
+                            {
+                                continue;
+                            }
+                            for (int i = 0; i < 3; ++i)
+                            {
+                                const RasterVertex& v = vertices[idx[i]];
+                                tri.x[i] = (int64_t)floor(v.x * RASTER_SUBPIXEL_ONE + 0.5);
+                                tri.y[i] = (int64_t)floor(v.y * RASTER_SUBPIXEL_ONE + 0.5);
+                                tri.z[i] = v.z;
+                                tri.color[i] = colors.data[idx[i]];
+                            }
+                            tri.area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]);
+                            if (tri.area == 0)
+                            {
+                                continue;
+                            }
+                            if (tri.area < 0)
+                            {
+                                // keep the provoking vertex at index 0 for flat shading.
+                                Swap(tri.x[1], tri.x[2]);
+                                Swap(tri.y[1], tri.y[2]);
+                                Swap(tri.z[1], tri.z[2]);
+                                Swap(tri.color[1], tri.color[2]);
+                                tri.area = -tri.area;
+                            }
+                            const int64_t minX = Min(tri.x[0], Min(tri.x[1], tri.x[2])) >> RASTER_SUBPIXEL_BITS;
+                            const int64_t minY = Min(tri.y[0], Min(tri.y[1], tri.y[2])) >> RASTER_SUBPIXEL_BITS;
+                            const int64_t maxX = Max(tri.x[0], Max(tri.x[1], tri.x[2])) >> RASTER_SUBPIXEL_BITS;
+                            const int64_t maxY = Max(tri.y[0], Max(tri.y[1], tri.y[2])) >> RASTER_SUBPIXEL_BITS;
+                            if (maxX < 0 || maxY < 0 || minX >= int64_t(target.width) || minY >= int64_t(target.height))
+                            {
+                                continue;
+                            }
+                            tri.minX = (size_t)Max<int64_t>(minX, 0);
+                            tri.minY = (size_t)Max<int64_t>(minY, 0);
+                            tri.maxX = (size_t)Min<int64_t>(maxX, target.width - 1);
+                            tri.maxY = (size_t)Min<int64_t>(maxY, target.height - 1);
+                            tri.visible = true;
+                        }
+                    });
+
+        // 3- bin the triangles into tiles (CSR layout), submission order is kept inside each tile.
+        size_t trianglesDrawn = 0;
+        for (size_t t = 0; t < trianglesCount; ++t)
+        {
+            const RasterTriangle& tri = triangles[t];
+            if (!tri.visible)
+            {
+                continue;
+            }
+            trianglesDrawn++;
+            for (size_t ty = tri.minY / RASTER_TILE_SIZE; ty <= tri.maxY / RASTER_TILE_SIZE; ++ty)
+            {
+                for (size_t tx = tri.minX / RASTER_TILE_SIZE; tx <= tri.maxX / RASTER_TILE_SIZE; ++tx)
+                {
+                    tileOffsets[ty * tilesX + tx + 1]++;
+                }
+            }
+            MarkBitmapDirty(target, tri.minX, tri.minY, tri.maxX + 1, tri.maxY + 1);
+        }
+        for (size_t i = 0; i < tilesCount; ++i)
+        {
+            tileOffsets[i + 1] += tileOffsets[i];
+        }
+        MemoryBlock binBlock = allocator.AllocateMemoryBlock(Max<size_t>(tileOffsets[tilesCount], 1) * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(binBlock));
+        MemoryBlock cursorBlock = allocator.AllocateMemoryBlock(tilesCount * sizeof(size_t));
+        defer(allocator.FreeMemoryBlock(cursorBlock));
+        uint32_t* bins = (uint32_t*)binBlock.data;
+        size_t* cursors = (size_t*)cursorBlock.data;
+        GEDO_MEMCPY(cursors, tileOffsets, tilesCount * sizeof(size_t));
+        for (size_t t = 0; t < trianglesCount; ++t)
+        {
+            const RasterTriangle& tri = triangles[t];
+            if (!tri.visible)
+            {
+                continue;
+            }
+            for (size_t ty = tri.minY / RASTER_TILE_SIZE; ty <= tri.maxY / RASTER_TILE_SIZE; ++ty)
+            {
+                for (size_t tx = tri.minX / RASTER_TILE_SIZE; tx <= tri.maxX / RASTER_TILE_SIZE; ++tx)
+                {
+                    bins[cursors[ty * tilesX + tx]++] = (uint32_t)t;
+                }
+            }
+        }
+
+        // 4- every tile owns its pixels so the tiles can be rasterized in parallel without locking.
+        ParallelFor(tilesCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t tile = begin; tile < end; ++tile)
+                        {
+                            const size_t tileMinX = (tile % tilesX) * RASTER_TILE_SIZE;
+                            const size_t tileMinY = (tile / tilesX) * RASTER_TILE_SIZE;
+                            const size_t tileMaxX = Min(tileMinX + RASTER_TILE_SIZE, target.width) - 1;
+                            const size_t tileMaxY = Min(tileMinY + RASTER_TILE_SIZE, target.height) - 1;
+                            for (size_t i = tileOffsets[tile]; i < tileOffsets[tile + 1]; ++i)
+                            {
+                                RasterizeTriangleInTile(target, depth, triangles[bins[i]],
+                                                        tileMinX, tileMinY, tileMaxX, tileMaxY, shading);
+                            }
+                        }
+                    });
+        if (stats)
+        {
+            stats->trianglesDrawn = trianglesDrawn;
+            stats->seconds = GetElapsedSeconds(stopwatch);
+            stats->trianglesPerSecond = (stats->seconds > 0.0) ? double(trianglesCount) / stats->seconds : 0.0;
+        }
+    }
+
+    void BlendPixel(Color& dest, Color color, uint32_t coverage)
+    {
+        const uint32_t alpha = (color.a * coverage + 127) / 255;
+        if (!alpha)
+        {
+            return;
+        }
+        if (alpha == 255)
+        {
+            dest = color;
+            return;
+        }
+        dest.r = (uint8_t)(dest.r + ((int32_t(color.r) - int32_t(dest.r)) * int32_t(alpha)) / 255);
+        dest.g = (uint8_t)(dest.g + ((int32_t(color.g) - int32_t(dest.g)) * int32_t(alpha)) / 255);
+        dest.b = (uint8_t)(dest.b + ((int32_t(color.b) - int32_t(dest.b)) * int32_t(alpha)) / 255);
+        dest.a = (uint8_t)(alpha + (dest.a * (255 - alpha) + 127) / 255);
+    }
+
+    template<bool CLIP>
+    static inline void PlotPixel(ColorBitmap& dest, int64_t x, int64_t y, Color color, double coverage)
+    {
+        if (CLIP && (x < 0 || y < 0 || x >= int64_t(dest.width) || y >= int64_t(dest.height)))
+        {
+            return;
+        }
+        BlendPixel(dest.data[y * dest.width + x], color, (uint32_t)(Clamp(coverage, 0.0, 1.0) * 255.0 + 0.5));
+    }
+
+    // Xiaolin Wu's line algorithm, CLIP=false is only valid when the line plus one pixel is inside the bitmap.
+    template<bool CLIP>
+    static void DrawLineWu(ColorBitmap& dest, double x0, double y0, double x1, double y1, Color color)
+    {
+        // move to a space where the pixel centers are on integer coordinates.
+        x0 -= 0.5;
+        y0 -= 0.5;
+        x1 -= 0.5;
+        y1 -= 0.5;
+        const bool steep = fabs(y1 - y0) > fabs(x1 - x0);
+        if (steep)
+        {
+            Swap(x0, y0);
+            Swap(x1, y1);
+        }
+        if (x0 > x1)
+        {
+            Swap(x0, x1);
+            Swap(y0, y1);
+        }
+        const double dx = x1 - x0;
+        const double gradient = (dx == 0.0) ? 1.0 : (y1 - y0) / dx;
+
+        auto plot = [&](int64_t a, int64_t b, double c)
+        {
+            if (steep)
+            {
+                PlotPixel<CLIP>(dest, b, a, color, c);
+            }
+            else
+            {
+                PlotPixel<CLIP>(dest, a, b, color, c);
+            }
+        };
+
+        // first endpoint.
+        double xEnd = floor(x0 + 0.5);
+        double yEnd = y0 + gradient * (xEnd - x0);
+        double xGap = 1.0 - (x0 + 0.5 - floor(x0 + 0.5));
+        const int64_t xStart = (int64_t)xEnd;
+        int64_t yPixel = (int64_t)floor(yEnd);
+        plot(xStart, yPixel, (1.0 - (yEnd - floor(yEnd))) * xGap);
+        plot(xStart, yPixel + 1, (yEnd - floor(yEnd)) * xGap);
+        double intery = yEnd + gradient;
+
+        // second endpoint.
+        xEnd = floor(x1 + 0.5);
+        yEnd = y1 + gradient * (xEnd - x1);
+        xGap = x1 + 0.5 - floor(x1 + 0.5);
+        const int64_t xStop = (int64_t)xEnd;
+        yPixel = (int64_t)floor(yEnd);
+        plot(xStop, yPixel, (1.0 - (yEnd - floor(yEnd))) * xGap);
+        plot(xStop, yPixel + 1, (yEnd - floor(yEnd)) * xGap);
+
+        for (int64_t x = xStart + 1; x < xStop; ++x)
+        {
+            const double f = floor(intery);
+            plot(x, (int64_t)f, 1.0 - (intery - f));
+            plot(x, (int64_t)f + 1, intery - f);
+            intery += gradient;
+        }
+    }
+
+    // Liang-Barsky clipping against [minX, maxX] x [minY, maxY], returns false if nothing is left.
+    static bool ClipSegment(double& x0, double& y0, double& x1, double& y1,
+                            double minX, double minY, double maxX, double maxY)
+    {
+        const double dx = x1 - x0;
+        const double dy = y1 - y0;
+        const double p[4] = { -dx, dx, -dy, dy };
+        const double q[4] = { x0 - minX, maxX - x0, y0 - minY, maxY - y0 };
+        double t0 = 0.0;
+        double t1 = 1.0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (p[i] == 0.0)
+            {
+                if (q[i] < 0.0)
+                {
+                    return false;
+                }
+                continue;
+            }
+            const double t = q[i] / p[i];
+            if (p[i] < 0.0)
+            {
+                t0 = Max(t0, t);
+            }
+            else
+            {
+                t1 = Min(t1, t);
+            }
+            if (t0 > t1)
+            {
+                return false;
+            }
+        }
+        const double sx = x0;
+        const double sy = y0;
+        x0 = sx + t0 * dx;
+        y0 = sy + t0 * dy;
+        x1 = sx + t1 * dx;
+        y1 = sy + t1 * dy;
+        return true;
+    }
+
+    static void DrawClippedLine(ColorBitmap& dest, Vec2d from, Vec2d to, Color color)
+    {
+        // keep a margin so the partially covered pixels on the edges are still drawn.
+        const double margin = 2.0;
+        if (ClipSegment(from.x, from.y, to.x, to.y, -margin, -margin,
+                        double(dest.width) + margin, double(dest.height) + margin))
+        {
+            DrawLineWu<true>(dest, from.x, from.y, to.x, to.y, color);
+        }
+    }
+
+    void DrawLine(ColorBitmap& dest, Vec2d from, Vec2d to, Color color)
+    {
+        MarkBitmapDirty(dest, (int64_t)floor(Min(from.x, to.x)) - 2, (int64_t)floor(Min(from.y, to.y)) - 2,
+                        (int64_t)ceil(Max(from.x, to.x)) + 2, (int64_t)ceil(Max(from.y, to.y)) + 2);
+        DrawClippedLine(dest, from, to, color);
+    }
+
+    void DrawPolyline(ColorBitmap& dest, ArrayView<Vec2d> points, bool closed, Color color)
+    {
+        if (points.size < 2)
+        {
+            return;
+        }
+        Vec2d minPoint = points.data[0];
+        Vec2d maxPoint = points.data[0];
+        for (size_t i = 1; i < points.size; ++i)
+        {
+            const Vec2d& p = points.data[i];
+            minPoint.x = Min(minPoint.x, p.x);
+            minPoint.y = Min(minPoint.y, p.y);
+            maxPoint.x = Max(maxPoint.x, p.x);
+            maxPoint.y = Max(maxPoint.y, p.y);
+        }
+        MarkBitmapDirty(dest, (int64_t)floor(minPoint.x) - 2, (int64_t)floor(minPoint.y) - 2,
+                        (int64_t)ceil(maxPoint.x) + 2, (int64_t)ceil(maxPoint.y) + 2);
+        // Wu lines touch at most one pixel around the ideal line.
+        const bool inside = minPoint.x >= 2.0 && minPoint.y >= 2.0 &&
+            maxPoint.x <= double(dest.width) - 2.0 && maxPoint.y <= double(dest.height) - 2.0;
+        const size_t segments = closed ? points.size : points.size - 1;
+        for (size_t i = 0; i < segments; ++i)
+        {
+            const Vec2d& a = points.data[i];
+            const Vec2d& b = points.data[(i + 1) % points.size];
+            if (inside)
+            {
+                DrawLineWu<false>(dest, a.x, a.y, b.x, b.y, color);
+            }
+            else
+            {
+                DrawClippedLine(dest, a, b, color);
+            }
+        }
+    }
+
+    void DrawCircle(ColorBitmap& dest, Vec2d center, double radius, Color color)
+    {
+        MarkBitmapDirty(dest, (int64_t)floor(center.x - radius) - 2, (int64_t)floor(center.y - radius) - 2,
+                        (int64_t)ceil(center.x + radius) + 2, (int64_t)ceil(center.y + radius) + 2);
+        // coverage of a 1 pixel wide ring falls off linearly with the distance to the circle.
+        const int64_t minY = Max<int64_t>((int64_t)floor(center.y - radius - 1.0), 0);
+        const int64_t maxY = Min<int64_t>((int64_t)ceil(center.y + radius + 1.0), int64_t(dest.height) - 1);
+        const double outer = radius + 1.0;
+        const double inner = Max(radius - 1.0, 0.0);
+        for (int64_t y = minY; y <= maxY; ++y)
+        {
+            const double dy = y + 0.5 - center.y;
+            if (fabs(dy) > outer)
+            {
+                continue;
+            }
+            const double outerHalf = sqrt(outer * outer - dy * dy);
+            const double innerHalf = (fabs(dy) < inner) ? sqrt(inner * inner - dy * dy) : 0.0;
+            const int64_t minX = Max<int64_t>((int64_t)floor(center.x - outerHalf), 0);
+            const int64_t maxX = Min<int64_t>((int64_t)ceil(center.x + outerHalf), int64_t(dest.width) - 1);
+            // pixels well inside the ring are skipped.
+            const int64_t holeMinX = (int64_t)ceil(center.x - innerHalf);
+            const int64_t holeMaxX = (int64_t)floor(center.x + innerHalf) - 1;
+            Color* row = dest.data + y * dest.width;
+            for (int64_t x = minX; x <= maxX; ++x)
+            {
+                if (x > holeMinX && x < holeMaxX)
+                {
+                    x = holeMaxX - 1;
+                    continue;
+                }
+                const double dx = x + 0.5 - center.x;
+                const double coverage = 1.0 - fabs(sqrt(dx * dx + dy * dy) - radius);
+                if (coverage > 0.0)
+                {
+                    BlendPixel(row[x], color, (uint32_t)(Min(coverage, 1.0) * 255.0 + 0.5));
+                }
+            }
+        }
+    }
+
+    void FillCircle(ColorBitmap& dest, Vec2d center, double radius, Color color)
+    {
+        MarkBitmapDirty(dest, (int64_t)floor(center.x - radius) - 1, (int64_t)floor(center.y - radius) - 1,
+                        (int64_t)ceil(center.x + radius) + 1, (int64_t)ceil(center.y + radius) + 1);
+        const double outer = radius + 0.5;
+        const double inner = Max(radius - 0.5, 0.0);
+        const int64_t minY = Max<int64_t>((int64_t)floor(center.y - outer), 0);
+        const int64_t maxY = Min<int64_t>((int64_t)ceil(center.y + outer), int64_t(dest.height) - 1);
+        for (int64_t y = minY; y <= maxY; ++y)
+        {
+            const double dy = y + 0.5 - center.y;
+            if (fabs(dy) > outer)
+            {
+                continue;
+            }
+            const double outerHalf = sqrt(outer * outer - dy * dy);
+            const double innerHalf = (fabs(dy) < inner) ? sqrt(inner * inner - dy * dy) : 0.0;
+            const int64_t minX = Max<int64_t>((int64_t)floor(center.x - outerHalf), 0);
+            const int64_t maxX = Min<int64_t>((int64_t)ceil(center.x + outerHalf), int64_t(dest.width) - 1);
+            // the pixels fully covered in the middle of the span don't need a distance.
+            const int64_t solidMinX = (int64_t)ceil(center.x - innerHalf);
+            const int64_t solidMaxX = (int64_t)floor(center.x + innerHalf) - 1;
+            Color* row = dest.data + y * dest.width;
+            for (int64_t x = minX; x <= maxX; ++x)
+            {
+                if (x >= solidMinX && x <= solidMaxX)
+                {
+                    BlendPixel(row[x], color, 255);
+                    continue;
+                }
+                const double dx = x + 0.5 - center.x;
+                const double coverage = radius + 0.5 - sqrt(dx * dx + dy * dy);
+                if (coverage > 0.0)
+                {
+                    BlendPixel(row[x], color, (uint32_t)(Min(coverage, 1.0) * 255.0 + 0.5));
+                }
+            }
+        }
+    }
+
+    void DrawThickLine(ColorBitmap& dest, Vec2d from, Vec2d to, double thickness, Color color, Allocator& allocator)
+    {
+        Vec2d direction = to - from;
+        const double length = sqrt(DotProduct(direction, direction));
+        if (length == 0.0)
+        {
+            return;
+        }
+        const double half = thickness * 0.5 / length;
+        const Vec2d normal = Vec2d{ -direction.y * half, direction.x * half };
+        Vec2d quad[4] = { from + normal, to + normal, to - normal, from - normal };
+        ArrayView<Vec2d> points;
+        points.data = quad;
+        points.size = 4;
+        FillPolygon(dest, points, color, FillRule::NON_ZERO, allocator);
+    }
+
+    struct PolygonEdge
+    {
+        double x0;     // x at yMin.
+        double dxdy;
+        double yMin;
+        double yMax;
+        double x;      // x at the current sub-scanline.
+        int32_t winding;
+    };
+
+    static const int64_t POLYGON_SUBSAMPLES = 4;
+    static const int32_t POLYGON_COVERAGE_ONE = 256;
+
+    // adds the coverage of [xa, xb) on one sub-scanline, fully covered pixels are stored as
+    // a difference in spans so a long span costs the same as a short one.
+    static void AddPolygonSpan(int32_t* coverage, int32_t* spans, double xa, double xb, double width,
+                               int64_t& touchedMin, int64_t& touchedMax)
+    {
+        xa = Clamp(xa, 0.0, width);
+        xb = Clamp(xb, 0.0, width);
+        if (xb <= xa)
+        {
+            return;
+        }
+        const int64_t ia = (int64_t)xa;
+        const int64_t ib = (int64_t)xb;
+        if (ia == ib)
+        {
+            coverage[ia] += (int32_t)((xb - xa) * POLYGON_COVERAGE_ONE + 0.5);
+        }
+        else
+        {
+            coverage[ia] += (int32_t)((ia + 1 - xa) * POLYGON_COVERAGE_ONE + 0.5);
+            spans[ia + 1] += POLYGON_COVERAGE_ONE;
+            spans[ib] -= POLYGON_COVERAGE_ONE;
+            coverage[ib] += (int32_t)((xb - ib) * POLYGON_COVERAGE_ONE + 0.5);
+        }
+        touchedMin = Min(touchedMin, ia);
+        touchedMax = Max(touchedMax, ib);
+    }
+
+    void FillPolygon(ColorBitmap& dest, ArrayView<Vec2d> points, Color color, FillRule rule, Allocator& allocator)
+    {
+        if (points.size < 3 || !dest.width || !dest.height)
+        {
+            return;
+        }
+
+        MemoryBlock edgeBlock = allocator.AllocateMemoryBlock(points.size * sizeof(PolygonEdge) * 2);
+        defer(allocator.FreeMemoryBlock(edgeBlock));
+        MemoryBlock coverageBlock = allocator.AllocateMemoryBlock((dest.width + 2) * sizeof(int32_t) * 2);
+        defer(allocator.FreeMemoryBlock(coverageBlock));
+        PolygonEdge* edges = (PolygonEdge*)edgeBlock.data;
+        PolygonEdge* active = edges + points.size;
+        int32_t* coverage = (int32_t*)coverageBlock.data;
+        int32_t* spans = coverage + dest.width + 2;
+
+        // edge table sorted by the top of the edges, horizontal edges never cross a sub-scanline.
+        size_t edgesCount = 0;
+        double minY = points.data[0].y;
+        double maxY = points.data[0].y;
+        for (size_t i = 0; i < points.size; ++i)
+        {
+            Vec2d a = points.data[i];
+            Vec2d b = points.data[(i + 1) % points.size];
+            minY = Min(minY, a.y);
+            maxY = Max(maxY, a.y);
+            if (a.y == b.y)
+            {
+                continue;
+            }
+            PolygonEdge e;
+            e.winding = 1;
+            if (a.y > b.y)
+            {
+                Swap(a, b);
+                e.winding = -1;
+            }
+            e.x0 = a.x;
+            e.x = a.x;
+            e.dxdy = (b.x - a.x) / (b.y - a.y);
+            e.yMin = a.y;
+            e.yMax = b.y;
+            edges[edgesCount++] = e;
+        }
+        QuickSort(edges, edgesCount, [](const PolygonEdge& a, const PolygonEdge& b)
+                  {
+                      return a.yMin < b.yMin;
+                  });
+
+        const int64_t firstRow = Max<int64_t>((int64_t)floor(minY), 0);
+        const int64_t lastRow = Min<int64_t>((int64_t)ceil(maxY), int64_t(dest.height) - 1);
+        const double width = double(dest.width);
+        if (dest.dirty)
+        {
+            double minX = points.data[0].x;
+            double maxX = points.data[0].x;
+            for (size_t i = 1; i < points.size; ++i)
+            {
+                minX = Min(minX, points.data[i].x);
+                maxX = Max(maxX, points.data[i].x);
+            }
+            MarkBitmapDirty(dest, (int64_t)floor(minX), firstRow, (int64_t)ceil(maxX) + 1, lastRow + 1);
+        }
+        size_t nextEdge = 0;
+        size_t activeCount = 0;
+        for (int64_t row = firstRow; row <= lastRow; ++row)
+        {
+            int64_t touchedMin = int64_t(dest.width);
+            int64_t touchedMax = -1;
+            for (int64_t s = 0; s < POLYGON_SUBSAMPLES; ++s)
+            {
+                const double y = row + (s + 0.5) / POLYGON_SUBSAMPLES;
+
+                // update the active edge table.
+                while (nextEdge < edgesCount && edges[nextEdge].yMin <= y)
+                {
+                    active[activeCount++] = edges[nextEdge++];
+                }
+                size_t kept = 0;
+                for (size_t i = 0; i < activeCount; ++i)
+                {
+                    if (active[i].yMax > y)
+                    {
+                        active[i].x = active[i].x0 + (y - active[i].yMin) * active[i].dxdy;
+                        active[kept++] = active[i];
+                    }
+                }
+                activeCount = kept;
+
+                // the list is almost sorted from the previous sub-scanline, insertion sort is linear then.
+                for (size_t i = 1; i < activeCount; ++i)
+                {
+                    for (size_t j = i; j > 0 && active[j].x < active[j - 1].x; --j)
+                    {
+                        Swap(active[j], active[j - 1]);
+                    }
+                }
+
+                int32_t winding = 0;
+                double spanStart = 0;
+                for (size_t i = 0; i < activeCount; ++i)
+                {
+                    const bool wasInside = (rule == FillRule::NON_ZERO) ? winding != 0 : (winding & 1) != 0;
+                    winding += active[i].winding;
+                    const bool isInside = (rule == FillRule::NON_ZERO) ? winding != 0 : (winding & 1) != 0;
+                    if (!wasInside && isInside)
+                    {
+                        spanStart = active[i].x;
+                    }
+                    else if (wasInside && !isInside)
+                    {
+                        AddPolygonSpan(coverage, spans, spanStart, active[i].x, width, touchedMin, touchedMax);
+                    }
+                }
+            }
+
+            // resolve the accumulated coverage of the row and clear the buffers for the next one.
+            Color* pixels = dest.data + row * dest.width;
+            int32_t run = 0;
+            for (int64_t x = touchedMin; x <= touchedMax; ++x)
+            {
+                run += spans[x];
+                const int32_t total = run + coverage[x];
+                spans[x] = 0;
+                coverage[x] = 0;
+                if (x < int64_t(dest.width) && total > 0)
+                {
+                    const int32_t full = POLYGON_SUBSAMPLES * POLYGON_COVERAGE_ONE;
+                    BlendPixel(pixels[x], color, (uint32_t)((Min(total, full) * 255 + full / 2) / full));
+                }
+            }
+        }
+    }
+
+    void BlendCoverage(Color* dest, const uint8_t* coverage, size_t count, Color color)
+    {
+        // integer blend written so the loop has no branches and vectorises.
+        const int32_t sr = color.r;
+        const int32_t sg = color.g;
+        const int32_t sb = color.b;
+        const int32_t sa = color.a;
+        for (size_t i = 0; i < count; ++i)
+        {
+            Color& d = dest[i];
+            const int32_t alpha = (sa * coverage[i] + 127) / 255;
+            d.r = (uint8_t)(d.r + ((sr - d.r) * alpha) / 255);
+            d.g = (uint8_t)(d.g + ((sg - d.g) * alpha) / 255);
+            d.b = (uint8_t)(d.b + ((sb - d.b) * alpha) / 255);
+            d.a = (uint8_t)(alpha + (d.a * (255 - alpha) + 127) / 255);
+        }
+    }
+
+    GlyphAtlas CreateGlyphAtlas(size_t width, size_t height, Allocator& allocator)
+    {
+        GlyphAtlas result;
+        result.bitmap = CreateBitmap(width, height, allocator);
+        result.skyline.allocator = &allocator;
+        result.glyphs.allocator = &allocator;
+        ClearGlyphAtlas(result);
+        return result;
+    }
+
+    void DestroyGlyphAtlas(GlyphAtlas& atlas, Allocator& allocator)
+    {
+        DestoryBitmap(atlas.bitmap, allocator);
+        if (atlas.skyline.block.data)
+        {
+            atlas.skyline.allocator->FreeMemoryBlock(atlas.skyline.block);
+        }
+        if (atlas.glyphs.block.data)
+        {
+            atlas.glyphs.allocator->FreeMemoryBlock(atlas.glyphs.block);
+        }
+        atlas.skyline.count = 0;
+        atlas.glyphs.count = 0;
+    }
+
+    void ClearGlyphAtlas(GlyphAtlas& atlas)
+    {
+        atlas.skyline.clear();
+        SkylineNode node;
+        node.width = atlas.bitmap.width;
+        atlas.skyline.push_back(node);
+        atlas.glyphs.clear();
+    }
+
+    // returns the y at which a rect of width x height fits when its left side is on skyline[index].
+    static bool FitSkyline(const GlyphAtlas& atlas, size_t index, size_t width, size_t height, size_t& y)
+    {
+        const SkylineNode* nodes = atlas.skyline.data();
+        if (nodes[index].x + width > atlas.bitmap.width)
+        {
+            return false;
+        }
+        y = nodes[index].y;
+        size_t widthLeft = width;
+        for (size_t i = index; widthLeft > 0; ++i)
+        {
+            y = Max(y, nodes[i].y);
+            if (y + height > atlas.bitmap.height)
+            {
+                return false;
+            }
+            widthLeft -= Min(widthLeft, nodes[i].width);
+        }
+        return true;
+    }
+
+    static bool PackSkyline(GlyphAtlas& atlas, size_t width, size_t height, size_t& x, size_t& y)
+    {
+        // bottom-left heuristic: lowest top edge first, then the narrowest node.
+        size_t bestIndex = atlas.skyline.size();
+        size_t bestTop = SIZE_MAX;
+        size_t bestWidth = SIZE_MAX;
+        for (size_t i = 0; i < atlas.skyline.size(); ++i)
+        {
+            size_t top = 0;
+            if (FitSkyline(atlas, i, width, height, top))
+            {
+                const size_t nodeWidth = atlas.skyline[i].width;
+                if (top + height < bestTop || (top + height == bestTop && nodeWidth < bestWidth))
+                {
+                    bestIndex = i;
+                    bestTop = top + height;
+                    bestWidth = nodeWidth;
+                    y = top;
+                }
+            }
+        }
+        if (bestIndex == atlas.skyline.size())
+        {
+            return false;
+        }
+        x = atlas.skyline[bestIndex].x;
+
+        // insert the new node and trim the ones it covers.
+        SkylineNode node;
+        node.x = x;
+        node.y = y + height;
+        node.width = width;
+        atlas.skyline.push_back(node);
+        SkylineNode* nodes = atlas.skyline.data();
+        for (size_t i = atlas.skyline.size() - 1; i > bestIndex; --i)
+        {
+            nodes[i] = nodes[i - 1];
+        }
+        nodes[bestIndex] = node;
+
+        size_t i = bestIndex + 1;
+        while (i < atlas.skyline.size())
+        {
+            const size_t previousEnd = nodes[i - 1].x + nodes[i - 1].width;
+            if (nodes[i].x >= previousEnd)
+            {
+                break;
+            }
+            const size_t shrink = previousEnd - nodes[i].x;
+            if (nodes[i].width > shrink)
+            {
+                nodes[i].x += shrink;
+                nodes[i].width -= shrink;
+                break;
+            }
+            for (size_t j = i; j + 1 < atlas.skyline.size(); ++j)
+            {
+                nodes[j] = nodes[j + 1];
+            }
+            atlas.skyline.pop_back();
+        }
+
+        // merge neighbours at the same height.
+        for (i = 0; i + 1 < atlas.skyline.size();)
+        {
+            if (nodes[i].y == nodes[i + 1].y)
+            {
+                nodes[i].width += nodes[i + 1].width;
+                for (size_t j = i + 1; j + 1 < atlas.skyline.size(); ++j)
+                {
+                    nodes[j] = nodes[j + 1];
+                }
+                atlas.skyline.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+        return true;
+    }
+
+    const Glyph* AddGlyph(GlyphAtlas& atlas, GlyphKey key, const Bitmap& mask, int32_t offsetX, int32_t offsetY, int32_t advance)
+    {
+        const Glyph* existing = atlas.glyphs.find(key);
+        if (existing)
+        {
+            return existing;
+        }
+        // one pixel of padding so filtered sampling of the atlas doesn't bleed between glyphs.
+        size_t x = 0;
+        size_t y = 0;
+        if (!PackSkyline(atlas, mask.width + 1, mask.height + 1, x, y))
+        {
+            return NULL;
+        }
+        for (size_t row = 0; row < mask.height; ++row)
+        {
+            GEDO_MEMCPY(atlas.bitmap.data + (y + row) * atlas.bitmap.width + x,
+                        mask.data + row * mask.width, mask.width);
+        }
+        Glyph glyph;
+        glyph.rect = Rect{ x, y, mask.width, mask.height };
+        glyph.offsetX = offsetX;
+        glyph.offsetY = offsetY;
+        glyph.advance = advance;
+        return &atlas.glyphs.insert(key, glyph);
+    }
+
+    const Glyph* FindGlyph(const GlyphAtlas& atlas, GlyphKey key)
+    {
+        return atlas.glyphs.find(key);
+    }
+
+    // decodes one utf8 codepoint, invalid bytes are returned as is.
+    static uint32_t DecodeUTF8(const char*& it, const char* end)
+    {
+        const uint8_t c = (uint8_t)*it++;
+        size_t extra = 0;
+        uint32_t codepoint = c;
+        if ((c & 0xE0) == 0xC0)
+        {
+            extra = 1;
+            codepoint = c & 0x1F;
+        }
+        else if ((c & 0xF0) == 0xE0)
+        {
+            extra = 2;
+            codepoint = c & 0x0F;
+        }
+        else if ((c & 0xF8) == 0xF0)
+        {
+            extra = 3;
+            codepoint = c & 0x07;
+        }
+        if (size_t(end - it) < extra)
+        {
+            return c;
+        }
+        for (size_t i = 0; i < extra; ++i)
+        {
+            codepoint = (codepoint << 6) | ((uint8_t)*it++ & 0x3F);
+        }
+        return codepoint;
+    }
+
+    int64_t DrawString(ColorBitmap& dest, const GlyphAtlas& atlas, uint32_t font, uint32_t size,
+                       StringView text, int64_t x, int64_t y, Color color)
+    {
+        GlyphKey key;
+        key.font = font;
+        key.size = size;
+        const char* it = text.begin();
+        while (it < text.end())
+        {
+            key.codepoint = DecodeUTF8(it, text.end());
+            const Glyph* glyph = atlas.glyphs.find(key);
+            if (!glyph)
+            {
+                continue;
+            }
+
+            // clip the glyph to the destination and blend it row by row.
+            const int64_t left = x + glyph->offsetX;
+            const int64_t top = y + glyph->offsetY;
+            const int64_t minX = Max<int64_t>(left, 0);
+            const int64_t minY = Max<int64_t>(top, 0);
+            const int64_t maxX = Min<int64_t>(left + glyph->rect.width, dest.width);
+            const int64_t maxY = Min<int64_t>(top + glyph->rect.height, dest.height);
+            MarkBitmapDirty(dest, minX, minY, maxX, maxY);
+            for (int64_t row = minY; row < maxY; ++row)
+            {
+                const uint8_t* coverage = atlas.bitmap.data +
+                    (glyph->rect.y + (row - top)) * atlas.bitmap.width + glyph->rect.x + (minX - left);
+                if (minX < maxX)
+                {
+                    BlendCoverage(dest.data + row * dest.width + minX, coverage, maxX - minX, color);
+                }
+            }
+            x += glyph->advance;
+        }
+        return x;
+    }
+    //-----------------------------------------------------------//
+
+    //--------------------------------File IO---------------------//
+#if defined GEDO_OS_WINDOWS
+    static MemoryBlock UTF8ToUTF16(const char* fileName, Allocator& allocator)
+    {
+        const size_t len = strlen(fileName);
+        const size_t wlen =
+            MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, fileName, len, NULL, 0);
+        MemoryBlock data =
+            allocator.AllocateMemoryBlock(sizeof(wchar_t) * (wlen + 1));
+        wchar_t* utf16 = (wchar_t*)data.data;
+        utf16[wlen] = 0;
+        MultiByteToWideChar(
+            CP_UTF8, MB_ERR_INVALID_CHARS, fileName, len, utf16, wlen);
+        return data;
+    }
+
+    static HANDLE GetFileHandle(const char* fileName, bool read, Allocator& allocator)
+    {
+        if (!fileName)
+        {
+            return NULL;
+        }
+        MemoryBlock utf16Memory = UTF8ToUTF16(fileName, allocator);
+        defer(allocator.FreeMemoryBlock(utf16Memory));
+        wchar_t* text = (wchar_t*)utf16Memory.data;
+        HANDLE handle = NULL;
+        if (read)
+        {
+            handle =
+                CreateFile(text,            // file to open
+                           GENERIC_READ,    // open for reading
+                           FILE_SHARE_READ, // share for reading
+                           NULL,            // default security
+                           OPEN_EXISTING,   // existing file only
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, // normal file
+                           NULL);
+        }
+        else
+        {
+            handle = CreateFile(text,                  // name of the write
+                                GENERIC_WRITE,         // open for writing
+                                0,                     // do not share
+                                NULL,                  // default security
+                                CREATE_NEW,            // create new file only
+                                FILE_ATTRIBUTE_NORMAL, // normal file
+                                NULL);
+        }
+        return handle;
+    }
+
+    MemoryBlock ReadFile(const char* fileName, Allocator& allocator)
+    {
+        MemoryBlock result;
+        const int64_t fileSize = GetFileSize(fileName);
+        if (fileSize < 0)
+        {
+            return result;
+        }
+        result = allocator.AllocateMemoryBlock(fileSize + 1);
+        HANDLE handle = GetFileHandle(fileName, true, allocator);
+        defer(CloseHandle(handle));
+        OVERLAPPED overlapped = {};
+        const bool success = ReadFileEx(handle,
+                                        result.data,
+                                        result.size - 1,
+                                        &overlapped,
+                                        NULL);
+        GEDO_ASSERT(success);
+        return result;
+    }
+
+    bool WriteFile(const char* fileName, MemoryBlock block, Allocator& allocator)
+    {
+        HANDLE handle = GetFileHandle(fileName, false, allocator);
+        if (handle)
+        {
+            defer(CloseHandle(handle));
+            OVERLAPPED overlapped = {};
+            return WriteFileEx(handle, block.data, block.size - 1, &overlapped, NULL);
+        }
+        return false;
+    }
+
+    bool DoesFileExist(const char* fileName, Allocator& allocator)
+    {
+        HANDLE handle = GetFileHandle(fileName, true, allocator);
+        const bool found = handle != INVALID_HANDLE_VALUE;
+        if (found)
+        {
+            CloseHandle(handle);
+        }
+        return found;
+    }
+
+    int64_t GetFileSize(const char* fileName, Allocator& allocator)
+    {
+        HANDLE handle = GetFileHandle(fileName, true, allocator);
+        const bool found = handle != INVALID_HANDLE_VALUE;
+        if (found)
+        {
+            LARGE_INTEGER size;
+            GetFileSizeEx(handle, &size);
+            CloseHandle(handle);
+            return size.QuadPart;
+        }
+        return -1;
+    }
+
+    PathType GetPathType(const char* path, Allocator& allocator)
+    {
+        HANDLE handle = GetFileHandle(path, true, allocator);
+        const bool found = handle != INVALID_HANDLE_VALUE;
+        if (found)
+        {
+            defer(CloseHandle(handle));
+            FILE_BASIC_INFO basicInfo;
+            GetFileInformationByHandleEx(handle, FileBasicInfo, &basicInfo, sizeof(basicInfo));
+            return (basicInfo.FileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                ? PathType::DIRECTORY
+                : PathType::FILE;
+        }
+        return PathType::FAILURE;
+    }
+    MappedFile MapFile(const char* fileName, Allocator& allocator)
+    {
+        MappedFile result;
+        result.file = GetFileHandle(fileName, true, allocator);
+        if (result.file == INVALID_HANDLE_VALUE || result.file == NULL)
+        {
+            result.file = INVALID_HANDLE_VALUE;
+            return result;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(result.file, &size) || size.QuadPart == 0)
+        {
+            UnmapFile(result);
+            return result;
+        }
+        result.mapping = CreateFileMapping(result.file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (result.mapping)
+        {
+            result.block.data = (uint8_t*)MapViewOfFile(result.mapping, FILE_MAP_READ, 0, 0, 0);
+            result.block.size = result.block.data ? (size_t)size.QuadPart : 0;
+        }
+        if (!result.block.data)
+        {
+            UnmapFile(result);
+        }
+        return result;
+    }
+
+    void UnmapFile(MappedFile& file)
+    {
+        if (file.block.data)
+        {
+            UnmapViewOfFile(file.block.data);
+        }
+        if (file.mapping)
+        {
+            CloseHandle(file.mapping);
+        }
+        if (file.file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file.file);
+        }
+        file = MappedFile{};
+    }
+
+    BufferedFileWriter CreateBufferedFileWriter(const char* fileName, size_t bufferSize, Allocator& allocator)
+    {
+        BufferedFileWriter result;
+        result.allocator = &allocator;
+        MemoryBlock utf16Memory = UTF8ToUTF16(fileName, allocator);
+        defer(allocator.FreeMemoryBlock(utf16Memory));
+        result.file = CreateFile((wchar_t*)utf16Memory.data, GENERIC_WRITE, 0, NULL,
+                                 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        result.failed = result.file == INVALID_HANDLE_VALUE;
+        if (!result.failed)
+        {
+            result.buffer = allocator.AllocateMemoryBlock(Max<size_t>(bufferSize, 4096));
+        }
+        return result;
+    }
+
+    static bool WriteFileHandle(HANDLE file, const uint8_t* data, size_t size)
+    {
+        while (size)
+        {
+            DWORD written = 0;
+            const DWORD chunk = (DWORD)Min<size_t>(size, 1u << 30);
+            if (!::WriteFile(file, data, chunk, &written, NULL) || !written)
+            {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    static void CloseFileHandle(BufferedFileWriter& writer)
+    {
+        if (writer.file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(writer.file);
+            writer.file = INVALID_HANDLE_VALUE;
+        }
+    }
+#elif defined GEDO_OS_LINUX
+    MemoryBlock ReadFile(const char* fileName, Allocator& allocator)
+    {
+        FILE* fp = fopen(fileName, "r");
+        MemoryBlock result;
+        if (fp)
+        {
+            fseek(fp, 0, SEEK_END);
+            const int64_t size = ftell(fp);
+            fseek(fp, 0, SEEK_SET);
+            result = allocator.AllocateMemoryBlock(size + 1);
+            fread(result.data, 1, size, fp);
+            result.data[size] = 0;
+            fclose(fp);
+        }
+        return result;
+    }
+
+    bool WriteFile(const char* fileName, MemoryBlock block, Allocator& allocator)
+    {
+        FILE* fp = fopen(fileName, "w");
+        MemoryBlock result;
+        if (fp)
+        {
+            fwrite(result.data, 1, result.size, fp);
+            fclose(fp);
+            return true;
+        }
+        return false;
+    }
+
+    bool DoesFileExist(const char* fileName, Allocator& allocator)
+    {
+        FILE* fp = fopen(fileName, "r");
+        if (fp)
+        {
+            fclose(fp);
+            return true;
+        }
+        return false;
+    }
+
+    int64_t GetFileSize(const char* fileName, Allocator& allocator)
+    {
+        FILE* fp = fopen(fileName, "r");
+        if (fp)
+        {
+            fseek(fp, 0, SEEK_END);
+            const int64_t size = ftell(fp);
+            fclose(fp);
+            return size;
+        }
+        return -1;
+    }
+
+    PathType GetPathType(const char* path, Allocator& allocator)
+    {
+        struct stat s;
+        if (stat(path, &s) == 0)
+        {
+            if (s.st_mode & S_IFDIR)
+            {
+                return PathType::DIRECTORY;
+            }
+            else if (s.st_mode & S_IFREG)
+            {
+                return PathType::FILE;
+            }
+        }
+        return PathType::FAILURE;
+    }
+
+    MappedFile MapFile(const char* fileName, Allocator& allocator)
+    {
+        (void)allocator; // only windows allocates, for the wide file name.
+        MappedFile result;
+        result.file = open(fileName, O_RDONLY);
+        if (result.file < 0)
+        {
+            return result;
+        }
+        struct stat s;
+        if (fstat(result.file, &s) != 0 || s.st_size == 0)
+        {
+            UnmapFile(result);
+            return result;
+        }
+        void* data = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, result.file, 0);
+        if (data == MAP_FAILED)
+        {
+            UnmapFile(result);
+            return result;
+        }
+        result.block.data = (uint8_t*)data;
+        result.block.size = s.st_size;
+        return result;
+    }
+
+    void UnmapFile(MappedFile& file)
+    {
+        if (file.block.data)
+        {
+            munmap(file.block.data, file.block.size);
+        }
+        if (file.file >= 0)
+        {
+            close(file.file);
+        }
+        file = MappedFile{};
+    }
+
+    BufferedFileWriter CreateBufferedFileWriter(const char* fileName, size_t bufferSize, Allocator& allocator)
+    {
+        BufferedFileWriter result;
+        result.allocator = &allocator;
+        result.file = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        result.failed = result.file < 0;
+        if (!result.failed)
+        {
+            result.buffer = allocator.AllocateMemoryBlock(Max<size_t>(bufferSize, 4096));
+        }
+        return result;
+    }
+
+    static bool WriteFileHandle(int file, const uint8_t* data, size_t size)
+    {
+        while (size)
+        {
+            const ssize_t written = write(file, data, size);
+            if (written <= 0)
+            {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    static void CloseFileHandle(BufferedFileWriter& writer)
+    {
+        if (writer.file >= 0)
+        {
+            close(writer.file);
+            writer.file = -1;
+        }
+    }
+#endif
+
+    bool FlushFileWriter(BufferedFileWriter& writer)
+    {
+        if (!writer.failed && writer.used)
+        {
+            writer.failed = !WriteFileHandle(writer.file, writer.buffer.data, writer.used);
+        }
+        writer.used = 0;
+        return !writer.failed;
+    }
+
+    bool WriteToFile(BufferedFileWriter& writer, const void* data, size_t size)
+    {
+        if (writer.failed)
+        {
+            return false;
+        }
+        if (writer.used + size > writer.buffer.size)
+        {
+            if (!FlushFileWriter(writer))
+            {
+                return false;
+            }
+            // big writes skip the buffer.
+            if (size >= writer.buffer.size)
+            {
+                writer.failed = !WriteFileHandle(writer.file, (const uint8_t*)data, size);
+                return !writer.failed;
+            }
+        }
+        GEDO_MEMCPY(writer.buffer.data + writer.used, data, size);
+        writer.used += size;
+        return true;
+    }
+
+    bool DestroyBufferedFileWriter(BufferedFileWriter& writer)
+    {
+        const bool success = FlushFileWriter(writer);
+        CloseFileHandle(writer);
+        if (writer.buffer.data)
+        {
+            writer.allocator->FreeMemoryBlock(writer.buffer);
+        }
+        return success;
+    }
+
+    bool HashFile(const char* fileName, uint64_t& hash, Allocator& allocator)
+    {
+        MappedFile file = MapFile(fileName, allocator);
+        defer(UnmapFile(file));
+        // empty files can't be mapped, they are told apart from the missing and unreadable ones.
+        if (!file.block.data && (GetPathType(fileName, allocator) != PathType::FILE || GetFileSize(fileName, allocator) != 0))
+        {
+            return false;
+        }
+        // blocks are hashed in parallel and then the block hashes, so the result doesn't depend on the cores count.
+        const size_t blockSize = 64 * 1024 * 1024;
+        const size_t blocksCount = (file.block.size + blockSize - 1) / blockSize;
+        MemoryBlock hashesBlock = allocator.AllocateMemoryBlock(Max<size_t>(blocksCount, 1) * sizeof(uint64_t));
+        defer(allocator.FreeMemoryBlock(hashesBlock));
+        uint64_t* hashes = (uint64_t*)hashesBlock.data;
+        ParallelFor(blocksCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            const size_t size = Min(blockSize, file.block.size - i * blockSize);
+                            hashes[i] = HashBytes(file.block.data + i * blockSize, size);
+                        }
+                    });
+        hash = HashBytes(hashes, blocksCount * sizeof(uint64_t), file.block.size);
+        return true;
+    }
+    //------------------------------------------------------------//
+
+    //------------------Strings----------------------------------//
+    static String CopyString(const char* string, size_t from, size_t to, Allocator& allocator)
+    {
+        String s;
+        s.allocator = &allocator;
+        s.reserve(to - from + 1);
+        for (size_t i = from; i < to; ++i)
+        {
+            s.append(string[i]);
+        }
+        return s;
+    }
+
+    size_t StringLength(const char* string)
+    {
+        size_t result = 0;
+        while (*string++)
+        {
+            result++;
+        }
+        return result;
+    }
+
+    const char* GetFileExtension(const char* string)
+    {
+        const size_t len = StringLength(string);
+        if (!len)
+        {
+            return NULL;
+        }
+
+        for (int64_t i = len - 1; i >= 0; --i)
+        {
+            if (string[i] == '.')
+            {
+                return string + i;
+            }
+        }
+        return NULL;
+    }
+
+    bool CompareStrings(const StringView str1, const StringView str2)
+    {
+        if (str1.size != str2.size)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < str1.size; ++i)
+        {
+            if (str1.data[i] != str2.data[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool CompareStrings(const char* str1, const char* str2)
+    {
+        const size_t len1 = StringLength(str1);
+        const size_t len2 = StringLength(str2);
+        if (len1 != len2)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < len1; ++i)
+        {
+            if (str1[i] != str2[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    String ConcatStrings(const String* strings, size_t stringsCount, char seperator)
+    {
+        const bool addSeperator = seperator != 0;
+        size_t resultSize = 0;
+        for (size_t i = 0; i < stringsCount; ++i)
+        {
+            resultSize += strings[i].size();
+        }
+        if (addSeperator)
+        {
+            resultSize += (stringsCount - 1);
+        }
+
+        String result;
+        result.reserve(resultSize);
+        for (size_t i = 0; i < stringsCount; ++i)
+        {
+            result.append(strings[i].data());
+            if (addSeperator && i != stringsCount - 1)
+            {
+                result.append(seperator);
+            }
+        }
+        return result;
+    }
+
+    StringView CreateStringView(const char* string)
+    {
+        StringView result;
+        result.data = string;
+        result.size = StringLength(string);
+        return result;
+    }
+
+    Array<StringView> SplitStringView(const char* string, char delim, Allocator& allocator)
+    {
+        Array<StringView> result;
+        result.allocator = &allocator;
+        const size_t len = StringLength(string);
+        size_t previousOffset = 0;
+        size_t i = 0;
+
+        size_t partsCount = 0;
+        while (i < len)
+        {
+            if (string[i] == delim)
+            {
+                if (i - previousOffset)
+                {
+                    partsCount++;
+                }
+                while (string[i] == delim && i < len)
+                {
+                    i++;
+                }
+                previousOffset = i;
+            }
+            else
+            {
+                i++;
+            }
+        }
+        if (i - previousOffset)
+        {
+            partsCount++;
+        }
+        result.reserve(partsCount);
+
+        previousOffset = 0;
+        i = 0;
+        while (i < len)
+        {
+            if (string[i] == delim)
+            {
+                const size_t slen = i - previousOffset;
+                if (slen)
+                {
+                    StringView l;
+                    l.data = string + previousOffset;
+                    l.size = slen;
+                    result.push_back(l);
+                }
+                while (string[i] == delim && i < len)
+                {
+                    i++;
+                }
+                previousOffset = i;
+            }
+            else
+            {
+                i++;
+            }
+        }
+        const size_t slen = i - previousOffset;
+        if (slen)
+        {
+            StringView l;
+            l.data = string + previousOffset;
+            l.size = slen;
+            result.push_back(l);
+        }
+        return result;
+    }
+
+    Array<String> SplitString(const char* string, char delim, Allocator& allocator)
+    {
+        Array<String> result;
+        result.allocator = &allocator;
+        const size_t len = StringLength(string);
+        size_t previousOffset = 0;
+        size_t i = 0;
+        size_t partsCount = 0;
+        while (i < len)
+        {
+            if (string[i] == delim)
+            {
+                if (i - previousOffset)
+                {
+                    partsCount++;
+                }
+                while (string[i] == delim && i < len)
+                {
+                    i++;
+                }
+                previousOffset = i;
+            }
+            else
+            {
+                i++;
+            }
+        }
+        if (i - previousOffset)
+        {
+            partsCount++;
+        }
+        result.reserve(partsCount);
+
+        i = 0;
+        previousOffset = 0;
         while (i < len)
         {
-            if (string[i] == delim)
+            if (string[i] == delim)
+            {
+                const size_t slen = i - previousOffset;
+                if (slen)
+                {
+                    String l = CopyString(string, previousOffset, i, allocator);
+                    result.push_back(l);
+                }
+                while (string[i] == delim && i < len)
+                {
+                    i++;
+                }
+                previousOffset = i;
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        const size_t slen = i - previousOffset;
+        if (slen)
+        {
+            String l = CopyString(string, previousOffset, i, allocator);
+            result.push_back(l);
+        }
+        return result;
+    }
+
+    Array<String> SplitStringIntoLines(const char* string, Allocator& allocator)
+    {
+        Array<String> result;
+        result.allocator = &allocator;
+        const size_t len = StringLength(string);
+        size_t partsCount = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (string[i] == '\n')
+            {
+                partsCount++;
+            }
+        }
+        result.reserve(partsCount);
+
+        size_t previousOffset = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (string[i] == '\n')
+            {
+                if (i - previousOffset)
+                {
+                    String l = CopyString(string, previousOffset, i, allocator);
+                    result.push_back(l);
+                }
+                previousOffset = i;
+            }
+        }
+        if (len - previousOffset)
+        {
+            String l = CopyString(string, previousOffset, len, allocator);
+            result.push_back(l);
+        }
+        return result;
+    }
+
+    Array<StringView> SplitStringViewIntoLines(const char* string, char delim, Allocator& allocator)
+    {
+        Array<StringView> result;
+        result.allocator = &allocator;
+        const size_t len = StringLength(string);
+        size_t partsCount = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (string[i] == '\n')
+            {
+                partsCount++;
+            }
+        }
+        result.reserve(partsCount);
+
+        size_t previousOffset = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (string[i] == '\n')
+            {
+                if (i - previousOffset)
+                {
+                    StringView l;
+                    l.data = string + previousOffset;
+                    l.size = i - previousOffset;
+                    result.push_back(l);
+                }
+                previousOffset = i;
+            }
+        }
+        if (len - previousOffset)
+        {
+            StringView l;
+            l.data = string + previousOffset;
+            l.size = len - previousOffset;
+            result.push_back(l);
+        }
+        return result;
+    }
+
+    bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+    }
+
+    const char* ParseDouble(const char* begin, const char* end, double& value)
+    {
+        static const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        // digits after the 19th don't fit in the mantissa and only scale it.
+        const uint64_t maxMantissa = 1000000000000000000ull;
+        const char* p = begin;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+        uint64_t mantissa = 0;
+        int32_t exponent = 0;
+        bool hasDigits = false;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            hasDigits = true;
+            if (mantissa < maxMantissa)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && IsDigit(*p); ++p)
+            {
+                hasDigits = true;
+                if (mantissa < maxMantissa)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    exponent--;
+                }
+            }
+        }
+        if (!hasDigits)
+        {
+            return NULL;
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* e = p + 1;
+            bool negativeExponent = false;
+            if (e < end && (*e == '-' || *e == '+'))
+            {
+                negativeExponent = *e == '-';
+                e++;
+            }
+            int32_t digitsExponent = 0;
+            const char* digitsBegin = e;
+            for (; e < end && IsDigit(*e); ++e)
+            {
+                digitsExponent = Min(digitsExponent * 10 + (*e - '0'), 100000);
+            }
+            // a lone 'e' isn't part of the number.
+            if (e != digitsBegin)
+            {
+                exponent += negativeExponent ? -digitsExponent : digitsExponent;
+                p = e;
+            }
+        }
+        double result = (double)mantissa;
+        if (exponent < 0)
+        {
+            result = (exponent >= -22) ? result / powersOf10[-exponent] : result * pow(10.0, exponent);
+        }
+        else if (exponent > 0)
+        {
+            result = (exponent <= 22) ? result * powersOf10[exponent] : result * pow(10.0, exponent);
+        }
+        value = negative ? -result : result;
+        return p;
+    }
+
+    const char* ParseInt64(const char* begin, const char* end, int64_t& value)
+    {
+        const char* p = begin;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+        const char* digitsBegin = p;
+        uint64_t result = 0;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            const uint64_t digit = *p - '0';
+            if (result > (UINT64_MAX - digit) / 10)
+            {
+                return NULL;
+            }
+            result = result * 10 + digit;
+        }
+        // the negative range has one more value than the positive one.
+        const uint64_t limit = negative ? uint64_t(INT64_MAX) + 1 : uint64_t(INT64_MAX);
+        if (p == digitsBegin || result > limit)
+        {
+            return NULL;
+        }
+        value = negative ? int64_t(0 - result) : int64_t(result);
+        return p;
+    }
+    //------------------------------------------------------------//
+
+    //--------------------UUID------------------------------------//
+#if defined (GEDO_OS_WINDOWS)
+    UUId GenerateUUID()
+    {
+        GUID uuid;
+        UuidCreate(&uuid);
+
+        UUId result
+        {
+            (uint8_t)((uuid.Data1 >> 24) & 0xFF),
+            (uint8_t)((uuid.Data1 >> 16) & 0xFF),
+            (uint8_t)((uuid.Data1 >> 8) & 0xFF),
+            (uint8_t)((uuid.Data1) & 0xff),
+
+            (uint8_t)((uuid.Data2 >> 8) & 0xFF),
+            (uint8_t)((uuid.Data2) & 0xff),
+
+            (uint8_t)((uuid.Data3 >> 8) & 0xFF),
+            (uint8_t)((uuid.Data3) & 0xFF),
+
+            (uint8_t)uuid.Data4[0],
+            (uint8_t)uuid.Data4[1],
+            (uint8_t)uuid.Data4[2],
+            (uint8_t)uuid.Data4[3],
+            (uint8_t)uuid.Data4[4],
+            (uint8_t)uuid.Data4[5],
+            (uint8_t)uuid.Data4[6],
+            (uint8_t)uuid.Data4[7]
+        };
+        return result;
+    }
+
+#elif defined (GEDO_OS_LINUX)
+    UUId GenerateUUID()
+    {
+        UUId result;
+        uuid_generate(result.data);
+        return result;
+    }
+#endif
+    bool CompareUUID(const UUId& a, const UUId& b)
+    {
+        for (size_t i = 0; i < 16; ++i)
+        {
+            if (a.data[i] != b.data[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    //------------------------------------------------------------//
+
+    //--------------------Math-----------------------------------//
+    Vec2d operator+(const Vec2d a, const Vec2d& b)
+    {
+        return Vec2d{ a.x + b.x, a.y + b.y };
+    }
+
+    Vec2d operator-(const Vec2d a, const Vec2d& b)
+    {
+        return Vec2d{ a.x - b.x, a.y - b.y };
+    }
+
+    Vec2d operator*(const Vec2d a, const Vec2d& b)
+    {
+        return Vec2d{ a.x * b.x, a.y * b.y };
+    }
+
+    Vec2d operator*(const Vec2d a, double x)
+    {
+        return Vec2d{ a.x * x, a.y * x };
+    }
+
+    Vec2d operator*(double x, const Vec2d a)
+    {
+        return Vec2d{ a.x * x, a.y * x };
+    }
+
+    Vec3d operator+(const Vec3d a, const Vec3d& b)
+    {
+        return Vec3d{ a.x + b.x, a.y + b.y, a.z + b.z };
+    }
+
+    Vec3d operator-(const Vec3d a, const Vec3d& b)
+    {
+        return Vec3d{ a.x - b.x, a.y - b.y, a.z - b.z };
+    }
+
+    Vec3d operator*(const Vec3d a, const Vec3d& b)
+    {
+        return Vec3d{ a.x * b.x, a.y * b.y, a.z * b.z };
+    }
+
+    Vec3d operator*(const Vec3d a, double x)
+    {
+        return Vec3d{ a.x * x, a.y * x, a.z * x };
+    }
+
+    Vec3d operator*(double x, const Vec3d a)
+    {
+        return Vec3d{ a.x * x, a.y * x, a.z * x };
+    }
+
+    double DotProduct(const Vec3d a, const Vec3d& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    double DotProduct(const Vec2d a, const Vec2d& b)
+    {
+        return a.x * b.x + a.y * b.y;
+    }
+
+    double DotProduct(const double a[4], const double b[4])
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    }
+
+    Mat4 operator*(const Mat4& left, const Mat4& right)
+    {
+        Mat4 result;
+        for (int columns = 0; columns < 4; ++columns)
+        {
+            for (int rows = 0; rows < 4; ++rows)
+            {
+                double sum = 0;
+                for (int currentMatrice = 0; currentMatrice < 4; ++currentMatrice)
+                {
+                    sum += left.elements[currentMatrice][rows] * right.elements[columns][currentMatrice];
+                }
+                result.elements[columns][rows] = sum;
+            }
+        }
+        return result;
+    }
+
+    Mat4 operator*(Mat4 left, double x)
+    {
+        for (int columns = 0; columns < 4; ++columns)
+        {
+            for (int rows = 0; rows < 4; ++rows)
+            {
+                left.elements[columns][rows] *= x;
+            }
+        }
+        return left;
+    }
+
+    Vec3d operator*(const Mat3 a, const Vec3d& v)
+    {
+        Vec3d r;
+        for (int rows = 0; rows < 3; ++rows)
+        {
+            double sum = 0;
+            for (int columns = 0; columns < 3; ++columns)
+            {
+                sum += a.elements[columns][rows] * v.data[columns];
+            }
+            r.data[rows] = sum;
+        }
+        return r;
+    }
+
+    Vec3d CrossProduct(const Vec3d a, const Vec3d& b)
+    {
+        return Vec3d{ a.y * b.z - a.z * b.y,
+                      a.z * b.x - a.x * b.z,
+                      a.x * b.y - a.y * b.x };
+    }
+
+    double Length(const Vec2d& v)
+    {
+        return sqrtf(v.x * v.x + v.y * v.y);
+    }
+
+    double Length(const Vec3d& v)
+    {
+        return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    }
+
+    void Normalise(Vec2d& v)
+    {
+        const double length = Length(v);
+        v.x /= length;
+        v.y /= length;
+    }
+
+    Vec2d Normalised(const Vec2d& v)
+    {
+        const double length = Length(v);
+        return Vec2d{ v.x / length, v.y / length };
+    }
+
+    void Normalise(Vec3d& v)
+    {
+        const double length = Length(v);
+        v.x /= length;
+        v.y /= length;
+        v.z /= length;
+    }
+
+    Vec3d Normalised(const Vec3d& v)
+    {
+        const double length = Length(v);
+        return Vec3d{ v.x / length, v.y / length, v.z / length };
+    }
+
+    Mat4 Transpose(Mat4 m)
+    {
+        Swap(m.elements[0][1], m.elements[1][0]);
+        Swap(m.elements[0][2], m.elements[2][0]);
+        Swap(m.elements[0][3], m.elements[3][0]);
+        Swap(m.elements[1][2], m.elements[2][1]);
+        Swap(m.elements[1][3], m.elements[3][1]);
+        Swap(m.elements[2][3], m.elements[3][2]);
+        return m;
+    }
+
+    Mat3 Transpose(Mat3 m)
+    {
+        Swap(m.elements[0][1], m.elements[1][0]);
+        Swap(m.elements[0][2], m.elements[2][0]);
+        Swap(m.elements[1][2], m.elements[2][1]);
+        return m;
+    }
+
+    Mat4 Translate(const Mat4& m, Vec3d translation)
+    {
+        Mat4 translate = Identity();
+        translate.elements[3][0] = translation.x;
+        translate.elements[3][1] = translation.y;
+        translate.elements[3][2] = translation.z;
+        return m * translate;
+    }
+
+    Mat4 Rotate(const Mat4& m, double angle, Vec3d axis)
+    {
+        const double sinTheta = sinf(angle);
+        const double cosTheta = cosf(angle);
+        const double cosValue = 1.0f - cosTheta;
+
+        Normalise(axis);
+        Mat4 rotate = Identity();
+
+        rotate.elements[0][0] = (axis.x * axis.x * cosValue) + cosTheta;
+        rotate.elements[0][1] = (axis.x * axis.y * cosValue) + (axis.z * sinTheta);
+        rotate.elements[0][2] = (axis.x * axis.z * cosValue) - (axis.y * sinTheta);
+
+        rotate.elements[1][0] = (axis.y * axis.x * cosValue) - (axis.z * sinTheta);
+        rotate.elements[1][1] = (axis.y * axis.y * cosValue) + cosTheta;
+        rotate.elements[1][2] = (axis.y * axis.z * cosValue) + (axis.x * sinTheta);
+
+        rotate.elements[2][0] = (axis.z * axis.x * cosValue) + (axis.y * sinTheta);
+        rotate.elements[2][1] = (axis.z * axis.y * cosValue) - (axis.x * sinTheta);
+        rotate.elements[2][2] = (axis.z * axis.z * cosValue) + cosTheta;
+
+        return m * rotate;
+    }
+
+    Mat4 Identity()
+    {
+        Mat4 m = { 0 };
+        m.elements[0][0] = m.elements[1][1] = m.elements[2][2] = m.elements[3][3] = 1.0f;
+        return m;
+    }
+
+    Mat4 LookAt(const Vec3d& eye, const Vec3d& center, const Vec3d& up)
+    {
+        const Vec3d f = Normalised(center - eye);
+        const Vec3d s = Normalised(CrossProduct(f, up));
+        const Vec3d u = CrossProduct(s, f);
+
+        Mat4 dest;
+        dest.elements[0][0] = s.x;
+        dest.elements[0][1] = u.x;
+        dest.elements[0][2] = -f.x;
+        dest.elements[0][3] = 0;
+
+        dest.elements[1][0] = s.y;
+        dest.elements[1][1] = u.y;
+        dest.elements[1][2] = -f.y;
+        dest.elements[1][3] = 0;
+
+        dest.elements[2][0] = s.z;
+        dest.elements[2][1] = u.z;
+        dest.elements[2][2] = -f.z;
+        dest.elements[2][3] = 0;
+
+        dest.elements[3][0] = -DotProduct(s, eye);
+        dest.elements[3][1] = -DotProduct(u, eye);
+        dest.elements[3][2] = DotProduct(f, eye);
+        dest.elements[3][3] = 1.0f;
+        return dest;
+    }
+
+    Mat4 Perspective(double fovy, double aspect, double zNear, double zFar)
+    {
+        const double f = 1.0f / tanf(fovy * 0.5f);
+        const double fn = 1.0f / (zNear - zFar);
+        Mat4 dest = { 0 };
+        dest.elements[0][0] = f / aspect;
+        dest.elements[1][1] = f;
+        dest.elements[2][2] = (zNear + zFar) * fn;
+        dest.elements[2][3] = -1.0f;
+        dest.elements[3][2] = 2.0f * zNear * zFar * fn;
+        return dest;
+    }
+
+    double Deg2Rad(double v)
+    {
+        return (PI / 180.0) * v;
+    }
+
+    double Rad2Deg(double v)
+    {
+        return (180.0 / PI) * v;
+    }
+    //----------------------------------------------------------//
+
+    //--------------------Geometry-------------------------------//
+    template<typename T>
+    static void FreeArray(Array<T>& array)
+    {
+        if (array.block.data)
+        {
+            array.allocator->FreeMemoryBlock(array.block);
+        }
+        array.count = 0;
+    }
+
+    MinMax<float> MinMaxRange(const float* values, size_t count)
+    {
+        GEDO_ASSERT(count);
+        MinMax<float> result = { values[0], values[0] };
+        size_t i = 0;
+#if defined __AVX2__
+        if (count >= 32)
+        {
+            // 4 independent accumulators hide the latency of min and max.
+            __m256 low[4];
+            __m256 high[4];
+            for (size_t k = 0; k < 4; ++k)
+            {
+                low[k] = _mm256_loadu_ps(values + k * 8);
+                high[k] = low[k];
+            }
+            for (i = 32; i + 32 <= count; i += 32)
+            {
+                for (size_t k = 0; k < 4; ++k)
+                {
+                    const __m256 v = _mm256_loadu_ps(values + i + k * 8);
+                    low[k] = _mm256_min_ps(low[k], v);
+                    high[k] = _mm256_max_ps(high[k], v);
+                }
+            }
+            const __m256 low8 = _mm256_min_ps(_mm256_min_ps(low[0], low[1]), _mm256_min_ps(low[2], low[3]));
+            const __m256 high8 = _mm256_max_ps(_mm256_max_ps(high[0], high[1]), _mm256_max_ps(high[2], high[3]));
+            float lows[8];
+            float highs[8];
+            _mm256_storeu_ps(lows, low8);
+            _mm256_storeu_ps(highs, high8);
+            for (size_t k = 0; k < 8; ++k)
+            {
+                result.min = Min(result.min, lows[k]);
+                result.max = Max(result.max, highs[k]);
+            }
+        }
+#endif // __AVX2__
+        for (; i < count; ++i)
+        {
+            result.min = Min(result.min, values[i]);
+            result.max = Max(result.max, values[i]);
+        }
+        return result;
+    }
+
+    MinMax<double> MinMaxRange(const double* values, size_t count)
+    {
+        GEDO_ASSERT(count);
+        MinMax<double> result = { values[0], values[0] };
+        size_t i = 0;
+#if defined __AVX2__
+        if (count >= 16)
+        {
+            __m256d low[4];
+            __m256d high[4];
+            for (size_t k = 0; k < 4; ++k)
+            {
+                low[k] = _mm256_loadu_pd(values + k * 4);
+                high[k] = low[k];
+            }
+            for (i = 16; i + 16 <= count; i += 16)
+            {
+                for (size_t k = 0; k < 4; ++k)
+                {
+                    const __m256d v = _mm256_loadu_pd(values + i + k * 4);
+                    low[k] = _mm256_min_pd(low[k], v);
+                    high[k] = _mm256_max_pd(high[k], v);
+                }
+            }
+            const __m256d low4 = _mm256_min_pd(_mm256_min_pd(low[0], low[1]), _mm256_min_pd(low[2], low[3]));
+            const __m256d high4 = _mm256_max_pd(_mm256_max_pd(high[0], high[1]), _mm256_max_pd(high[2], high[3]));
+            double lows[4];
+            double highs[4];
+            _mm256_storeu_pd(lows, low4);
+            _mm256_storeu_pd(highs, high4);
+            for (size_t k = 0; k < 4; ++k)
+            {
+                result.min = Min(result.min, lows[k]);
+                result.max = Max(result.max, highs[k]);
+            }
+        }
+#endif // __AVX2__
+        for (; i < count; ++i)
+        {
+            result.min = Min(result.min, values[i]);
+            result.max = Max(result.max, values[i]);
+        }
+        return result;
+    }
+
+    static Bounds ComputeBoundsRange(const Vec3d* points, size_t count)
+    {
+        Bounds result = { { { INFINITY, INFINITY, INFINITY } }, { { -INFINITY, -INFINITY, -INFINITY } } };
+        size_t i = 0;
+#if defined __AVX2__
+        if (count >= 4)
+        {
+            // 4 points are the 12 doubles x y z x | y z x y | z x y z, every load keeps its own accumulators
+            // so the lanes are only sorted by axis once at the end.
+            const double* data = points[0].data;
+            __m256d low[3];
+            __m256d high[3];
+            for (size_t k = 0; k < 3; ++k)
+            {
+                low[k] = _mm256_set1_pd(INFINITY);
+                high[k] = _mm256_set1_pd(-INFINITY);
+            }
+            for (; i + 4 <= count; i += 4)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    const __m256d v = _mm256_loadu_pd(data + i * 3 + k * 4);
+                    low[k] = _mm256_min_pd(low[k], v);
+                    high[k] = _mm256_max_pd(high[k], v);
+                }
+            }
+            double lows[12];
+            double highs[12];
+            for (size_t k = 0; k < 3; ++k)
+            {
+                _mm256_storeu_pd(lows + k * 4, low[k]);
+                _mm256_storeu_pd(highs + k * 4, high[k]);
+            }
+            for (size_t k = 0; k < 12; ++k)
+            {
+                result.min.data[k % 3] = Min(result.min.data[k % 3], lows[k]);
+                result.max.data[k % 3] = Max(result.max.data[k % 3], highs[k]);
+            }
+        }
+#endif // __AVX2__
+        for (; i < count; ++i)
+        {
+            for (size_t a = 0; a < 3; ++a)
+            {
+                result.min.data[a] = Min(result.min.data[a], points[i].data[a]);
+                result.max.data[a] = Max(result.max.data[a], points[i].data[a]);
+            }
+        }
+        return result;
+    }
+
+    Bounds ComputeBounds(ArrayView<Vec3d> points)
+    {
+        const size_t maxChunks = 64;
+        Bounds chunks[maxChunks];
+        const size_t chunksCount = Min<size_t>((points.size + MIN_MAX_BATCH - 1) / MIN_MAX_BATCH, maxChunks);
+        ParallelFor(chunksCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t c = begin; c < end; ++c)
+                        {
+                            const size_t first = points.size * c / chunksCount;
+                            const size_t last = points.size * (c + 1) / chunksCount;
+                            chunks[c] = ComputeBoundsRange(points.data + first, last - first);
+                        }
+                    });
+        Bounds result = { { { INFINITY, INFINITY, INFINITY } }, { { -INFINITY, -INFINITY, -INFINITY } } };
+        for (size_t c = 0; c < chunksCount; ++c)
+        {
+            for (size_t a = 0; a < 3; ++a)
+            {
+                result.min.data[a] = Min(result.min.data[a], chunks[c].min.data[a]);
+                result.max.data[a] = Max(result.max.data[a], chunks[c].max.data[a]);
+            }
+        }
+        return result;
+    }
+
+    TriangleMesh CreateTriangleMesh(size_t verticesCount, size_t trianglesCount, bool withNormals, bool withUVs, Allocator& allocator)
+    {
+        TriangleMesh result;
+        result.positions.allocator = &allocator;
+        result.normals.allocator = &allocator;
+        result.uvs.allocator = &allocator;
+        result.indices.allocator = &allocator;
+        result.twins.allocator = &allocator;
+        result.vertexHalfEdges.allocator = &allocator;
+        result.positions.resize(verticesCount);
+        if (withNormals)
+        {
+            result.normals.resize(verticesCount);
+        }
+        if (withUVs)
+        {
+            result.uvs.resize(verticesCount);
+        }
+        result.indices.resize(trianglesCount * 3);
+        return result;
+    }
+
+    void DestroyTriangleMesh(TriangleMesh& mesh)
+    {
+        FreeArray(mesh.positions);
+        FreeArray(mesh.normals);
+        FreeArray(mesh.uvs);
+        FreeArray(mesh.indices);
+        FreeArray(mesh.twins);
+        FreeArray(mesh.vertexHalfEdges);
+        mesh.nonManifoldEdges = 0;
+    }
+
+    uint32_t NextHalfEdge(uint32_t halfEdge)
+    {
+        return (halfEdge % 3 == 2) ? halfEdge - 2 : halfEdge + 1;
+    }
+
+    uint32_t PrevHalfEdge(uint32_t halfEdge)
+    {
+        return (halfEdge % 3 == 0) ? halfEdge + 2 : halfEdge - 1;
+    }
+
+    void BuildHalfEdges(TriangleMesh& mesh, Allocator& allocator)
+    {
+        const size_t halfEdgesCount = mesh.indices.size();
+        const uint32_t* indices = mesh.indices.data();
+        FreeArray(mesh.twins);
+        FreeArray(mesh.vertexHalfEdges);
+        mesh.twins.allocator = &allocator;
+        mesh.vertexHalfEdges.allocator = &allocator;
+        mesh.twins.resize(halfEdgesCount);
+        mesh.vertexHalfEdges.resize(mesh.positions.size());
+        GEDO_MEMSET(mesh.twins.data(), 0xff, halfEdgesCount * sizeof(uint32_t));
+        GEDO_MEMSET(mesh.vertexHalfEdges.data(), 0xff, mesh.positions.size() * sizeof(uint32_t));
+        mesh.nonManifoldEdges = 0;
+
+        // directed edge (from, to) -> the half edge still waiting for its twin, INVALID_INDEX once paired.
+        HashTable<uint64_t, uint32_t> edges;
+        edges.allocator = &allocator;
+        edges.reserve(halfEdgesCount);
+        uint32_t* twins = mesh.twins.data();
+        for (uint32_t halfEdge = 0; halfEdge < halfEdgesCount; ++halfEdge)
+        {
+            const uint32_t from = indices[halfEdge];
+            const uint32_t to = indices[NextHalfEdge(halfEdge)];
+            if (from == to)
+            {
+                mesh.nonManifoldEdges++;
+                continue;
+            }
+            uint32_t* twin = edges.find((uint64_t(to) << 32) | from);
+            if (twin && *twin != INVALID_INDEX)
+            {
+                twins[halfEdge] = *twin;
+                twins[*twin] = halfEdge;
+                *twin = INVALID_INDEX;
+                continue;
+            }
+            const uint64_t key = (uint64_t(from) << 32) | to;
+            if (twin || edges.find(key))
+            {
+                mesh.nonManifoldEdges++;
+                continue;
+            }
+            edges.insert(key, halfEdge);
+        }
+
+        // prefer the outgoing boundary half edge so one ring walks start at the boundary.
+        uint32_t* vertexHalfEdges = mesh.vertexHalfEdges.data();
+        for (uint32_t halfEdge = 0; halfEdge < halfEdgesCount; ++halfEdge)
+        {
+            uint32_t& outgoing = vertexHalfEdges[indices[halfEdge]];
+            if (outgoing == INVALID_INDEX || twins[halfEdge] == INVALID_INDEX)
+            {
+                outgoing = halfEdge;
+            }
+        }
+    }
+
+    bool IsBoundaryHalfEdge(const TriangleMesh& mesh, uint32_t halfEdge)
+    {
+        return mesh.twins[halfEdge] == INVALID_INDEX;
+    }
+
+    bool IsBoundaryVertex(const TriangleMesh& mesh, uint32_t vertex)
+    {
+        const uint32_t halfEdge = mesh.vertexHalfEdges[vertex];
+        return halfEdge != INVALID_INDEX && mesh.twins[halfEdge] == INVALID_INDEX;
+    }
+
+    uint32_t NextBoundaryHalfEdge(const TriangleMesh& mesh, uint32_t halfEdge)
+    {
+        // rotate clockwise around the end vertex until the outgoing half edge has no twin.
+        uint32_t next = NextHalfEdge(halfEdge);
+        size_t steps = mesh.twins.size();
+        while (mesh.twins[next] != INVALID_INDEX && --steps)
+        {
+            next = NextHalfEdge(mesh.twins[next]);
+        }
+        return next;
+    }
+
+    bool IsManifold(const TriangleMesh& mesh)
+    {
+        if (mesh.nonManifoldEdges)
+        {
+            return false;
+        }
+        // every half edge leaves exactly one vertex, if the fans reached from vertexHalfEdges cover all
+        // of them then no vertex has a second fan.
+        size_t fansSize = 0;
+        for (size_t vertex = 0; vertex < mesh.vertexHalfEdges.size(); ++vertex)
+        {
+            const uint32_t start = mesh.vertexHalfEdges[vertex];
+            if (start == INVALID_INDEX)
+            {
+                continue;
+            }
+            uint32_t halfEdge = start;
+            size_t steps = mesh.twins.size();
+            do
+            {
+                fansSize++;
+                halfEdge = mesh.twins[PrevHalfEdge(halfEdge)];
+            } while (halfEdge != INVALID_INDEX && halfEdge != start && --steps);
+        }
+        return fansSize == mesh.twins.size();
+    }
+
+    // binary STL: 80 bytes header, the triangles count then 50 bytes per triangle
+    // (normal and 3 vertices as little endian floats and a 16 bits attribute).
+    static const size_t STL_HEADER_SIZE = 84;
+    static const size_t STL_TRIANGLE_SIZE = 50;
+    static const size_t STL_MAX_CHUNKS = 256;
+
+    static bool IsBinarySTL(MemoryBlock data)
+    {
+        if (data.size < STL_HEADER_SIZE)
+        {
+            return false;
+        }
+        // ASCII files can't match the size exactly, binary files that start with "solid" do.
+        const size_t trianglesCount = ReadLittleEndian32(data.data + 80);
+        return STL_HEADER_SIZE + trianglesCount * STL_TRIANGLE_SIZE == data.size;
+    }
+
+    static bool ParseBinarySTL(MemoryBlock data, Array<Vec3d>& positions)
+    {
+        const size_t trianglesCount = ReadLittleEndian32(data.data + 80);
+        positions.resize(trianglesCount * 3);
+        Vec3d* dest = positions.data();
+        const uint8_t* triangles = data.data + STL_HEADER_SIZE;
+        ParallelFor(trianglesCount, 16 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            // skip the normal, it is recomputed from the vertices when needed.
+                            float v[9];
+                            GEDO_MEMCPY(v, triangles + i * STL_TRIANGLE_SIZE + 12, sizeof(v));
+                            for (size_t k = 0; k < 3; ++k)
+                            {
+                                dest[i * 3 + k] = Vec3d{ { v[k * 3], v[k * 3 + 1], v[k * 3 + 2] } };
+                            }
+                        }
+                    });
+        return true;
+    }
+
+    // the next "facet" keyword (not "endfacet") at or after p.
+    static const char* FindSTLFacet(const char* p, const char* begin, const char* end)
+    {
+        while (p + 5 <= end)
+        {
+            p = (const char*)memchr(p, 'f', end - p);
+            if (!p || p + 5 > end)
+            {
+                break;
+            }
+            if (p > begin && IsSpace(p[-1]) && memcmp(p, "facet", 5) == 0)
+            {
+                return p;
+            }
+            p++;
+        }
+        return end;
+    }
+
+    static inline const char* FindSTLVertex(const char* p, const char* end)
+    {
+        while (p + 6 <= end)
+        {
+            p = (const char*)memchr(p, 'v', end - p);
+            if (!p || p + 6 > end)
+            {
+                break;
+            }
+            if (memcmp(p, "vertex", 6) == 0)
+            {
+                return p;
+            }
+            p++;
+        }
+        return NULL;
+    }
+
+    // the file is split at facet boundaries, every chunk counts its vertices, a prefix sum gives each chunk
+    // its output range and then the chunks are parsed in place in parallel.
+    static bool ParseASCIISTL(MemoryBlock data, Array<Vec3d>& positions)
+    {
+        const char* text = (const char*)data.data;
+        const char* end = text + data.size;
+        // skip the "solid name" line.
+        const char* begin = (const char*)memchr(text, '\n', data.size);
+        if (!begin)
+        {
+            return true;
+        }
+        const size_t chunksCount = Clamp<size_t>(data.size / (1024 * 1024), 1, STL_MAX_CHUNKS);
+        const char* bounds[STL_MAX_CHUNKS + 1];
+        bounds[0] = begin;
+        for (size_t i = 1; i < chunksCount; ++i)
+        {
+            const char* guess = Max(text + i * (data.size / chunksCount), bounds[i - 1]);
+            bounds[i] = FindSTLFacet(guess, text, end);
+        }
+        bounds[chunksCount] = end;
+
+        size_t offsets[STL_MAX_CHUNKS + 1] = {};
+        ParallelFor(chunksCount, 1, [&](size_t first, size_t last)
+                    {
+                        for (size_t c = first; c < last; ++c)
+                        {
+                            size_t count = 0;
+                            for (const char* p = FindSTLVertex(bounds[c], bounds[c + 1]); p; p = FindSTLVertex(p + 6, bounds[c + 1]))
+                            {
+                                count++;
+                            }
+                            offsets[c + 1] = count;
+                        }
+                    });
+        for (size_t i = 0; i < chunksCount; ++i)
+        {
+            offsets[i + 1] += offsets[i];
+        }
+        if (offsets[chunksCount] % 3)
+        {
+            return false;
+        }
+
+        positions.resize(offsets[chunksCount]);
+        Vec3d* dest = positions.data();
+        bool failed[STL_MAX_CHUNKS] = {};
+        ParallelFor(chunksCount, 1, [&](size_t first, size_t last)
+                    {
+                        for (size_t c = first; c < last; ++c)
+                        {
+                            const char* chunkEnd = bounds[c + 1];
+                            size_t i = offsets[c];
+                            for (const char* p = FindSTLVertex(bounds[c], chunkEnd); p; p = FindSTLVertex(p, chunkEnd))
+                            {
+                                p += 6;
+                                for (size_t k = 0; k < 3 && p; ++k)
+                                {
+                                    while (p < chunkEnd && IsSpace(*p))
+                                    {
+                                        p++;
+                                    }
+                                    p = ParseDouble(p, chunkEnd, dest[i].data[k]);
+                                }
+                                if (!p)
+                                {
+                                    failed[c] = true;
+                                    break;
+                                }
+                                i++;
+                            }
+                        }
+                    });
+        for (size_t i = 0; i < chunksCount; ++i)
+        {
+            if (failed[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ParseSTL(MemoryBlock data, Array<Vec3d>& positions, Allocator& allocator)
+    {
+        FreeArray(positions);
+        positions.allocator = &allocator;
+        if (IsBinarySTL(data))
+        {
+            return ParseBinarySTL(data, positions);
+        }
+        if (data.size >= 5 && memcmp(data.data, "solid", 5) == 0)
+        {
+            return ParseASCIISTL(data, positions);
+        }
+        return false;
+    }
+
+    bool LoadSTL(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats, Allocator& allocator)
+    {
+        const Stopwatch stopwatch = StartStopwatch();
+        MappedFile file = MapFile(fileName, allocator);
+        defer(UnmapFile(file));
+        if (!file.block.data)
+        {
+            return false;
+        }
+        DestroyTriangleMesh(mesh);
+        mesh = CreateTriangleMesh(0, 0, false, false, allocator);
+        if (!ParseSTL(file.block, mesh.positions, allocator))
+        {
+            return false;
+        }
+        // STL doesn't share vertices, every corner gets its own.
+        mesh.indices.resize(mesh.positions.size());
+        uint32_t* indices = mesh.indices.data();
+        ParallelFor(mesh.indices.size(), 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            indices[i] = (uint32_t)i;
+                        }
+                    });
+        if (stats)
+        {
+            stats->bytes = file.block.size;
+            stats->seconds = GetElapsedSeconds(stopwatch);
+            stats->gigabytesPerSecond = (stats->seconds > 0.0) ? BytesToGigaBytes(file.block.size) / stats->seconds : 0.0;
+        }
+        return true;
+    }
+
+    static const size_t OBJ_MAX_CHUNKS = 256;
+
+    struct ObjCorner
+    {
+        uint32_t position;
+        uint32_t uv;
+        uint32_t normal;
+    };
+
+    static bool operator==(const ObjCorner& a, const ObjCorner& b)
+    {
+        return a.position == b.position && a.uv == b.uv && a.normal == b.normal;
+    }
+
+    // counts of one chunk in the count pass and the first index of the chunk after the prefix sum.
+    struct ObjCounts
+    {
+        size_t positions;
+        size_t uvs;
+        size_t normals;
+        size_t triangles;
+    };
+
+    static inline const char* SkipObjSpaces(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        {
+            p++;
+        }
+        return p;
+    }
+
+    // the keyword of the line, 'v', 't' (vt), 'n' (vn), 'f' or 0 for anything else, p is moved after it.
+    static inline char GetObjLineType(const char*& p, const char* end)
+    {
+        p = SkipObjSpaces(p, end);
+        char type = 0;
+        size_t length = 1;
+        if (p < end && *p == 'v')
+        {
+            type = 'v';
+            if (p + 1 < end && (p[1] == 't' || p[1] == 'n'))
+            {
+                type = p[1];
+                length = 2;
+            }
+        }
+        else if (p < end && *p == 'f')
+        {
+            type = 'f';
+        }
+        // the keyword must be followed by a space, e.g. "vp" isn't a vertex.
+        if (!type || p + length >= end || (p[length] != ' ' && p[length] != '\t'))
+        {
+            return 0;
+        }
+        p += length;
+        return type;
+    }
+
+    // one based, negative indices are relative to the count of elements defined before the line.
+    static inline bool ResolveObjIndex(int64_t index, size_t countSoFar, size_t total, uint32_t& result)
+    {
+        const int64_t resolved = (index > 0) ? index - 1 : int64_t(countSoFar) + index;
+        if (index == 0 || resolved < 0 || resolved >= int64_t(total))
+        {
+            return false;
+        }
+        result = (uint32_t)resolved;
+        return true;
+    }
+
+    static const char* ParseObjCorner(const char* p, const char* end, const ObjCounts& soFar, const ObjCounts& totals, ObjCorner& corner)
+    {
+        int64_t index = 0;
+        p = ParseInt64(p, end, index);
+        if (!p || !ResolveObjIndex(index, soFar.positions, totals.positions, corner.position))
+        {
+            return NULL;
+        }
+        corner.uv = INVALID_INDEX;
+        corner.normal = INVALID_INDEX;
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p != '/')
+            {
+                p = ParseInt64(p, end, index);
+                if (!p || !ResolveObjIndex(index, soFar.uvs, totals.uvs, corner.uv))
+                {
+                    return NULL;
+                }
+            }
+            if (p < end && *p == '/')
+            {
+                p = ParseInt64(p + 1, end, index);
+                if (!p || !ResolveObjIndex(index, soFar.normals, totals.normals, corner.normal))
+                {
+                    return NULL;
+                }
+            }
+        }
+        return p;
+    }
+
+    static size_t CountObjFaceCorners(const char* p, const char* end)
+    {
+        size_t count = 0;
+        for (p = SkipObjSpaces(p, end); p < end && *p != '#'; p = SkipObjSpaces(p, end))
+        {
+            count++;
+            while (p < end && !IsSpace(*p))
+            {
+                p++;
+            }
+        }
+        return count;
+    }
+
+    // calls func(line, lineEnd, type) for every v, vt, vn and f line of the chunk.
+    template<typename F>
+    static void ForEachObjLine(const char* begin, const char* end, F func)
+    {
+        StreamBuffer stream;
+        stream.data = begin;
+        stream.size = end - begin;
+        while (stream.cursor < stream.size)
+        {
+            const char* line = stream.data + stream.cursor;
+            const char* lineEnd = (const char*)memchr(line, '\n', stream.size - stream.cursor);
+            lineEnd = lineEnd ? lineEnd : end;
+            stream.cursor = (lineEnd - stream.data) + 1;
+            const char type = GetObjLineType(line, lineEnd);
+            if (type)
+            {
+                func(line, lineEnd, type);
+            }
+        }
+    }
+
+    // the file is split into line aligned chunks, a first parallel pass counts the elements of every chunk,
+    // a prefix sum turns the counts into each chunk's range in the output (and the base of its negative
+    // indices) and the second parallel pass parses every chunk directly into its range.
+    bool ParseOBJ(MemoryBlock data, ObjData& obj, Allocator& allocator)
+    {
+        FreeArray(obj.positions);
+        FreeArray(obj.uvs);
+        FreeArray(obj.normals);
+        FreeArray(obj.positionIndices);
+        FreeArray(obj.uvIndices);
+        FreeArray(obj.normalIndices);
+        obj.positions.allocator = &allocator;
+        obj.uvs.allocator = &allocator;
+        obj.normals.allocator = &allocator;
+        obj.positionIndices.allocator = &allocator;
+        obj.uvIndices.allocator = &allocator;
+        obj.normalIndices.allocator = &allocator;
+
+        const char* text = (const char*)data.data;
+        const char* end = text + data.size;
+        const size_t chunksCount = Clamp<size_t>(data.size / (1024 * 1024), 1, OBJ_MAX_CHUNKS);
+        const char* bounds[OBJ_MAX_CHUNKS + 1];
+        bounds[0] = text;
+        for (size_t i = 1; i < chunksCount; ++i)
+        {
+            const char* guess = Max(text + i * (data.size / chunksCount), bounds[i - 1]);
+            const char* newLine = (const char*)memchr(guess, '\n', end - guess);
+            bounds[i] = newLine ? newLine + 1 : end;
+        }
+        bounds[chunksCount] = end;
+
+        ObjCounts offsets[OBJ_MAX_CHUNKS + 1] = {};
+        ParallelFor(chunksCount, 1, [&](size_t first, size_t last)
+                    {
+                        for (size_t c = first; c < last; ++c)
+                        {
+                            ObjCounts counts = {};
+                            ForEachObjLine(bounds[c], bounds[c + 1], [&](const char* line, const char* lineEnd, char type)
+                                           {
+                                               switch (type)
+                                               {
+                                                   case 'v': counts.positions++; break;
+                                                   case 't': counts.uvs++; break;
+                                                   case 'n': counts.normals++; break;
+                                                   default:
+                                                   {
+                                                       const size_t corners = CountObjFaceCorners(line, lineEnd);
+                                                       counts.triangles += (corners > 2) ? corners - 2 : 0;
+                                                   }
+                                               }
+                                           });
+                            offsets[c + 1] = counts;
+                        }
+                    });
+        for (size_t i = 0; i < chunksCount; ++i)
+        {
+            offsets[i + 1].positions += offsets[i].positions;
+            offsets[i + 1].uvs += offsets[i].uvs;
+            offsets[i + 1].normals += offsets[i].normals;
+            offsets[i + 1].triangles += offsets[i].triangles;
+        }
+        const ObjCounts totals = offsets[chunksCount];
+        obj.positions.resize(totals.positions);
+        obj.uvs.resize(totals.uvs);
+        obj.normals.resize(totals.normals);
+        obj.positionIndices.resize(totals.triangles * 3);
+        obj.uvIndices.resize(totals.triangles * 3);
+        obj.normalIndices.resize(totals.triangles * 3);
+
+        bool failed[OBJ_MAX_CHUNKS] = {};
+        ParallelFor(chunksCount, 1, [&](size_t first, size_t last)
+                    {
+                        for (size_t c = first; c < last; ++c)
+                        {
+                            ObjCounts cursor = offsets[c];
+                            ForEachObjLine(bounds[c], bounds[c + 1], [&](const char* line, const char* lineEnd, char type)
+                                           {
+                                               if (failed[c])
+                                               {
+                                                   return;
+                                               }
+                                               double values[3] = {};
+                                               if (type != 'f')
+                                               {
+                                                   // uvs may omit v, extra values (w) are ignored.
+                                                   const size_t required = (type == 't') ? 1 : 3;
+                                                   const size_t count = (type == 't') ? 2 : 3;
+                                                   for (size_t k = 0; k < count; ++k)
+                                                   {
+                                                       const char* next = ParseDouble(SkipObjSpaces(line, lineEnd), lineEnd, values[k]);
+                                                       if (!next)
+                                                       {
+                                                           failed[c] = k < required;
+                                                           break;
+                                                       }
+                                                       line = next;
+                                                   }
+                                               }
+                                               switch (type)
+                                               {
+                                                   case 'v': obj.positions[cursor.positions++] = Vec3d{ { values[0], values[1], values[2] } }; break;
+                                                   case 't': obj.uvs[cursor.uvs++] = Vec2d{ { values[0], values[1] } }; break;
+                                                   case 'n': obj.normals[cursor.normals++] = Vec3d{ { values[0], values[1], values[2] } }; break;
+                                                   default:
+                                                   {
+                                                       // polygons are triangulated as a fan around their first corner.
+                                                       ObjCorner first = {};
+                                                       ObjCorner previous = {};
+                                                       size_t corners = 0;
+                                                       for (line = SkipObjSpaces(line, lineEnd); line < lineEnd && *line != '#'; line = SkipObjSpaces(line, lineEnd))
+                                                       {
+                                                           ObjCorner corner;
+                                                           line = ParseObjCorner(line, lineEnd, cursor, totals, corner);
+                                                           if (!line)
+                                                           {
+                                                               failed[c] = true;
+                                                               return;
+                                                           }
+                                                           if (corners >= 2)
+                                                           {
+                                                               const size_t i = cursor.triangles * 3;
+                                                               const ObjCorner triangle[3] = { first, previous, corner };
+                                                               for (size_t k = 0; k < 3; ++k)
+                                                               {
+                                                                   obj.positionIndices[i + k] = triangle[k].position;
+                                                                   obj.uvIndices[i + k] = triangle[k].uv;
+                                                                   obj.normalIndices[i + k] = triangle[k].normal;
+                                                               }
+                                                               cursor.triangles++;
+                                                           }
+                                                           first = corners ? first : corner;
+                                                           previous = corner;
+                                                           corners++;
+                                                       }
+                                                   }
+                                               }
+                                           });
+                        }
+                    });
+        for (size_t i = 0; i < chunksCount; ++i)
+        {
+            if (failed[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool LoadOBJ(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats, Allocator& allocator)
+    {
+        const Stopwatch stopwatch = StartStopwatch();
+        MappedFile file = MapFile(fileName, allocator);
+        defer(UnmapFile(file));
+        if (!file.block.data)
+        {
+            return false;
+        }
+        ObjData obj;
+        if (!ParseOBJ(file.block, obj, allocator))
+        {
+            return false;
+        }
+        DestroyTriangleMesh(mesh);
+        mesh = CreateTriangleMesh(0, 0, false, false, allocator);
+        if (!obj.uvs.size() && !obj.normals.size())
+        {
+            mesh.positions = static_cast<Array<Vec3d>&&>(obj.positions);
+            mesh.indices = static_cast<Array<uint32_t>&&>(obj.positionIndices);
+        }
+        else
+        {
+            // a TriangleMesh vertex owns one position, uv and normal so every distinct corner becomes a vertex.
+            const bool hasUVs = obj.uvs.size() != 0;
+            const bool hasNormals = obj.normals.size() != 0;
+            const size_t indicesCount = obj.positionIndices.size();
+            HashTable<ObjCorner, uint32_t> vertices;
+            vertices.allocator = &allocator;
+            vertices.reserve(obj.positions.size());
+            mesh.indices.resize(indicesCount);
+            for (size_t i = 0; i < indicesCount; ++i)
+            {
+                const ObjCorner corner = { obj.positionIndices[i], obj.uvIndices[i], obj.normalIndices[i] };
+                const uint32_t* vertex = vertices.find(corner);
+                if (vertex)
+                {
+                    mesh.indices[i] = *vertex;
+                    continue;
+                }
+                const uint32_t newVertex = (uint32_t)mesh.positions.size();
+                mesh.positions.push_back(obj.positions[corner.position]);
+                if (hasUVs)
+                {
+                    mesh.uvs.push_back((corner.uv != INVALID_INDEX) ? obj.uvs[corner.uv] : Vec2d{});
+                }
+                if (hasNormals)
+                {
+                    mesh.normals.push_back((corner.normal != INVALID_INDEX) ? obj.normals[corner.normal] : Vec3d{});
+                }
+                vertices.insert(corner, newVertex);
+                mesh.indices[i] = newVertex;
+            }
+        }
+        if (stats)
+        {
+            stats->bytes = file.block.size;
+            stats->seconds = GetElapsedSeconds(stopwatch);
+            stats->gigabytesPerSecond = (stats->seconds > 0.0) ? BytesToGigaBytes(file.block.size) / stats->seconds : 0.0;
+        }
+        return true;
+    }
+
+    static const char* PLY_TYPE_NAMES[][2] = { { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+                                               { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" } };
+
+    size_t GetPlyTypeSize(PlyType type)
+    {
+        static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+        return sizes[(size_t)type];
+    }
+
+    static bool TokenEquals(StringView token, const char* string)
+    {
+        const size_t length = StringLength(string);
+        return token.size == length && memcmp(token.data, string, length) == 0;
+    }
+
+    // the next space separated token of [p, end), empty at the end.
+    static StringView NextToken(const char*& p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+        {
+            p++;
+        }
+        StringView result;
+        result.data = p;
+        while (p < end && !IsSpace(*p))
+        {
+            p++;
+        }
+        result.size = p - result.data;
+        return result;
+    }
+
+    static bool ParsePlyType(StringView token, PlyType& type)
+    {
+        for (size_t i = 0; i < 8; ++i)
+        {
+            if (TokenEquals(token, PLY_TYPE_NAMES[i][0]) || TokenEquals(token, PLY_TYPE_NAMES[i][1]))
+            {
+                type = (PlyType)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void CopyPlyName(StringView token, char (&name)[64])
+    {
+        const size_t length = Min<size_t>(token.size, sizeof(name) - 1);
+        GEDO_MEMCPY(name, token.data, length);
+        name[length] = 0;
+    }
+
+    bool ParsePlyHeader(MemoryBlock data, PlyHeader& header, Allocator& allocator)
+    {
+        FreeArray(header.elements);
+        FreeArray(header.properties);
+        header.elements.allocator = &allocator;
+        header.properties.allocator = &allocator;
+        header.size = 0;
+        const char* text = (const char*)data.data;
+        const char* end = text + data.size;
+        const char* p = text;
+        if (!TokenEquals(NextToken(p, end), "ply"))
+        {
+            return false;
+        }
+        bool hasFormat = false;
+        while (p < end)
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+            if (!lineEnd)
+            {
+                return false;
+            }
+            const StringView keyword = NextToken(p, lineEnd);
+            if (TokenEquals(keyword, "format"))
+            {
+                const StringView format = NextToken(p, lineEnd);
+                hasFormat = true;
+                if (TokenEquals(format, "ascii"))
+                {
+                    header.format = PlyFormat::ASCII;
+                }
+                else if (TokenEquals(format, "binary_little_endian"))
+                {
+                    header.format = PlyFormat::BINARY_LITTLE_ENDIAN;
+                }
+                else if (TokenEquals(format, "binary_big_endian"))
+                {
+                    header.format = PlyFormat::BINARY_BIG_ENDIAN;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            else if (TokenEquals(keyword, "element"))
+            {
+                PlyElement element;
+                CopyPlyName(NextToken(p, lineEnd), element.name);
+                const StringView count = NextToken(p, lineEnd);
+                int64_t value = 0;
+                if (ParseInt64(count.data, count.data + count.size, value) != count.data + count.size || value < 0)
+                {
+                    return false;
+                }
+                element.count = (size_t)value;
+                element.firstProperty = header.properties.size();
+                header.elements.push_back(element);
+            }
+            else if (TokenEquals(keyword, "property"))
+            {
+                if (!header.elements.size())
+                {
+                    return false;
+                }
+                PlyProperty property;
+                StringView type = NextToken(p, lineEnd);
+                if (TokenEquals(type, "list"))
+                {
+                    property.isList = true;
+                    if (!ParsePlyType(NextToken(p, lineEnd), property.countType))
+                    {
+                        return false;
+                    }
+                    type = NextToken(p, lineEnd);
+                }
+                if (!ParsePlyType(type, property.type))
+                {
+                    return false;
+                }
+                CopyPlyName(NextToken(p, lineEnd), property.name);
+                header.properties.push_back(property);
+                header.elements[header.elements.size() - 1].propertiesCount++;
+            }
+            else if (TokenEquals(keyword, "end_header"))
+            {
+                header.size = (lineEnd - text) + 1;
+                break;
+            }
+            // comment, obj_info and empty lines are skipped.
+            p = lineEnd + 1;
+        }
+        if (!header.size || !hasFormat)
+        {
+            return false;
+        }
+
+        // record layouts and where every element starts, as long as the previous ones have fixed sizes.
+        // the counts are untrusted, every record takes at least its smallest size (one byte per value in
+        // ascii) so the counts that don't fit in the rest of the data are rejected before any allocation.
+        size_t offset = header.size;
+        size_t available = data.size - header.size;
+        for (size_t i = 0; i < header.elements.size(); ++i)
+        {
+            PlyElement& element = header.elements[i];
+            size_t stride = 0;
+            size_t minimumSize = 0;
+            bool variable = false;
+            for (size_t k = 0; k < element.propertiesCount; ++k)
+            {
+                PlyProperty& property = header.properties[element.firstProperty + k];
+                property.offset = stride;
+                variable |= property.isList;
+                stride += property.isList ? 0 : GetPlyTypeSize(property.type);
+                minimumSize += property.isList ? GetPlyTypeSize(property.countType) : GetPlyTypeSize(property.type);
+            }
+            if (header.format == PlyFormat::ASCII)
+            {
+                minimumSize = element.propertiesCount;
+            }
+            if (minimumSize && element.count > available / minimumSize)
+            {
+                return false;
+            }
+            available -= element.count * minimumSize;
+            element.stride = variable ? 0 : stride;
+            element.offset = (header.format != PlyFormat::ASCII) ? offset : SIZE_MAX;
+            offset = (element.stride && offset != SIZE_MAX) ? offset + element.stride * element.count : SIZE_MAX;
+        }
+        return true;
+    }
+
+    const PlyElement* FindPlyElement(const PlyHeader& header, const char* name)
+    {
+        for (size_t i = 0; i < header.elements.size(); ++i)
+        {
+            if (CompareStrings(header.elements[i].name, name))
+            {
+                return &header.elements[i];
+            }
+        }
+        return NULL;
+    }
+
+    const PlyProperty* FindPlyProperty(const PlyHeader& header, const PlyElement& element, const char* name)
+    {
+        for (size_t i = 0; i < element.propertiesCount; ++i)
+        {
+            const PlyProperty& property = header.properties[element.firstProperty + i];
+            if (CompareStrings(property.name, name))
+            {
+                return &property;
+            }
+        }
+        return NULL;
+    }
+
+    static bool IsLittleEndianHost()
+    {
+        const uint16_t one = 1;
+        uint8_t first = 0;
+        GEDO_MEMCPY(&first, &one, 1);
+        return first == 1;
+    }
+
+    // binary PLY values are swapped when the byte order of the file isn't the one of the host.
+    static bool NeedsPlySwap(const PlyHeader& header)
+    {
+        return (header.format == PlyFormat::BINARY_BIG_ENDIAN) == IsLittleEndianHost();
+    }
+
+    // the bytes are reversed in registers, the loop has no branches so compilers turn it into bswap.
+    template<typename TSource, typename TDest, bool swap>
+    static void CopyPlyColumn(const uint8_t* src, size_t stride, size_t count, TDest* dest, size_t destStride)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint8_t bytes[sizeof(TSource)];
+            GEDO_MEMCPY(bytes, src + i * stride, sizeof(TSource));
+            if (swap)
+            {
+                for (size_t k = 0; k < sizeof(TSource) / 2; ++k)
+                {
+                    Swap(bytes[k], bytes[sizeof(TSource) - 1 - k]);
+                }
+            }
+            TSource value;
+            GEDO_MEMCPY(&value, bytes, sizeof(TSource));
+            dest[i * destStride] = (TDest)value;
+        }
+    }
+
+    template<typename TSource, typename TDest>
+    static void CopyPlyColumn(const uint8_t* src, size_t stride, size_t count, bool swap, TDest* dest, size_t destStride)
+    {
+        if (swap)
+        {
+            CopyPlyColumn<TSource, TDest, true>(src, stride, count, dest, destStride);
+        }
+        else
+        {
+            CopyPlyColumn<TSource, TDest, false>(src, stride, count, dest, destStride);
+        }
+    }
+
+    template<typename TDest>
+    static void CopyPlyColumn(PlyType type, const uint8_t* src, size_t stride, size_t count, bool swap, TDest* dest, size_t destStride)
+    {
+        switch (type)
+        {
+            case PlyType::INT8: CopyPlyColumn<int8_t>(src, stride, count, swap, dest, destStride); break;
+            case PlyType::UINT8: CopyPlyColumn<uint8_t>(src, stride, count, swap, dest, destStride); break;
+            case PlyType::INT16: CopyPlyColumn<int16_t>(src, stride, count, swap, dest, destStride); break;
+            case PlyType::UINT16: CopyPlyColumn<uint16_t>(src, stride, count, swap, dest, destStride); break;
+            case PlyType::INT32: CopyPlyColumn<int32_t>(src, stride, count, swap, dest, destStride); break;
+            case PlyType::UINT32: CopyPlyColumn<uint32_t>(src, stride, count, swap, dest, destStride); break;
+            case PlyType::FLOAT32: CopyPlyColumn<float>(src, stride, count, swap, dest, destStride); break;
+            case PlyType::FLOAT64: CopyPlyColumn<double>(src, stride, count, swap, dest, destStride); break;
+        }
+    }
+
+    template<typename TDest>
+    static bool ReadPlyColumn(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                              size_t first, size_t count, TDest* dest, size_t destStride)
+    {
+        if (header.format == PlyFormat::ASCII || !element.stride || element.offset == SIZE_MAX || property.isList ||
+            first > element.count || count > element.count - first || element.offset > data.size ||
+            element.count > (data.size - element.offset) / element.stride)
+        {
+            return false;
+        }
+        const uint8_t* src = data.data + element.offset + first * element.stride + property.offset;
+        const bool swap = NeedsPlySwap(header);
+        ParallelFor(count, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        CopyPlyColumn(property.type, src + begin * element.stride, element.stride, end - begin, swap,
+                                      dest + begin * destStride, destStride);
+                    });
+        return true;
+    }
+
+    bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                         size_t first, size_t count, float* dest)
+    {
+        return ReadPlyColumn(data, header, element, property, first, count, dest, 1);
+    }
+
+    bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                         size_t first, size_t count, double* dest)
+    {
+        return ReadPlyColumn(data, header, element, property, first, count, dest, 1);
+    }
+
+    bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                         Array<float>& column, Allocator& allocator)
+    {
+        FreeArray(column);
+        column.allocator = &allocator;
+        column.resize(element.count);
+        return ReadPlyColumn(data, header, element, property, 0, element.count, column.data(), 1);
+    }
+
+    bool ReadPlyProperty(MemoryBlock data, const PlyHeader& header, const PlyElement& element, const PlyProperty& property,
+                         Array<double>& column, Allocator& allocator)
+    {
+        FreeArray(column);
+        column.allocator = &allocator;
+        column.resize(element.count);
+        return ReadPlyColumn(data, header, element, property, 0, element.count, column.data(), 1);
+    }
+
+    // returns false for negative, non finite or too large values, they are neither valid counts nor valid
+    // indices. float lists are allowed by the format so the value goes through a double.
+    static bool ReadPlyInteger(const uint8_t* p, PlyType type, bool swap, uint64_t& result)
+    {
+        double value = 0.0;
+        CopyPlyColumn(type, p, 0, 1, swap, &value, 1);
+        if (!(value >= 0.0 && value <= double(UINT32_MAX)))
+        {
+            return false;
+        }
+        result = (uint64_t)value;
+        return true;
+    }
+
+    bool ReadPlyTriangles(MemoryBlock data, const PlyHeader& header, Array<uint32_t>& indices, Allocator& allocator)
+    {
+        FreeArray(indices);
+        indices.allocator = &allocator;
+        const PlyElement* face = FindPlyElement(header, "face");
+        if (!face || header.format == PlyFormat::ASCII || face->offset == SIZE_MAX || face->offset > data.size)
+        {
+            return false;
+        }
+        // records without properties take no bytes, there is nothing to read whatever their count.
+        if (!face->propertiesCount)
+        {
+            return true;
+        }
+        const PlyElement* vertex = FindPlyElement(header, "vertex");
+        const size_t verticesCount = vertex ? vertex->count : 0;
+        const bool swap = NeedsPlySwap(header);
+        const uint8_t* end = data.data + data.size;
+        // face records have variable sizes, the first pass counts the triangles and checks the bounds.
+        for (size_t pass = 0; pass < 2; ++pass)
+        {
+            const uint8_t* p = data.data + face->offset;
+            size_t trianglesCount = 0;
+            // every record takes at least one bounds checked byte, so a truncated file ends the loop before
+            // the declared count does.
+            for (size_t i = 0; i < face->count; ++i)
+            {
+                for (size_t k = 0; k < face->propertiesCount; ++k)
+                {
+                    const PlyProperty& property = header.properties[face->firstProperty + k];
+                    const size_t itemSize = GetPlyTypeSize(property.type);
+                    if (!property.isList)
+                    {
+                        if (itemSize > size_t(end - p))
+                        {
+                            return false;
+                        }
+                        p += itemSize;
+                        continue;
+                    }
+                    const size_t countSize = GetPlyTypeSize(property.countType);
+                    if (countSize > size_t(end - p))
+                    {
+                        return false;
+                    }
+                    uint64_t itemsCount = 0;
+                    if (!ReadPlyInteger(p, property.countType, swap, itemsCount))
+                    {
+                        return false;
+                    }
+                    p += countSize;
+                    if (itemsCount > size_t(end - p) / itemSize)
+                    {
+                        return false;
+                    }
+                    const bool vertexIndices = CompareStrings(property.name, "vertex_indices") || CompareStrings(property.name, "vertex_index");
+                    if (vertexIndices && itemsCount > 2)
+                    {
+                        if (pass)
+                        {
+                            uint64_t first = 0;
+                            uint64_t previous = 0;
+                            if (!ReadPlyInteger(p, property.type, swap, first) || !ReadPlyInteger(p + itemSize, property.type, swap, previous))
+                            {
+                                return false;
+                            }
+                            for (size_t item = 2; item < itemsCount; ++item)
+                            {
+                                uint64_t current = 0;
+                                if (!ReadPlyInteger(p + item * itemSize, property.type, swap, current) ||
+                                    first >= verticesCount || previous >= verticesCount || current >= verticesCount)
+                                {
+                                    return false;
+                                }
+                                uint32_t* triangle = indices.data() + trianglesCount * 3;
+                                triangle[0] = (uint32_t)first;
+                                triangle[1] = (uint32_t)previous;
+                                triangle[2] = (uint32_t)current;
+                                previous = current;
+                                trianglesCount++;
+                            }
+                        }
+                        else
+                        {
+                            trianglesCount += itemsCount - 2;
+                        }
+                    }
+                    p += itemsCount * itemSize;
+                }
+            }
+            if (!pass)
+            {
+                indices.resize(trianglesCount * 3);
+            }
+        }
+        return true;
+    }
+
+    bool WritePly(BufferedFileWriter& writer, size_t verticesCount, ArrayView<PlyColumn> columns, ArrayView<uint32_t> triangles)
+    {
+        String text;
+        text.allocator = writer.allocator;
+        char line[128];
+        // the values are copied as they are in memory so the file declares the byte order of the host.
+        snprintf(line, sizeof(line), "ply\nformat %s 1.0\nelement vertex %zu\n",
+                 IsLittleEndianHost() ? "binary_little_endian" : "binary_big_endian", verticesCount);
+        text.append(line);
+        size_t recordSize = 0;
+        for (size_t i = 0; i < columns.size; ++i)
+        {
+            snprintf(line, sizeof(line), "property %s %s\n", PLY_TYPE_NAMES[(size_t)columns.data[i].type][0], columns.data[i].name);
+            text.append(line);
+            recordSize += GetPlyTypeSize(columns.data[i].type);
+        }
+        const size_t trianglesCount = triangles.size / 3;
+        if (trianglesCount)
+        {
+            snprintf(line, sizeof(line), "element face %zu\nproperty list uchar int vertex_indices\n", trianglesCount);
+            text.append(line);
+        }
+        text.append("end_header\n");
+        WriteToFile(writer, text.data(), text.size());
+
+        // records are interleaved in a small chunk, never for the whole element.
+        uint8_t chunk[16 * 1024];
+        size_t used = 0;
+        for (size_t i = 0; i < verticesCount; ++i)
+        {
+            if (used + recordSize > sizeof(chunk))
+            {
+                WriteToFile(writer, chunk, used);
+                used = 0;
+            }
+            for (size_t c = 0; c < columns.size; ++c)
+            {
+                const PlyColumn& column = columns.data[c];
+                const size_t size = GetPlyTypeSize(column.type);
+                const size_t stride = column.stride ? column.stride : size;
+                if (recordSize > sizeof(chunk))
+                {
+                    WriteToFile(writer, (const uint8_t*)column.data + i * stride, size);
+                    continue;
+                }
+                GEDO_MEMCPY(chunk + used, (const uint8_t*)column.data + i * stride, size);
+                used += size;
+            }
+        }
+        const size_t faceSize = 1 + 3 * sizeof(int32_t);
+        for (size_t i = 0; i < trianglesCount; ++i)
+        {
+            if (used + faceSize > sizeof(chunk))
+            {
+                WriteToFile(writer, chunk, used);
+                used = 0;
+            }
+            chunk[used] = 3;
+            GEDO_MEMCPY(chunk + used + 1, triangles.data + i * 3, 3 * sizeof(uint32_t));
+            used += faceSize;
+        }
+        WriteToFile(writer, chunk, used);
+        return !writer.failed;
+    }
+
+    bool LoadPLY(const char* fileName, TriangleMesh& mesh, MeshIOStats* stats, Allocator& allocator)
+    {
+        const Stopwatch stopwatch = StartStopwatch();
+        MappedFile file = MapFile(fileName, allocator);
+        defer(UnmapFile(file));
+        if (!file.block.data)
+        {
+            return false;
+        }
+        PlyHeader header;
+        if (!ParsePlyHeader(file.block, header, allocator))
+        {
+            return false;
+        }
+        const PlyElement* vertex = FindPlyElement(header, "vertex");
+        if (!vertex)
+        {
+            return false;
+        }
+        const char* positionNames[] = { "x", "y", "z" };
+        const char* normalNames[] = { "nx", "ny", "nz" };
+        const char* uvNames[][2] = { { "u", "v" }, { "s", "t" }, { "texture_u", "texture_v" } };
+        const PlyProperty* positions[3];
+        const PlyProperty* normals[3];
+        const PlyProperty* uvs[2] = {};
+        bool hasNormals = true;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            positions[i] = FindPlyProperty(header, *vertex, positionNames[i]);
+            normals[i] = FindPlyProperty(header, *vertex, normalNames[i]);
+            hasNormals &= normals[i] != NULL;
+            if (!positions[i])
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < 3 && !uvs[0]; ++i)
+        {
+            uvs[0] = FindPlyProperty(header, *vertex, uvNames[i][0]);
+            uvs[1] = FindPlyProperty(header, *vertex, uvNames[i][1]);
+            uvs[0] = uvs[1] ? uvs[0] : NULL;
+        }
+
+        DestroyTriangleMesh(mesh);
+        mesh = CreateTriangleMesh(vertex->count, 0, hasNormals, uvs[0] != NULL, allocator);
+        bool result = true;
+        for (size_t i = 0; i < 3 && vertex->count; ++i)
+        {
+            // the columns are copied straight into the x, y and z of the vectors.
+            result = result && ReadPlyColumn(file.block, header, *vertex, *positions[i], 0, vertex->count, mesh.positions.data()->data + i, 3);
+            if (hasNormals)
+            {
+                result = result && ReadPlyColumn(file.block, header, *vertex, *normals[i], 0, vertex->count, mesh.normals.data()->data + i, 3);
+            }
+        }
+        for (size_t i = 0; i < 2 && uvs[0] && vertex->count; ++i)
+        {
+            result = result && ReadPlyColumn(file.block, header, *vertex, *uvs[i], 0, vertex->count, mesh.uvs.data()->data + i, 2);
+        }
+        // point clouds have no faces.
+        if (result && FindPlyElement(header, "face"))
+        {
+            result = ReadPlyTriangles(file.block, header, mesh.indices, allocator);
+        }
+        if (stats)
+        {
+            stats->bytes = file.block.size;
+            stats->seconds = GetElapsedSeconds(stopwatch);
+            stats->gigabytesPerSecond = (stats->seconds > 0.0) ? BytesToGigaBytes(file.block.size) / stats->seconds : 0.0;
+        }
+        return result;
+    }
+
+    bool SavePLY(const char* fileName, const TriangleMesh& mesh, Allocator& allocator)
+    {
+        StaticArray<PlyColumn, 8> columns;
+        const char* names[] = { "x", "y", "z", "nx", "ny", "nz", "u", "v" };
+        const size_t verticesCount = mesh.positions.size();
+        const bool hasNormals = mesh.normals.size() == verticesCount && verticesCount;
+        const bool hasUVs = mesh.uvs.size() == verticesCount && verticesCount;
+        // an empty mesh still declares x, y and z so it loads back, its columns are never read.
+        const double* positions = verticesCount ? mesh.positions.data()->data : NULL;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            columns.push_back(PlyColumn{ names[i], PlyType::FLOAT64, positions ? positions + i : NULL, sizeof(Vec3d) });
+        }
+        for (size_t i = 0; i < 3 && hasNormals; ++i)
+        {
+            columns.push_back(PlyColumn{ names[3 + i], PlyType::FLOAT64, mesh.normals.data()->data + i, sizeof(Vec3d) });
+        }
+        for (size_t i = 0; i < 2 && hasUVs; ++i)
+        {
+            columns.push_back(PlyColumn{ names[6 + i], PlyType::FLOAT64, mesh.uvs.data()->data + i, sizeof(Vec2d) });
+        }
+        BufferedFileWriter writer = CreateBufferedFileWriter(fileName, 1024 * 1024, allocator);
+        if (writer.failed)
+        {
+            return false;
+        }
+        ArrayView<PlyColumn> columnsView;
+        columnsView.data = columns.data();
+        columnsView.size = columns.size();
+        ArrayView<uint32_t> triangles;
+        triangles.data = mesh.indices.data();
+        triangles.size = mesh.indices.size();
+        WritePly(writer, verticesCount, columnsView, triangles);
+        return DestroyBufferedFileWriter(writer);
+    }
+
+    // the on disk header, every section starts at a MESH_CACHE_ALIGNMENT aligned offset.
+    struct MeshCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t verticesCount;
+        uint64_t indicesCount;
+        uint64_t positionsOffset;
+        uint64_t normalsOffset; // 0 if the mesh has no normals.
+        uint64_t uvsOffset;     // 0 if the mesh has no uvs.
+        uint64_t indicesOffset;
+    };
+
+    // "GMSH", a cache written on a machine with the other endianness doesn't match.
+    static const uint32_t MESH_CACHE_MAGIC = 0x48534d47;
+    static const uint32_t MESH_CACHE_VERSION = 1;
+    static const size_t MESH_CACHE_ALIGNMENT = 64;
+
+    static size_t AlignSize(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool SaveMeshCache(const char* fileName, const TriangleMesh& mesh, uint64_t sourceHash, Allocator& allocator)
+    {
+        const size_t verticesCount = mesh.positions.size();
+        const bool hasNormals = mesh.normals.size() == verticesCount && verticesCount;
+        const bool hasUVs = mesh.uvs.size() == verticesCount && verticesCount;
+        MeshCacheHeader header = {};
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.verticesCount = verticesCount;
+        header.indicesCount = mesh.indices.size();
+        size_t offset = AlignSize(sizeof(MeshCacheHeader), MESH_CACHE_ALIGNMENT);
+        header.positionsOffset = offset;
+        offset = AlignSize(offset + verticesCount * sizeof(Vec3d), MESH_CACHE_ALIGNMENT);
+        if (hasNormals)
+        {
+            header.normalsOffset = offset;
+            offset = AlignSize(offset + verticesCount * sizeof(Vec3d), MESH_CACHE_ALIGNMENT);
+        }
+        if (hasUVs)
+        {
+            header.uvsOffset = offset;
+            offset = AlignSize(offset + verticesCount * sizeof(Vec2d), MESH_CACHE_ALIGNMENT);
+        }
+        header.indicesOffset = offset;
+
+        BufferedFileWriter writer = CreateBufferedFileWriter(fileName, 1024 * 1024, allocator);
+        if (writer.failed)
+        {
+            return false;
+        }
+        const uint8_t padding[MESH_CACHE_ALIGNMENT] = {};
+        size_t written = 0;
+        auto writeSection = [&](size_t sectionOffset, const void* data, size_t size)
+        {
+            WriteToFile(writer, padding, sectionOffset - written);
+            WriteToFile(writer, data, size);
+            written = sectionOffset + size;
+        };
+        writeSection(0, &header, sizeof(header));
+        writeSection(header.positionsOffset, mesh.positions.data(), verticesCount * sizeof(Vec3d));
+        if (hasNormals)
+        {
+            writeSection(header.normalsOffset, mesh.normals.data(), verticesCount * sizeof(Vec3d));
+        }
+        if (hasUVs)
+        {
+            writeSection(header.uvsOffset, mesh.uvs.data(), verticesCount * sizeof(Vec2d));
+        }
+        writeSection(header.indicesOffset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+        return DestroyBufferedFileWriter(writer);
+    }
+
+    bool LoadMeshCache(const char* fileName, MeshCache& cache, Allocator& allocator)
+    {
+        UnloadMeshCache(cache);
+        cache.file = MapFile(fileName, allocator);
+        const MemoryBlock data = cache.file.block;
+        MeshCacheHeader header;
+        if (!data.data || data.size < sizeof(header))
+        {
+            UnloadMeshCache(cache);
+            return false;
+        }
+        GEDO_MEMCPY(&header, data.data, sizeof(header));
+        // every section must be aligned and inside the file, the counts can't be trusted before that.
+        auto isValid = [&](uint64_t offset, uint64_t count, size_t elementSize)
+        {
+            return offset % MESH_CACHE_ALIGNMENT == 0 && offset <= data.size && count <= (data.size - offset) / elementSize;
+        };
+        const bool valid = header.magic == MESH_CACHE_MAGIC && header.version == MESH_CACHE_VERSION &&
+                           isValid(header.positionsOffset, header.verticesCount, sizeof(Vec3d)) &&
+                           (!header.normalsOffset || isValid(header.normalsOffset, header.verticesCount, sizeof(Vec3d))) &&
+                           (!header.uvsOffset || isValid(header.uvsOffset, header.verticesCount, sizeof(Vec2d))) &&
+                           isValid(header.indicesOffset, header.indicesCount, sizeof(uint32_t));
+        if (!valid)
+        {
+            UnloadMeshCache(cache);
+            return false;
+        }
+        // nothing is read or copied here, the pages are faulted in when the views are used.
+        cache.sourceHash = header.sourceHash;
+        cache.positions.data = (const Vec3d*)(data.data + header.positionsOffset);
+        cache.positions.size = header.verticesCount;
+        if (header.normalsOffset)
+        {
+            cache.normals.data = (const Vec3d*)(data.data + header.normalsOffset);
+            cache.normals.size = header.verticesCount;
+        }
+        if (header.uvsOffset)
+        {
+            cache.uvs.data = (const Vec2d*)(data.data + header.uvsOffset);
+            cache.uvs.size = header.verticesCount;
+        }
+        cache.indices.data = (const uint32_t*)(data.data + header.indicesOffset);
+        cache.indices.size = header.indicesCount;
+        return true;
+    }
+
+    void UnloadMeshCache(MeshCache& cache)
+    {
+        UnmapFile(cache.file);
+        cache = MeshCache{};
+    }
+
+    struct WeldCell
+    {
+        int64_t x;
+        int64_t y;
+        int64_t z;
+    };
+
+    static bool operator==(const WeldCell& a, const WeldCell& b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    static const size_t WELD_CHUNK_SIZE = 64 * 1024;
+
+    static WeldCell GetWeldCell(const Vec3d& p, double inverseCellSize)
+    {
+        return WeldCell{ (int64_t)floor(p.x * inverseCellSize), (int64_t)floor(p.y * inverseCellSize), (int64_t)floor(p.z * inverseCellSize) };
+    }
+
+    // the vertices of a cell are linked through next starting at heads[cell], the cells are 2 * epsilon wide
+    // so at most 2 cells per axis are within epsilon of p. returns the smallest matching vertex so the result
+    // doesn't depend on the table order.
+    static uint32_t FindWeldVertex(const Vec3d* positions, const HashTable<WeldCell, uint32_t>& heads, const uint32_t* next,
+                                   const Vec3d& p, double epsilon, double inverseCellSize)
+    {
+        const Vec3d offset = Vec3d{ { epsilon, epsilon, epsilon } };
+        const WeldCell minCell = GetWeldCell(p - offset, inverseCellSize);
+        const WeldCell maxCell = GetWeldCell(p + offset, inverseCellSize);
+        const double epsilonSquared = epsilon * epsilon;
+        uint32_t result = INVALID_INDEX;
+        for (int64_t z = minCell.z; z <= maxCell.z; ++z)
+        {
+            for (int64_t y = minCell.y; y <= maxCell.y; ++y)
+            {
+                for (int64_t x = minCell.x; x <= maxCell.x; ++x)
+                {
+                    const uint32_t* head = heads.find(WeldCell{ x, y, z });
+                    for (uint32_t v = head ? *head : INVALID_INDEX; v != INVALID_INDEX; v = next[v])
+                    {
+                        const Vec3d d = positions[v] - p;
+                        if (v < result && DotProduct(d, d) <= epsilonSquared)
+                        {
+                            result = v;
+                        }
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    static void InsertWeldVertex(HashTable<WeldCell, uint32_t>& heads, uint32_t* next, uint32_t vertex, const Vec3d& p, double inverseCellSize)
+    {
+        const WeldCell cell = GetWeldCell(p, inverseCellSize);
+        const uint32_t* head = heads.find(cell);
+        next[vertex] = head ? *head : INVALID_INDEX;
+        heads.insert(cell, vertex);
+    }
+
+    bool WeldVertices(ArrayView<Vec3d> positions, double epsilon, Array<Vec3d>& uniquePositions, Array<uint32_t>& indices, Allocator& allocator)
+    {
+        FreeArray(uniquePositions);
+        FreeArray(indices);
+        uniquePositions.allocator = &allocator;
+        indices.allocator = &allocator;
+        const size_t verticesCount = positions.size;
+        if (verticesCount >= INVALID_INDEX)
+        {
+            return false;
+        }
+        epsilon = Max(epsilon, 0.0);
+        const double inverseCellSize = (epsilon > 0.0) ? 0.5 / epsilon : 1.0;
+        const Vec3d* p = positions.data;
+
+        // groups[v] is the vertex v was merged into in its chunk, itself for the first vertex of a group.
+        MemoryBlock groupsBlock = allocator.AllocateMemoryBlock(Max<size_t>(verticesCount, 1) * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(groupsBlock));
+        MemoryBlock nextBlock = allocator.AllocateMemoryBlock(Max<size_t>(verticesCount, 1) * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(nextBlock));
+        uint32_t* groups = (uint32_t*)groupsBlock.data;
+        uint32_t* next = (uint32_t*)nextBlock.data;
+
+        // the allocator isn't thread safe, so every task gets a table allocated here that is big enough
+        // for a whole chunk and never grows inside the workers.
+        const size_t chunksCount = (verticesCount + WELD_CHUNK_SIZE - 1) / WELD_CHUNK_SIZE;
+        const size_t tasksCount = Min<size_t>(Min<size_t>(GetProcessorCount(), 64), chunksCount);
+        StaticArray<HashTable<WeldCell, uint32_t>, 64> tables;
+        tables.resize(tasksCount);
+        for (size_t t = 0; t < tasksCount; ++t)
+        {
+            tables[t].allocator = &allocator;
+            tables[t].reserve(Min(verticesCount, WELD_CHUNK_SIZE));
+        }
+        ParallelFor(tasksCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t t = begin; t < end; ++t)
+                        {
+                            HashTable<WeldCell, uint32_t>& heads = tables[t];
+                            for (size_t c = t * chunksCount / tasksCount; c < (t + 1) * chunksCount / tasksCount; ++c)
+                            {
+                                heads.clear();
+                                const size_t last = Min(verticesCount, (c + 1) * WELD_CHUNK_SIZE);
+                                for (size_t v = c * WELD_CHUNK_SIZE; v < last; ++v)
+                                {
+                                    const uint32_t match = FindWeldVertex(p, heads, next, p[v], epsilon, inverseCellSize);
+                                    groups[v] = (match != INVALID_INDEX) ? match : (uint32_t)v;
+                                    if (match == INVALID_INDEX)
+                                    {
+                                        InsertWeldVertex(heads, next, (uint32_t)v, p[v], inverseCellSize);
+                                    }
+                                }
+                            }
+                        }
+                    });
+
+        // merges the groups of all the chunks in input order, the chunk lists in next aren't needed anymore
+        // and next is reused for the merged table.
+        HashTable<WeldCell, uint32_t> heads;
+        heads.allocator = &allocator;
+        size_t uniqueCount = 0;
+        for (size_t v = 0; v < verticesCount; ++v)
+        {
+            if (groups[v] != v)
+            {
+                continue;
+            }
+            const uint32_t match = FindWeldVertex(p, heads, next, p[v], epsilon, inverseCellSize);
+            if (match != INVALID_INDEX)
+            {
+                groups[v] = match;
+            }
+            else
+            {
+                InsertWeldVertex(heads, next, (uint32_t)v, p[v], inverseCellSize);
+                uniqueCount++;
+            }
+        }
+
+        // a group is merged at most once, so the final vertex is at most 2 steps away. next now maps the
+        // first vertex of every merged group to its unique index.
+        uniquePositions.resize(uniqueCount);
+        uniqueCount = 0;
+        for (size_t v = 0; v < verticesCount; ++v)
+        {
+            if (groups[v] == v)
+            {
+                next[v] = (uint32_t)uniqueCount;
+                uniquePositions[uniqueCount++] = p[v];
+            }
+        }
+        indices.resize(verticesCount);
+        uint32_t* result = indices.data();
+        ParallelFor(verticesCount, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t v = begin; v < end; ++v)
+                        {
+                            result[v] = next[groups[groups[v]]];
+                        }
+                    });
+        return true;
+    }
+
+    bool WeldVertices(TriangleMesh& mesh, double epsilon, Allocator& allocator)
+    {
+        Array<Vec3d> positions;
+        Array<uint32_t> remap;
+        if (!WeldVertices(ArrayView<Vec3d>{ mesh.positions.data(), mesh.positions.size() }, epsilon, positions, remap, allocator))
+        {
+            return false;
+        }
+        // the unique vertices are in the order of their first vertex, which is never before them,
+        // so the attributes are compacted in place.
+        const size_t verticesCount = mesh.positions.size();
+        const bool hasNormals = mesh.normals.size() == verticesCount;
+        const bool hasUVs = mesh.uvs.size() == verticesCount;
+        size_t uniqueCount = 0;
+        for (size_t v = 0; v < verticesCount; ++v)
+        {
+            if (remap[v] != uniqueCount)
+            {
+                continue;
+            }
+            mesh.positions[uniqueCount] = mesh.positions[v];
+            if (hasNormals)
+            {
+                mesh.normals[uniqueCount] = mesh.normals[v];
+            }
+            if (hasUVs)
+            {
+                mesh.uvs[uniqueCount] = mesh.uvs[v];
+            }
+            uniqueCount++;
+        }
+        mesh.positions.resize(uniqueCount);
+        if (hasNormals)
+        {
+            mesh.normals.resize(uniqueCount);
+        }
+        if (hasUVs)
+        {
+            mesh.uvs.resize(uniqueCount);
+        }
+        uint32_t* indices = mesh.indices.data();
+        const uint32_t* r = remap.data();
+        ParallelFor(mesh.indices.size(), 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            indices[i] = r[indices[i]];
+                        }
+                    });
+        FreeArray(mesh.twins);
+        FreeArray(mesh.vertexHalfEdges);
+        mesh.nonManifoldEdges = 0;
+        return true;
+    }
+
+    void BuildVertexCorners(const TriangleMesh& mesh, VertexCorners& vertexCorners, Allocator& allocator)
+    {
+        DestroyVertexCorners(vertexCorners);
+        vertexCorners.offsets.allocator = &allocator;
+        vertexCorners.corners.allocator = &allocator;
+        const size_t verticesCount = mesh.positions.size();
+        const size_t cornersCount = mesh.indices.size();
+        // counting sort of the corners by vertex, the arrays come zeroed from the allocator.
+        vertexCorners.offsets.resize(verticesCount + 1);
+        vertexCorners.corners.resize(cornersCount);
+        uint32_t* offsets = vertexCorners.offsets.data();
+        uint32_t* corners = vertexCorners.corners.data();
+        const uint32_t* indices = mesh.indices.data();
+        for (size_t i = 0; i < cornersCount; ++i)
+        {
+            offsets[indices[i] + 1]++;
+        }
+        for (size_t v = 0; v < verticesCount; ++v)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+        // offsets[v] is used as the cursor of v, which leaves it at the start of v + 1, shifting back restores it.
+        for (size_t i = 0; i < cornersCount; ++i)
+        {
+            corners[offsets[indices[i]]++] = (uint32_t)i;
+        }
+        for (size_t v = verticesCount; v > 0; --v)
+        {
+            offsets[v] = offsets[v - 1];
+        }
+        offsets[0] = 0;
+    }
+
+    void DestroyVertexCorners(VertexCorners& vertexCorners)
+    {
+        FreeArray(vertexCorners.offsets);
+        FreeArray(vertexCorners.corners);
+    }
+
+    // Length and Normalise go through sqrtf, the normals need the full precision.
+    static Vec3d NormalisedOrZero(const Vec3d& v)
+    {
+        const double length = sqrt(DotProduct(v, v));
+        return (length > 0.0) ? v * (1.0 / length) : Vec3d{};
+    }
+
+#if defined __AVX2__
+    // one triangle per register (x, y, z and an unused lane), the cross product is done by permuting the lanes
+    // so the vertices are loaded without gathers. same operations as CrossProduct(p1 - p0, p2 - p0).
+    static size_t ComputeFaceNormalsAVX2(const Vec3d* positions, const uint32_t* indices, size_t count, Vec3d* faceNormals)
+    {
+        const __m256i xyz = _mm256_setr_epi64x(-1, -1, -1, 0);
+        for (size_t t = 0; t < count; ++t)
+        {
+            const __m256d p0 = _mm256_maskload_pd(positions[indices[t * 3]].data, xyz);
+            const __m256d a = _mm256_sub_pd(_mm256_maskload_pd(positions[indices[t * 3 + 1]].data, xyz), p0);
+            const __m256d b = _mm256_sub_pd(_mm256_maskload_pd(positions[indices[t * 3 + 2]].data, xyz), p0);
+            const __m256d ayzx = _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 0, 2, 1));
+            const __m256d bzxy = _mm256_permute4x64_pd(b, _MM_SHUFFLE(3, 1, 0, 2));
+            const __m256d azxy = _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 1, 0, 2));
+            const __m256d byzx = _mm256_permute4x64_pd(b, _MM_SHUFFLE(3, 0, 2, 1));
+            _mm256_maskstore_pd(faceNormals[t].data, xyz, _mm256_sub_pd(_mm256_mul_pd(ayzx, bzxy), _mm256_mul_pd(azxy, byzx)));
+        }
+        return count;
+    }
+#endif // __AVX2__
+
+    void ComputeVertexNormals(TriangleMesh& mesh, const VertexCorners& vertexCorners, Allocator& allocator)
+    {
+        const size_t verticesCount = mesh.positions.size();
+        const size_t trianglesCount = mesh.indices.size() / 3;
+        MemoryBlock faceNormalsBlock = allocator.AllocateMemoryBlock(Max<size_t>(trianglesCount, 1) * sizeof(Vec3d));
+        defer(allocator.FreeMemoryBlock(faceNormalsBlock));
+        Vec3d* faceNormals = (Vec3d*)faceNormalsBlock.data;
+        const Vec3d* positions = mesh.positions.data();
+        const uint32_t* indices = mesh.indices.data();
+        // the cross product is twice the area, so the normals are area weighted by not normalising them.
+        ParallelFor(trianglesCount, 16 * 1024, [&](size_t begin, size_t end)
+                    {
+                        size_t t = begin;
+#if defined __AVX2__
+                        t += ComputeFaceNormalsAVX2(positions, indices + begin * 3, end - begin, faceNormals + begin);
+#endif // __AVX2__
+                        for (; t < end; ++t)
+                        {
+                            const Vec3d& p0 = positions[indices[t * 3]];
+                            faceNormals[t] = CrossProduct(positions[indices[t * 3 + 1]] - p0, positions[indices[t * 3 + 2]] - p0);
+                        }
+                    });
+        mesh.normals.resize(verticesCount);
+        Vec3d* normals = mesh.normals.data();
+        const uint32_t* offsets = vertexCorners.offsets.data();
+        const uint32_t* corners = vertexCorners.corners.data();
+        ParallelFor(verticesCount, 16 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t v = begin; v < end; ++v)
+                        {
+                            Vec3d normal = {};
+                            for (uint32_t c = offsets[v]; c < offsets[v + 1]; ++c)
+                            {
+                                normal = normal + faceNormals[corners[c] / 3];
+                            }
+                            normals[v] = NormalisedOrZero(normal);
+                        }
+                    });
+    }
+
+    void ComputeVertexNormals(TriangleMesh& mesh, Allocator& allocator)
+    {
+        VertexCorners vertexCorners;
+        BuildVertexCorners(mesh, vertexCorners, allocator);
+        defer(DestroyVertexCorners(vertexCorners));
+        ComputeVertexNormals(mesh, vertexCorners, allocator);
+    }
+
+    bool ComputeVertexTangents(const TriangleMesh& mesh, const VertexCorners& vertexCorners, Array<Vec3d>& tangents, Array<double>& signs, Allocator& allocator)
+    {
+        const size_t verticesCount = mesh.positions.size();
+        if (mesh.normals.size() != verticesCount || mesh.uvs.size() != verticesCount)
+        {
+            return false;
+        }
+        const size_t trianglesCount = mesh.indices.size() / 3;
+        // the tangent and bitangent of every face, zero for faces with a degenerate uv mapping.
+        MemoryBlock faceFramesBlock = allocator.AllocateMemoryBlock(Max<size_t>(trianglesCount, 1) * 2 * sizeof(Vec3d));
+        defer(allocator.FreeMemoryBlock(faceFramesBlock));
+        Vec3d* faceFrames = (Vec3d*)faceFramesBlock.data;
+        const Vec3d* positions = mesh.positions.data();
+        const Vec3d* normals = mesh.normals.data();
+        const Vec2d* uvs = mesh.uvs.data();
+        const uint32_t* indices = mesh.indices.data();
+        ParallelFor(trianglesCount, 16 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t t = begin; t < end; ++t)
+                        {
+                            const uint32_t i0 = indices[t * 3];
+                            const uint32_t i1 = indices[t * 3 + 1];
+                            const uint32_t i2 = indices[t * 3 + 2];
+                            const Vec3d e1 = positions[i1] - positions[i0];
+                            const Vec3d e2 = positions[i2] - positions[i0];
+                            const Vec2d d1 = uvs[i1] - uvs[i0];
+                            const Vec2d d2 = uvs[i2] - uvs[i0];
+                            const double determinant = d1.x * d2.y - d2.x * d1.y;
+                            if (determinant == 0.0)
+                            {
+                                faceFrames[t * 2] = Vec3d{};
+                                faceFrames[t * 2 + 1] = Vec3d{};
+                                continue;
+                            }
+                            const double r = 1.0 / determinant;
+                            faceFrames[t * 2] = (e1 * d2.y - e2 * d1.y) * r;
+                            faceFrames[t * 2 + 1] = (e2 * d1.x - e1 * d2.x) * r;
+                        }
+                    });
+
+        FreeArray(tangents);
+        FreeArray(signs);
+        tangents.allocator = &allocator;
+        signs.allocator = &allocator;
+        tangents.resize(verticesCount);
+        signs.resize(verticesCount);
+        Vec3d* resultTangents = tangents.data();
+        double* resultSigns = signs.data();
+        const uint32_t* offsets = vertexCorners.offsets.data();
+        const uint32_t* corners = vertexCorners.corners.data();
+        ParallelFor(verticesCount, 16 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t v = begin; v < end; ++v)
+                        {
+                            const Vec3d& n = normals[v];
+                            Vec3d tangent = {};
+                            Vec3d bitangent = {};
+                            for (uint32_t c = offsets[v]; c < offsets[v + 1]; ++c)
+                            {
+                                const uint32_t corner = corners[c];
+                                const uint32_t t = corner / 3;
+                                const Vec3d& p = positions[v];
+                                const Vec3d a = NormalisedOrZero(positions[indices[NextHalfEdge(corner)]] - p);
+                                const Vec3d b = NormalisedOrZero(positions[indices[PrevHalfEdge(corner)]] - p);
+                                const double angle = acos(Clamp(DotProduct(a, b), -1.0, 1.0));
+                                const Vec3d& faceTangent = faceFrames[t * 2];
+                                const Vec3d& faceBitangent = faceFrames[t * 2 + 1];
+                                tangent = tangent + NormalisedOrZero(faceTangent - n * DotProduct(n, faceTangent)) * angle;
+                                bitangent = bitangent + NormalisedOrZero(faceBitangent - n * DotProduct(n, faceBitangent)) * angle;
+                            }
+                            tangent = NormalisedOrZero(tangent - n * DotProduct(n, tangent));
+                            resultTangents[v] = tangent;
+                            resultSigns[v] = (DotProduct(CrossProduct(n, tangent), bitangent) < 0.0) ? -1.0 : 1.0;
+                        }
+                    });
+        return true;
+    }
+
+    bool ComputeVertexTangents(const TriangleMesh& mesh, Array<Vec3d>& tangents, Array<double>& signs, Allocator& allocator)
+    {
+        VertexCorners vertexCorners;
+        BuildVertexCorners(mesh, vertexCorners, allocator);
+        defer(DestroyVertexCorners(vertexCorners));
+        return ComputeVertexTangents(mesh, vertexCorners, tangents, signs, allocator);
+    }
+
+    static const size_t RADIX_SORT_MAX_CHUNKS = 64;
+    static const size_t RADIX_SORT_MIN_CHUNK_SIZE = 16 * 1024;
+
+    // stable LSD radix sort of values by keys, 8 bits per pass up to keyBits. every pass counts the digits of
+    // fixed chunks in parallel and scatters them in parallel at offsets ordered by digit then chunk.
+    template<typename TKey>
+    static void RadixSortPairs(TKey* keys, uint32_t* values, size_t count, size_t keyBits, Allocator& allocator)
+    {
+        if (count < 2)
+        {
+            return;
+        }
+        MemoryBlock keysBlock = allocator.AllocateMemoryBlock(count * sizeof(TKey));
+        defer(allocator.FreeMemoryBlock(keysBlock));
+        MemoryBlock valuesBlock = allocator.AllocateMemoryBlock(count * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(valuesBlock));
+        MemoryBlock countsBlock = allocator.AllocateMemoryBlock(RADIX_SORT_MAX_CHUNKS * 256 * sizeof(size_t));
+        defer(allocator.FreeMemoryBlock(countsBlock));
+        TKey* sourceKeys = keys;
+        uint32_t* sourceValues = values;
+        TKey* destKeys = (TKey*)keysBlock.data;
+        uint32_t* destValues = (uint32_t*)valuesBlock.data;
+        size_t* counts = (size_t*)countsBlock.data;
+        const size_t chunksCount = Clamp<size_t>(count / RADIX_SORT_MIN_CHUNK_SIZE, 1, RADIX_SORT_MAX_CHUNKS);
+        for (size_t shift = 0; shift < keyBits; shift += 8)
+        {
+            ParallelFor(chunksCount, 1, [&](size_t begin, size_t end)
+                        {
+                            for (size_t c = begin; c < end; ++c)
+                            {
+                                size_t* chunkCounts = counts + c * 256;
+                                GEDO_MEMSET(chunkCounts, 0, 256 * sizeof(size_t));
+                                for (size_t i = count * c / chunksCount; i < count * (c + 1) / chunksCount; ++i)
+                                {
+                                    chunkCounts[(sourceKeys[i] >> shift) & 0xff]++;
+                                }
+                            }
+                        });
+            size_t offset = 0;
+            for (size_t digit = 0; digit < 256; ++digit)
+            {
+                for (size_t c = 0; c < chunksCount; ++c)
+                {
+                    const size_t digitCount = counts[c * 256 + digit];
+                    counts[c * 256 + digit] = offset;
+                    offset += digitCount;
+                }
+            }
+            ParallelFor(chunksCount, 1, [&](size_t begin, size_t end)
+                        {
+                            for (size_t c = begin; c < end; ++c)
+                            {
+                                size_t* chunkOffsets = counts + c * 256;
+                                for (size_t i = count * c / chunksCount; i < count * (c + 1) / chunksCount; ++i)
+                                {
+                                    const size_t position = chunkOffsets[(sourceKeys[i] >> shift) & 0xff]++;
+                                    destKeys[position] = sourceKeys[i];
+                                    destValues[position] = sourceValues[i];
+                                }
+                            }
+                        });
+            Swap(sourceKeys, destKeys);
+            Swap(sourceValues, destValues);
+        }
+        if (sourceKeys != keys)
+        {
+            GEDO_MEMCPY(keys, sourceKeys, count * sizeof(TKey));
+            GEDO_MEMCPY(values, sourceValues, count * sizeof(uint32_t));
+        }
+    }
+
+    // symmetric 4x4 quadric, Q(p) = pT A p + 2 b.p + c, with the sum of the weights of its planes. floats
+    // halve the memory, the positions are normalised to the unit cube so they keep enough precision.
+    struct SimplifyQuadric
+    {
+        float a00, a11, a22, a01, a02, a12;
+        float b0, b1, b2;
+        float c;
+        float weight;
+    };
+
+    enum SimplifyVertexKind : uint8_t
+    {
+        SIMPLIFY_INTERIOR,
+        SIMPLIFY_BORDER, // on exactly one border, only collapses along it.
+        SIMPLIFY_LOCKED, // non manifold, a corner of several borders or a locked border.
+    };
+
+    enum SimplifyVertexState : uint8_t
+    {
+        SIMPLIFY_FREE,
+        SIMPLIFY_NO_SOURCE, // next to a collapse of the pass, its triangles are stale.
+        SIMPLIFY_DONE,      // collapsed or collapsed onto during the pass.
+    };
+
+    static const float SIMPLIFY_BORDER_WEIGHT = 10.0f;
+    static const size_t SIMPLIFY_MAX_VALENCE = 64;
+
+    static void AddPlaneQuadric(SimplifyQuadric& q, const Vec3d& normal, double distance, double weight)
+    {
+        q.a00 += (float)(weight * normal.x * normal.x);
+        q.a11 += (float)(weight * normal.y * normal.y);
+        q.a22 += (float)(weight * normal.z * normal.z);
+        q.a01 += (float)(weight * normal.x * normal.y);
+        q.a02 += (float)(weight * normal.x * normal.z);
+        q.a12 += (float)(weight * normal.y * normal.z);
+        q.b0 += (float)(weight * normal.x * distance);
+        q.b1 += (float)(weight * normal.y * distance);
+        q.b2 += (float)(weight * normal.z * distance);
+        q.c += (float)(weight * distance * distance);
+        q.weight += (float)weight;
+    }
+
+    static void AddQuadric(SimplifyQuadric& q, const SimplifyQuadric& r)
+    {
+        q.a00 += r.a00;
+        q.a11 += r.a11;
+        q.a22 += r.a22;
+        q.a01 += r.a01;
+        q.a02 += r.a02;
+        q.a12 += r.a12;
+        q.b0 += r.b0;
+        q.b1 += r.b1;
+        q.b2 += r.b2;
+        q.c += r.c;
+        q.weight += r.weight;
+    }
+
+    static double EvaluateQuadric(const SimplifyQuadric& q, const Vec3d& p)
+    {
+        const double rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+        const double ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+        const double rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+        const double error = rx * p.x + ry * p.y + rz * p.z + 2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+        return Max(error, 0.0);
+    }
+
+    // the weighted mean of the squared distances of p to the planes of both vertices of a collapse.
+    static double GetCollapseError(const SimplifyQuadric& a, const SimplifyQuadric& b, const Vec3d& p)
+    {
+        const double weight = (double)a.weight + b.weight;
+        return (weight > 0.0) ? (EvaluateQuadric(a, p) + EvaluateQuadric(b, p)) / weight : 0.0;
+    }
+
+    struct SimplifyCandidate
+    {
+        uint32_t source;
+        uint32_t target;
+        uint8_t border;
+    };
+
+    // the smallest error of a bucket of SimplifyMesh.
+    static double GetSimplifyBucketError(uint16_t bucket)
+    {
+        const uint32_t bits = (uint32_t)bucket << 16;
+        float error;
+        GEDO_MEMCPY(&error, &bits, sizeof(float));
+        return error;
+    }
+
+    struct SimplifyContext
+    {
+        const uint32_t* indices;
+        const uint32_t* offsets; // VertexCorners of the current indices.
+        const uint32_t* corners;
+        const Vec3d* positions;  // normalised to the unit cube.
+        SimplifyQuadric* quadrics;
+        uint32_t* remap;         // the vertex every vertex was last collapsed onto, itself otherwise.
+        uint8_t* borders;        // 1 for the half edges without a twin.
+        uint8_t* kinds;
+        uint8_t* states;
+    };
+
+    // true if no triangle has the opposite of halfEdge.
+    static bool IsSimplifyBorderEdge(const SimplifyContext& context, uint32_t halfEdge)
+    {
+        const uint32_t a = context.indices[halfEdge];
+        const uint32_t b = context.indices[NextHalfEdge(halfEdge)];
+        for (uint32_t c = context.offsets[b]; c < context.offsets[b + 1]; ++c)
+        {
+            if (context.indices[NextHalfEdge(context.corners[c])] == a)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static uint8_t ClassifySimplifyVertex(const SimplifyContext& context, uint32_t v, bool lockBorders)
+    {
+        size_t outgoingBorders = 0;
+        size_t incomingBorders = 0;
+        for (uint32_t c = context.offsets[v]; c < context.offsets[v + 1]; ++c)
+        {
+            const uint32_t corner = context.corners[c];
+            const uint32_t next = context.indices[NextHalfEdge(corner)];
+            outgoingBorders += context.borders[corner];
+            incomingBorders += context.borders[PrevHalfEdge(corner)];
+            // an edge used twice in the same direction is non manifold.
+            for (uint32_t d = context.offsets[v]; d < c; ++d)
+            {
+                if (context.indices[NextHalfEdge(context.corners[d])] == next)
+                {
+                    return SIMPLIFY_LOCKED;
+                }
+            }
+        }
+        if (!outgoingBorders && !incomingBorders)
+        {
+            return SIMPLIFY_INTERIOR;
+        }
+        return (outgoingBorders == 1 && incomingBorders == 1 && !lockBorders) ? SIMPLIFY_BORDER : SIMPLIFY_LOCKED;
+    }
+
+    static bool CanCollapse(const SimplifyContext& context, uint32_t source, bool borderEdge)
+    {
+        const uint8_t kind = context.kinds[source];
+        return kind == SIMPLIFY_INTERIOR || (kind == SIMPLIFY_BORDER && borderEdge);
+    }
+
+    // adds vertex to the neighbours if it isn't there yet, false if there is no room left. not a StaticArray
+    // as clearing it costs more than the check.
+    static bool AddSimplifyNeighbour(uint32_t* neighbours, size_t& count, uint32_t vertex)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (neighbours[i] == vertex)
+            {
+                return true;
+            }
+        }
+        if (count == SIMPLIFY_MAX_VALENCE)
+        {
+            return false;
+        }
+        neighbours[count++] = vertex;
+        return true;
+    }
+
+    // checks the link condition (the collapse keeps the mesh manifold) and that no triangle of source flips or
+    // becomes degenerate, returns the count of triangles the collapse removes or 0 if it can't be done.
+    static size_t CheckCollapse(const SimplifyContext& context, uint32_t source, uint32_t target, bool borderEdge)
+    {
+        uint32_t sourceNeighbours[SIMPLIFY_MAX_VALENCE];
+        size_t sourceCount = 0;
+        size_t removed = 0;
+        const Vec3d& p = context.positions[source];
+        const Vec3d& targetPosition = context.positions[target];
+        for (uint32_t c = context.offsets[source]; c < context.offsets[source + 1]; ++c)
+        {
+            const uint32_t corner = context.corners[c];
+            const uint32_t next = context.remap[context.indices[NextHalfEdge(corner)]];
+            const uint32_t previous = context.remap[context.indices[PrevHalfEdge(corner)]];
+            if (next == target || previous == target)
+            {
+                removed++;
+                continue;
+            }
+            if (!AddSimplifyNeighbour(sourceNeighbours, sourceCount, next) || !AddSimplifyNeighbour(sourceNeighbours, sourceCount, previous))
+            {
+                return 0;
+            }
+            const Vec3d& p1 = context.positions[next];
+            const Vec3d& p2 = context.positions[previous];
+            const Vec3d before = CrossProduct(p1 - p, p2 - p);
+            const Vec3d after = CrossProduct(p1 - targetPosition, p2 - targetPosition);
+            if (DotProduct(before, after) <= 0.25 * sqrt(DotProduct(before, before) * DotProduct(after, after)))
+            {
+                return 0;
+            }
+        }
+        // the triangles of target can be stale, the remap gives their current vertices.
+        uint32_t targetNeighbours[SIMPLIFY_MAX_VALENCE];
+        size_t targetCount = 0;
+        for (uint32_t c = context.offsets[target]; c < context.offsets[target + 1]; ++c)
+        {
+            const uint32_t corner = context.corners[c];
+            const uint32_t ring[2] = { context.remap[context.indices[NextHalfEdge(corner)]], context.remap[context.indices[PrevHalfEdge(corner)]] };
+            for (const uint32_t n : ring)
+            {
+                if (n != source && n != target && !AddSimplifyNeighbour(targetNeighbours, targetCount, n))
+                {
+                    return 0;
+                }
+            }
+        }
+        // only the vertices opposite to the collapsed edge can be shared by the rings of source and target,
+        // any other would get an edge used by more than 2 triangles.
+        size_t shared = 0;
+        for (size_t i = 0; i < targetCount; ++i)
+        {
+            for (size_t j = 0; j < sourceCount; ++j)
+            {
+                shared += targetNeighbours[i] == sourceNeighbours[j];
+            }
+        }
+        const size_t expected = borderEdge ? 1 : 2;
+        return (shared == expected && removed == expected) ? removed : 0;
+    }
+
+    double SimplifyMesh(TriangleMesh& mesh, size_t targetTrianglesCount, double maxError, bool lockBorders, Allocator& allocator)
+    {
+        const size_t verticesCount = mesh.positions.size();
+        if (mesh.indices.size() / 3 <= targetTrianglesCount || !verticesCount)
+        {
+            return 0.0;
+        }
+        // the errors are computed in the unit cube of the mesh.
+        const Bounds bounds = ComputeBounds(ArrayView<Vec3d>{ mesh.positions.data(), verticesCount });
+        const Vec3d low = bounds.min;
+        const Vec3d size = bounds.max - bounds.min;
+        const double extent = Max(Max(size.x, size.y), size.z);
+        const double scale = (extent > 0.0) ? 1.0 / extent : 1.0;
+        const double maxErrorSquared = maxError * scale * maxError * scale;
+
+        MemoryBlock positionsBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(Vec3d));
+        defer(allocator.FreeMemoryBlock(positionsBlock));
+        MemoryBlock quadricsBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(SimplifyQuadric));
+        defer(allocator.FreeMemoryBlock(quadricsBlock));
+        MemoryBlock remapBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(remapBlock));
+        MemoryBlock kindsBlock = allocator.AllocateMemoryBlock(verticesCount * 2);
+        defer(allocator.FreeMemoryBlock(kindsBlock));
+        Vec3d* positions = (Vec3d*)positionsBlock.data;
+        SimplifyContext context;
+        context.positions = positions;
+        context.quadrics = (SimplifyQuadric*)quadricsBlock.data;
+        context.remap = (uint32_t*)remapBlock.data;
+        context.kinds = kindsBlock.data;
+        context.states = kindsBlock.data + verticesCount;
+        ParallelFor(verticesCount, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t v = begin; v < end; ++v)
+                        {
+                            positions[v] = (mesh.positions[v] - low) * scale;
+                            context.remap[v] = (uint32_t)v;
+                        }
+                    });
+
+        VertexCorners vertexCorners;
+        Array<uint8_t> borders;
+        borders.allocator = &allocator;
+        Array<uint16_t> buckets;
+        buckets.allocator = &allocator;
+        Array<uint32_t> collapseEdges;
+        collapseEdges.allocator = &allocator;
+        Array<SimplifyCandidate> candidates;
+        candidates.allocator = &allocator;
+        size_t trianglesCount = mesh.indices.size() / 3;
+        double resultError = 0.0;
+        for (size_t pass = 0; trianglesCount > targetTrianglesCount; ++pass)
+        {
+            BuildVertexCorners(mesh, vertexCorners, allocator);
+            context.indices = mesh.indices.data();
+            context.offsets = vertexCorners.offsets.data();
+            context.corners = vertexCorners.corners.data();
+            borders.resize(mesh.indices.size());
+            context.borders = borders.data();
+            ParallelFor(mesh.indices.size(), 16 * 1024, [&](size_t begin, size_t end)
+                        {
+                            for (size_t h = begin; h < end; ++h)
+                            {
+                                context.borders[h] = IsSimplifyBorderEdge(context, (uint32_t)h);
+                            }
+                        });
+            ParallelFor(verticesCount, 16 * 1024, [&](size_t begin, size_t end)
+                        {
+                            for (size_t v = begin; v < end; ++v)
+                            {
+                                context.kinds[v] = ClassifySimplifyVertex(context, (uint32_t)v, lockBorders);
+                                context.states[v] = SIMPLIFY_FREE;
+                            }
+                        });
+            if (!pass)
+            {
+                // the face planes weighted by area plus planes orthogonal to the borders that keep them in place,
+                // every vertex gathers the planes of its triangles.
+                ParallelFor(verticesCount, 16 * 1024, [&](size_t begin, size_t end)
+                            {
+                                for (size_t v = begin; v < end; ++v)
+                                {
+                                    SimplifyQuadric q = {};
+                                    for (uint32_t c = context.offsets[v]; c < context.offsets[v + 1]; ++c)
+                                    {
+                                        const uint32_t corner = context.corners[c];
+                                        const uint32_t next = context.indices[NextHalfEdge(corner)];
+                                        const uint32_t previous = context.indices[PrevHalfEdge(corner)];
+                                        const Vec3d& p = positions[v];
+                                        const Vec3d normal = CrossProduct(positions[next] - p, positions[previous] - p);
+                                        const double length = sqrt(DotProduct(normal, normal));
+                                        if (length == 0.0)
+                                        {
+                                            continue;
+                                        }
+                                        const Vec3d n = normal * (1.0 / length);
+                                        AddPlaneQuadric(q, n, -DotProduct(n, p), length * 0.5);
+                                        // both border edges of the corner, each of them is added by both its vertices.
+                                        const uint32_t ends[2] = { next, previous };
+                                        const bool borders[2] = { context.borders[corner] != 0, context.borders[PrevHalfEdge(corner)] != 0 };
+                                        for (size_t e = 0; e < 2; ++e)
+                                        {
+                                            if (!borders[e])
+                                            {
+                                                continue;
+                                            }
+                                            const Vec3d edge = positions[ends[e]] - p;
+                                            const Vec3d borderNormal = NormalisedOrZero(CrossProduct(edge, n));
+                                            AddPlaneQuadric(q, borderNormal, -DotProduct(borderNormal, p), DotProduct(edge, edge) * SIMPLIFY_BORDER_WEIGHT);
+                                        }
+                                    }
+                                    context.quadrics[v] = q;
+                                }
+                            });
+            }
+
+            // every edge once, from its smaller vertex or from its only half edge on borders. the errors are
+            // bucketed by the upper half of their float bits (positive floats sort like their bits), which keeps
+            // them ordered within 1% in 2 radix passes. the values are the half edges times 2 plus the direction.
+            const uint32_t* indices = mesh.indices.data();
+            const size_t halfEdgesCount = trianglesCount * 3;
+            buckets.resize(halfEdgesCount);
+            collapseEdges.resize(halfEdgesCount);
+            uint16_t* keys = buckets.data();
+            uint32_t* values = collapseEdges.data();
+            ParallelFor(halfEdgesCount, 16 * 1024, [&](size_t begin, size_t end)
+                        {
+                            for (size_t h = begin; h < end; ++h)
+                            {
+                                const uint32_t a = indices[h];
+                                const uint32_t b = indices[NextHalfEdge((uint32_t)h)];
+                                keys[h] = UINT16_MAX;
+                                values[h] = (uint32_t)h * 2;
+                                const bool border = context.borders[h];
+                                if (a == b || (a > b && !border))
+                                {
+                                    continue;
+                                }
+                                double best = INFINITY;
+                                if (CanCollapse(context, a, border))
+                                {
+                                    best = GetCollapseError(context.quadrics[a], context.quadrics[b], positions[b]);
+                                }
+                                if (CanCollapse(context, b, border))
+                                {
+                                    const double error = GetCollapseError(context.quadrics[a], context.quadrics[b], positions[a]);
+                                    values[h] += (error < best) ? 1 : 0;
+                                    best = Min(best, error);
+                                }
+                                if (best < INFINITY)
+                                {
+                                    const float error = (float)best;
+                                    uint32_t bits;
+                                    GEDO_MEMCPY(&bits, &error, sizeof(float));
+                                    keys[h] = (uint16_t)(bits >> 16);
+                                }
+                            }
+                        });
+            size_t candidatesCount = 0;
+            for (size_t h = 0; h < halfEdgesCount; ++h)
+            {
+                if (keys[h] != UINT16_MAX)
+                {
+                    keys[candidatesCount] = keys[h];
+                    values[candidatesCount++] = values[h];
+                }
+            }
+            if (!candidatesCount)
+            {
+                break;
+            }
+            RadixSortPairs(keys, values, candidatesCount, 16, allocator);
+            // gathered in order so the serial loop below only jumps around the vertices.
+            candidates.resize(candidatesCount);
+            SimplifyCandidate* sortedCandidates = candidates.data();
+            ParallelFor(candidatesCount, 16 * 1024, [&](size_t begin, size_t end)
+                        {
+                            for (size_t i = begin; i < end; ++i)
+                            {
+                                const uint32_t h = values[i] >> 1;
+                                const bool reversed = values[i] & 1;
+                                sortedCandidates[i].source = reversed ? indices[NextHalfEdge(h)] : indices[h];
+                                sortedCandidates[i].target = reversed ? indices[h] : indices[NextHalfEdge(h)];
+                                sortedCandidates[i].border = context.borders[h];
+                            }
+                        });
+
+            // a pass aims at the collapses left to reach the target, but not at a much larger error than the one
+            // of its last collapse so the cheap collapses the pass unlocks are done first. the candidates that
+            // would flip or break the mesh likely fail again next pass, so they push the limit further.
+            size_t goal = Min((trianglesCount - targetTrianglesCount + 1) / 2, candidatesCount);
+            double goalError = GetSimplifyBucketError(keys[goal - 1]);
+            size_t collapses = 0;
+            for (size_t i = 0; i < candidatesCount && trianglesCount > targetTrianglesCount; ++i)
+            {
+                const double bucketError = GetSimplifyBucketError(keys[i]);
+                if (bucketError > maxErrorSquared || bucketError > Max(goalError * 1.5, 1e-12))
+                {
+                    break;
+                }
+                const uint32_t source = sortedCandidates[i].source;
+                const uint32_t target = sortedCandidates[i].target;
+                // the triangles of a free source are all up to date, the ones of target are once remapped.
+                if (context.states[source] != SIMPLIFY_FREE || context.states[target] == SIMPLIFY_DONE)
+                {
+                    continue;
+                }
+                // neither quadric changed since the candidates were made.
+                const double error = GetCollapseError(context.quadrics[source], context.quadrics[target], positions[target]);
+                const size_t removed = (error <= maxErrorSquared) ? CheckCollapse(context, source, target, sortedCandidates[i].border) : 0;
+                if (!removed)
+                {
+                    if (goal < candidatesCount)
+                    {
+                        goalError = GetSimplifyBucketError(keys[goal++]);
+                    }
+                    continue;
+                }
+                context.remap[source] = target;
+                AddQuadric(context.quadrics[target], context.quadrics[source]);
+                context.states[source] = SIMPLIFY_DONE;
+                context.states[target] = SIMPLIFY_DONE;
+                for (uint32_t c = context.offsets[source]; c < context.offsets[source + 1]; ++c)
+                {
+                    const uint32_t corner = context.corners[c];
+                    const uint32_t ring[2] = { indices[NextHalfEdge(corner)], indices[PrevHalfEdge(corner)] };
+                    for (const uint32_t n : ring)
+                    {
+                        context.states[n] = Max<uint8_t>(context.states[n], SIMPLIFY_NO_SOURCE);
+                    }
+                }
+                trianglesCount -= removed;
+                resultError = Max(resultError, error);
+                collapses++;
+            }
+            if (!collapses)
+            {
+                break;
+            }
+
+            // re-indexes the triangles and drops the collapsed ones.
+            size_t kept = 0;
+            uint32_t* writeIndices = mesh.indices.data();
+            for (size_t t = 0; t < mesh.indices.size() / 3; ++t)
+            {
+                const uint32_t a = context.remap[writeIndices[t * 3]];
+                const uint32_t b = context.remap[writeIndices[t * 3 + 1]];
+                const uint32_t c = context.remap[writeIndices[t * 3 + 2]];
+                if (a == b || b == c || c == a)
+                {
+                    continue;
+                }
+                writeIndices[kept * 3] = a;
+                writeIndices[kept * 3 + 1] = b;
+                writeIndices[kept * 3 + 2] = c;
+                kept++;
+            }
+            mesh.indices.resize(kept * 3);
+            trianglesCount = kept;
+        }
+        FreeArray(borders);
+        FreeArray(buckets);
+        FreeArray(collapseEdges);
+        FreeArray(candidates);
+        DestroyVertexCorners(vertexCorners);
+
+        // removes the unused vertices, the kept ones stay in order so they are moved in place.
+        uint32_t* newIndices = context.remap;
+        for (size_t v = 0; v < verticesCount; ++v)
+        {
+            newIndices[v] = INVALID_INDEX;
+        }
+        for (size_t i = 0; i < mesh.indices.size(); ++i)
+        {
+            newIndices[mesh.indices[i]] = 0;
+        }
+        const bool hasNormals = mesh.normals.size() == verticesCount;
+        const bool hasUVs = mesh.uvs.size() == verticesCount;
+        size_t usedCount = 0;
+        for (size_t v = 0; v < verticesCount; ++v)
+        {
+            if (newIndices[v] == INVALID_INDEX)
+            {
+                continue;
+            }
+            newIndices[v] = (uint32_t)usedCount;
+            mesh.positions[usedCount] = mesh.positions[v];
+            if (hasNormals)
+            {
+                mesh.normals[usedCount] = mesh.normals[v];
+            }
+            if (hasUVs)
+            {
+                mesh.uvs[usedCount] = mesh.uvs[v];
+            }
+            usedCount++;
+        }
+        mesh.positions.resize(usedCount);
+        if (hasNormals)
+        {
+            mesh.normals.resize(usedCount);
+        }
+        if (hasUVs)
+        {
+            mesh.uvs.resize(usedCount);
+        }
+        for (size_t i = 0; i < mesh.indices.size(); ++i)
+        {
+            mesh.indices[i] = newIndices[mesh.indices[i]];
+        }
+        FreeArray(mesh.twins);
+        FreeArray(mesh.vertexHalfEdges);
+        mesh.nonManifoldEdges = 0;
+        return sqrt(resultError) / scale;
+    }
+
+    static uint64_t SpreadMorton2(uint64_t x)
+    {
+        x &= 0xffffffffull;
+        x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+        x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+        x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+        x = (x | (x << 2)) & 0x3333333333333333ull;
+        x = (x | (x << 1)) & 0x5555555555555555ull;
+        return x;
+    }
+
+    static uint32_t CompactMorton2(uint64_t x)
+    {
+        x &= 0x5555555555555555ull;
+        x = (x | (x >> 1)) & 0x3333333333333333ull;
+        x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+        x = (x | (x >> 4)) & 0x00ff00ff00ff00ffull;
+        x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+        x = (x | (x >> 16)) & 0xffffffffull;
+        return (uint32_t)x;
+    }
+
+    static uint64_t SpreadMorton3(uint64_t x)
+    {
+        x &= 0x1fffffull;
+        x = (x | (x << 32)) & 0x001f00000000ffffull;
+        x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+        x = (x | (x << 8)) & 0x100f00f00f00f00full;
+        x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+        x = (x | (x << 2)) & 0x1249249249249249ull;
+        return x;
+    }
+
+    static uint32_t CompactMorton3(uint64_t x)
+    {
+        x &= 0x1249249249249249ull;
+        x = (x | (x >> 2)) & 0x10c30c30c30c30c3ull;
+        x = (x | (x >> 4)) & 0x100f00f00f00f00full;
+        x = (x | (x >> 8)) & 0x001f0000ff0000ffull;
+        x = (x | (x >> 16)) & 0x001f00000000ffffull;
+        x = (x | (x >> 32)) & 0x1fffffull;
+        return (uint32_t)x;
+    }
+
+    uint64_t EncodeMorton2(uint32_t x, uint32_t y)
+    {
+#if defined __BMI2__
+        return _pdep_u64(x, 0x5555555555555555ull) | _pdep_u64(y, 0xaaaaaaaaaaaaaaaaull);
+#else
+        return SpreadMorton2(x) | (SpreadMorton2(y) << 1);
+#endif // __BMI2__
+    }
+
+    uint64_t EncodeMorton3(uint32_t x, uint32_t y, uint32_t z)
+    {
+#if defined __BMI2__
+        return _pdep_u64(x, 0x1249249249249249ull) | _pdep_u64(y, 0x2492492492492492ull) | _pdep_u64(z, 0x4924924924924924ull);
+#else
+        return SpreadMorton3(x) | (SpreadMorton3(y) << 1) | (SpreadMorton3(z) << 2);
+#endif // __BMI2__
+    }
+
+    void DecodeMorton2(uint64_t code, uint32_t& x, uint32_t& y)
+    {
+#if defined __BMI2__
+        x = (uint32_t)_pext_u64(code, 0x5555555555555555ull);
+        y = (uint32_t)_pext_u64(code, 0xaaaaaaaaaaaaaaaaull);
+#else
+        x = CompactMorton2(code);
+        y = CompactMorton2(code >> 1);
+#endif // __BMI2__
+    }
+
+    void DecodeMorton3(uint64_t code, uint32_t& x, uint32_t& y, uint32_t& z)
+    {
+#if defined __BMI2__
+        x = (uint32_t)_pext_u64(code, 0x1249249249249249ull);
+        y = (uint32_t)_pext_u64(code, 0x2492492492492492ull);
+        z = (uint32_t)_pext_u64(code, 0x4924924924924924ull);
+#else
+        x = CompactMorton3(code);
+        y = CompactMorton3(code >> 1);
+        z = CompactMorton3(code >> 2);
+#endif // __BMI2__
+    }
+
+#if defined __AVX2__
+    static __m256i SpreadMorton3(__m256i x)
+    {
+        x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 32)), _mm256_set1_epi64x(0x001f00000000ffffll));
+        x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 16)), _mm256_set1_epi64x(0x001f0000ff0000ffll));
+        x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 8)), _mm256_set1_epi64x(0x100f00f00f00f00fll));
+        x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 4)), _mm256_set1_epi64x(0x10c30c30c30c30c3ll));
+        x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 2)), _mm256_set1_epi64x(0x1249249249249249ll));
+        return x;
+    }
+#endif // __AVX2__
+
+    void EncodeMorton3(ArrayView<Vec3d> points, const Bounds& bounds, size_t bitsPerAxis, uint64_t* codes)
+    {
+        GEDO_ASSERT(bitsPerAxis >= 1 && bitsPerAxis <= 21);
+        const Vec3d size = bounds.max - bounds.min;
+        const double extent = Max(Max(size.x, size.y), size.z);
+        const double cells = (double)((1u << bitsPerAxis) - 1);
+        const double scale = (extent > 0.0) ? cells / extent : 0.0;
+        ParallelFor(points.size, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        size_t i = begin;
+#if defined __AVX2__
+                        const __m256d scales = _mm256_set1_pd(scale);
+                        const __m256d highs = _mm256_set1_pd(cells);
+                        for (; i + 4 <= end; i += 4)
+                        {
+                            const Vec3d* p = points.data + i;
+                            __m256i axes[3];
+                            for (size_t a = 0; a < 3; ++a)
+                            {
+                                __m256d q = _mm256_set_pd(p[3].data[a], p[2].data[a], p[1].data[a], p[0].data[a]);
+                                q = _mm256_mul_pd(_mm256_sub_pd(q, _mm256_set1_pd(bounds.min.data[a])), scales);
+                                q = _mm256_min_pd(_mm256_max_pd(q, _mm256_setzero_pd()), highs);
+                                axes[a] = SpreadMorton3(_mm256_cvtepu32_epi64(_mm256_cvttpd_epi32(q)));
+                            }
+                            const __m256i code = _mm256_or_si256(axes[0], _mm256_or_si256(_mm256_slli_epi64(axes[1], 1), _mm256_slli_epi64(axes[2], 2)));
+                            _mm256_storeu_si256((__m256i*)(codes + i), code);
+                        }
+#endif // __AVX2__
+                        for (; i < end; ++i)
+                        {
+                            uint32_t q[3];
+                            for (size_t a = 0; a < 3; ++a)
+                            {
+                                q[a] = (uint32_t)Clamp((points.data[i].data[a] - bounds.min.data[a]) * scale, 0.0, cells);
+                            }
+                            codes[i] = EncodeMorton3(q[0], q[1], q[2]);
+                        }
+                    });
+    }
+
+    // sorts the Morton codes of points with order, about 64 cells per point is enough for the locality.
+    static void SortMorton3(ArrayView<Vec3d> points, const Bounds& bounds, uint32_t* order, Allocator& allocator)
+    {
+        size_t bitsPerAxis = 1;
+        while (bitsPerAxis < 21 && ((uint64_t)1 << (3 * bitsPerAxis)) < (uint64_t)points.size * 64)
+        {
+            bitsPerAxis++;
+        }
+        MemoryBlock codesBlock = allocator.AllocateMemoryBlock(points.size * sizeof(uint64_t));
+        defer(allocator.FreeMemoryBlock(codesBlock));
+        uint64_t* codes = (uint64_t*)codesBlock.data;
+        EncodeMorton3(points, bounds, bitsPerAxis, codes);
+        for (size_t i = 0; i < points.size; ++i)
+        {
+            order[i] = (uint32_t)i;
+        }
+        RadixSortPairs(codes, order, points.size, 3 * bitsPerAxis, allocator);
+    }
+
+    void ComputeSpatialOrder(ArrayView<Vec3d> points, Array<uint32_t>& order, Allocator& allocator)
+    {
+        FreeArray(order);
+        order.allocator = &allocator;
+        order.resize(points.size);
+        if (!points.size)
+        {
+            return;
+        }
+        SortMorton3(points, ComputeBounds(points), order.data(), allocator);
+    }
+
+    // reorders values in place through scratch, item i becomes the old item order[i].
+    template<typename T>
+    static void GatherByOrder(T* values, const uint32_t* order, size_t count, MemoryBlock scratch)
+    {
+        T* sorted = (T*)scratch.data;
+        ParallelFor(count, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            sorted[i] = values[order[i]];
+                        }
+                    });
+        GEDO_MEMCPY(values, sorted, count * sizeof(T));
+    }
+
+    void SpatialSort(TriangleMesh& mesh, Array<uint32_t>* remap, Allocator& allocator)
+    {
+        const size_t verticesCount = mesh.positions.size();
+        const size_t trianglesCount = mesh.indices.size() / 3;
+        FreeArray(mesh.twins);
+        FreeArray(mesh.vertexHalfEdges);
+        mesh.nonManifoldEdges = 0;
+        if (remap)
+        {
+            FreeArray(*remap);
+            remap->allocator = &allocator;
+            remap->resize(verticesCount);
+        }
+        if (!verticesCount)
+        {
+            return;
+        }
+        const Bounds bounds = ComputeBounds(ArrayView<Vec3d>{ mesh.positions.data(), verticesCount });
+        const size_t count = Max(verticesCount, trianglesCount);
+        MemoryBlock orderBlock = allocator.AllocateMemoryBlock(count * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(orderBlock));
+        MemoryBlock scratchBlock = allocator.AllocateMemoryBlock(count * Max(sizeof(Vec3d), 3 * sizeof(uint32_t)));
+        defer(allocator.FreeMemoryBlock(scratchBlock));
+        MemoryBlock remapBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(remapBlock));
+        uint32_t* order = (uint32_t*)orderBlock.data;
+        uint32_t* newIndices = (uint32_t*)remapBlock.data;
+
+        SortMorton3(ArrayView<Vec3d>{ mesh.positions.data(), verticesCount }, bounds, order, allocator);
+        for (size_t i = 0; i < verticesCount; ++i)
+        {
+            newIndices[order[i]] = (uint32_t)i;
+        }
+        GatherByOrder(mesh.positions.data(), order, verticesCount, scratchBlock);
+        // the attributes are per vertex only when they have one entry per position, others are left as is.
+        if (mesh.normals.size() == verticesCount)
+        {
+            GatherByOrder(mesh.normals.data(), order, verticesCount, scratchBlock);
+        }
+        if (mesh.uvs.size() == verticesCount)
+        {
+            GatherByOrder(mesh.uvs.data(), order, verticesCount, scratchBlock);
+        }
+        if (remap)
+        {
+            GEDO_MEMCPY(remap->data(), newIndices, verticesCount * sizeof(uint32_t));
+        }
+        if (!trianglesCount)
+        {
+            return;
+        }
+
+        // the triangles are sorted by their centers with the new indices.
+        uint32_t* indices = mesh.indices.data();
+        Vec3d* centers = (Vec3d*)scratchBlock.data;
+        const Vec3d* positions = mesh.positions.data();
+        ParallelFor(mesh.indices.size(), 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            indices[i] = newIndices[indices[i]];
+                        }
+                    });
+        ParallelFor(trianglesCount, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t t = begin; t < end; ++t)
+                        {
+                            centers[t] = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) * (1.0 / 3.0);
+                        }
+                    });
+        SortMorton3(ArrayView<Vec3d>{ centers, trianglesCount }, bounds, order, allocator);
+        uint32_t* sortedIndices = (uint32_t*)scratchBlock.data;
+        ParallelFor(trianglesCount, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t t = begin; t < end; ++t)
+                        {
+                            for (size_t k = 0; k < 3; ++k)
+                            {
+                                sortedIndices[t * 3 + k] = indices[order[t] * 3 + k];
+                            }
+                        }
+                    });
+        GEDO_MEMCPY(indices, sortedIndices, trianglesCount * 3 * sizeof(uint32_t));
+    }
+
+    VertexCacheStats AnalyzeVertexCache(ArrayView<uint32_t> indices, size_t verticesCount, size_t cacheSize, Allocator& allocator)
+    {
+        VertexCacheStats stats;
+        if (!indices.size)
+        {
+            return stats;
+        }
+        // a vertex is in the FIFO while fewer than cacheSize misses happened since its own miss.
+        MemoryBlock timestampsBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(size_t));
+        defer(allocator.FreeMemoryBlock(timestampsBlock));
+        size_t* timestamps = (size_t*)timestampsBlock.data;
+        size_t time = cacheSize + 1;
+        size_t usedCount = 0;
+        for (size_t i = 0; i < indices.size; ++i)
+        {
+            const uint32_t v = indices.data[i];
+            GEDO_ASSERT(v < verticesCount);
+            if (time - timestamps[v] > cacheSize)
+            {
+                usedCount += timestamps[v] == 0;
+                timestamps[v] = time++;
+                stats.transformedVertices++;
+            }
+        }
+        stats.acmr = (double)stats.transformedVertices / (double)(indices.size / 3);
+        stats.atvr = (double)stats.transformedVertices / (double)usedCount;
+        return stats;
+    }
+
+    static const size_t VERTEX_CACHE_SIZE = 32;
+    static const size_t VERTEX_CACHE_MAX_VALENCE = 32;
+
+    // the scores of a vertex by its position in the LRU cache and by its count of triangles left.
+    struct VertexCacheTables
+    {
+        float cacheScores[VERTEX_CACHE_SIZE];
+        float valenceScores[VERTEX_CACHE_MAX_VALENCE + 1];
+    };
+
+    static VertexCacheTables CreateVertexCacheTables()
+    {
+        const double cacheDecayPower = 1.5;
+        const double lastTriangleScore = 0.75;
+        const double valenceBoostScale = 2.0;
+        const double valenceBoostPower = 0.5;
+        VertexCacheTables tables;
+        for (size_t i = 0; i < VERTEX_CACHE_SIZE; ++i)
+        {
+            // the 3 vertices of the last triangle get a fixed score so the next one doesn't reuse them all.
+            tables.cacheScores[i] = (i < 3) ? (float)lastTriangleScore : (float)pow(1.0 - (double)(i - 3) / (VERTEX_CACHE_SIZE - 3), cacheDecayPower);
+        }
+        tables.valenceScores[0] = 0.0f;
+        for (size_t i = 1; i <= VERTEX_CACHE_MAX_VALENCE; ++i)
+        {
+            tables.valenceScores[i] = (float)(valenceBoostScale * pow((double)i, -valenceBoostPower));
+        }
+        return tables;
+    }
+
+    static const VertexCacheTables& GetVertexCacheTables()
+    {
+        static const VertexCacheTables tables = CreateVertexCacheTables();
+        return tables;
+    }
+
+    static float GetVertexCacheScore(const VertexCacheTables& tables, int32_t cachePosition, uint32_t liveTriangles)
+    {
+        if (!liveTriangles)
+        {
+            return -1.0f;
+        }
+        const float cacheScore = (cachePosition >= 0) ? tables.cacheScores[cachePosition] : 0.0f;
+        return cacheScore + tables.valenceScores[Min<uint32_t>(liveTriangles, VERTEX_CACHE_MAX_VALENCE)];
+    }
+
+    static void ReorderTrianglesForVertexCache(TriangleMesh& mesh, Allocator& allocator)
+    {
+        const size_t verticesCount = mesh.positions.size();
+        const size_t trianglesCount = mesh.indices.size() / 3;
+        const VertexCacheTables& tables = GetVertexCacheTables();
+        // the corners of every vertex, the first liveTriangles of them belong to triangles not emitted yet.
+        VertexCorners vertexCorners;
+        BuildVertexCorners(mesh, vertexCorners, allocator);
+        defer(DestroyVertexCorners(vertexCorners));
+        const uint32_t* offsets = vertexCorners.offsets.data();
+        uint32_t* corners = vertexCorners.corners.data();
+
+        MemoryBlock liveBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(liveBlock));
+        MemoryBlock positionsBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(int32_t));
+        defer(allocator.FreeMemoryBlock(positionsBlock));
+        MemoryBlock vertexScoresBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(float));
+        defer(allocator.FreeMemoryBlock(vertexScoresBlock));
+        MemoryBlock triangleScoresBlock = allocator.AllocateMemoryBlock(trianglesCount * sizeof(float));
+        defer(allocator.FreeMemoryBlock(triangleScoresBlock));
+        MemoryBlock emittedBlock = allocator.AllocateMemoryBlock(trianglesCount);
+        defer(allocator.FreeMemoryBlock(emittedBlock));
+        MemoryBlock indicesBlock = allocator.AllocateMemoryBlock(trianglesCount * 3 * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(indicesBlock));
+        uint32_t* liveTriangles = (uint32_t*)liveBlock.data;
+        int32_t* cachePositions = (int32_t*)positionsBlock.data;
+        float* vertexScores = (float*)vertexScoresBlock.data;
+        float* triangleScores = (float*)triangleScoresBlock.data;
+        uint8_t* emitted = emittedBlock.data;
+        uint32_t* newIndices = (uint32_t*)indicesBlock.data;
+        const uint32_t* indices = mesh.indices.data();
+
+        for (size_t v = 0; v < verticesCount; ++v)
+        {
+            liveTriangles[v] = offsets[v + 1] - offsets[v];
+            cachePositions[v] = -1;
+            vertexScores[v] = GetVertexCacheScore(tables, -1, liveTriangles[v]);
+        }
+        uint32_t best = 0;
+        for (size_t t = 0; t < trianglesCount; ++t)
+        {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+            best = (triangleScores[t] > triangleScores[best]) ? (uint32_t)t : best;
+        }
+
+        // the cache holds VERTEX_CACHE_SIZE vertices plus the 3 pushed by the last triangle before the evictions.
+        uint32_t cache[VERTEX_CACHE_SIZE + 3];
+        size_t cacheSize = 0;
+        size_t cursor = 0;
+        for (size_t emittedCount = 0; emittedCount < trianglesCount; ++emittedCount)
+        {
+            if (best == INVALID_INDEX)
             {
-                const size_t slen = i - previousOffset;
-                if (slen)
+                while (emitted[cursor])
                 {
-                    StringView l;
-                    l.data = string + previousOffset;
-                    l.size = slen;
-                    result.push_back(l);
+                    cursor++;
                 }
-                while (string[i] == delim && i < len)
+                best = (uint32_t)cursor;
+            }
+            emitted[best] = 1;
+            uint32_t newCache[VERTEX_CACHE_SIZE + 3];
+            size_t newCacheSize = 0;
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const uint32_t v = indices[best * 3 + k];
+                newIndices[emittedCount * 3 + k] = v;
+                newCache[newCacheSize++] = v;
+                // removes the triangle from the live corners of v.
+                uint32_t* vertexCornersBegin = corners + offsets[v];
+                for (uint32_t c = 0; c < liveTriangles[v]; ++c)
+                {
+                    if (vertexCornersBegin[c] / 3 == best)
+                    {
+                        Swap(vertexCornersBegin[c], vertexCornersBegin[liveTriangles[v] - 1]);
+                        liveTriangles[v]--;
+                        break;
+                    }
+                }
+            }
+            for (size_t i = 0; i < cacheSize; ++i)
+            {
+                const uint32_t v = cache[i];
+                if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+                {
+                    newCache[newCacheSize++] = v;
+                }
+            }
+            // updates the scores of the cached and evicted vertices and their triangles, the best triangle of
+            // the next step is one of theirs.
+            best = INVALID_INDEX;
+            float bestScore = -INFINITY;
+            for (size_t i = 0; i < newCacheSize; ++i)
+            {
+                const uint32_t v = newCache[i];
+                cachePositions[v] = (i < VERTEX_CACHE_SIZE) ? (int32_t)i : -1;
+                const float score = GetVertexCacheScore(tables, cachePositions[v], liveTriangles[v]);
+                const float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                const uint32_t* vertexCornersBegin = corners + offsets[v];
+                for (uint32_t c = 0; c < liveTriangles[v]; ++c)
+                {
+                    const uint32_t t = vertexCornersBegin[c] / 3;
+                    triangleScores[t] += delta;
+                    if (triangleScores[t] > bestScore)
+                    {
+                        bestScore = triangleScores[t];
+                        best = t;
+                    }
+                }
+            }
+            cacheSize = Min(newCacheSize, VERTEX_CACHE_SIZE);
+            GEDO_MEMCPY(cache, newCache, cacheSize * sizeof(uint32_t));
+        }
+        GEDO_MEMCPY(mesh.indices.data(), newIndices, trianglesCount * 3 * sizeof(uint32_t));
+    }
+
+    void OptimizeVertexCache(TriangleMesh& mesh, VertexCacheStats* before, VertexCacheStats* after, Allocator& allocator)
+    {
+        FreeArray(mesh.twins);
+        FreeArray(mesh.vertexHalfEdges);
+        mesh.nonManifoldEdges = 0;
+        const ArrayView<uint32_t> indices = { mesh.indices.data(), mesh.indices.size() };
+        if (before)
+        {
+            *before = AnalyzeVertexCache(indices, mesh.positions.size(), 16, allocator);
+        }
+        if (mesh.indices.size() >= 3)
+        {
+            ReorderTrianglesForVertexCache(mesh, allocator);
+        }
+        if (after)
+        {
+            *after = AnalyzeVertexCache(indices, mesh.positions.size(), 16, allocator);
+        }
+    }
+
+    void OptimizeVertexFetch(TriangleMesh& mesh, Array<uint32_t>* remap, Allocator& allocator)
+    {
+        const size_t verticesCount = mesh.positions.size();
+        FreeArray(mesh.twins);
+        FreeArray(mesh.vertexHalfEdges);
+        mesh.nonManifoldEdges = 0;
+        if (remap)
+        {
+            FreeArray(*remap);
+            remap->allocator = &allocator;
+            remap->resize(verticesCount);
+        }
+        if (!verticesCount)
+        {
+            return;
+        }
+        MemoryBlock orderBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(orderBlock));
+        MemoryBlock remapBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(remapBlock));
+        MemoryBlock scratchBlock = allocator.AllocateMemoryBlock(verticesCount * sizeof(Vec3d));
+        defer(allocator.FreeMemoryBlock(scratchBlock));
+        uint32_t* order = (uint32_t*)orderBlock.data;
+        uint32_t* newIndices = (uint32_t*)remapBlock.data;
+        GEDO_MEMSET(newIndices, 0xff, verticesCount * sizeof(uint32_t));
+        uint32_t* indices = mesh.indices.data();
+        uint32_t next = 0;
+        for (size_t i = 0; i < mesh.indices.size(); ++i)
+        {
+            const uint32_t v = indices[i];
+            if (newIndices[v] == INVALID_INDEX)
+            {
+                order[next] = v;
+                newIndices[v] = next++;
+            }
+            indices[i] = newIndices[v];
+        }
+        for (uint32_t v = 0; v < verticesCount; ++v)
+        {
+            if (newIndices[v] == INVALID_INDEX)
+            {
+                order[next] = v;
+                newIndices[v] = next++;
+            }
+        }
+        GatherByOrder(mesh.positions.data(), order, verticesCount, scratchBlock);
+        // the attributes are per vertex only when they have one entry per position, others are left as is.
+        if (mesh.normals.size() == verticesCount)
+        {
+            GatherByOrder(mesh.normals.data(), order, verticesCount, scratchBlock);
+        }
+        if (mesh.uvs.size() == verticesCount)
+        {
+            GatherByOrder(mesh.uvs.data(), order, verticesCount, scratchBlock);
+        }
+        if (remap)
+        {
+            GEDO_MEMCPY(remap->data(), newIndices, verticesCount * sizeof(uint32_t));
+        }
+    }
+
+    static const size_t BVH_BINS = 16;
+    static const size_t BVH_MAX_LEAF_SIZE = 4;
+    // the SAH stops below it and splits the remaining ranges in the middle, the traversal stack needs
+    // BVH_MAX_SAH_DEPTH + 32 entries at most.
+    static const size_t BVH_MAX_SAH_DEPTH = 64;
+    static const size_t BVH_STACK_SIZE = BVH_MAX_SAH_DEPTH + 32;
+    static const size_t BVH_MAX_CHUNKS = 64;
+    static const size_t BVH_MIN_CHUNK_SIZE = 16 * 1024;
+
+    struct BVHBox
+    {
+        float min[3];
+        float max[3];
+    };
+
+    // the triangles are partitioned with their boxes so the binning reads them sequentially.
+    struct BVHPrimitive
+    {
+        BVHBox box;
+        uint32_t triangle;
+    };
+
+    struct BVHBin
+    {
+        BVHBox box;
+        size_t count;
+    };
+
+    struct BVHBuildTask
+    {
+        size_t node;
+        size_t begin;
+        size_t end;
+        size_t depth;
+    };
+
+    struct BVHBuilder
+    {
+        BVHPrimitive* primitives;   // partitioned in place.
+        BVHNode* nodes;             // 2 * triangles - 1, a subtree of n triangles uses the 2 * n - 1 nodes after its root.
+        BVHBin* chunkBins;          // BVH_MAX_CHUNKS * 3 * BVH_BINS for the parallel binning.
+        BVHBox* chunkBoxes;         // BVH_MAX_CHUNKS * 2.
+        Array<BVHBuildTask>* tasks; // if not NULL the small ranges are left here to be built in parallel.
+        size_t taskSize;
+    };
+
+    static BVHBox EmptyBVHBox()
+    {
+        return BVHBox{ { INFINITY, INFINITY, INFINITY }, { -INFINITY, -INFINITY, -INFINITY } };
+    }
+
+    static void GrowBVHBox(BVHBox& box, const BVHBox& b)
+    {
+        for (size_t a = 0; a < 3; ++a)
+        {
+            box.min[a] = Min(box.min[a], b.min[a]);
+            box.max[a] = Max(box.max[a], b.max[a]);
+        }
+    }
+
+    static void GrowBVHBox(BVHBox& box, const float p[3])
+    {
+        for (size_t a = 0; a < 3; ++a)
+        {
+            box.min[a] = Min(box.min[a], p[a]);
+            box.max[a] = Max(box.max[a], p[a]);
+        }
+    }
+
+    static float GetBVHBoxArea(const BVHBox& box)
+    {
+        const float x = box.max[0] - box.min[0];
+        const float y = box.max[1] - box.min[1];
+        const float z = box.max[2] - box.min[2];
+        return (x < 0.0f) ? 0.0f : x * y + y * z + z * x;
+    }
+
+    // the float box is rounded outwards so it contains the triangle.
+    static BVHBox GetBVHTriangleBox(const TriangleMesh& mesh, size_t triangle)
+    {
+        const uint32_t* indices = mesh.indices.data() + triangle * 3;
+        const Vec3d* positions = mesh.positions.data();
+        BVHBox box;
+        for (size_t a = 0; a < 3; ++a)
+        {
+            const double low = Min(Min(positions[indices[0]].data[a], positions[indices[1]].data[a]), positions[indices[2]].data[a]);
+            const double high = Max(Max(positions[indices[0]].data[a], positions[indices[1]].data[a]), positions[indices[2]].data[a]);
+            box.min[a] = (float)low;
+            box.max[a] = (float)high;
+            box.min[a] = ((double)box.min[a] > low) ? nextafterf(box.min[a], -INFINITY) : box.min[a];
+            box.max[a] = ((double)box.max[a] < high) ? nextafterf(box.max[a], INFINITY) : box.max[a];
+        }
+        return box;
+    }
+
+    static void SetBVHNodeBox(BVHNode& node, const BVHBox& box)
+    {
+        for (size_t a = 0; a < 3; ++a)
+        {
+            node.min[a] = box.min[a];
+            node.max[a] = box.max[a];
+        }
+    }
+
+    static void GetBVHCentroid(const BVHBox& box, float centroid[3])
+    {
+        for (size_t a = 0; a < 3; ++a)
+        {
+            centroid[a] = (box.min[a] + box.max[a]) * 0.5f;
+        }
+    }
+
+    // splits [begin, end) in up to BVH_MAX_CHUNKS chunks, processed in parallel when parallel is set.
+    template<typename F>
+    static size_t ForEachBVHChunk(size_t begin, size_t end, bool parallel, F func)
+    {
+        const size_t count = end - begin;
+        const size_t chunksCount = parallel ? Clamp<size_t>(count / BVH_MIN_CHUNK_SIZE, 1, BVH_MAX_CHUNKS) : 1;
+        if (chunksCount == 1)
+        {
+            func(begin, end, size_t(0));
+            return 1;
+        }
+        ParallelFor(chunksCount, 1, [&](size_t chunkBegin, size_t chunkEnd)
+                    {
+                        for (size_t c = chunkBegin; c < chunkEnd; ++c)
+                        {
+                            func(begin + count * c / chunksCount, begin + count * (c + 1) / chunksCount, c);
+                        }
+                    });
+        return chunksCount;
+    }
+
+    static size_t GetBVHBin(const float centroid[3], const BVHBox& centroidBox, const float scale[3], size_t axis)
+    {
+        const float bin = (centroid[axis] - centroidBox.min[axis]) * scale[axis];
+        return Min((size_t)Max(bin, 0.0f), BVH_BINS - 1);
+    }
+
+    static void BuildBVHNode(BVHBuilder& builder, size_t nodeIndex, size_t begin, size_t end, size_t depth)
+    {
+        const bool parallel = builder.tasks && end - begin >= 2 * BVH_MIN_CHUNK_SIZE;
+        const BVHPrimitive* primitives = builder.primitives;
+        // bounds of the triangles and of their centroids.
+        const size_t chunksCount = ForEachBVHChunk(begin, end, parallel, [&](size_t chunkBegin, size_t chunkEnd, size_t chunk)
+                                                   {
+                                                       BVHBox box = EmptyBVHBox();
+                                                       BVHBox centroidBox = EmptyBVHBox();
+                                                       for (size_t i = chunkBegin; i < chunkEnd; ++i)
+                                                       {
+                                                           float centroid[3];
+                                                           GetBVHCentroid(primitives[i].box, centroid);
+                                                           GrowBVHBox(box, primitives[i].box);
+                                                           GrowBVHBox(centroidBox, centroid);
+                                                       }
+                                                       builder.chunkBoxes[chunk * 2] = box;
+                                                       builder.chunkBoxes[chunk * 2 + 1] = centroidBox;
+                                                   });
+        BVHBox box = EmptyBVHBox();
+        BVHBox centroidBox = EmptyBVHBox();
+        for (size_t c = 0; c < chunksCount; ++c)
+        {
+            GrowBVHBox(box, builder.chunkBoxes[c * 2]);
+            GrowBVHBox(centroidBox, builder.chunkBoxes[c * 2 + 1]);
+        }
+        BVHNode& node = builder.nodes[nodeIndex];
+        SetBVHNodeBox(node, box);
+        const size_t count = end - begin;
+        if (count == 1)
+        {
+            node.first = (uint32_t)begin;
+            node.count = 1;
+            return;
+        }
+
+        // SAH over BVH_BINS bins on every axis, the bins of the chunks are merged afterwards.
+        float scale[3];
+        for (size_t a = 0; a < 3; ++a)
+        {
+            const float extent = centroidBox.max[a] - centroidBox.min[a];
+            scale[a] = (extent > 0.0f) ? BVH_BINS / extent : 0.0f;
+        }
+        size_t bestAxis = 0;
+        size_t bestSplit = 0;
+        float bestCost = INFINITY;
+        if (depth < BVH_MAX_SAH_DEPTH)
+        {
+            ForEachBVHChunk(begin, end, parallel, [&](size_t chunkBegin, size_t chunkEnd, size_t chunk)
+                            {
+                                BVHBin* bins = builder.chunkBins + chunk * 3 * BVH_BINS;
+                                for (size_t b = 0; b < 3 * BVH_BINS; ++b)
+                                {
+                                    bins[b] = BVHBin{ EmptyBVHBox(), 0 };
+                                }
+                                for (size_t i = chunkBegin; i < chunkEnd; ++i)
+                                {
+                                    float centroid[3];
+                                    GetBVHCentroid(primitives[i].box, centroid);
+                                    for (size_t a = 0; a < 3; ++a)
+                                    {
+                                        BVHBin& bin = bins[a * BVH_BINS + GetBVHBin(centroid, centroidBox, scale, a)];
+                                        GrowBVHBox(bin.box, primitives[i].box);
+                                        bin.count++;
+                                    }
+                                }
+                            });
+            for (size_t c = 1; c < chunksCount; ++c)
+            {
+                for (size_t b = 0; b < 3 * BVH_BINS; ++b)
+                {
+                    BVHBin& bin = builder.chunkBins[b];
+                    const BVHBin& chunkBin = builder.chunkBins[c * 3 * BVH_BINS + b];
+                    GrowBVHBox(bin.box, chunkBin.box);
+                    bin.count += chunkBin.count;
+                }
+            }
+            for (size_t a = 0; a < 3; ++a)
+            {
+                if (scale[a] == 0.0f)
+                {
+                    continue;
+                }
+                const BVHBin* bins = builder.chunkBins + a * BVH_BINS;
+                // the cost of the right side of every split is swept from the right first.
+                float rightCosts[BVH_BINS];
+                BVHBox right = EmptyBVHBox();
+                size_t rightCount = 0;
+                for (size_t b = BVH_BINS - 1; b > 0; --b)
+                {
+                    GrowBVHBox(right, bins[b].box);
+                    rightCount += bins[b].count;
+                    rightCosts[b] = GetBVHBoxArea(right) * rightCount;
+                }
+                BVHBox left = EmptyBVHBox();
+                size_t leftCount = 0;
+                for (size_t b = 1; b < BVH_BINS; ++b)
+                {
+                    GrowBVHBox(left, bins[b - 1].box);
+                    leftCount += bins[b - 1].count;
+                    const float cost = GetBVHBoxArea(left) * leftCount + rightCosts[b];
+                    if (leftCount && leftCount < count && cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = a;
+                        bestSplit = b;
+                    }
+                }
+            }
+        }
+        // a traversal step costs as much as a triangle test.
+        const float area = GetBVHBoxArea(box);
+        const float splitCost = (bestCost < INFINITY && area > 0.0f) ? 1.0f + bestCost / area : INFINITY;
+        if (count <= BVH_MAX_LEAF_SIZE && (float)count <= splitCost)
+        {
+            node.first = (uint32_t)begin;
+            node.count = (uint32_t)count;
+            return;
+        }
+
+        size_t middle = begin + count / 2;
+        if (bestCost < INFINITY)
+        {
+            size_t i = begin;
+            size_t j = end;
+            while (i < j)
+            {
+                float centroid[3];
+                GetBVHCentroid(builder.primitives[i].box, centroid);
+                if (GetBVHBin(centroid, centroidBox, scale, bestAxis) < bestSplit)
                 {
                     i++;
                 }
-                previousOffset = i;
+                else
+                {
+                    Swap(builder.primitives[i], builder.primitives[--j]);
+                }
+            }
+            middle = i;
+        }
+        // otherwise the centroids are all in the same place or the tree is too deep, the range is split in the middle.
+
+        const size_t left = nodeIndex + 1;
+        const size_t right = nodeIndex + 2 * (middle - begin);
+        node.first = (uint32_t)right;
+        node.count = 0;
+        const BVHBuildTask children[2] = { { left, begin, middle, depth + 1 }, { right, middle, end, depth + 1 } };
+        for (const BVHBuildTask& child : children)
+        {
+            if (builder.tasks && child.end - child.begin <= builder.taskSize)
+            {
+                builder.tasks->push_back(child);
+            }
+            else
+            {
+                BuildBVHNode(builder, child.node, child.begin, child.end, child.depth);
+            }
+        }
+    }
+
+    // copies the nodes depth first into dest, the built tree has holes where leaves hold several triangles.
+    static void CompactBVHNode(const BVHNode* source, size_t nodeIndex, BVHNode* dest, size_t& count)
+    {
+        const size_t destIndex = count++;
+        dest[destIndex] = source[nodeIndex];
+        if (source[nodeIndex].count)
+        {
+            return;
+        }
+        CompactBVHNode(source, nodeIndex + 1, dest, count);
+        dest[destIndex].first = (uint32_t)count;
+        CompactBVHNode(source, source[nodeIndex].first, dest, count);
+    }
+
+    void BuildBVH(const TriangleMesh& mesh, BVH& bvh, Allocator& allocator)
+    {
+        DestroyBVH(bvh);
+        bvh.nodes.allocator = &allocator;
+        bvh.triangles.allocator = &allocator;
+        const size_t trianglesCount = mesh.indices.size() / 3;
+        if (!trianglesCount)
+        {
+            return;
+        }
+        MemoryBlock primitivesBlock = allocator.AllocateMemoryBlock(trianglesCount * sizeof(BVHPrimitive));
+        defer(allocator.FreeMemoryBlock(primitivesBlock));
+        MemoryBlock nodesBlock = allocator.AllocateMemoryBlock((2 * trianglesCount - 1) * sizeof(BVHNode));
+        defer(allocator.FreeMemoryBlock(nodesBlock));
+        MemoryBlock chunksBlock = allocator.AllocateMemoryBlock(BVH_MAX_CHUNKS * (3 * BVH_BINS * sizeof(BVHBin) + 2 * sizeof(BVHBox)));
+        defer(allocator.FreeMemoryBlock(chunksBlock));
+        BVHPrimitive* primitives = (BVHPrimitive*)primitivesBlock.data;
+        ParallelFor(trianglesCount, 16 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t t = begin; t < end; ++t)
+                        {
+                            primitives[t].box = GetBVHTriangleBox(mesh, t);
+                            primitives[t].triangle = (uint32_t)t;
+                        }
+                    });
+
+        // the top of the tree is built with a parallel binning until the ranges are small enough to give
+        // every core a few subtrees, which are then built independently.
+        Array<BVHBuildTask> tasks;
+        tasks.allocator = &allocator;
+        BVHBuilder builder;
+        builder.primitives = primitives;
+        builder.nodes = (BVHNode*)nodesBlock.data;
+        builder.chunkBins = (BVHBin*)chunksBlock.data;
+        builder.chunkBoxes = (BVHBox*)(builder.chunkBins + BVH_MAX_CHUNKS * 3 * BVH_BINS);
+        builder.tasks = &tasks;
+        builder.taskSize = Max<size_t>(trianglesCount / (4 * GetProcessorCount()), BVH_MIN_CHUNK_SIZE);
+        if (trianglesCount <= builder.taskSize)
+        {
+            tasks.push_back(BVHBuildTask{ 0, 0, trianglesCount, 0 });
+        }
+        else
+        {
+            BuildBVHNode(builder, 0, 0, trianglesCount, 0);
+        }
+        // the serial builds only need the bins of one chunk, so every worker reuses one of the chunks of the
+        // parallel binning instead of allocating its own (the allocator isn't thread safe).
+        const size_t workersCount = Min<size_t>(Min<size_t>(GetProcessorCount(), BVH_MAX_CHUNKS), tasks.size());
+        ParallelFor(workersCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t w = begin; w < end; ++w)
+                        {
+                            BVHBuilder taskBuilder = builder;
+                            taskBuilder.chunkBins = builder.chunkBins + w * 3 * BVH_BINS;
+                            taskBuilder.chunkBoxes = builder.chunkBoxes + w * 2;
+                            taskBuilder.tasks = NULL;
+                            for (size_t i = w * tasks.size() / workersCount; i < (w + 1) * tasks.size() / workersCount; ++i)
+                            {
+                                BuildBVHNode(taskBuilder, tasks[i].node, tasks[i].begin, tasks[i].end, tasks[i].depth);
+                            }
+                        }
+                    });
+
+        bvh.triangles.resize(trianglesCount);
+        uint32_t* triangles = bvh.triangles.data();
+        ParallelFor(trianglesCount, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            triangles[i] = primitives[i].triangle;
+                        }
+                    });
+        size_t nodesCount = 0;
+        bvh.nodes.resize(2 * trianglesCount - 1);
+        CompactBVHNode(builder.nodes, 0, bvh.nodes.data(), nodesCount);
+        bvh.nodes.resize(nodesCount);
+    }
+
+    void RefitBVH(const TriangleMesh& mesh, BVH& bvh)
+    {
+        BVHNode* nodes = bvh.nodes.data();
+        const uint32_t* triangles = bvh.triangles.data();
+        ParallelFor(bvh.nodes.size(), 16 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            if (!nodes[i].count)
+                            {
+                                continue;
+                            }
+                            BVHBox box = EmptyBVHBox();
+                            for (uint32_t k = 0; k < nodes[i].count; ++k)
+                            {
+                                GrowBVHBox(box, GetBVHTriangleBox(mesh, triangles[nodes[i].first + k]));
+                            }
+                            SetBVHNodeBox(nodes[i], box);
+                        }
+                    });
+        // the children are after their parent.
+        for (size_t i = bvh.nodes.size(); i-- > 0;)
+        {
+            BVHNode& node = nodes[i];
+            if (node.count)
+            {
+                continue;
+            }
+            const BVHNode& left = nodes[i + 1];
+            const BVHNode& right = nodes[node.first];
+            for (size_t a = 0; a < 3; ++a)
+            {
+                node.min[a] = Min(left.min[a], right.min[a]);
+                node.max[a] = Max(left.max[a], right.max[a]);
+            }
+        }
+    }
+
+    void DestroyBVH(BVH& bvh)
+    {
+        FreeArray(bvh.nodes);
+        FreeArray(bvh.triangles);
+    }
+
+    // Möller-Trumbore, hit is updated if the triangle is closer than hit.distance.
+    static bool IntersectTriangle(const TriangleMesh& mesh, uint32_t triangle, const Vec3d& origin, const Vec3d& direction, RayHit& hit)
+    {
+        const Vec3d& p0 = mesh.positions[mesh.indices[triangle * 3]];
+        const Vec3d e1 = mesh.positions[mesh.indices[triangle * 3 + 1]] - p0;
+        const Vec3d e2 = mesh.positions[mesh.indices[triangle * 3 + 2]] - p0;
+        const Vec3d p = CrossProduct(direction, e2);
+        const double determinant = DotProduct(e1, p);
+        if (determinant == 0.0)
+        {
+            return false;
+        }
+        const double inverseDeterminant = 1.0 / determinant;
+        const Vec3d s = origin - p0;
+        const double u = DotProduct(s, p) * inverseDeterminant;
+        if (u < 0.0 || u > 1.0)
+        {
+            return false;
+        }
+        const Vec3d q = CrossProduct(s, e1);
+        const double v = DotProduct(direction, q) * inverseDeterminant;
+        if (v < 0.0 || u + v > 1.0)
+        {
+            return false;
+        }
+        const double distance = DotProduct(e2, q) * inverseDeterminant;
+        if (distance < 0.0 || distance >= hit.distance)
+        {
+            return false;
+        }
+        hit.distance = distance;
+        hit.triangle = triangle;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+
+    // the slab test is done in float, exit distances are pushed out by 3 float ulps so rounding can't make a
+    // ray miss a box it touches.
+    static const float BVH_EXIT_SCALE = 1.0f + 6.0f * 0.5f * 1.1920929e-7f;
+
+    static float GetBVHInverseDirection(double d)
+    {
+        // avoids 0 * infinity in the slab test for rays parallel to an axis.
+        const double minimum = 1e-30;
+        return (float)(1.0 / ((Abs(d) < minimum) ? (d < 0.0 ? -minimum : minimum) : d));
+    }
+
+    struct BVHRay
+    {
+        float origin[3];
+        float inverseDirection[3];
+    };
+
+    static bool IntersectBVHNode(const BVHNode& node, const BVHRay& ray, float maxDistance, float& distance)
+    {
+        float tMin = 0.0f;
+        float tMax = maxDistance;
+        for (size_t a = 0; a < 3; ++a)
+        {
+            const float t0 = (node.min[a] - ray.origin[a]) * ray.inverseDirection[a];
+            const float t1 = (node.max[a] - ray.origin[a]) * ray.inverseDirection[a];
+            tMin = Max(tMin, Min(t0, t1));
+            tMax = Min(tMax, Max(t0, t1) * BVH_EXIT_SCALE);
+        }
+        distance = tMin;
+        return tMin <= tMax;
+    }
+
+    bool IntersectRay(const BVH& bvh, const TriangleMesh& mesh, const Ray& ray, RayHit& hit)
+    {
+        hit = RayHit{};
+        hit.distance = ray.maxDistance;
+        if (!bvh.nodes.size())
+        {
+            return false;
+        }
+        BVHRay bvhRay;
+        for (size_t a = 0; a < 3; ++a)
+        {
+            bvhRay.origin[a] = (float)ray.origin.data[a];
+            bvhRay.inverseDirection[a] = GetBVHInverseDirection(ray.direction.data[a]);
+        }
+        const BVHNode* nodes = bvh.nodes.data();
+        const uint32_t* triangles = bvh.triangles.data();
+        uint32_t stack[BVH_STACK_SIZE];
+        float stackDistances[BVH_STACK_SIZE];
+        size_t stackSize = 0;
+        float distance;
+        uint32_t nodeIndex = 0;
+        if (!IntersectBVHNode(nodes[0], bvhRay, (float)hit.distance, distance))
+        {
+            return false;
+        }
+        for (;;)
+        {
+            const BVHNode& node = nodes[nodeIndex];
+            if (node.count)
+            {
+                for (uint32_t k = 0; k < node.count; ++k)
+                {
+                    IntersectTriangle(mesh, triangles[node.first + k], ray.origin, ray.direction, hit);
+                }
+            }
+            else
+            {
+                // the closest child is visited first and the other one is pushed.
+                float leftDistance;
+                float rightDistance;
+                const bool hitLeft = IntersectBVHNode(nodes[nodeIndex + 1], bvhRay, (float)hit.distance, leftDistance);
+                const bool hitRight = IntersectBVHNode(nodes[node.first], bvhRay, (float)hit.distance, rightDistance);
+                if (hitLeft && hitRight)
+                {
+                    const bool leftFirst = leftDistance <= rightDistance;
+                    stackDistances[stackSize] = leftFirst ? rightDistance : leftDistance;
+                    stack[stackSize++] = leftFirst ? node.first : nodeIndex + 1;
+                    nodeIndex = leftFirst ? nodeIndex + 1 : node.first;
+                    continue;
+                }
+                if (hitLeft || hitRight)
+                {
+                    nodeIndex = hitLeft ? nodeIndex + 1 : node.first;
+                    continue;
+                }
+            }
+            // nodes pushed before a closer hit was found are skipped.
+            while (stackSize && stackDistances[stackSize - 1] > hit.distance)
+            {
+                stackSize--;
             }
-            else
+            if (!stackSize)
             {
-                i++;
+                break;
             }
+            nodeIndex = stack[--stackSize];
         }
-        const size_t slen = i - previousOffset;
-        if (slen)
-        {
-            StringView l;
-            l.data = string + previousOffset;
-            l.size = slen;
-            result.push_back(l);
-        }
-        return result;
+        return hit.triangle != INVALID_INDEX;
     }
 
-    Array<String> SplitString(const char* string, char delim, Allocator& allocator)
+    // the rays of a packet in SoA form so the slab tests of the lanes are done together, with AVX2 when
+    // it's enabled at compile time.
+    struct BVHRayPacket
     {
-        Array<String> result;
-        result.allocator = &allocator;
-        const size_t len = StringLength(string);
-        size_t previousOffset = 0;
-        size_t i = 0;
-        size_t partsCount = 0;
-        while (i < len)
+        float origin[3][RAY_PACKET_SIZE];
+        float inverseDirection[3][RAY_PACKET_SIZE];
+        float maxDistance[RAY_PACKET_SIZE];
+    };
+
+    // returns the mask of the lanes that hit the node and the nearest entry distance among them.
+    static uint32_t IntersectBVHNodePacket(const BVHNode& node, const BVHRayPacket& packet, float& distance)
+    {
+        float distances[RAY_PACKET_SIZE];
+#if defined __AVX2__
+        __m256 tMin = _mm256_setzero_ps();
+        __m256 tMax = _mm256_loadu_ps(packet.maxDistance);
+        for (size_t a = 0; a < 3; ++a)
         {
-            if (string[i] == delim)
+            const __m256 origin = _mm256_loadu_ps(packet.origin[a]);
+            const __m256 inverseDirection = _mm256_loadu_ps(packet.inverseDirection[a]);
+            const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min[a]), origin), inverseDirection);
+            const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max[a]), origin), inverseDirection);
+            tMin = _mm256_max_ps(tMin, _mm256_min_ps(t0, t1));
+            tMax = _mm256_min_ps(tMax, _mm256_mul_ps(_mm256_max_ps(t0, t1), _mm256_set1_ps(BVH_EXIT_SCALE)));
+        }
+        const __m256 hit = _mm256_cmp_ps(tMin, tMax, _CMP_LE_OQ);
+        const uint32_t mask = (uint32_t)_mm256_movemask_ps(hit);
+        _mm256_storeu_ps(distances, _mm256_blendv_ps(_mm256_set1_ps(INFINITY), tMin, hit));
+#else
+        uint32_t mask = 0;
+        for (size_t k = 0; k < RAY_PACKET_SIZE; ++k)
+        {
+            float tMin = 0.0f;
+            float tMax = packet.maxDistance[k];
+            for (size_t a = 0; a < 3; ++a)
             {
-                if (i - previousOffset)
-                {
-                    partsCount++;
-                }
-                while (string[i] == delim && i < len)
-                {
-                    i++;
-                }
-                previousOffset = i;
+                const float t0 = (node.min[a] - packet.origin[a][k]) * packet.inverseDirection[a][k];
+                const float t1 = (node.max[a] - packet.origin[a][k]) * packet.inverseDirection[a][k];
+                tMin = Max(tMin, Min(t0, t1));
+                tMax = Min(tMax, Max(t0, t1) * BVH_EXIT_SCALE);
             }
-            else
+            mask |= (uint32_t)(tMin <= tMax) << k;
+            distances[k] = (tMin <= tMax) ? tMin : INFINITY;
+        }
+#endif // __AVX2__
+        distance = distances[0];
+        for (size_t k = 1; k < RAY_PACKET_SIZE; ++k)
+        {
+            distance = Min(distance, distances[k]);
+        }
+        return mask;
+    }
+
+    size_t IntersectRayPacket(const BVH& bvh, const TriangleMesh& mesh, const Ray rays[RAY_PACKET_SIZE], RayHit hits[RAY_PACKET_SIZE])
+    {
+        BVHRayPacket packet;
+        for (size_t k = 0; k < RAY_PACKET_SIZE; ++k)
+        {
+            hits[k] = RayHit{};
+            hits[k].distance = rays[k].maxDistance;
+            packet.maxDistance[k] = (float)rays[k].maxDistance;
+            for (size_t a = 0; a < 3; ++a)
             {
-                i++;
+                packet.origin[a][k] = (float)rays[k].origin.data[a];
+                packet.inverseDirection[a][k] = GetBVHInverseDirection(rays[k].direction.data[a]);
             }
         }
-        if (i - previousOffset)
+        if (!bvh.nodes.size())
         {
-            partsCount++;
+            return 0;
         }
-        result.reserve(partsCount);
-
-        i = 0;
-        previousOffset = 0;
-        while (i < len)
+        const BVHNode* nodes = bvh.nodes.data();
+        const uint32_t* triangles = bvh.triangles.data();
+        uint32_t stack[BVH_STACK_SIZE];
+        size_t stackSize = 0;
+        float distance;
+        uint32_t nodeIndex = 0;
+        uint32_t mask = IntersectBVHNodePacket(nodes[0], packet, distance);
+        if (!mask)
         {
-            if (string[i] == delim)
+            return 0;
+        }
+        for (;;)
+        {
+            const BVHNode& node = nodes[nodeIndex];
+            if (node.count)
             {
-                const size_t slen = i - previousOffset;
-                if (slen)
+                for (uint32_t i = 0; i < node.count; ++i)
                 {
-                    String l = CopyString(string, previousOffset, i, allocator);
-                    result.push_back(l);
+                    for (size_t k = 0; k < RAY_PACKET_SIZE; ++k)
+                    {
+                        if ((mask >> k & 1) && IntersectTriangle(mesh, triangles[node.first + i], rays[k].origin, rays[k].direction, hits[k]))
+                        {
+                            packet.maxDistance[k] = (float)hits[k].distance;
+                        }
+                    }
                 }
-                while (string[i] == delim && i < len)
+            }
+            else
+            {
+                float leftDistance;
+                float rightDistance;
+                const uint32_t leftMask = IntersectBVHNodePacket(nodes[nodeIndex + 1], packet, leftDistance);
+                const uint32_t rightMask = IntersectBVHNodePacket(nodes[node.first], packet, rightDistance);
+                if (leftMask && rightMask)
                 {
-                    i++;
+                    const bool leftFirst = leftDistance <= rightDistance;
+                    stack[stackSize++] = leftFirst ? node.first : nodeIndex + 1;
+                    nodeIndex = leftFirst ? nodeIndex + 1 : node.first;
+                    mask = leftFirst ? leftMask : rightMask;
+                    continue;
+                }
+                if (leftMask || rightMask)
+                {
+                    nodeIndex = leftMask ? nodeIndex + 1 : node.first;
+                    mask = leftMask | rightMask;
+                    continue;
                 }
-                previousOffset = i;
             }
-            else
+            // the lanes of a popped node are tested again with the distances found since it was pushed.
+            for (;;)
             {
-                i++;
+                if (!stackSize)
+                {
+                    size_t hitsCount = 0;
+                    for (size_t k = 0; k < RAY_PACKET_SIZE; ++k)
+                    {
+                        hitsCount += hits[k].triangle != INVALID_INDEX;
+                    }
+                    return hitsCount;
+                }
+                nodeIndex = stack[--stackSize];
+                mask = IntersectBVHNodePacket(nodes[nodeIndex], packet, distance);
+                if (mask)
+                {
+                    break;
+                }
             }
         }
+    }
 
-        const size_t slen = i - previousOffset;
-        if (slen)
+    struct KdTreePoint
+    {
+        Vec3d position;
+        uint32_t index;
+    };
+
+    void BuildKdTree(ArrayView<Vec3d> points, KdTree& tree, KdTreeStats* stats, Allocator& allocator)
+    {
+        const Stopwatch stopwatch = StartStopwatch();
+        DestroyKdTree(tree);
+        tree.points.allocator = &allocator;
+        tree.indices.allocator = &allocator;
+        tree.splits.allocator = &allocator;
+        tree.axes.allocator = &allocator;
+        const size_t count = points.size;
+        // the leaves of a level d tree have at most ceil(count / 2^d) points.
+        tree.depth = 0;
+        while ((count + ((size_t)1 << tree.depth) - 1) >> tree.depth > KDTREE_LEAF_SIZE)
         {
-            String l = CopyString(string, previousOffset, i, allocator);
-            result.push_back(l);
+            tree.depth++;
+        }
+        const size_t innerCount = ((size_t)1 << tree.depth) - 1;
+        tree.splits.resize(innerCount);
+        tree.axes.resize(innerCount);
+
+        MemoryBlock pointsBlock = allocator.AllocateMemoryBlock(Max<size_t>(count, 1) * sizeof(KdTreePoint));
+        defer(allocator.FreeMemoryBlock(pointsBlock));
+        KdTreePoint* treePoints = (KdTreePoint*)pointsBlock.data;
+        ParallelFor(count, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            treePoints[i] = KdTreePoint{ points.data[i], (uint32_t)i };
+                        }
+                    });
+        // the nodes of a level own disjoint ranges, the first levels have few large nodes and the last
+        // ones many small nodes so the levels are split by nodes.
+        for (size_t depth = 0; depth < tree.depth; ++depth)
+        {
+            const size_t first = ((size_t)1 << depth) - 1;
+            const size_t levelCount = (size_t)1 << depth;
+            ParallelFor(levelCount, 1, [&](size_t begin, size_t end)
+                        {
+                            for (size_t n = begin; n < end; ++n)
+                            {
+                                // the range of the node follows from halving the points at every level.
+                                size_t rangeBegin = 0;
+                                size_t rangeEnd = count;
+                                for (size_t level = depth; level-- > 0;)
+                                {
+                                    const size_t middle = rangeBegin + (rangeEnd - rangeBegin) / 2;
+                                    if ((n >> level) & 1)
+                                    {
+                                        rangeBegin = middle;
+                                    }
+                                    else
+                                    {
+                                        rangeEnd = middle;
+                                    }
+                                }
+                                Vec3d low = { { INFINITY, INFINITY, INFINITY } };
+                                Vec3d high = { { -INFINITY, -INFINITY, -INFINITY } };
+                                for (size_t i = rangeBegin; i < rangeEnd; ++i)
+                                {
+                                    for (size_t a = 0; a < 3; ++a)
+                                    {
+                                        low.data[a] = Min(low.data[a], treePoints[i].position.data[a]);
+                                        high.data[a] = Max(high.data[a], treePoints[i].position.data[a]);
+                                    }
+                                }
+                                const Vec3d extent = high - low;
+                                const uint8_t axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+                                const size_t middle = (rangeEnd - rangeBegin) / 2;
+                                NthElement(treePoints + rangeBegin, rangeEnd - rangeBegin, middle,
+                                           [axis](const KdTreePoint& a, const KdTreePoint& b)
+                                           {
+                                               return a.position.data[axis] < b.position.data[axis];
+                                           });
+                                tree.splits[first + n] = treePoints[rangeBegin + middle].position.data[axis];
+                                tree.axes[first + n] = axis;
+                            }
+                        });
+        }
+        tree.points.resize(count);
+        tree.indices.resize(count);
+        Vec3d* treePositions = tree.points.data();
+        uint32_t* treeIndices = tree.indices.data();
+        ParallelFor(count, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            treePositions[i] = treePoints[i].position;
+                            treeIndices[i] = treePoints[i].index;
+                        }
+                    });
+        if (stats)
+        {
+            *stats = KdTreeStats();
+            stats->count = count;
+            stats->seconds = GetElapsedSeconds(stopwatch);
+            stats->countPerSecond = (stats->seconds > 0.0) ? double(count) / stats->seconds : 0.0;
         }
-        return result;
     }
 
-    Array<String> SplitStringIntoLines(const char* string, Allocator& allocator)
+    void DestroyKdTree(KdTree& tree)
     {
-        Array<String> result;
-        result.allocator = &allocator;
-        const size_t len = StringLength(string);
-        size_t partsCount = 0;
-        for (size_t i = 0; i < len; ++i)
+        FreeArray(tree.points);
+        FreeArray(tree.indices);
+        FreeArray(tree.splits);
+        FreeArray(tree.axes);
+        tree.depth = 0;
+    }
+
+    // bounded max heap on the squared distances, the root is the farthest of the k best points.
+    static void PushKdTreeNeighbour(uint32_t* indices, double* squaredDistances, size_t& count, size_t k, uint32_t index, double squaredDistance)
+    {
+        size_t i;
+        if (count < k)
         {
-            if (string[i] == '\n')
+            i = count++;
+            while (i && squaredDistances[(i - 1) / 2] < squaredDistance)
             {
-                partsCount++;
+                indices[i] = indices[(i - 1) / 2];
+                squaredDistances[i] = squaredDistances[(i - 1) / 2];
+                i = (i - 1) / 2;
             }
         }
-        result.reserve(partsCount);
-
-        size_t previousOffset = 0;
-        for (size_t i = 0; i < len; ++i)
+        else
         {
-            if (string[i] == '\n')
+            // replaces the root and sifts the new point down.
+            i = 0;
+            for (;;)
             {
-                if (i - previousOffset)
+                size_t child = i * 2 + 1;
+                if (child >= count)
                 {
-                    String l = CopyString(string, previousOffset, i, allocator);
-                    result.push_back(l);
+                    break;
                 }
-                previousOffset = i;
+                if (child + 1 < count && squaredDistances[child + 1] > squaredDistances[child])
+                {
+                    child++;
+                }
+                if (squaredDistances[child] <= squaredDistance)
+                {
+                    break;
+                }
+                indices[i] = indices[child];
+                squaredDistances[i] = squaredDistances[child];
+                i = child;
             }
         }
-        if (len - previousOffset)
-        {
-            String l = CopyString(string, previousOffset, len, allocator);
-            result.push_back(l);
-        }
-        return result;
+        indices[i] = index;
+        squaredDistances[i] = squaredDistance;
     }
 
-    Array<StringView> SplitStringViewIntoLines(const char* string, char delim, Allocator& allocator)
+    size_t FindNearestNeighbours(const KdTree& tree, const Vec3d& query, size_t k, uint32_t* indices, double* squaredDistances)
     {
-        Array<StringView> result;
-        result.allocator = &allocator;
-        const size_t len = StringLength(string);
-        size_t partsCount = 0;
-        for (size_t i = 0; i < len; ++i)
+        struct Range
         {
-            if (string[i] == '\n')
-            {
-                partsCount++;
-            }
+            size_t node;
+            size_t begin;
+            size_t end;
+            double distance; // lower bound of the squared distance to the points of the range.
+        };
+        if (!k)
+        {
+            return 0;
         }
-        result.reserve(partsCount);
-
-        size_t previousOffset = 0;
-        for (size_t i = 0; i < len; ++i)
+        const size_t innerCount = ((size_t)1 << tree.depth) - 1;
+        const Vec3d* points = tree.points.data();
+        Range stack[64];
+        size_t stackSize = 0;
+        size_t count = 0;
+        Range range = { 0, 0, tree.points.size(), 0.0 };
+        for (;;)
         {
-            if (string[i] == '\n')
+            if (range.node >= innerCount)
             {
-                if (i - previousOffset)
+                for (size_t i = range.begin; i < range.end; ++i)
                 {
-                    StringView l;
-                    l.data = string + previousOffset;
-                    l.size = i - previousOffset;
-                    result.push_back(l);
+                    const Vec3d d = points[i] - query;
+                    const double distance = DotProduct(d, d);
+                    if (count < k || distance < squaredDistances[0])
+                    {
+                        PushKdTreeNeighbour(indices, squaredDistances, count, k, tree.indices[i], distance);
+                    }
                 }
-                previousOffset = i;
+                // the far sides pushed before the heap got closer points are skipped.
+                while (stackSize && count == k && stack[stackSize - 1].distance >= squaredDistances[0])
+                {
+                    stackSize--;
+                }
+                if (!stackSize)
+                {
+                    break;
+                }
+                range = stack[--stackSize];
+                continue;
             }
+            // the near side is visited first, the far side is at least as far as the split plane.
+            const size_t middle = range.begin + (range.end - range.begin) / 2;
+            const double offset = query.data[tree.axes[range.node]] - tree.splits[range.node];
+            const Range left = { range.node * 2 + 1, range.begin, middle, range.distance };
+            const Range right = { range.node * 2 + 2, middle, range.end, range.distance };
+            Range farSide = (offset < 0.0) ? right : left;
+            farSide.distance = Max(range.distance, offset * offset);
+            if (count < k || farSide.distance < squaredDistances[0])
+            {
+                stack[stackSize++] = farSide;
+            }
+            range = (offset < 0.0) ? left : right;
         }
-        if (len - previousOffset)
+        // sorts the heap in place by popping the farthest point to the end.
+        for (size_t n = count; n > 1; --n)
         {
-            StringView l;
-            l.data = string + previousOffset;
-            l.size = len - previousOffset;
-            result.push_back(l);
+            const uint32_t index = indices[n - 1];
+            const double distance = squaredDistances[n - 1];
+            indices[n - 1] = indices[0];
+            squaredDistances[n - 1] = squaredDistances[0];
+            size_t heapSize = n - 1;
+            PushKdTreeNeighbour(indices, squaredDistances, heapSize, heapSize, index, distance);
         }
-        return result;
+        return count;
     }
-    //------------------------------------------------------------//
 
-    //--------------------UUID------------------------------------//
-#if defined (GEDO_OS_WINDOWS)
-    UUId GenerateUUID()
+    void FindNearestNeighbours(const KdTree& tree, ArrayView<Vec3d> queries, size_t k, Array<uint32_t>& indices, Array<double>& squaredDistances,
+                               KdTreeStats* stats, Allocator& allocator)
     {
-        GUID uuid;
-        UuidCreate(&uuid);
-
-        UUId result
+        const Stopwatch stopwatch = StartStopwatch();
+        FreeArray(indices);
+        FreeArray(squaredDistances);
+        indices.allocator = &allocator;
+        squaredDistances.allocator = &allocator;
+        indices.resize(queries.size * k);
+        squaredDistances.resize(queries.size * k);
+        uint32_t* resultIndices = indices.data();
+        double* resultDistances = squaredDistances.data();
+        ParallelFor(queries.size, 256, [&](size_t begin, size_t end)
+                    {
+                        for (size_t q = begin; q < end; ++q)
+                        {
+                            const size_t found = FindNearestNeighbours(tree, queries.data[q], k, resultIndices + q * k, resultDistances + q * k);
+                            for (size_t i = found; i < k; ++i)
+                            {
+                                resultIndices[q * k + i] = INVALID_INDEX;
+                                resultDistances[q * k + i] = INFINITY;
+                            }
+                        }
+                    });
+        if (stats)
         {
-            (uint8_t)((uuid.Data1 >> 24) & 0xFF),
-            (uint8_t)((uuid.Data1 >> 16) & 0xFF),
-            (uint8_t)((uuid.Data1 >> 8) & 0xFF),
-            (uint8_t)((uuid.Data1) & 0xff),
-
-            (uint8_t)((uuid.Data2 >> 8) & 0xFF),
-            (uint8_t)((uuid.Data2) & 0xff),
-
-            (uint8_t)((uuid.Data3 >> 8) & 0xFF),
-            (uint8_t)((uuid.Data3) & 0xFF),
-
-            (uint8_t)uuid.Data4[0],
-            (uint8_t)uuid.Data4[1],
-            (uint8_t)uuid.Data4[2],
-            (uint8_t)uuid.Data4[3],
-            (uint8_t)uuid.Data4[4],
-            (uint8_t)uuid.Data4[5],
-            (uint8_t)uuid.Data4[6],
-            (uint8_t)uuid.Data4[7]
-        };
-        return result;
+            *stats = KdTreeStats();
+            stats->count = queries.size;
+            // every query finds k points unless the tree has less.
+            stats->resultsCount = queries.size * Min(k, tree.points.size());
+            stats->seconds = GetElapsedSeconds(stopwatch);
+            stats->countPerSecond = (stats->seconds > 0.0) ? double(queries.size) / stats->seconds : 0.0;
+        }
     }
 
-#elif defined (GEDO_OS_LINUX)
-    UUId GenerateUUID()
+    void FindPointsInRadius(const KdTree& tree, const Vec3d& query, double radius, Array<uint32_t>& indices)
     {
-        UUId result;
-        uuid_generate(result.data);
-        return result;
+        indices.clear();
+        ForEachPointInRadius(tree, query, radius, [&](uint32_t index, double) { indices.push_back(index); });
     }
-#endif
-    bool CompareUUID(const UUId& a, const UUId& b)
+
+    void FindPointsInRadius(const KdTree& tree, ArrayView<Vec3d> queries, double radius, Array<uint32_t>& offsets, Array<uint32_t>& indices,
+                            KdTreeStats* stats, Allocator& allocator)
     {
-        for (size_t i = 0; i < 16; ++i)
+        const Stopwatch stopwatch = StartStopwatch();
+        FreeArray(offsets);
+        FreeArray(indices);
+        offsets.allocator = &allocator;
+        indices.allocator = &allocator;
+        offsets.resize(queries.size + 1);
+        uint32_t* resultOffsets = offsets.data();
+        // the queries are run twice, once to count the points and once to write them, so the results
+        // don't need per thread buffers.
+        ParallelFor(queries.size, 256, [&](size_t begin, size_t end)
+                    {
+                        for (size_t q = begin; q < end; ++q)
+                        {
+                            uint32_t found = 0;
+                            ForEachPointInRadius(tree, queries.data[q], radius, [&](uint32_t, double) { found++; });
+                            resultOffsets[q + 1] = found;
+                        }
+                    });
+        for (size_t q = 0; q < queries.size; ++q)
         {
-            if (a.data[i] != b.data[i])
-            {
-                return false;
-            }
+            resultOffsets[q + 1] += resultOffsets[q];
+        }
+        indices.resize(resultOffsets[queries.size]);
+        uint32_t* resultIndices = indices.data();
+        ParallelFor(queries.size, 256, [&](size_t begin, size_t end)
+                    {
+                        for (size_t q = begin; q < end; ++q)
+                        {
+                            uint32_t cursor = resultOffsets[q];
+                            ForEachPointInRadius(tree, queries.data[q], radius, [&](uint32_t index, double) { resultIndices[cursor++] = index; });
+                        }
+                    });
+        if (stats)
+        {
+            *stats = KdTreeStats();
+            stats->count = queries.size;
+            stats->resultsCount = resultOffsets[queries.size];
+            stats->seconds = GetElapsedSeconds(stopwatch);
+            stats->countPerSecond = (stats->seconds > 0.0) ? double(queries.size) / stats->seconds : 0.0;
         }
-        return true;
     }
-    //------------------------------------------------------------//
 
-    //--------------------Math-----------------------------------//
-    Vec2d operator+(const Vec2d a, const Vec2d& b)
+    size_t GetSpatialHashGridBucket(const SpatialHashGrid& grid, int64_t x, int64_t y, int64_t z)
     {
-        return Vec2d{ a.x + b.x, a.y + b.y };
+        const uint64_t hash = ((uint64_t)x * 73856093) ^ ((uint64_t)y * 19349663) ^ ((uint64_t)z * 83492791);
+        // the low bits of the products are weak, a final mix spreads them.
+        return (size_t)((hash * 0x9e3779b97f4a7c15ull) >> 32) & (grid.bucketStarts.size() - 2);
     }
 
-    Vec2d operator-(const Vec2d a, const Vec2d& b)
+    void BuildSpatialHashGrid(ArrayView<Vec3d> points, double cellSize, SpatialHashGrid& grid, Allocator& allocator)
     {
-        return Vec2d{ a.x - b.x, a.y - b.y };
-    }
+        DestroySpatialHashGrid(grid);
+        grid.bucketStarts.allocator = &allocator;
+        grid.points.allocator = &allocator;
+        grid.indices.allocator = &allocator;
+        grid.cellSize = cellSize;
+        const size_t count = points.size;
+        size_t bucketsCount = 1;
+        size_t bucketBits = 0;
+        while (bucketsCount < 2 * count)
+        {
+            bucketsCount *= 2;
+            bucketBits++;
+        }
+        grid.bucketStarts.resize(bucketsCount + 1);
+        grid.points.resize(count);
+        grid.indices.resize(count);
+        if (!count)
+        {
+            return;
+        }
 
-    Vec2d operator*(const Vec2d a, const Vec2d& b)
-    {
-        return Vec2d{ a.x * b.x, a.y * b.y };
+        MemoryBlock keysBlock = allocator.AllocateMemoryBlock(count * sizeof(uint64_t));
+        defer(allocator.FreeMemoryBlock(keysBlock));
+        uint64_t* keys = (uint64_t*)keysBlock.data;
+        uint32_t* indices = grid.indices.data();
+        const double inverseCellSize = 1.0 / cellSize;
+        ParallelFor(count, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            const Vec3d& p = points.data[i];
+                            keys[i] = GetSpatialHashGridBucket(grid, (int64_t)floor(p.x * inverseCellSize), (int64_t)floor(p.y * inverseCellSize),
+                                                               (int64_t)floor(p.z * inverseCellSize));
+                            indices[i] = (uint32_t)i;
+                        }
+                    });
+        RadixSortPairs(keys, indices, count, bucketBits, allocator);
+
+        // every bucket starts at the first point with a key not smaller than it, so each bucket is written by
+        // exactly one point.
+        uint32_t* bucketStarts = grid.bucketStarts.data();
+        Vec3d* sortedPoints = grid.points.data();
+        ParallelFor(count, 64 * 1024, [&](size_t begin, size_t end)
+                    {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            sortedPoints[i] = points.data[indices[i]];
+                            const size_t previous = i ? (size_t)keys[i - 1] + 1 : 0;
+                            for (size_t b = previous; b <= keys[i]; ++b)
+                            {
+                                bucketStarts[b] = (uint32_t)i;
+                            }
+                        }
+                    });
+        for (size_t b = (size_t)keys[count - 1] + 1; b <= bucketsCount; ++b)
+        {
+            bucketStarts[b] = (uint32_t)count;
+        }
     }
 
-    Vec2d operator*(const Vec2d a, double x)
+    void DestroySpatialHashGrid(SpatialHashGrid& grid)
     {
-        return Vec2d{ a.x * x, a.y * x };
+        FreeArray(grid.bucketStarts);
+        FreeArray(grid.points);
+        FreeArray(grid.indices);
     }
 
-    Vec2d operator*(double x, const Vec2d a)
+    ScalarVolume CreateScalarVolume(size_t width, size_t height, size_t depth, Allocator& allocator)
     {
-        return Vec2d{ a.x * x, a.y * x };
+        ScalarVolume result;
+        result.width = width;
+        result.height = height;
+        result.depth = depth;
+        MemoryBlock block = allocator.AllocateMemoryBlock(sizeof(float) * width * height * depth);
+        GEDO_ASSERT(block.data);
+        result.data = (float*)block.data;
+        return result;
     }
 
-    Vec3d operator+(const Vec3d a, const Vec3d& b)
+    void DestroyScalarVolume(ScalarVolume& volume, Allocator& allocator)
     {
-        return Vec3d{ a.x + b.x, a.y + b.y, a.z + b.z };
+        GEDO_ASSERT(volume.data);
+        MemoryBlock block;
+        block.data = (uint8_t*)volume.data;
+        block.size = volume.width * volume.height * volume.depth * sizeof(float);
+        allocator.FreeMemoryBlock(block);
+        volume.data = NULL;
     }
 
-    Vec3d operator-(const Vec3d a, const Vec3d& b)
+    // corner i of a cube is at (i & 1, (i >> 1) & 1, i >> 2). edge e is parallel to axis e / 4 and e % 4 gives
+    // its 2 other coordinates, the lower axis in bit 0.
+    static const size_t MARCHING_CUBES_MAX_TRIANGLES = 5;
+
+    struct MarchingCubesTables
     {
-        return Vec3d{ a.x - b.x, a.y - b.y, a.z - b.z };
-    }
+        uint8_t trianglesCount[256];
+        uint8_t edges[256][MARCHING_CUBES_MAX_TRIANGLES * 3];
+    };
 
-    Vec3d operator*(const Vec3d a, const Vec3d& b)
+    static size_t GetCubeEdge(size_t corner0, size_t corner1)
     {
-        return Vec3d{ a.x * b.x, a.y * b.y, a.z * b.z };
+        const size_t axis = (corner0 ^ corner1) >> 1;
+        const size_t low = (axis == 0) ? 1 : 0;
+        const size_t high = (axis == 2) ? 1 : 2;
+        return axis * 4 + ((corner0 >> low) & 1) + ((corner0 >> high) & 1) * 2;
     }
 
-    Vec3d operator*(const Vec3d a, double x)
+    // the 2 faces edge is on as bits of axis * 2 + side.
+    static uint32_t GetCubeEdgeFaces(size_t edge)
     {
-        return Vec3d{ a.x * x, a.y * x, a.z * x };
+        const size_t axis = edge / 4;
+        const size_t low = (axis == 0) ? 1 : 0;
+        const size_t high = (axis == 2) ? 1 : 2;
+        return (1u << (low * 2 + (edge & 1))) | (1u << (high * 2 + ((edge >> 1) & 1)));
     }
 
-    Vec3d operator*(double x, const Vec3d a)
+    // the surface of every case is made of the loops of its edges: on every face, the edge where an outside
+    // corner is followed by an inside one (counter clockwise seen from outside the cube) links to the next
+    // crossed edge, which cuts the inside corners off the others. every loop is then triangulated as a fan.
+    static MarchingCubesTables CreateMarchingCubesTables()
     {
-        return Vec3d{ a.x * x, a.y * x, a.z * x };
+        MarchingCubesTables tables;
+        for (size_t config = 0; config < 256; ++config)
+        {
+            uint8_t next[12];
+            for (size_t e = 0; e < 12; ++e)
+            {
+                next[e] = UINT8_MAX;
+            }
+            for (size_t face = 0; face < 6; ++face)
+            {
+                const size_t axis = face / 2;
+                const size_t u = (axis + 1) % 3;
+                const size_t v = (axis + 2) % 3;
+                const size_t side = (face & 1) << axis;
+                size_t corners[4] = { side, side | ((size_t)1 << u), side | ((size_t)1 << u) | ((size_t)1 << v), side | ((size_t)1 << v) };
+                if (!(face & 1))
+                {
+                    Swap(corners[1], corners[3]);
+                }
+                for (size_t i = 0; i < 4; ++i)
+                {
+                    const size_t a = corners[i];
+                    const size_t b = corners[(i + 1) % 4];
+                    if (((config >> a) & 1) || !((config >> b) & 1))
+                    {
+                        continue;
+                    }
+                    for (size_t j = 1; j < 4; ++j)
+                    {
+                        const size_t c = corners[(i + j) % 4];
+                        const size_t d = corners[(i + j + 1) % 4];
+                        if (((config >> c) & 1) != ((config >> d) & 1))
+                        {
+                            next[GetCubeEdge(a, b)] = (uint8_t)GetCubeEdge(c, d);
+                            break;
+                        }
+                    }
+                }
+            }
+            size_t count = 0;
+            for (size_t first = 0; first < 12; ++first)
+            {
+                uint8_t loop[12];
+                size_t loopSize = 0;
+                for (uint8_t edge = (uint8_t)first; next[edge] != UINT8_MAX;)
+                {
+                    loop[loopSize++] = edge;
+                    const uint8_t following = next[edge];
+                    next[edge] = UINT8_MAX;
+                    edge = following;
+                }
+                // a diagonal between 2 edges of the same face could also be made by the cube on the other side
+                // of it, the fan starts where none of its diagonals is on a face.
+                size_t start = 0;
+                for (size_t i = 0; i < loopSize; ++i)
+                {
+                    bool onFace = false;
+                    for (size_t j = 2; j + 1 < loopSize; ++j)
+                    {
+                        onFace |= (GetCubeEdgeFaces(loop[i]) & GetCubeEdgeFaces(loop[(i + j) % loopSize])) != 0;
+                    }
+                    if (!onFace)
+                    {
+                        start = i;
+                        break;
+                    }
+                }
+                for (size_t i = 1; i + 1 < loopSize; ++i)
+                {
+                    GEDO_ASSERT(count < MARCHING_CUBES_MAX_TRIANGLES);
+                    tables.edges[config][count * 3] = loop[start];
+                    tables.edges[config][count * 3 + 1] = loop[(start + i) % loopSize];
+                    tables.edges[config][count * 3 + 2] = loop[(start + i + 1) % loopSize];
+                    count++;
+                }
+            }
+            tables.trianglesCount[config] = (uint8_t)count;
+        }
+        return tables;
     }
 
-    double DotProduct(const Vec3d a, const Vec3d& b)
+    static const MarchingCubesTables& GetMarchingCubesTables()
     {
-        return a.x * b.x + a.y * b.y + a.z * b.z;
+        static const MarchingCubesTables tables = CreateMarchingCubesTables();
+        return tables;
     }
 
-    double DotProduct(const Vec2d a, const Vec2d& b)
+    // the vertex indices of the edges around the current layer of cubes, each a slice of the volume.
+    struct MarchingCubesCaches
     {
-        return a.x * b.x + a.y * b.y;
-    }
+        uint32_t* lowerX; // the x edges of the lower plane of samples.
+        uint32_t* lowerY;
+        uint32_t* upperX;
+        uint32_t* upperY;
+        uint32_t* vertical; // the z edges between both planes.
+    };
 
-    double DotProduct(const double a[4], const double b[4])
+    static Vec3d GetMarchingCubesVertex(const ScalarVolume& volume, float isoValue, float a, float b, size_t x, size_t y, size_t z, size_t axis)
     {
-        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+        Vec3d p = { { (double)x, (double)y, (double)z } };
+        p.data[axis] += (isoValue - a) / (b - a);
+        return volume.origin + p * volume.spacing;
     }
 
-    Mat4 operator*(const Mat4& left, const Mat4& right)
+    // numbers the vertices on the x and y edges of plane z in scan order from next, positions can be NULL to
+    // only predict the indices of another slab.
+    static void MakeMarchingCubesPlaneVertices(const ScalarVolume& volume, size_t z, float isoValue, uint32_t* idsX, uint32_t* idsY, uint32_t& next, Vec3d* positions)
     {
-        Mat4 result;
-        for (int columns = 0; columns < 4; ++columns)
+        const float* plane = volume.data + z * volume.width * volume.height;
+        for (size_t y = 0; y < volume.height; ++y)
         {
-            for (int rows = 0; rows < 4; ++rows)
+            for (size_t x = 0; x < volume.width; ++x)
             {
-                double sum = 0;
-                for (int currentMatrice = 0; currentMatrice < 4; ++currentMatrice)
+                const size_t i = x + y * volume.width;
+                const bool inside = plane[i] < isoValue;
+                if (x + 1 < volume.width && inside != (plane[i + 1] < isoValue))
                 {
-                    sum += left.elements[currentMatrice][rows] * right.elements[columns][currentMatrice];
+                    if (positions)
+                    {
+                        positions[next] = GetMarchingCubesVertex(volume, isoValue, plane[i], plane[i + 1], x, y, z, 0);
+                    }
+                    idsX[i] = next++;
+                }
+                if (y + 1 < volume.height && inside != (plane[i + volume.width] < isoValue))
+                {
+                    if (positions)
+                    {
+                        positions[next] = GetMarchingCubesVertex(volume, isoValue, plane[i], plane[i + volume.width], x, y, z, 1);
+                    }
+                    idsY[i] = next++;
                 }
-                result.elements[columns][rows] = sum;
             }
         }
-        return result;
     }
 
-    Mat4 operator*(Mat4 left, double x)
+    static void MakeMarchingCubesVerticalVertices(const ScalarVolume& volume, size_t z, float isoValue, uint32_t* ids, uint32_t& next, Vec3d* positions)
     {
-        for (int columns = 0; columns < 4; ++columns)
+        const size_t sliceSize = volume.width * volume.height;
+        const float* lower = volume.data + z * sliceSize;
+        const float* upper = lower + sliceSize;
+        for (size_t i = 0; i < sliceSize; ++i)
         {
-            for (int rows = 0; rows < 4; ++rows)
+            if ((lower[i] < isoValue) != (upper[i] < isoValue))
             {
-                left.elements[columns][rows] *= x;
+                positions[next] = GetMarchingCubesVertex(volume, isoValue, lower[i], upper[i], i % volume.width, i / volume.width, z, 2);
+                ids[i] = next++;
             }
         }
-        return left;
     }
 
-    Vec3d operator*(const Mat3 a, const Vec3d& v)
+    static size_t GetMarchingCubesCase(const ScalarVolume& volume, size_t x, size_t y, size_t z, float isoValue)
     {
-        Vec3d r;
-        for (int rows = 0; rows < 3; ++rows)
+        const size_t sliceSize = volume.width * volume.height;
+        const float* p = volume.data + x + y * volume.width + z * sliceSize;
+        const size_t offsets[8] = { 0, 1, volume.width, volume.width + 1, sliceSize, sliceSize + 1, sliceSize + volume.width, sliceSize + volume.width + 1 };
+        size_t config = 0;
+        for (size_t i = 0; i < 8; ++i)
         {
-            double sum = 0;
-            for (int columns = 0; columns < 3; ++columns)
+            config |= (size_t)(p[offsets[i]] < isoValue) << i;
+        }
+        return config;
+    }
+
+    static size_t CountMarchingCubesPlaneVertices(const ScalarVolume& volume, size_t z, float isoValue)
+    {
+        const float* plane = volume.data + z * volume.width * volume.height;
+        size_t count = 0;
+        for (size_t y = 0; y < volume.height; ++y)
+        {
+            for (size_t x = 0; x < volume.width; ++x)
             {
-                sum += a.elements[columns][rows] * v.data[columns];
+                const size_t i = x + y * volume.width;
+                const bool inside = plane[i] < isoValue;
+                count += x + 1 < volume.width && inside != (plane[i + 1] < isoValue);
+                count += y + 1 < volume.height && inside != (plane[i + volume.width] < isoValue);
             }
-            r.data[rows] = sum;
         }
-        return r;
+        return count;
     }
 
-    Vec3d CrossProduct(const Vec3d a, const Vec3d& b)
+    void MarchingCubes(const ScalarVolume& volume, float isoValue, TriangleMesh& mesh, Allocator& allocator)
     {
-        return Vec3d{ a.y * b.z - a.z * b.y,
-                      a.z * b.x - a.x * b.z,
-                      a.x * b.y - a.y * b.x };
+        DestroyTriangleMesh(mesh);
+        const size_t width = volume.width;
+        const size_t height = volume.height;
+        if (width < 2 || height < 2 || volume.depth < 2)
+        {
+            mesh = CreateTriangleMesh(0, 0, false, false, allocator);
+            return;
+        }
+        const MarchingCubesTables& tables = GetMarchingCubesTables();
+        const size_t sliceSize = width * height;
+        const size_t layersCount = volume.depth - 1;
+        // slab s has the layers of cubes from s * layersCount / slabsCount to (s + 1) * layersCount / slabsCount,
+        // the vertices of the planes of samples from its first one to the one before the next slab, and the
+        // vertical ones of its layers.
+        const size_t slabsCount = Min<size_t>(layersCount, GetProcessorCount() * 4);
+        MemoryBlock offsetsBlock = allocator.AllocateMemoryBlock((slabsCount + 1) * 2 * sizeof(size_t));
+        defer(allocator.FreeMemoryBlock(offsetsBlock));
+        size_t* vertexOffsets = (size_t*)offsetsBlock.data;
+        size_t* triangleOffsets = vertexOffsets + slabsCount + 1;
+        ParallelFor(slabsCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t s = begin; s < end; ++s)
+                        {
+                            const size_t firstLayer = s * layersCount / slabsCount;
+                            const size_t lastLayer = (s + 1) * layersCount / slabsCount;
+                            size_t verticesCount = (s + 1 == slabsCount) ? CountMarchingCubesPlaneVertices(volume, lastLayer, isoValue) : 0;
+                            size_t trianglesCount = 0;
+                            for (size_t z = firstLayer; z < lastLayer; ++z)
+                            {
+                                verticesCount += CountMarchingCubesPlaneVertices(volume, z, isoValue);
+                                const float* lower = volume.data + z * sliceSize;
+                                for (size_t i = 0; i < sliceSize; ++i)
+                                {
+                                    verticesCount += (lower[i] < isoValue) != (lower[i + sliceSize] < isoValue);
+                                }
+                                for (size_t y = 0; y + 1 < height; ++y)
+                                {
+                                    for (size_t x = 0; x + 1 < width; ++x)
+                                    {
+                                        trianglesCount += tables.trianglesCount[GetMarchingCubesCase(volume, x, y, z, isoValue)];
+                                    }
+                                }
+                            }
+                            vertexOffsets[s + 1] = verticesCount;
+                            triangleOffsets[s + 1] = trianglesCount;
+                        }
+                    });
+        for (size_t s = 0; s < slabsCount; ++s)
+        {
+            vertexOffsets[s + 1] += vertexOffsets[s];
+            triangleOffsets[s + 1] += triangleOffsets[s];
+        }
+        GEDO_ASSERT(vertexOffsets[slabsCount] < UINT32_MAX);
+        mesh = CreateTriangleMesh(vertexOffsets[slabsCount], triangleOffsets[slabsCount], false, false, allocator);
+        Vec3d* positions = mesh.positions.data();
+        uint32_t* indices = mesh.indices.data();
+
+        // the allocator isn't thread safe, so the caches of every worker are allocated here.
+        const size_t workersCount = Min<size_t>(Min<size_t>(GetProcessorCount(), 64), slabsCount);
+        MemoryBlock cachesBlock = allocator.AllocateMemoryBlock(workersCount * sliceSize * 5 * sizeof(uint32_t));
+        defer(allocator.FreeMemoryBlock(cachesBlock));
+        ParallelFor(workersCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t w = begin; w < end; ++w)
+                        {
+                            uint32_t* slices = (uint32_t*)cachesBlock.data + w * sliceSize * 5;
+                            MarchingCubesCaches caches = { slices, slices + sliceSize, slices + sliceSize * 2, slices + sliceSize * 3, slices + sliceSize * 4 };
+                            for (size_t s = w * slabsCount / workersCount; s < (w + 1) * slabsCount / workersCount; ++s)
+                            {
+                                const size_t firstLayer = s * layersCount / slabsCount;
+                                const size_t lastLayer = (s + 1) * layersCount / slabsCount;
+                                uint32_t next = (uint32_t)vertexOffsets[s];
+                                uint32_t* triangle = indices + triangleOffsets[s] * 3;
+                                MakeMarchingCubesPlaneVertices(volume, firstLayer, isoValue, caches.lowerX, caches.lowerY, next, positions);
+                                for (size_t z = firstLayer; z < lastLayer; ++z)
+                                {
+                                    MakeMarchingCubesVerticalVertices(volume, z, isoValue, caches.vertical, next, positions);
+                                    if (z + 1 == lastLayer && s + 1 < slabsCount)
+                                    {
+                                        // the first plane of the next slab, which numbers it first.
+                                        uint32_t predicted = (uint32_t)vertexOffsets[s + 1];
+                                        MakeMarchingCubesPlaneVertices(volume, z + 1, isoValue, caches.upperX, caches.upperY, predicted, NULL);
+                                    }
+                                    else
+                                    {
+                                        MakeMarchingCubesPlaneVertices(volume, z + 1, isoValue, caches.upperX, caches.upperY, next, positions);
+                                    }
+                                    for (size_t y = 0; y + 1 < height; ++y)
+                                    {
+                                        for (size_t x = 0; x + 1 < width; ++x)
+                                        {
+                                            const size_t config = GetMarchingCubesCase(volume, x, y, z, isoValue);
+                                            const uint8_t* edges = tables.edges[config];
+                                            for (size_t i = 0; i < tables.trianglesCount[config] * 3u; ++i)
+                                            {
+                                                const size_t k = edges[i] % 4;
+                                                const size_t cell = x + y * width;
+                                                switch (edges[i] / 4)
+                                                {
+                                                case 0:
+                                                    *triangle++ = ((k >> 1) ? caches.upperX : caches.lowerX)[cell + (k & 1) * width];
+                                                    break;
+                                                case 1:
+                                                    *triangle++ = ((k >> 1) ? caches.upperY : caches.lowerY)[cell + (k & 1)];
+                                                    break;
+                                                default:
+                                                    *triangle++ = caches.vertical[cell + (k & 1) + (k >> 1) * width];
+                                                    break;
+                                                }
+                                            }
+                                        }
+                                    }
+                                    Swap(caches.lowerX, caches.upperX);
+                                    Swap(caches.lowerY, caches.upperY);
+                                }
+                                GEDO_ASSERT(next == vertexOffsets[s + 1]);
+                                GEDO_ASSERT(triangle == indices + triangleOffsets[s + 1] * 3);
+                            }
+                        }
+                    });
     }
 
-    double Length(const Vec2d& v)
+    static const size_t VOXEL_TESTS = 8;
+
+    struct VoxelizeContext
     {
-        return sqrtf(v.x * v.x + v.y * v.y);
-    }
+        const TriangleMesh* mesh;
+        Vec3d origin;
+        double inverseVoxelSize;
+        size_t width;
+        size_t height;
+        size_t depth;
+        size_t wordsPerRow;
+        VoxelizationMode mode;
+        const uint32_t* binStarts; // the triangles of every slab of VOXEL_BRICK_SIZE layers (CSR).
+        const uint32_t* binTriangles;
+    };
 
-    double Length(const Vec3d& v)
+    static size_t CountBits(uint64_t v)
     {
-        return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+        v = v - ((v >> 1) & 0x5555555555555555ull);
+        v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+        v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (size_t)((v * 0x0101010101010101ull) >> 56);
     }
 
-    void Normalise(Vec2d& v)
+    // the triangle in voxel units, voxel (x, y, z) is the box [x, x + 1] x [y, y + 1] x [z, z + 1].
+    static void GetVoxelTriangle(const VoxelizeContext& context, size_t triangle, Vec3d* v)
     {
-        const double length = Length(v);
-        v.x /= length;
-        v.y /= length;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            v[i] = (context.mesh->positions[context.mesh->indices[triangle * 3 + i]] - context.origin) * context.inverseVoxelSize;
+        }
     }
 
-    Vec2d Normalised(const Vec2d& v)
+    // sets the bits of the voxels of rows [z0, z1) of the slab words that the triangle touches. the overlap is
+    // the plane test plus the edge tests of the 3 projections, all linear in the voxel corner, so with y and z
+    // fixed each is a * x + b >= 0. the yz ones are checked once per row, the 8 others on 8 voxels at once.
+    static void VoxelizeTriangleSurface(const VoxelizeContext& context, const Vec3d* v, size_t z0, size_t z1, uint64_t* words)
     {
-        const double length = Length(v);
-        return Vec2d{ v.x / length, v.y / length };
+        size_t low[3];
+        size_t high[3];
+        const size_t sizes[3] = { context.width, context.height, context.depth };
+        for (size_t a = 0; a < 3; ++a)
+        {
+            const double minimum = Min(Min(v[0].data[a], v[1].data[a]), v[2].data[a]);
+            const double maximum = Max(Max(v[0].data[a], v[1].data[a]), v[2].data[a]);
+            low[a] = (size_t)Clamp(floor(minimum), 0.0, (double)sizes[a] - 1);
+            high[a] = (size_t)Clamp(floor(maximum), 0.0, (double)sizes[a] - 1);
+        }
+        low[2] = Max(low[2], z0);
+        high[2] = Min(high[2], z1 - 1);
+        const Vec3d e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+        const Vec3d n = CrossProduct(e[0], e[1]);
+        const Vec3d critical = { { n.x > 0.0 ? 1.0 : 0.0, n.y > 0.0 ? 1.0 : 0.0, n.z > 0.0 ? 1.0 : 0.0 } };
+        const double d1 = DotProduct(n, critical - v[0]);
+        const double d2 = DotProduct(n, Vec3d{ { 1.0, 1.0, 1.0 } } - critical - v[0]);
+        // the edge normals of the projections on (x, y), (y, z) and (z, x) with their offsets.
+        double xy[3][3];
+        double yz[3][3];
+        double zx[3][3];
+        const double signZ = (n.z < 0.0) ? -1.0 : 1.0;
+        const double signX = (n.x < 0.0) ? -1.0 : 1.0;
+        const double signY = (n.y < 0.0) ? -1.0 : 1.0;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            xy[i][0] = -e[i].y * signZ;
+            xy[i][1] = e[i].x * signZ;
+            xy[i][2] = -(xy[i][0] * v[i].x + xy[i][1] * v[i].y) + Max(0.0, xy[i][0]) + Max(0.0, xy[i][1]);
+            yz[i][0] = -e[i].z * signX;
+            yz[i][1] = e[i].y * signX;
+            yz[i][2] = -(yz[i][0] * v[i].y + yz[i][1] * v[i].z) + Max(0.0, yz[i][0]) + Max(0.0, yz[i][1]);
+            zx[i][0] = -e[i].x * signY;
+            zx[i][1] = e[i].z * signY;
+            zx[i][2] = -(zx[i][0] * v[i].z + zx[i][1] * v[i].x) + Max(0.0, zx[i][0]) + Max(0.0, zx[i][1]);
+        }
+        // floats on 8 voxels, every test gets a small slack so rounding can only add voxels.
+        float a[VOXEL_TESTS];
+        float b[VOXEL_TESTS];
+        for (size_t i = 0; i < 3; ++i)
+        {
+            a[i] = (float)xy[i][0];
+            a[i + 3] = (float)zx[i][1];
+        }
+        a[6] = (float)n.x;
+        a[7] = (float)-n.x;
+        for (size_t z = low[2]; z <= high[2]; ++z)
+        {
+            for (size_t y = low[1]; y <= high[1]; ++y)
+            {
+                bool outside = false;
+                for (size_t i = 0; i < 3; ++i)
+                {
+                    outside |= yz[i][0] * y + yz[i][1] * z + yz[i][2] < 0.0;
+                }
+                if (outside)
+                {
+                    continue;
+                }
+                double rowB[VOXEL_TESTS];
+                for (size_t i = 0; i < 3; ++i)
+                {
+                    rowB[i] = xy[i][1] * y + xy[i][2];
+                    rowB[i + 3] = zx[i][0] * z + zx[i][2];
+                }
+                const double planeOffset = n.y * y + n.z * z;
+                rowB[6] = planeOffset + d1;
+                rowB[7] = -(planeOffset + d2);
+                for (size_t i = 0; i < VOXEL_TESTS; ++i)
+                {
+                    b[i] = (float)(rowB[i] + 1e-5 * (Abs((double)a[i]) * (high[0] + 1) + Abs(rowB[i]) + 1.0));
+                }
+                uint64_t* row = words + ((z - z0) * context.height + y) * context.wordsPerRow;
+                for (size_t x0 = low[0] & ~(size_t)7; x0 <= high[0]; x0 += 8)
+                {
+#if defined __AVX2__
+                    const __m256 xs = _mm256_add_ps(_mm256_set1_ps((float)x0), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+                    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                    for (size_t i = 0; i < VOXEL_TESTS; ++i)
+                    {
+                        const __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[i]), xs), _mm256_set1_ps(b[i]));
+                        inside = _mm256_and_ps(inside, _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_GE_OQ));
+                    }
+                    uint64_t mask = (uint64_t)_mm256_movemask_ps(inside);
+#else
+                    uint64_t mask = 0;
+                    for (size_t lane = 0; lane < 8; ++lane)
+                    {
+                        const float x = (float)(x0 + lane);
+                        bool inside = true;
+                        for (size_t i = 0; i < VOXEL_TESTS; ++i)
+                        {
+                            inside &= a[i] * x + b[i] >= 0.0f;
+                        }
+                        mask |= (uint64_t)inside << lane;
+                    }
+#endif // __AVX2__
+                    // keeps the voxels of the bounds.
+                    if (x0 < low[0])
+                    {
+                        mask &= ~(uint64_t)0 << (low[0] - x0);
+                    }
+                    if (high[0] < x0 + 7)
+                    {
+                        mask &= ((uint64_t)1 << (high[0] - x0 + 1)) - 1;
+                    }
+                    row[x0 / 64] |= mask << (x0 % 64);
+                }
+            }
+        }
     }
 
-    void Normalise(Vec3d& v)
+    // the yz edge function of a to b at p, made with the endpoints in a fixed order so the 2 triangles of an
+    // edge get exactly opposite values.
+    static double GetVoxelEdgeFunction(const Vec3d& a, const Vec3d& b, double y, double z)
     {
-        const double length = Length(v);
-        v.x /= length;
-        v.y /= length;
-        v.z /= length;
+        const bool swapped = (b.y < a.y) || (b.y == a.y && b.z < a.z);
+        const Vec3d& p0 = swapped ? b : a;
+        const Vec3d& p1 = swapped ? a : b;
+        const double value = (p1.y - p0.y) * (z - p0.z) - (p1.z - p0.z) * (y - p0.y);
+        return swapped ? -value : value;
     }
 
-    Vec3d Normalised(const Vec3d& v)
+    // flips the bit of the first voxel whose center is past the triangle on every column of rows [z0, z1)
+    // whose center the triangle covers in the yz projection. the top left rule counts the columns on shared
+    // edges once.
+    static void VoxelizeTriangleSolid(const VoxelizeContext& context, const Vec3d* triangle, size_t z0, size_t z1, uint64_t* flips)
     {
-        const double length = Length(v);
-        return Vec3d{ v.x / length, v.y / length, v.z / length };
+        Vec3d v[3] = { triangle[0], triangle[1], triangle[2] };
+        const double area = GetVoxelEdgeFunction(v[0], v[1], v[2].y, v[2].z);
+        if (area == 0.0)
+        {
+            return;
+        }
+        if (area < 0.0)
+        {
+            Swap(v[1], v[2]);
+        }
+        const Vec3d n = CrossProduct(v[1] - v[0], v[2] - v[0]);
+        const double minY = Min(Min(v[0].y, v[1].y), v[2].y);
+        const double maxY = Max(Max(v[0].y, v[1].y), v[2].y);
+        const double minZ = Min(Min(v[0].z, v[1].z), v[2].z);
+        const double maxZ = Max(Max(v[0].z, v[1].z), v[2].z);
+        const int64_t lowY = Max<int64_t>((int64_t)ceil(minY - 0.5), 0);
+        const int64_t highY = Min<int64_t>((int64_t)floor(maxY - 0.5), (int64_t)context.height - 1);
+        const int64_t lowZ = Max<int64_t>((int64_t)ceil(minZ - 0.5), (int64_t)z0);
+        const int64_t highZ = Min<int64_t>((int64_t)floor(maxZ - 0.5), (int64_t)z1 - 1);
+        bool topLeft[3];
+        for (size_t i = 0; i < 3; ++i)
+        {
+            const Vec3d& a = v[i];
+            const Vec3d& b = v[(i + 1) % 3];
+            topLeft[i] = (b.z < a.z) || (b.z == a.z && b.y < a.y);
+        }
+        for (int64_t z = lowZ; z <= highZ; ++z)
+        {
+            for (int64_t y = lowY; y <= highY; ++y)
+            {
+                const double cy = y + 0.5;
+                const double cz = z + 0.5;
+                bool inside = true;
+                for (size_t i = 0; i < 3; ++i)
+                {
+                    const double value = GetVoxelEdgeFunction(v[i], v[(i + 1) % 3], cy, cz);
+                    inside &= value > 0.0 || (value == 0.0 && topLeft[i]);
+                }
+                if (!inside)
+                {
+                    continue;
+                }
+                const double hit = v[0].x - (n.y * (cy - v[0].y) + n.z * (cz - v[0].z)) / n.x;
+                const double first = Max(floor(hit - 0.5) + 1.0, 0.0);
+                if (first < (double)context.width)
+                {
+                    const size_t x = (size_t)first;
+                    flips[((z - z0) * context.height + y) * context.wordsPerRow + x / 64] ^= (uint64_t)1 << (x % 64);
+                }
+            }
+        }
     }
 
-    Mat4 Transpose(Mat4 m)
+    // voxelizes slab into words, VOXEL_BRICK_SIZE layers of rows (fewer for the last slab). scratch holds
+    // the surface while words gets the parity for SURFACE_AND_SOLID.
+    static void VoxelizeSlab(const VoxelizeContext& context, size_t slab, uint64_t* words, uint64_t* scratch)
     {
-        Swap(m.elements[0][1], m.elements[1][0]);
-        Swap(m.elements[0][2], m.elements[2][0]);
-        Swap(m.elements[0][3], m.elements[3][0]);
-        Swap(m.elements[1][2], m.elements[2][1]);
-        Swap(m.elements[1][3], m.elements[3][1]);
-        Swap(m.elements[2][3], m.elements[3][2]);
-        return m;
+        const size_t z0 = slab * VOXEL_BRICK_SIZE;
+        const size_t z1 = Min(z0 + VOXEL_BRICK_SIZE, context.depth);
+        const size_t rowsCount = (z1 - z0) * context.height;
+        const size_t wordsCount = rowsCount * context.wordsPerRow;
+        GEDO_MEMSET(words, 0, wordsCount * sizeof(uint64_t));
+        const bool both = context.mode == VoxelizationMode::SURFACE_AND_SOLID;
+        if (both)
+        {
+            GEDO_MEMSET(scratch, 0, wordsCount * sizeof(uint64_t));
+        }
+        for (uint32_t i = context.binStarts[slab]; i < context.binStarts[slab + 1]; ++i)
+        {
+            Vec3d v[3];
+            GetVoxelTriangle(context, context.binTriangles[i], v);
+            if (context.mode == VoxelizationMode::SURFACE)
+            {
+                VoxelizeTriangleSurface(context, v, z0, z1, words);
+                continue;
+            }
+            VoxelizeTriangleSolid(context, v, z0, z1, words);
+            if (both)
+            {
+                VoxelizeTriangleSurface(context, v, z0, z1, scratch);
+            }
+        }
+        if (context.mode == VoxelizationMode::SURFACE)
+        {
+            return;
+        }
+        // a voxel is inside when an odd count of flips precedes it on its row.
+        const uint64_t lastWordMask = (context.width % 64) ? ((uint64_t)1 << (context.width % 64)) - 1 : ~(uint64_t)0;
+        for (size_t r = 0; r < rowsCount; ++r)
+        {
+            uint64_t* row = words + r * context.wordsPerRow;
+            uint64_t parity = 0;
+            for (size_t w = 0; w < context.wordsPerRow; ++w)
+            {
+                uint64_t bits = row[w];
+                bits ^= bits << 1;
+                bits ^= bits << 2;
+                bits ^= bits << 4;
+                bits ^= bits << 8;
+                bits ^= bits << 16;
+                bits ^= bits << 32;
+                bits ^= parity;
+                parity = (bits >> 63) ? ~(uint64_t)0 : 0;
+                row[w] = bits;
+            }
+            row[context.wordsPerRow - 1] &= lastWordMask;
+            if (both)
+            {
+                const uint64_t* surface = scratch + r * context.wordsPerRow;
+                for (size_t w = 0; w < context.wordsPerRow; ++w)
+                {
+                    row[w] |= surface[w];
+                }
+            }
+        }
     }
 
-    Mat3 Transpose(Mat3 m)
+    // sizes the grid over the bounds of mesh and bins the triangles by slab.
+    static size_t PrepareVoxelization(const TriangleMesh& mesh, double voxelSize, VoxelizationMode mode, VoxelizeContext& context, Array<uint32_t>& binStarts, Array<uint32_t>& binTriangles)
     {
-        Swap(m.elements[0][1], m.elements[1][0]);
-        Swap(m.elements[0][2], m.elements[2][0]);
-        Swap(m.elements[1][2], m.elements[2][1]);
-        return m;
+        Vec3d low = {};
+        Vec3d high = {};
+        if (mesh.positions.size())
+        {
+            const Bounds bounds = ComputeBounds(ArrayView<Vec3d>{ mesh.positions.data(), mesh.positions.size() });
+            low = bounds.min;
+            high = bounds.max;
+        }
+        context.mesh = &mesh;
+        context.origin = low;
+        context.inverseVoxelSize = 1.0 / voxelSize;
+        context.width = (size_t)floor((high.x - low.x) * context.inverseVoxelSize) + 1;
+        context.height = (size_t)floor((high.y - low.y) * context.inverseVoxelSize) + 1;
+        context.depth = (size_t)floor((high.z - low.z) * context.inverseVoxelSize) + 1;
+        context.wordsPerRow = (context.width + 63) / 64;
+        context.mode = mode;
+
+        const size_t slabsCount = (context.depth + VOXEL_BRICK_SIZE - 1) / VOXEL_BRICK_SIZE;
+        const size_t trianglesCount = mesh.indices.size() / 3;
+        binStarts.resize(slabsCount + 1);
+        uint32_t* starts = binStarts.data();
+        GEDO_MEMSET(starts, 0, (slabsCount + 1) * sizeof(uint32_t));
+        // every triangle goes in the slabs of its voxel z range.
+        auto getSlabs = [&](size_t t, size_t& first, size_t& last)
+        {
+            double minimum = INFINITY;
+            double maximum = -INFINITY;
+            for (size_t i = 0; i < 3; ++i)
+            {
+                const double z = (mesh.positions[mesh.indices[t * 3 + i]].z - low.z) * context.inverseVoxelSize;
+                minimum = Min(minimum, z);
+                maximum = Max(maximum, z);
+            }
+            first = (size_t)Clamp(floor(minimum), 0.0, (double)context.depth - 1) / VOXEL_BRICK_SIZE;
+            last = (size_t)Clamp(floor(maximum), 0.0, (double)context.depth - 1) / VOXEL_BRICK_SIZE;
+        };
+        for (size_t t = 0; t < trianglesCount; ++t)
+        {
+            size_t first;
+            size_t last;
+            getSlabs(t, first, last);
+            for (size_t s = first; s <= last; ++s)
+            {
+                starts[s + 1]++;
+            }
+        }
+        for (size_t s = 0; s < slabsCount; ++s)
+        {
+            starts[s + 1] += starts[s];
+        }
+        binTriangles.resize(starts[slabsCount]);
+        uint32_t* triangles = binTriangles.data();
+        for (size_t t = 0; t < trianglesCount; ++t)
+        {
+            size_t first;
+            size_t last;
+            getSlabs(t, first, last);
+            for (size_t s = first; s <= last; ++s)
+            {
+                triangles[starts[s]++] = (uint32_t)t;
+            }
+        }
+        for (size_t s = slabsCount; s > 0; --s)
+        {
+            starts[s] = starts[s - 1];
+        }
+        starts[0] = 0;
+        context.binStarts = starts;
+        context.binTriangles = triangles;
+        return slabsCount;
     }
 
-    Mat4 Translate(const Mat4& m, Vec3d translation)
+    void VoxelizeMesh(const TriangleMesh& mesh, double voxelSize, VoxelizationMode mode, VoxelGrid& grid, Allocator& allocator)
     {
-        Mat4 translate = Identity();
-        translate.elements[3][0] = translation.x;
-        translate.elements[3][1] = translation.y;
-        translate.elements[3][2] = translation.z;
-        return m * translate;
+        DestroyVoxelGrid(grid);
+        grid.words.allocator = &allocator;
+        VoxelizeContext context;
+        Array<uint32_t> binStarts;
+        binStarts.allocator = &allocator;
+        Array<uint32_t> binTriangles;
+        binTriangles.allocator = &allocator;
+        const size_t slabsCount = PrepareVoxelization(mesh, voxelSize, mode, context, binStarts, binTriangles);
+        grid.width = context.width;
+        grid.height = context.height;
+        grid.depth = context.depth;
+        grid.wordsPerRow = context.wordsPerRow;
+        grid.origin = context.origin;
+        grid.voxelSize = voxelSize;
+        grid.words.resize(grid.wordsPerRow * grid.height * grid.depth);
+        const size_t slabWords = VOXEL_BRICK_SIZE * grid.height * grid.wordsPerRow;
+        // the allocator isn't thread safe, so the scratch slabs of every worker are allocated here.
+        const size_t workersCount = Min<size_t>(Min<size_t>(GetProcessorCount(), 64), slabsCount);
+        MemoryBlock scratchBlock;
+        if (mode == VoxelizationMode::SURFACE_AND_SOLID && workersCount)
+        {
+            scratchBlock = allocator.AllocateMemoryBlock(workersCount * slabWords * sizeof(uint64_t));
+        }
+        defer(if (scratchBlock.data) allocator.FreeMemoryBlock(scratchBlock));
+        ParallelFor(workersCount, 1, [&](size_t begin, size_t end)
+                    {
+                        for (size_t w = begin; w < end; ++w)
+                        {
+                            uint64_t* scratch = scratchBlock.data ? (uint64_t*)scratchBlock.data + w * slabWords : NULL;
+                            for (size_t s = w * slabsCount / workersCount; s < (w + 1) * slabsCount / workersCount; ++s)
+                            {
+                                VoxelizeSlab(context, s, grid.words.data() + s * slabWords, scratch);
+                            }
+                        }
+                    });
     }
 
-    Mat4 Rotate(const Mat4& m, double angle, Vec3d axis)
+    void VoxelizeMesh(const TriangleMesh& mesh, double voxelSize, VoxelizationMode mode, SparseVoxelGrid& grid, Allocator& allocator)
     {
-        const double sinTheta = sinf(angle);
-        const double cosTheta = cosf(angle);
-        const double cosValue = 1.0f - cosTheta;
-
-        Normalise(axis);
-        Mat4 rotate = Identity();
-
-        rotate.elements[0][0] = (axis.x * axis.x * cosValue) + cosTheta;
-        rotate.elements[0][1] = (axis.x * axis.y * cosValue) + (axis.z * sinTheta);
-        rotate.elements[0][2] = (axis.x * axis.z * cosValue) - (axis.y * sinTheta);
-
-        rotate.elements[1][0] = (axis.y * axis.x * cosValue) - (axis.z * sinTheta);
-        rotate.elements[1][1] = (axis.y * axis.y * cosValue) + cosTheta;
-        rotate.elements[1][2] = (axis.y * axis.z * cosValue) + (axis.x * sinTheta);
-
-        rotate.elements[2][0] = (axis.z * axis.x * cosValue) + (axis.y * sinTheta);
-        rotate.elements[2][1] = (axis.z * axis.y * cosValue) - (axis.x * sinTheta);
-        rotate.elements[2][2] = (axis.z * axis.z * cosValue) + cosTheta;
-
-        return m * rotate;
+        DestroySparseVoxelGrid(grid);
+        grid.brickIndices.allocator = &allocator;
+        grid.bricks.allocator = &allocator;
+        VoxelizeContext context;
+        Array<uint32_t> binStarts;
+        binStarts.allocator = &allocator;
+        Array<uint32_t> binTriangles;
+        binTriangles.allocator = &allocator;
+        const size_t slabsCount = PrepareVoxelization(mesh, voxelSize, mode, context, binStarts, binTriangles);
+        grid.width = context.width;
+        grid.height = context.height;
+        grid.depth = context.depth;
+        grid.bricksWidth = (grid.width + VOXEL_BRICK_SIZE - 1) / VOXEL_BRICK_SIZE;
+        grid.bricksHeight = (grid.height + VOXEL_BRICK_SIZE - 1) / VOXEL_BRICK_SIZE;
+        grid.bricksDepth = slabsCount;
+        grid.origin = context.origin;
+        grid.voxelSize = voxelSize;
+        grid.brickIndices.resize(grid.bricksWidth * grid.bricksHeight * grid.bricksDepth);
+
+        // waves of one slab per thread are voxelized in parallel, then their bricks are appended in order.
+        const size_t wordsPerRow = context.wordsPerRow;
+        const size_t slabWords = VOXEL_BRICK_SIZE * grid.height * wordsPerRow;
+        const size_t waveSize = Min<size_t>(GetProcessorCount(), slabsCount);
+        const size_t buffersCount = (mode == VoxelizationMode::SURFACE_AND_SOLID) ? 2 : 1;
+        MemoryBlock slabsBlock = allocator.AllocateMemoryBlock(waveSize * buffersCount * slabWords * sizeof(uint64_t));
+        defer(allocator.FreeMemoryBlock(slabsBlock));
+        uint64_t* slabs = (uint64_t*)slabsBlock.data;
+        for (size_t wave = 0; wave < slabsCount; wave += waveSize)
+        {
+            const size_t waveEnd = Min(wave + waveSize, slabsCount);
+            ParallelFor(waveEnd - wave, 1, [&](size_t begin, size_t end)
+                        {
+                            for (size_t i = begin; i < end; ++i)
+                            {
+                                uint64_t* words = slabs + i * buffersCount * slabWords;
+                                VoxelizeSlab(context, wave + i, words, words + slabWords);
+                            }
+                        });
+            for (size_t s = wave; s < waveEnd; ++s)
+            {
+                const uint64_t* words = slabs + (s - wave) * buffersCount * slabWords;
+                const size_t layersCount = Min(VOXEL_BRICK_SIZE, grid.depth - s * VOXEL_BRICK_SIZE);
+                for (size_t by = 0; by < grid.bricksHeight; ++by)
+                {
+                    for (size_t bx = 0; bx < grid.bricksWidth; ++bx)
+                    {
+                        // every brick word is the 8 bytes of x of its 8 rows.
+                        uint64_t brick[VOXEL_BRICK_SIZE] = {};
+                        uint64_t any = 0;
+                        const size_t x = bx * VOXEL_BRICK_SIZE;
+                        for (size_t z = 0; z < layersCount; ++z)
+                        {
+                            for (size_t y = 0; y < VOXEL_BRICK_SIZE && by * VOXEL_BRICK_SIZE + y < grid.height; ++y)
+                            {
+                                const uint64_t row = words[(z * grid.height + by * VOXEL_BRICK_SIZE + y) * wordsPerRow + x / 64];
+                                brick[z] |= ((row >> (x % 64)) & 0xff) << (y * 8);
+                            }
+                            any |= brick[z];
+                        }
+                        uint32_t& index = grid.brickIndices[bx + (by + s * grid.bricksHeight) * grid.bricksWidth];
+                        index = INVALID_INDEX;
+                        if (any)
+                        {
+                            index = (uint32_t)(grid.bricks.size() / VOXEL_BRICK_SIZE);
+                            for (size_t z = 0; z < VOXEL_BRICK_SIZE; ++z)
+                            {
+                                grid.bricks.push_back(brick[z]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
     }
 
-    Mat4 Identity()
+    void DestroyVoxelGrid(VoxelGrid& grid)
     {
-        Mat4 m = { 0 };
-        m.elements[0][0] = m.elements[1][1] = m.elements[2][2] = m.elements[3][3] = 1.0f;
-        return m;
+        FreeArray(grid.words);
     }
 
-    Mat4 LookAt(const Vec3d& eye, const Vec3d& center, const Vec3d& up)
+    void DestroySparseVoxelGrid(SparseVoxelGrid& grid)
     {
-        const Vec3d f = Normalised(center - eye);
-        const Vec3d s = Normalised(CrossProduct(f, up));
-        const Vec3d u = CrossProduct(s, f);
-
-        Mat4 dest;
-        dest.elements[0][0] = s.x;
-        dest.elements[0][1] = u.x;
-        dest.elements[0][2] = -f.x;
-        dest.elements[0][3] = 0;
-
-        dest.elements[1][0] = s.y;
-        dest.elements[1][1] = u.y;
-        dest.elements[1][2] = -f.y;
-        dest.elements[1][3] = 0;
-
-        dest.elements[2][0] = s.z;
-        dest.elements[2][1] = u.z;
-        dest.elements[2][2] = -f.z;
-        dest.elements[2][3] = 0;
+        FreeArray(grid.brickIndices);
+        FreeArray(grid.bricks);
+    }
 
-        dest.elements[3][0] = -DotProduct(s, eye);
-        dest.elements[3][1] = -DotProduct(u, eye);
-        dest.elements[3][2] = DotProduct(f, eye);
-        dest.elements[3][3] = 1.0f;
-        return dest;
+    bool GetVoxel(const VoxelGrid& grid, size_t x, size_t y, size_t z)
+    {
+        GEDO_ASSERT(x < grid.width && y < grid.height && z < grid.depth);
+        return (grid.words[x / 64 + (y + z * grid.height) * grid.wordsPerRow] >> (x % 64)) & 1;
     }
 
-    Mat4 Perspective(double fovy, double aspect, double zNear, double zFar)
+    bool GetVoxel(const SparseVoxelGrid& grid, size_t x, size_t y, size_t z)
     {
-        const double f = 1.0f / tanf(fovy * 0.5f);
-        const double fn = 1.0f / (zNear - zFar);
-        Mat4 dest = { 0 };
-        dest.elements[0][0] = f / aspect;
-        dest.elements[1][1] = f;
-        dest.elements[2][2] = (zNear + zFar) * fn;
-        dest.elements[2][3] = -1.0f;
-        dest.elements[3][2] = 2.0f * zNear * zFar * fn;
-        return dest;
+        GEDO_ASSERT(x < grid.width && y < grid.height && z < grid.depth);
+        const size_t brick = x / VOXEL_BRICK_SIZE + (y / VOXEL_BRICK_SIZE + z / VOXEL_BRICK_SIZE * grid.bricksHeight) * grid.bricksWidth;
+        const uint32_t index = grid.brickIndices[brick];
+        if (index == INVALID_INDEX)
+        {
+            return false;
+        }
+        return (grid.bricks[index * VOXEL_BRICK_SIZE + z % VOXEL_BRICK_SIZE] >> (x % VOXEL_BRICK_SIZE + y % VOXEL_BRICK_SIZE * 8)) & 1;
     }
 
-    double Deg2Rad(double v)
+    size_t CountVoxels(const VoxelGrid& grid)
     {
-        return (PI / 180.0) * v;
+        size_t count = 0;
+        for (size_t i = 0; i < grid.words.size(); ++i)
+        {
+            count += CountBits(grid.words[i]);
+        }
+        return count;
     }
 
-    double Rad2Deg(double v)
+    size_t CountVoxels(const SparseVoxelGrid& grid)
     {
-        return (180.0 / PI) * v;
+        size_t count = 0;
+        for (size_t i = 0; i < grid.bricks.size(); ++i)
+        {
+            count += CountBits(grid.bricks[i]);
+        }
+        return count;
     }
     //----------------------------------------------------------//
 #endif // GEDO_IMPLEMENTATION
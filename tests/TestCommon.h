@@ -0,0 +1,27 @@
+// shared checks of the test programs, every test is a single translation unit that includes this header
+// once and returns ReportTests() from main.
+#pragma once
+
+#define GEDO_IMPLEMENTATION
+#include "Gedo.h"
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do                                                                            \
+    {                                                                             \
+        if (!(condition))                                                         \
+        {                                                                         \
+            printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                           \
+        }                                                                         \
+    } while (0)
+
+// prints the outcome and returns the exit code of the test.
+static int ReportTests()
+{
+    printf(failures ? "FAILED (%d)\n" : "PASSED\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+// a missing file must fail instead of hashing like an empty one, the hash follows the content.
+#include "TestCommon.h"
+
+using namespace gedo;
+
+static const char* TEST_FILE = "TestHashFile.bin";
+
+static void WriteTestFile(const char* text, size_t size)
+{
+    FILE* file = fopen(TEST_FILE, "wb");
+    CHECK(file != NULL);
+    if (file)
+    {
+        fwrite(text, 1, size, file);
+        fclose(file);
+    }
+}
+
+int main()
+{
+    uint64_t missing = 1;
+    remove(TEST_FILE);
+    CHECK(!HashFile(TEST_FILE, missing));
+    CHECK(missing == 1);
+
+    uint64_t empty = 0;
+    WriteTestFile("", 0);
+    CHECK(HashFile(TEST_FILE, empty));
+
+    uint64_t first = 0;
+    uint64_t second = 0;
+    WriteTestFile("content", 7);
+    CHECK(HashFile(TEST_FILE, first));
+    CHECK(HashFile(TEST_FILE, second));
+    CHECK(first == second && first != empty);
+
+    uint64_t changed = 0;
+    WriteTestFile("Content", 7);
+    CHECK(HashFile(TEST_FILE, changed));
+    CHECK(changed != first);
+
+    // a directory isn't a readable file either.
+    uint64_t directory = 0;
+    CHECK(!HashFile(".", directory));
+    remove(TEST_FILE);
+
+    return ReportTests();
+}
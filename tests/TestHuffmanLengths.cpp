@@ -0,0 +1,146 @@
+// checks the length limited huffman code lengths of the deflate encoder against a reference heap based
+// huffman builder, the code lengths may differ on ties but the encoded size must be the same.
+#include "TestCommon.h"
+
+#include <stdlib.h>
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+using namespace gedo;
+
+// unlimited huffman code lengths built by merging the two lightest trees until one is left.
+static std::vector<uint32_t> ReferenceLengths(const std::vector<uint32_t>& frequencies)
+{
+    typedef std::pair<uint64_t, size_t> Node;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+    std::vector<size_t> parents;
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        parents.push_back(SIZE_MAX);
+        if (frequencies[i])
+        {
+            heap.push(Node(frequencies[i], i));
+        }
+    }
+    while (heap.size() > 1)
+    {
+        const Node a = heap.top();
+        heap.pop();
+        const Node b = heap.top();
+        heap.pop();
+        parents[a.second] = parents[b.second] = parents.size();
+        parents.push_back(SIZE_MAX);
+        heap.push(Node(a.first + b.first, parents.size() - 1));
+    }
+    std::vector<uint32_t> lengths(frequencies.size(), 0);
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        for (size_t p = parents[i]; frequencies[i] && p != SIZE_MAX; p = parents[p])
+        {
+            lengths[i]++;
+        }
+    }
+    return lengths;
+}
+
+static void CheckLengths(const std::vector<uint32_t>& frequencies, uint32_t maxBits)
+{
+    std::vector<uint8_t> lengths(frequencies.size());
+    BuildHuffmanLengths(frequencies.data(), frequencies.size(), maxBits, lengths.data());
+
+    // the code is complete and fits in maxBits.
+    uint64_t kraft = 0;
+    size_t used = 0;
+    size_t symbols = 0;
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        CHECK(lengths[i] <= maxBits);
+        CHECK(!frequencies[i] || lengths[i]);
+        symbols += frequencies[i] != 0;
+        if (lengths[i])
+        {
+            kraft += uint64_t(1) << (maxBits - lengths[i]);
+            used++;
+        }
+    }
+    CHECK(kraft == (uint64_t(1) << maxBits));
+
+    // when the limit isn't reached the lengths are optimal, a lone symbol gets a 1 bit code instead of none.
+    const std::vector<uint32_t> reference = ReferenceLengths(frequencies);
+    uint32_t referenceMax = 0;
+    uint64_t size = 0;
+    uint64_t referenceSize = 0;
+    for (size_t i = 0; i < frequencies.size(); ++i)
+    {
+        referenceMax = referenceMax > reference[i] ? referenceMax : reference[i];
+        size += uint64_t(frequencies[i]) * lengths[i];
+        referenceSize += uint64_t(frequencies[i]) * reference[i];
+    }
+    CHECK(used == Max<size_t>(symbols, 2));
+    if (symbols > 1 && referenceMax <= maxBits)
+    {
+        CHECK(size == referenceSize);
+    }
+    else
+    {
+        CHECK(size >= referenceSize);
+    }
+}
+
+int main()
+{
+    srand(1);
+    // random alphabets of the 3 deflate code sizes with a varying amount of unused symbols.
+    const size_t alphabets[3] = { DEFLATE_LITLEN_CODES, DEFLATE_DIST_CODES, DEFLATE_CODELEN_CODES };
+    const uint32_t limits[3] = { 15, 15, 7 };
+    for (size_t test = 0; test < 3000; ++test)
+    {
+        const size_t alphabet = alphabets[test % 3];
+        std::vector<uint32_t> frequencies(alphabet);
+        const int zeros = rand() % 100;
+        const uint32_t range = 1 + rand() % 100000;
+        for (size_t i = 0; i < alphabet; ++i)
+        {
+            frequencies[i] = (rand() % 100 < zeros) ? 0 : 1 + rand() % range;
+        }
+        CheckLengths(frequencies, limits[test % 3]);
+    }
+
+    // fibonacci frequencies give the deepest trees and force the length limit.
+    for (size_t count = 2; count < 40; ++count)
+    {
+        std::vector<uint32_t> frequencies(DEFLATE_LITLEN_CODES, 0);
+        uint32_t a = 1, b = 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            frequencies[(i * 7) % DEFLATE_LITLEN_CODES] = a;
+            const uint32_t c = a + b;
+            a = b;
+            b = c;
+        }
+        CheckLengths(frequencies, 15);
+    }
+
+    // zero or one used symbol still makes a complete code.
+    for (size_t used = 0; used < 2; ++used)
+    {
+        std::vector<uint32_t> frequencies(DEFLATE_DIST_CODES, 0);
+        if (used)
+        {
+            frequencies[5] = 10;
+        }
+        std::vector<uint8_t> lengths(frequencies.size());
+        BuildHuffmanLengths(frequencies.data(), frequencies.size(), 15, lengths.data());
+        size_t ones = 0;
+        for (size_t i = 0; i < lengths.size(); ++i)
+        {
+            ones += lengths[i] == 1;
+        }
+        CHECK(ones == 2);
+        CHECK(!used || lengths[5] == 1);
+    }
+
+    return ReportTests();
+}
@@ -0,0 +1,121 @@
+// feeds the QOI and BMP decoders headers that claim more pixels than the data holds and BMP bitfields
+// masks they can't decode, they must return an empty bitmap without allocating for the claimed size.
+#include "TestCommon.h"
+
+#include <string.h>
+
+#include <vector>
+
+using namespace gedo;
+
+static MemoryBlock Block(std::vector<uint8_t>& bytes)
+{
+    MemoryBlock block;
+    block.data = bytes.data();
+    block.size = bytes.size();
+    return block;
+}
+
+static void Write32(std::vector<uint8_t>& bytes, size_t offset, uint32_t value, bool bigEndian)
+{
+    for (size_t i = 0; i < 4; ++i)
+    {
+        bytes[offset + i] = (uint8_t)(value >> (bigEndian ? 24 - 8 * i : 8 * i));
+    }
+}
+
+static std::vector<uint8_t> QOIImage(uint32_t width, uint32_t height, size_t opsSize)
+{
+    std::vector<uint8_t> bytes(14 + opsSize + 8, 0);
+    memcpy(bytes.data(), "qoif", 4);
+    Write32(bytes, 4, width, true);
+    Write32(bytes, 8, height, true);
+    bytes[12] = 4;
+    // runs of 62 pixels of the start color.
+    for (size_t i = 0; i < opsSize; ++i)
+    {
+        bytes[14 + i] = 0xc0 | 61;
+    }
+    bytes[bytes.size() - 1] = 1;
+    return bytes;
+}
+
+// a 2x2 top-down 32 bits image with the given masks, the alpha mask is only in headers of 56 bytes or more.
+static std::vector<uint8_t> BMPImage(uint32_t compression, const uint32_t masks[4], uint32_t infoSize)
+{
+    const size_t pixelsOffset = 14 + infoSize + ((infoSize == 40 && compression == 3) ? 12 : 0);
+    std::vector<uint8_t> bytes(pixelsOffset + 16, 0x80);
+    memset(bytes.data(), 0, pixelsOffset);
+    bytes[0] = 'B';
+    bytes[1] = 'M';
+    Write32(bytes, 2, (uint32_t)bytes.size(), false);
+    Write32(bytes, 10, (uint32_t)pixelsOffset, false);
+    Write32(bytes, 14, infoSize, false);
+    Write32(bytes, 18, 2, false);
+    Write32(bytes, 22, (uint32_t)-2, false);
+    bytes[26] = 1;
+    bytes[28] = 32;
+    Write32(bytes, 30, compression, false);
+    for (size_t i = 0; i < 4 && compression == 3; ++i)
+    {
+        if (i < 3 || infoSize >= 56)
+        {
+            Write32(bytes, 54 + i * 4, masks[i], false);
+        }
+    }
+    return bytes;
+}
+
+static void TestQOI()
+{
+    std::vector<uint8_t> valid = QOIImage(62, 2, 2);
+    ColorBitmap bitmap = DecodeQOI(Block(valid));
+    CHECK(bitmap.data && bitmap.width == 62 && bitmap.height == 2);
+    DestoryColorBitmap(bitmap);
+
+    // one pixel more than the runs can cover.
+    std::vector<uint8_t> short1 = QOIImage(125, 1, 2);
+    CHECK(!DecodeQOI(Block(short1)).data);
+    // the largest header dimensions with a few bytes of data.
+    std::vector<uint8_t> huge = QOIImage(0xffffffff, 0xffffffff, 16);
+    CHECK(!DecodeQOI(Block(huge)).data);
+    std::vector<uint8_t> wide = QOIImage(0xffffffff, 1, 16);
+    CHECK(!DecodeQOI(Block(wide)).data);
+}
+
+static void TestBMP()
+{
+    const uint32_t bgra[4] = { 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 };
+    const uint32_t infoSizes[] = { 40, 56, 108, 124 };
+    for (uint32_t infoSize : infoSizes)
+    {
+        std::vector<uint8_t> valid = BMPImage(3, bgra, infoSize);
+        ColorBitmap bitmap = DecodeBMP(Block(valid));
+        CHECK(bitmap.data && bitmap.width == 2 && bitmap.height == 2);
+        DestoryColorBitmap(bitmap);
+    }
+    const uint32_t invalid[][4] = {
+        { 0, 0, 0, 0 },                                    // zero masks.
+        { 0x00ff0000, 0x00ff0000, 0x000000ff, 0 },         // overlapping masks.
+        { 0x000000ff, 0x0000ff00, 0x00ff0000, 0 },         // RGBA order.
+        { 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00ff0000 } // alpha overlapping red.
+    };
+    for (const uint32_t* masks : invalid)
+    {
+        std::vector<uint8_t> bytes = BMPImage(3, masks, 56);
+        CHECK(!DecodeBMP(Block(bytes)).data);
+    }
+
+    // more rows than the data holds.
+    std::vector<uint8_t> tall = BMPImage(0, bgra, 40);
+    Write32(tall, 22, 0x7fffffff, false);
+    CHECK(!DecodeBMP(Block(tall)).data);
+}
+
+int main()
+{
+    TestQOI();
+    TestBMP();
+
+    return ReportTests();
+}
@@ -0,0 +1,114 @@
+// checks the k-d tree kNN and radius queries against brute force at several scales and prints the
+// build and query rates next to the brute force ones.
+#include "TestCommon.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace gedo;
+
+static double RandomDouble()
+{
+    return double(rand()) / double(RAND_MAX);
+}
+
+static void CheckScale(size_t pointsCount, size_t queriesCount, size_t k)
+{
+    std::vector<Vec3d> points(pointsCount);
+    for (size_t i = 0; i < pointsCount; ++i)
+    {
+        points[i] = Vec3d{ { RandomDouble(), RandomDouble(), RandomDouble() } };
+    }
+    // the duplicated points make ties that the distances must still agree on.
+    for (size_t i = 0; i + 1 < pointsCount; i += 97)
+    {
+        points[i + 1] = points[i];
+    }
+    std::vector<Vec3d> queries(queriesCount);
+    for (size_t i = 0; i < queriesCount; ++i)
+    {
+        queries[i] = Vec3d{ { RandomDouble() * 1.2 - 0.1, RandomDouble() * 1.2 - 0.1, RandomDouble() * 1.2 - 0.1 } };
+    }
+    const double radius = 0.5 * cbrt(double(k) / double(Max<size_t>(pointsCount, 1)));
+
+    KdTree tree;
+    KdTreeStats buildStats;
+    BuildKdTree(ArrayView<Vec3d>{ points.data(), points.size() }, tree, &buildStats);
+    CHECK(buildStats.count == pointsCount);
+
+    Array<uint32_t> indices;
+    Array<double> squaredDistances;
+    KdTreeStats nearestStats;
+    FindNearestNeighbours(tree, ArrayView<Vec3d>{ queries.data(), queries.size() }, k, indices, squaredDistances, &nearestStats);
+    CHECK(nearestStats.count == queriesCount);
+    CHECK(nearestStats.resultsCount == queriesCount * Min(k, pointsCount));
+
+    Array<uint32_t> offsets;
+    Array<uint32_t> radiusIndices;
+    KdTreeStats radiusStats;
+    FindPointsInRadius(tree, ArrayView<Vec3d>{ queries.data(), queries.size() }, radius, offsets, radiusIndices, &radiusStats);
+    CHECK(radiusStats.count == queriesCount);
+    CHECK(radiusStats.resultsCount == radiusIndices.size());
+
+    const Stopwatch stopwatch = StartStopwatch();
+    std::vector<double> distances(pointsCount);
+    std::vector<uint32_t> found;
+    for (size_t q = 0; q < queriesCount; ++q)
+    {
+        found.clear();
+        for (size_t i = 0; i < pointsCount; ++i)
+        {
+            const Vec3d d = points[i] - queries[q];
+            distances[i] = DotProduct(d, d);
+            if (distances[i] <= radius * radius)
+            {
+                found.push_back((uint32_t)i);
+            }
+        }
+        std::vector<double> sorted = distances;
+        const size_t foundCount = Min(k, pointsCount);
+        std::partial_sort(sorted.begin(), sorted.begin() + foundCount, sorted.end());
+        for (size_t i = 0; i < k; ++i)
+        {
+            const uint32_t index = indices[q * k + i];
+            if (i < foundCount)
+            {
+                CHECK(squaredDistances[q * k + i] == sorted[i]);
+                CHECK(index < pointsCount && distances[index] == sorted[i]);
+            }
+            else
+            {
+                CHECK(index == INVALID_INDEX);
+            }
+        }
+        std::vector<uint32_t> treeFound(radiusIndices.data() + offsets[q], radiusIndices.data() + offsets[q + 1]);
+        std::sort(treeFound.begin(), treeFound.end());
+        CHECK(treeFound == found);
+    }
+    const double bruteSeconds = GetElapsedSeconds(stopwatch);
+
+    printf("%8zu points %6zu queries k %2zu: build %6.2f Mpoints/s, knn %8.0f queries/s, radius %8.0f queries/s, brute force %8.0f queries/s\n",
+           pointsCount, queriesCount, k, buildStats.countPerSecond * 1e-6, nearestStats.countPerSecond, radiusStats.countPerSecond,
+           (bruteSeconds > 0.0) ? double(queriesCount) / bruteSeconds : 0.0);
+
+    FreeArray(indices);
+    FreeArray(squaredDistances);
+    FreeArray(offsets);
+    FreeArray(radiusIndices);
+    DestroyKdTree(tree);
+}
+
+int main()
+{
+    srand(1);
+    CheckScale(0, 10, 4);
+    CheckScale(1, 10, 4);
+    CheckScale(10, 100, 16);
+    CheckScale(1000, 1000, 8);
+    CheckScale(100000, 500, 8);
+    CheckScale(1000000, 100, 16);
+
+    return ReportTests();
+}
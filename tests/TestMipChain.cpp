@@ -0,0 +1,57 @@
+// checks every mip texel against the rounded average of its box in the previous level, the last row
+// and column of odd sizes must be folded into the edge texels.
+#include "TestCommon.h"
+
+using namespace gedo;
+
+static void CheckLevel(const ColorBitmap& prev, const ColorBitmap& level)
+{
+    for (size_t y = 0; y < level.height; ++y)
+    {
+        const size_t y1 = (y == level.height - 1) ? prev.height : 2 * y + 2;
+        for (size_t x = 0; x < level.width; ++x)
+        {
+            const size_t x1 = (x == level.width - 1) ? prev.width : 2 * x + 2;
+            uint32_t sum[4] = {};
+            for (size_t sy = 2 * y; sy < y1; ++sy)
+            {
+                for (size_t sx = 2 * x; sx < x1; ++sx)
+                {
+                    const Color c = prev.data[sy * prev.width + sx];
+                    sum[0] += c.r;
+                    sum[1] += c.g;
+                    sum[2] += c.b;
+                    sum[3] += c.a;
+                }
+            }
+            const uint32_t count = uint32_t((x1 - 2 * x) * (y1 - 2 * y));
+            const Color c = level.data[y * level.width + x];
+            CHECK(c.r == (sum[0] + count / 2) / count && c.g == (sum[1] + count / 2) / count &&
+                  c.b == (sum[2] + count / 2) / count && c.a == (sum[3] + count / 2) / count);
+        }
+    }
+}
+
+int main()
+{
+    const size_t sizes[][2] = { { 1, 1 }, { 1, 16 }, { 3, 3 }, { 5, 7 }, { 9, 2 }, { 64, 64 }, { 1023, 517 } };
+    for (const size_t* size : sizes)
+    {
+        ColorBitmap bitmap = CreateColorBitmap(size[0], size[1]);
+        for (size_t i = 0; i < size[0] * size[1]; ++i)
+        {
+            bitmap.data[i] = CreateColor((uint8_t)(i * 37), (uint8_t)(i * 11 + 5), (uint8_t)(i >> 3), (uint8_t)(255 - i));
+        }
+        MipChain chain = GenerateMipChain(bitmap);
+        const ColorBitmap& last = chain.levels[chain.levels.size() - 1];
+        CHECK(last.width == 1 && last.height == 1);
+        for (size_t l = 1; l < chain.levels.size(); ++l)
+        {
+            CheckLevel(chain.levels[l - 1], chain.levels[l]);
+        }
+        DestroyMipChain(chain);
+        DestoryColorBitmap(bitmap);
+    }
+
+    return ReportTests();
+}
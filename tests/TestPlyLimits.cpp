@@ -0,0 +1,115 @@
+// feeds the PLY reader headers with huge counts and truncated bodies, they must be rejected without
+// allocating for the declared counts.
+#include "TestCommon.h"
+
+#include <string.h>
+
+#include <string>
+
+using namespace gedo;
+
+static const char* TEST_FILE = "TestPlyLimits.ply";
+
+static bool ParseHeader(const std::string& text, PlyHeader& header)
+{
+    MemoryBlock data;
+    data.data = (uint8_t*)text.data();
+    data.size = text.size();
+    return ParsePlyHeader(data, header);
+}
+
+static bool LoadText(const std::string& text)
+{
+    FILE* file = fopen(TEST_FILE, "wb");
+    CHECK(file != NULL);
+    if (!file)
+    {
+        return false;
+    }
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+    TriangleMesh mesh;
+    const bool result = LoadPLY(TEST_FILE, mesh);
+    DestroyTriangleMesh(mesh);
+    remove(TEST_FILE);
+    return result;
+}
+
+static std::string Floats(size_t count)
+{
+    std::string bytes(count * sizeof(float), '\0');
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float value = float(i);
+        memcpy(&bytes[i * sizeof(float)], &value, sizeof(float));
+    }
+    return bytes;
+}
+
+// the count byte of the list followed by three indices, whatever the count says.
+static std::string Face(uint8_t count, const uint32_t* indices)
+{
+    std::string bytes(1, (char)count);
+    bytes.append((const char*)indices, 3 * sizeof(uint32_t));
+    return bytes;
+}
+
+static void TestHugeCounts()
+{
+    const char* counts[] = { "4000000000000", "9223372036854775807", "18446744073709551615", "99999999999999999999999" };
+    const char* formats[] = { "binary_little_endian", "ascii" };
+    for (const char* count : counts)
+    {
+        for (const char* format : formats)
+        {
+            const std::string text = std::string("ply\nformat ") + format + " 1.0\nelement vertex " + count +
+                                     "\nproperty float x\nproperty float y\nproperty float z\nend_header\n0 0 0\n";
+            PlyHeader header;
+            CHECK(!ParseHeader(text, header));
+            CHECK(!LoadText(text));
+            FreeArray(header.elements);
+            FreeArray(header.properties);
+        }
+    }
+
+    // a count that fits alone but not after the previous element.
+    const std::string text = "ply\nformat binary_little_endian 1.0\nelement vertex 2\nproperty float x\nproperty float y\nproperty float z\n"
+                             "element face 4000000000\nproperty list uchar int vertex_indices\nend_header\n" +
+                             Floats(6);
+    PlyHeader header;
+    CHECK(!ParseHeader(text, header));
+    FreeArray(header.elements);
+    FreeArray(header.properties);
+}
+
+static void TestTruncated()
+{
+    const std::string vertexHeader = "ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\nproperty float y\nproperty float z\n";
+    const std::string faceHeader = "element face 1\nproperty list uchar int vertex_indices\nend_header\n";
+    const uint32_t triangle[] = { 0, 1, 2 };
+    CHECK(LoadText(vertexHeader + faceHeader + Floats(9) + Face(3, triangle)));
+
+    // one vertex value or one face index short.
+    CHECK(!LoadText(vertexHeader + faceHeader + Floats(8)));
+    CHECK(!LoadText(vertexHeader + faceHeader + Floats(9) + Face(3, triangle).substr(0, 12)));
+    // the list claims more items than the file has.
+    CHECK(!LoadText(vertexHeader + faceHeader + Floats(9) + Face(200, triangle)));
+    // an index past the vertices.
+    const uint32_t outside[] = { 0, 1, 3 };
+    CHECK(!LoadText(vertexHeader + faceHeader + Floats(9) + Face(3, outside)));
+
+    // a float list count that isn't finite.
+    const std::string floatFaceHeader = "element face 1\nproperty list float int vertex_indices\nend_header\n";
+    const float nan = NAN;
+    std::string face((const char*)&nan, sizeof(float));
+    face.append((const char*)triangle, sizeof(triangle));
+    CHECK(!LoadText(vertexHeader + floatFaceHeader + Floats(9) + face));
+}
+
+int main()
+{
+    TestHugeCounts();
+    TestTruncated();
+
+    return ReportTests();
+}
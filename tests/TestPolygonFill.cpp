@@ -0,0 +1,90 @@
+// fills polygons with more edges than the insertion sort threshold of QuickSort, the scanline filler
+// needs its edge table sorted by the top of the edges.
+#include "TestCommon.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+using namespace gedo;
+
+static void TestQuickSort()
+{
+    for (size_t size = 0; size < 200; ++size)
+    {
+        Array<int> values;
+        for (size_t i = 0; i < size; ++i)
+        {
+            values.push_back(rand() % 50);
+        }
+        QuickSort(values.data(), values.size());
+        bool sorted = true;
+        for (size_t i = 1; i < values.size(); ++i)
+        {
+            sorted &= values[i - 1] <= values[i];
+        }
+        CHECK(sorted);
+    }
+}
+
+// a star with a random phase so the edges reach QuickSort in an arbitrary order.
+static void TestStar(size_t spikes, double phase)
+{
+    const size_t size = 256;
+    ColorBitmap bitmap = CreateColorBitmap(size, size);
+    defer(DestoryColorBitmap(bitmap));
+    FillRectangle(bitmap, Rect{ 0, 0, size, size }, BLACK);
+
+    Array<Vec2d> points;
+    const double pi = 3.14159265358979323846;
+    for (size_t i = 0; i < spikes * 2; ++i)
+    {
+        const double angle = phase + pi * double(i) / double(spikes);
+        const double radius = (i & 1) ? 60.0 : 110.0;
+        points.push_back(Vec2d{ 128.0 + radius * cos(angle), 128.0 + radius * sin(angle) });
+    }
+    FillPolygon(bitmap, ArrayView<Vec2d>{ points.data(), points.size() }, WHITE, FillRule::NON_ZERO);
+
+    // the coverage adds up to the area of the polygon.
+    double area = 0.0;
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        const Vec2d& a = points[i];
+        const Vec2d& b = points[(i + 1) % points.size()];
+        area += a.x * b.y - b.x * a.y;
+    }
+    area = fabs(area) * 0.5;
+    double coverage = 0.0;
+    for (size_t i = 0; i < size * size; ++i)
+    {
+        coverage += bitmap.data[i].r / 255.0;
+    }
+    CHECK(fabs(coverage - area) < area * 0.002);
+
+    // pixels away from the edges are either fully covered or untouched.
+    for (size_t y = 0; y < size; ++y)
+    {
+        for (size_t x = 0; x < size; ++x)
+        {
+            const double distance = sqrt((x + 0.5 - 128.0) * (x + 0.5 - 128.0) + (y + 0.5 - 128.0) * (y + 0.5 - 128.0));
+            if (distance < 55.0)
+            {
+                CHECK(bitmap.data[y * size + x].r == 255);
+            }
+            else if (distance > 112.0)
+            {
+                CHECK(bitmap.data[y * size + x].r == 0);
+            }
+        }
+    }
+}
+
+int main()
+{
+    srand(1);
+    TestQuickSort();
+    for (size_t spikes = 3; spikes <= 64; ++spikes)
+    {
+        TestStar(spikes, rand() / double(RAND_MAX));
+    }
+    return ReportTests();
+}
@@ -0,0 +1,193 @@
+// checks that the triangles of a mesh covering the screen cover every pixel exactly once (top-left fill
+// rule, no gaps or double hits on shared edges and tile seams) and the depth test ordering, then times
+// a fixed triangle soup and prints the triangles per second.
+#include "TestCommon.h"
+
+#include <stdlib.h>
+
+#include <vector>
+
+using namespace gedo;
+
+static const size_t WIDTH = 200; // not a multiple of the tile size, so the last tiles are partial.
+static const size_t HEIGHT = 150;
+
+// window space pixel coordinates to a position that the identity mvp maps back to them.
+static Vec3d WindowPosition(double x, double y, double z, size_t width, size_t height)
+{
+    return Vec3d{ { x / double(width) * 2.0 - 1.0, 1.0 - y / double(height) * 2.0, z } };
+}
+
+// a grid of (cells + 1)^2 vertices over the screen and a bit past it, the inner vertices are moved
+// by up to jitter pixels (small next to the cells so no triangle folds over), the diagonals alternate.
+static void CreateGrid(size_t cells, double jitter, double offset, std::vector<Vec3d>& positions, std::vector<uint32_t>& indices)
+{
+    positions.clear();
+    indices.clear();
+    const double margin = 3.0;
+    for (size_t j = 0; j <= cells; ++j)
+    {
+        for (size_t i = 0; i <= cells; ++i)
+        {
+            double x = -margin + (WIDTH + 2 * margin) * double(i) / double(cells);
+            double y = -margin + (HEIGHT + 2 * margin) * double(j) / double(cells);
+            if (i && j && i < cells && j < cells)
+            {
+                x = floor(x) + offset + jitter * (double(rand()) / RAND_MAX * 2.0 - 1.0);
+                y = floor(y) + offset + jitter * (double(rand()) / RAND_MAX * 2.0 - 1.0);
+            }
+            positions.push_back(WindowPosition(x, y, 0.0, WIDTH, HEIGHT));
+        }
+    }
+    for (size_t j = 0; j < cells; ++j)
+    {
+        for (size_t i = 0; i < cells; ++i)
+        {
+            const uint32_t v00 = uint32_t(j * (cells + 1) + i);
+            const uint32_t v10 = v00 + 1;
+            const uint32_t v01 = v00 + uint32_t(cells + 1);
+            const uint32_t v11 = v01 + 1;
+            const uint32_t quad[2][6] = { { v00, v10, v11, v00, v11, v01 }, { v00, v10, v01, v10, v11, v01 } };
+            indices.insert(indices.end(), quad[(i + j) & 1], quad[(i + j) & 1] + 6);
+        }
+    }
+}
+
+static void CheckCoverage(size_t cells, double jitter, double offset)
+{
+    std::vector<Vec3d> positions;
+    std::vector<uint32_t> indices;
+    CreateGrid(cells, jitter, offset, positions, indices);
+    std::vector<Color> colors(positions.size(), CreateColor(255, 255, 255, 255));
+
+    ColorBitmap target = CreateColorBitmap(WIDTH, HEIGHT);
+    DepthBuffer depth = CreateDepthBuffer(WIDTH, HEIGHT);
+    std::vector<uint32_t> hits(WIDTH * HEIGHT, 0);
+    // one triangle at a time so the pixels it covers are the ones it wrote.
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        GEDO_MEMSET(target.data, 0, WIDTH * HEIGHT * sizeof(Color));
+        ClearDepthBuffer(depth);
+        DrawTriangles(target, depth, Identity(), ArrayView<Vec3d>{ positions.data(), positions.size() },
+                      ArrayView<Color>{ colors.data(), colors.size() }, ArrayView<uint32_t>{ indices.data() + t, 3 }, ShadingMode::FLAT);
+        for (size_t i = 0; i < WIDTH * HEIGHT; ++i)
+        {
+            hits[i] += target.data[i].a != 0;
+        }
+    }
+    size_t wrong = 0;
+    for (size_t i = 0; i < WIDTH * HEIGHT; ++i)
+    {
+        wrong += hits[i] != 1;
+    }
+    CHECK(wrong == 0);
+
+    DestroyDepthBuffer(depth);
+    DestoryColorBitmap(target);
+}
+
+static void CheckDepthOrder()
+{
+    ColorBitmap target = CreateColorBitmap(WIDTH, HEIGHT);
+    DepthBuffer depth = CreateDepthBuffer(WIDTH, HEIGHT);
+    // two screen filling triangles, the near one at z -0.5 (0.25 in window space) and the far one at 0.5.
+    std::vector<Vec3d> positions;
+    std::vector<Color> colors;
+    const double zs[2] = { -0.5, 0.5 };
+    const Color fills[2] = { CreateColor(255, 0, 0, 255), CreateColor(0, 255, 0, 255) };
+    for (size_t k = 0; k < 2; ++k)
+    {
+        positions.push_back(WindowPosition(-10, -10, zs[k], WIDTH, HEIGHT));
+        positions.push_back(WindowPosition(3 * WIDTH, -10, zs[k], WIDTH, HEIGHT));
+        positions.push_back(WindowPosition(-10, 3 * HEIGHT, zs[k], WIDTH, HEIGHT));
+        colors.insert(colors.end(), 3, fills[k]);
+    }
+    const uint32_t orders[2][6] = { { 0, 1, 2, 3, 4, 5 }, { 3, 4, 5, 0, 1, 2 } };
+    for (size_t o = 0; o < 2; ++o)
+    {
+        ClearDepthBuffer(depth);
+        GEDO_MEMSET(target.data, 0, WIDTH * HEIGHT * sizeof(Color));
+        RasterStats stats;
+        DrawTriangles(target, depth, Identity(), ArrayView<Vec3d>{ positions.data(), positions.size() },
+                      ArrayView<Color>{ colors.data(), colors.size() }, ArrayView<uint32_t>{ orders[o], 6 }, ShadingMode::FLAT, &stats);
+        CHECK(stats.trianglesCount == 2 && stats.trianglesDrawn == 2);
+        size_t wrong = 0;
+        for (size_t i = 0; i < WIDTH * HEIGHT; ++i)
+        {
+            // the depth is interpolated from the barycentrics in float.
+            wrong += target.data[i].r != 255 || target.data[i].g != 0 || fabs(depth.data[i] - 0.25f) > 1e-6f;
+        }
+        CHECK(wrong == 0);
+    }
+
+    // a later triangle at the same depth fails the test, only closer fragments pass.
+    ClearDepthBuffer(depth);
+    DrawTriangles(target, depth, Identity(), ArrayView<Vec3d>{ positions.data(), positions.size() },
+                  ArrayView<Color>{ colors.data(), colors.size() }, ArrayView<uint32_t>{ orders[0] + 3, 3 }, ShadingMode::FLAT);
+    for (size_t k = 0; k < 3; ++k)
+    {
+        positions[k].z = zs[1];
+    }
+    DrawTriangles(target, depth, Identity(), ArrayView<Vec3d>{ positions.data(), positions.size() },
+                  ArrayView<Color>{ colors.data(), colors.size() }, ArrayView<uint32_t>{ orders[0], 3 }, ShadingMode::FLAT);
+    CHECK(target.data[(HEIGHT / 2) * WIDTH + WIDTH / 2].g == 255);
+
+    DestroyDepthBuffer(depth);
+    DestoryColorBitmap(target);
+}
+
+// a fixed soup of small gouraud triangles at random depths.
+static void BenchmarkSoup()
+{
+    const size_t width = 1280;
+    const size_t height = 720;
+    const size_t trianglesCount = 200000;
+    std::vector<Vec3d> positions;
+    std::vector<Color> colors;
+    std::vector<uint32_t> indices;
+    srand(7);
+    for (size_t t = 0; t < trianglesCount; ++t)
+    {
+        const double x = double(rand()) / RAND_MAX * width;
+        const double y = double(rand()) / RAND_MAX * height;
+        const double z = double(rand()) / RAND_MAX * 2.0 - 1.0;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            const double dx = (double(rand()) / RAND_MAX - 0.5) * 24.0;
+            const double dy = (double(rand()) / RAND_MAX - 0.5) * 24.0;
+            indices.push_back((uint32_t)positions.size());
+            positions.push_back(WindowPosition(x + dx, y + dy, z, width, height));
+            colors.push_back(CreateColor((uint8_t)rand(), (uint8_t)rand(), (uint8_t)rand(), 255));
+        }
+    }
+    ColorBitmap target = CreateColorBitmap(width, height);
+    DepthBuffer depth = CreateDepthBuffer(width, height);
+    double best = 0.0;
+    for (size_t run = 0; run < 5; ++run)
+    {
+        ClearDepthBuffer(depth);
+        RasterStats stats;
+        DrawTriangles(target, depth, Identity(), ArrayView<Vec3d>{ positions.data(), positions.size() },
+                      ArrayView<Color>{ colors.data(), colors.size() }, ArrayView<uint32_t>{ indices.data(), indices.size() },
+                      ShadingMode::GOURAUD, &stats);
+        CHECK(stats.trianglesCount == trianglesCount);
+        best = Max(best, stats.trianglesPerSecond);
+    }
+    printf("%zu triangles at %zux%zu: %.2f Mtriangles/s\n", trianglesCount, width, height, best * 1e-6);
+    DestroyDepthBuffer(depth);
+    DestoryColorBitmap(target);
+}
+
+int main()
+{
+    srand(1);
+    // vertices on pixel centers put the shared edges right through the samples.
+    CheckCoverage(8, 0.0, 0.5);
+    CheckCoverage(8, 0.0, 0.0);
+    CheckCoverage(13, 3.0, 0.5);
+    CheckCoverage(20, 1.5, 0.25);
+    CheckDepthOrder();
+    BenchmarkSoup();
+
+    return ReportTests();
+}